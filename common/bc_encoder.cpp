@@ -0,0 +1,892 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#include "bc_encoder.hpp"
+#include "nvh/parallel_work.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BC_ENCODER_AVX2 1
+#endif
+
+
+namespace bc {
+
+uint32_t blockBytes(Format format)
+{
+  return format == Format::eBC7 ? 16 : 8;
+}
+
+size_t compressedSize(Format format, uint32_t width, uint32_t height)
+{
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Block of 16 pixels, one array per channel
+//
+struct Block
+{
+  alignas(32) int32_t c[4][16];
+};
+
+// Palette entries, up to 16
+struct Palette
+{
+  int32_t  c[16][4];
+  uint32_t size{0};
+};
+
+// Pixels of the block (bx, by), the edges being repeated when the image isn't a multiple of 4
+static void loadBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, Block& block)
+{
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    const uint32_t x     = std::min(bx * 4 + (i & 3), width - 1);
+    const uint32_t y     = std::min(by * 4 + (i >> 2), height - 1);
+    const uint8_t* pixel = rgba + (size_t(y) * width + x) * 4;
+    for(uint32_t c = 0; c < 4; c++)
+      block.c[c][i] = pixel[c];
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Nearest palette entry of each pixel, returns the sum of the squared distances
+//
+static uint32_t nearestIndices(const Block& block, const Palette& palette, uint8_t indices[16])
+{
+#if BC_ENCODER_AVX2
+  uint32_t total = 0;
+  for(uint32_t half = 0; half < 2; half++)
+  {
+    const __m256i r      = _mm256_load_si256(reinterpret_cast<const __m256i*>(&block.c[0][half * 8]));
+    const __m256i g      = _mm256_load_si256(reinterpret_cast<const __m256i*>(&block.c[1][half * 8]));
+    const __m256i b      = _mm256_load_si256(reinterpret_cast<const __m256i*>(&block.c[2][half * 8]));
+    const __m256i a      = _mm256_load_si256(reinterpret_cast<const __m256i*>(&block.c[3][half * 8]));
+    __m256i       best   = _mm256_set1_epi32(std::numeric_limits<int32_t>::max());
+    __m256i       best_i = _mm256_setzero_si256();
+    for(uint32_t i = 0; i < palette.size; i++)
+    {
+      const __m256i dr = _mm256_sub_epi32(r, _mm256_set1_epi32(palette.c[i][0]));
+      const __m256i dg = _mm256_sub_epi32(g, _mm256_set1_epi32(palette.c[i][1]));
+      const __m256i db = _mm256_sub_epi32(b, _mm256_set1_epi32(palette.c[i][2]));
+      const __m256i da = _mm256_sub_epi32(a, _mm256_set1_epi32(palette.c[i][3]));
+      const __m256i d  = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(dr, dr), _mm256_mullo_epi32(dg, dg)),
+                                          _mm256_add_epi32(_mm256_mullo_epi32(db, db), _mm256_mullo_epi32(da, da)));
+      const __m256i closer = _mm256_cmpgt_epi32(best, d);  // Strictly, the first entry wins ties
+      best                 = _mm256_min_epi32(best, d);
+      best_i               = _mm256_blendv_epi8(best_i, _mm256_set1_epi32(static_cast<int32_t>(i)), closer);
+    }
+    alignas(32) int32_t dist[8];
+    alignas(32) int32_t idx[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(dist), best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(idx), best_i);
+    for(uint32_t j = 0; j < 8; j++)
+    {
+      indices[half * 8 + j] = static_cast<uint8_t>(idx[j]);
+      total += static_cast<uint32_t>(dist[j]);
+    }
+  }
+  return total;
+#else
+  uint32_t total = 0;
+  for(uint32_t p = 0; p < 16; p++)
+  {
+    int32_t best   = std::numeric_limits<int32_t>::max();
+    uint8_t best_i = 0;
+    for(uint32_t i = 0; i < palette.size; i++)
+    {
+      int32_t d = 0;
+      for(uint32_t c = 0; c < 4; c++)
+      {
+        const int32_t diff = block.c[c][p] - palette.c[i][c];
+        d += diff * diff;
+      }
+      if(d < best)
+      {
+        best   = d;
+        best_i = static_cast<uint8_t>(i);
+      }
+    }
+    indices[p] = best_i;
+    total += static_cast<uint32_t>(best);
+  }
+  return total;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------
+// Endpoints
+//
+
+// Extremes of the block along the line of best fit, or the corners of its bounding box (fast)
+static void findEndpoints(const Block& block, uint32_t numChannels, Quality quality, float e0[4], float e1[4])
+{
+  float lo[4] = {255.0F, 255.0F, 255.0F, 255.0F};
+  float hi[4] = {0.0F, 0.0F, 0.0F, 0.0F};
+  float mean[4]{};
+  for(uint32_t c = 0; c < numChannels; c++)
+  {
+    for(uint32_t i = 0; i < 16; i++)
+    {
+      lo[c] = std::min(lo[c], float(block.c[c][i]));
+      hi[c] = std::max(hi[c], float(block.c[c][i]));
+      mean[c] += float(block.c[c][i]);
+    }
+    mean[c] /= 16.0F;
+  }
+
+  float cov[4][4]{};
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    for(uint32_t c = 0; c < numChannels; c++)
+    {
+      for(uint32_t d = c; d < numChannels; d++)
+        cov[c][d] += (float(block.c[c][i]) - mean[c]) * (float(block.c[d][i]) - mean[d]);
+    }
+  }
+  for(uint32_t c = 0; c < numChannels; c++)
+  {
+    for(uint32_t d = 0; d < c; d++)
+      cov[c][d] = cov[d][c];
+  }
+
+  if(quality == Quality::eFast)
+  {
+    // The diagonal of the box going the way of the channel of largest range
+    uint32_t main = 0;
+    for(uint32_t c = 1; c < numChannels; c++)
+      main = (hi[c] - lo[c] > hi[main] - lo[main]) ? c : main;
+    for(uint32_t c = 0; c < 4; c++)
+    {
+      const bool flip = c < numChannels && cov[main][c] < 0.0F;
+      e0[c]           = c < numChannels ? (flip ? hi[c] : lo[c]) : 255.0F;
+      e1[c]           = c < numChannels ? (flip ? lo[c] : hi[c]) : 255.0F;
+    }
+    return;
+  }
+
+  // Principal axis by power iteration, from the diagonal of the box
+  float axis[4] = {};
+  for(uint32_t c = 0; c < numChannels; c++)
+    axis[c] = hi[c] - lo[c];
+  for(int iter = 0; iter < 8; iter++)
+  {
+    float next[4]{};
+    float norm = 0.0F;
+    for(uint32_t c = 0; c < numChannels; c++)
+    {
+      for(uint32_t d = 0; d < numChannels; d++)
+        next[c] += cov[c][d] * axis[d];
+      norm = std::max(norm, std::abs(next[c]));
+    }
+    if(norm < 1e-6F)
+      break;
+    for(uint32_t c = 0; c < numChannels; c++)
+      axis[c] = next[c] / norm;
+  }
+  float len2 = 0.0F;
+  for(uint32_t c = 0; c < numChannels; c++)
+    len2 += axis[c] * axis[c];
+
+  float tmin = 0.0F;
+  float tmax = 0.0F;
+  if(len2 > 1e-12F)
+  {
+    tmin = std::numeric_limits<float>::max();
+    tmax = -tmin;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+      float t = 0.0F;
+      for(uint32_t c = 0; c < numChannels; c++)
+        t += (float(block.c[c][i]) - mean[c]) * axis[c];
+      tmin = std::min(tmin, t / len2);
+      tmax = std::max(tmax, t / len2);
+    }
+  }
+  for(uint32_t c = 0; c < 4; c++)
+  {
+    e0[c] = c < numChannels ? std::clamp(mean[c] + axis[c] * tmin, 0.0F, 255.0F) : 255.0F;
+    e1[c] = c < numChannels ? std::clamp(mean[c] + axis[c] * tmax, 0.0F, 255.0F) : 255.0F;
+  }
+}
+
+// Endpoints minimizing the squared error of the pixels interpolated at `t`
+static bool leastSquares(const Block& block, uint32_t numChannels, const float t[16], float e0[4], float e1[4])
+{
+  float aa = 0.0F;
+  float ab = 0.0F;
+  float bb = 0.0F;
+  float x0[4]{};
+  float x1[4]{};
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    const float s = 1.0F - t[i];
+    aa += s * s;
+    ab += s * t[i];
+    bb += t[i] * t[i];
+    for(uint32_t c = 0; c < numChannels; c++)
+    {
+      x0[c] += s * float(block.c[c][i]);
+      x1[c] += t[i] * float(block.c[c][i]);
+    }
+  }
+  const float det = aa * bb - ab * ab;
+  if(std::abs(det) < 1e-6F)
+    return false;
+  for(uint32_t c = 0; c < numChannels; c++)
+  {
+    e0[c] = std::clamp((bb * x0[c] - ab * x1[c]) / det, 0.0F, 255.0F);
+    e1[c] = std::clamp((aa * x1[c] - ab * x0[c]) / det, 0.0F, 255.0F);
+  }
+  return true;
+}
+
+// Little-endian bit writer and reader of a block
+static void putBits(uint8_t* block, uint32_t& pos, uint32_t value, uint32_t count)
+{
+  for(uint32_t i = 0; i < count; i++, pos++)
+  {
+    if((value >> i) & 1U)
+      block[pos >> 3] |= static_cast<uint8_t>(1U << (pos & 7));
+  }
+}
+
+static uint32_t getBits(const uint8_t* block, uint32_t& pos, uint32_t count)
+{
+  uint32_t value = 0;
+  for(uint32_t i = 0; i < count; i++, pos++)
+    value |= uint32_t((block[pos >> 3] >> (pos & 7)) & 1U) << i;
+  return value;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// BC1
+//
+static uint16_t to565(const float e[4])
+{
+  const auto r = static_cast<uint32_t>(std::lround(e[0] * 31.0F / 255.0F));
+  const auto g = static_cast<uint32_t>(std::lround(e[1] * 63.0F / 255.0F));
+  const auto b = static_cast<uint32_t>(std::lround(e[2] * 31.0F / 255.0F));
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void from565(uint16_t c, int32_t rgb[4])
+{
+  const uint32_t r = (c >> 11) & 31;
+  const uint32_t g = (c >> 5) & 63;
+  const uint32_t b = c & 31;
+  rgb[0]           = static_cast<int32_t>((r << 3) | (r >> 2));
+  rgb[1]           = static_cast<int32_t>((g << 2) | (g >> 4));
+  rgb[2]           = static_cast<int32_t>((b << 3) | (b >> 2));
+  rgb[3]           = 255;
+}
+
+static void paletteBC1(uint16_t c0, uint16_t c1, Palette& palette)
+{
+  palette.size = 4;
+  from565(c0, palette.c[0]);
+  from565(c1, palette.c[1]);
+  for(uint32_t c = 0; c < 3; c++)
+  {
+    if(c0 > c1)
+    {
+      palette.c[2][c] = (2 * palette.c[0][c] + palette.c[1][c]) / 3;
+      palette.c[3][c] = (palette.c[0][c] + 2 * palette.c[1][c]) / 3;
+    }
+    else
+    {
+      palette.c[2][c] = (palette.c[0][c] + palette.c[1][c]) / 2;
+      palette.c[3][c] = 0;
+    }
+  }
+  palette.c[2][3] = 255;
+  palette.c[3][3] = 255;
+}
+
+// Endpoints in 4-color mode (c0 > c1), the indices and the error
+static uint32_t quantizeBC1(const Block& block, const float e0[4], const float e1[4], uint16_t& c0, uint16_t& c1, uint8_t indices[16])
+{
+  c0 = to565(e0);
+  c1 = to565(e1);
+  if(c0 < c1)
+    std::swap(c0, c1);
+  Palette palette;
+  paletteBC1(c0, c1, palette);
+  return nearestIndices(block, palette, indices);
+}
+
+static void encodeBlockBC1(Block& block, Quality quality, uint8_t* dst)
+{
+  for(uint32_t i = 0; i < 16; i++)
+    block.c[3][i] = 255;  // The alpha of the palette
+
+  float e0[4];
+  float e1[4];
+  findEndpoints(block, 3, quality, e0, e1);
+  if(quality == Quality::eFast)
+  {
+    // Inset of the box, as the extremes are rarely hit
+    for(uint32_t c = 0; c < 3; c++)
+    {
+      const float inset = (e1[c] - e0[c]) / 16.0F;
+      e0[c] += inset;
+      e1[c] -= inset;
+    }
+  }
+
+  uint16_t c0 = 0;
+  uint16_t c1 = 0;
+  uint8_t  indices[16];
+  uint32_t error = quantizeBC1(block, e0, e1, c0, c1, indices);
+
+  if(quality == Quality::eNormal)
+  {
+    static const float weights[4] = {0.0F, 1.0F, 1.0F / 3.0F, 2.0F / 3.0F};
+    for(int iter = 0; iter < 2 && error > 0; iter++)
+    {
+      float t[16];
+      for(uint32_t i = 0; i < 16; i++)
+        t[i] = weights[indices[i]];
+      // The endpoints are those of the palette, c0 first
+      float r0[4];
+      float r1[4];
+      if(!leastSquares(block, 3, t, r0, r1))
+        break;
+      uint16_t n0 = 0;
+      uint16_t n1 = 0;
+      uint8_t  n_indices[16];
+      const uint32_t n_error = quantizeBC1(block, r0, r1, n0, n1, n_indices);
+      if(n_error >= error)
+        break;
+      error = n_error;
+      c0    = n0;
+      c1    = n1;
+      memcpy(indices, n_indices, 16);
+    }
+  }
+
+  uint32_t bits = 0;
+  for(uint32_t i = 0; i < 16; i++)
+    bits |= uint32_t(indices[i]) << (2 * i);
+  memcpy(dst, &c0, 2);
+  memcpy(dst + 2, &c1, 2);
+  memcpy(dst + 4, &bits, 4);
+}
+
+static void decodeBlockBC1(const uint8_t* src, uint8_t pixels[16][4])
+{
+  uint16_t c0;
+  uint16_t c1;
+  uint32_t bits;
+  memcpy(&c0, src, 2);
+  memcpy(&c1, src + 2, 2);
+  memcpy(&bits, src + 4, 4);
+  Palette palette;
+  paletteBC1(c0, c1, palette);
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    const uint32_t index = (bits >> (2 * i)) & 3;
+    for(uint32_t c = 0; c < 4; c++)
+      pixels[i][c] = static_cast<uint8_t>(palette.c[index][c]);
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// BC4, values in [0,255]
+//
+static void paletteBC4(uint32_t r0, uint32_t r1, float palette[8])
+{
+  palette[0] = float(r0);
+  palette[1] = float(r1);
+  if(r0 > r1)
+  {
+    for(uint32_t k = 1; k < 7; k++)
+      palette[k + 1] = (float(7 - k) * r0 + float(k) * r1) / 7.0F;
+  }
+  else
+  {
+    for(uint32_t k = 1; k < 5; k++)
+      palette[k + 1] = (float(5 - k) * r0 + float(k) * r1) / 5.0F;
+    palette[6] = 0.0F;
+    palette[7] = 255.0F;
+  }
+}
+
+static float indicesBC4(const float values[16], uint32_t r0, uint32_t r1, uint8_t indices[16])
+{
+  float palette[8];
+  paletteBC4(r0, r1, palette);
+  float error = 0.0F;
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    float best = std::numeric_limits<float>::max();
+    for(uint32_t k = 0; k < 8; k++)
+    {
+      const float d = std::abs(values[i] - palette[k]);
+      if(d < best)
+      {
+        best       = d;
+        indices[i] = static_cast<uint8_t>(k);
+      }
+    }
+    error += best * best;
+  }
+  return error;
+}
+
+static void encodeBlockBC4(const float values[16], Quality quality, uint8_t* dst)
+{
+  float lo = 255.0F;
+  float hi = 0.0F;
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    lo = std::min(lo, values[i]);
+    hi = std::max(hi, values[i]);
+  }
+
+  const auto hi_i = static_cast<int>(std::lround(hi));
+  const auto lo_i = static_cast<int>(std::lround(lo));
+  auto       r0   = static_cast<uint32_t>(hi_i);
+  auto       r1   = static_cast<uint32_t>(lo_i);
+  uint8_t    indices[16];
+  float      error = indicesBC4(values, r0, r1, indices);
+
+  if(quality == Quality::eNormal && error > 0.0F)
+  {
+    auto try_endpoints = [&](int a, int b) {
+      if(a < 0 || a > 255 || b < 0 || b > 255)
+        return;
+      uint8_t     candidate[16];
+      const float e = indicesBC4(values, uint32_t(a), uint32_t(b), candidate);
+      if(e < error)
+      {
+        error = e;
+        r0    = uint32_t(a);
+        r1    = uint32_t(b);
+        memcpy(indices, candidate, 16);
+      }
+    };
+
+    // 8 values: endpoints moved inwards, the extremes being rarely the best. The window is around
+    // the extremes, not the best endpoints so far, which try_endpoints() changes.
+    const int range = std::max(int(std::lround((hi - lo) / 14.0F)), 1);
+    for(int d0 = 0; d0 <= range; d0++)
+    {
+      for(int d1 = 0; d1 <= range; d1++)
+      {
+        if(hi_i - d0 > lo_i + d1)
+          try_endpoints(hi_i - d0, lo_i + d1);
+      }
+    }
+
+    // 6 values, plus 0 and 255 for the values at the extremes
+    float lo6 = 255.0F;
+    float hi6 = 0.0F;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+      if(values[i] > 0.5F && values[i] < 254.5F)
+      {
+        lo6 = std::min(lo6, values[i]);
+        hi6 = std::max(hi6, values[i]);
+      }
+    }
+    if(lo6 <= hi6)
+      try_endpoints(int(std::lround(lo6)), int(std::lround(hi6)));
+  }
+
+  dst[0]        = static_cast<uint8_t>(r0);
+  dst[1]        = static_cast<uint8_t>(r1);
+  uint64_t bits = 0;
+  for(uint32_t i = 0; i < 16; i++)
+    bits |= uint64_t(indices[i]) << (3 * i);
+  for(uint32_t i = 0; i < 6; i++)
+    dst[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+static void decodeBlockBC4(const uint8_t* src, float values[16])
+{
+  float palette[8];
+  paletteBC4(src[0], src[1], palette);
+  uint64_t bits = 0;
+  for(uint32_t i = 0; i < 6; i++)
+    bits |= uint64_t(src[2 + i]) << (8 * i);
+  for(uint32_t i = 0; i < 16; i++)
+    values[i] = palette[(bits >> (3 * i)) & 7];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// BC7 mode 6
+//
+static const int32_t kWeights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Mode6
+{
+  int32_t q[2][4]{};  // 7-bit endpoints
+  int32_t p[2]{};     // p-bits
+};
+
+static int32_t mode6Value(const Mode6& m, uint32_t e, uint32_t c)
+{
+  return (m.q[e][c] << 1) | m.p[e];
+}
+
+static void paletteMode6(const Mode6& m, Palette& palette)
+{
+  palette.size = 16;
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    for(uint32_t c = 0; c < 4; c++)
+      palette.c[i][c] = ((64 - kWeights4[i]) * mode6Value(m, 0, c) + kWeights4[i] * mode6Value(m, 1, c) + 32) >> 6;
+  }
+}
+
+static void quantizeMode6(const float e[4], int32_t p, int32_t q[4])
+{
+  for(uint32_t c = 0; c < 4; c++)
+    q[c] = std::clamp(static_cast<int32_t>(std::lround((e[c] - float(p)) / 2.0F)), 0, 127);
+}
+
+// p-bit of an endpoint closest to it once quantized
+static int32_t bestPBit(const float e[4])
+{
+  float err[2] = {};
+  for(int32_t p = 0; p < 2; p++)
+  {
+    int32_t q[4];
+    quantizeMode6(e, p, q);
+    for(uint32_t c = 0; c < 4; c++)
+    {
+      const float d = float((q[c] << 1) | p) - e[c];
+      err[p] += d * d;
+    }
+  }
+  return err[1] < err[0] ? 1 : 0;
+}
+
+static uint32_t evaluateMode6(const Block& block, const float e0[4], const float e1[4], int32_t p0, int32_t p1, Mode6& m, uint8_t indices[16])
+{
+  m.p[0] = p0;
+  m.p[1] = p1;
+  quantizeMode6(e0, p0, m.q[0]);
+  quantizeMode6(e1, p1, m.q[1]);
+  Palette palette;
+  paletteMode6(m, palette);
+  return nearestIndices(block, palette, indices);
+}
+
+// Best of the quantizations of the endpoints: all p-bits (normal), or the closest ones (fast)
+static uint32_t quantizeBC7(const Block& block, Quality quality, const float e0[4], const float e1[4], Mode6& m, uint8_t indices[16])
+{
+  if(quality == Quality::eFast)
+    return evaluateMode6(block, e0, e1, bestPBit(e0), bestPBit(e1), m, indices);
+
+  uint32_t best = std::numeric_limits<uint32_t>::max();
+  for(int32_t p = 0; p < 4; p++)
+  {
+    Mode6          candidate;
+    uint8_t        candidate_indices[16];
+    const uint32_t error = evaluateMode6(block, e0, e1, p & 1, p >> 1, candidate, candidate_indices);
+    if(error < best)
+    {
+      best = error;
+      m    = candidate;
+      memcpy(indices, candidate_indices, 16);
+    }
+  }
+  return best;
+}
+
+static void encodeBlockBC7(const Block& block, Quality quality, uint8_t* dst)
+{
+  float e0[4];
+  float e1[4];
+  findEndpoints(block, 4, quality, e0, e1);
+
+  Mode6    m;
+  uint8_t  indices[16];
+  uint32_t error = quantizeBC7(block, quality, e0, e1, m, indices);
+
+  if(quality == Quality::eNormal)
+  {
+    for(int iter = 0; iter < 2 && error > 0; iter++)
+    {
+      float t[16];
+      for(uint32_t i = 0; i < 16; i++)
+        t[i] = float(kWeights4[indices[i]]) / 64.0F;
+      float r0[4];
+      float r1[4];
+      if(!leastSquares(block, 4, t, r0, r1))
+        break;
+      Mode6          n;
+      uint8_t        n_indices[16];
+      const uint32_t n_error = quantizeBC7(block, quality, r0, r1, n, n_indices);
+      if(n_error >= error)
+        break;
+      error = n_error;
+      m     = n;
+      memcpy(indices, n_indices, 16);
+    }
+  }
+
+  // The most significant bit of the first index is implicit 0: swap the endpoints if needed
+  if(indices[0] >= 8)
+  {
+    std::swap(m.q[0], m.q[1]);
+    std::swap(m.p[0], m.p[1]);
+    for(uint32_t i = 0; i < 16; i++)
+      indices[i] = static_cast<uint8_t>(15 - indices[i]);
+  }
+
+  memset(dst, 0, 16);
+  uint32_t pos = 0;
+  putBits(dst, pos, 1U << 6, 7);  // Mode 6
+  for(uint32_t c = 0; c < 4; c++)
+  {
+    putBits(dst, pos, uint32_t(m.q[0][c]), 7);
+    putBits(dst, pos, uint32_t(m.q[1][c]), 7);
+  }
+  putBits(dst, pos, uint32_t(m.p[0]), 1);
+  putBits(dst, pos, uint32_t(m.p[1]), 1);
+  putBits(dst, pos, indices[0], 3);
+  for(uint32_t i = 1; i < 16; i++)
+    putBits(dst, pos, indices[i], 4);
+}
+
+// Mode 6 only, the other modes decode to black
+static void decodeBlockBC7(const uint8_t* src, uint8_t pixels[16][4])
+{
+  if((src[0] & 0x7F) != 0x40)
+  {
+    memset(pixels, 0, 64);
+    return;
+  }
+  uint32_t pos = 7;
+  Mode6    m;
+  for(uint32_t c = 0; c < 4; c++)
+  {
+    m.q[0][c] = static_cast<int32_t>(getBits(src, pos, 7));
+    m.q[1][c] = static_cast<int32_t>(getBits(src, pos, 7));
+  }
+  m.p[0] = static_cast<int32_t>(getBits(src, pos, 1));
+  m.p[1] = static_cast<int32_t>(getBits(src, pos, 1));
+  Palette palette;
+  paletteMode6(m, palette);
+  for(uint32_t i = 0; i < 16; i++)
+  {
+    const uint32_t index = getBits(src, pos, i == 0 ? 3 : 4);
+    for(uint32_t c = 0; c < 4; c++)
+      pixels[i][c] = static_cast<uint8_t>(palette.c[index][c]);
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Images
+//
+
+// fn(bx, by) for all blocks, a row of blocks per task
+template <typename F>
+static void forEachBlock(uint32_t width, uint32_t height, uint32_t numThreads, F&& fn)
+{
+  const uint32_t blocks_x = (width + 3) / 4;
+  const uint32_t blocks_y = (height + 3) / 4;
+  nvh::parallel_batches<1>(
+      blocks_y,
+      [&](uint64_t by) {
+        for(uint32_t bx = 0; bx < blocks_x; bx++)
+          fn(bx, static_cast<uint32_t>(by));
+      },
+      numThreads == 0 ? std::thread::hardware_concurrency() : numThreads);
+}
+
+void encodeRGBA8(Format format, Quality quality, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks, uint32_t numThreads)
+{
+  const uint32_t blocks_x = (width + 3) / 4;
+  const uint32_t bytes    = blockBytes(format);
+  forEachBlock(width, height, numThreads, [&](uint32_t bx, uint32_t by) {
+    Block block;
+    loadBlock(rgba, width, height, bx, by, block);
+    uint8_t* dst = blocks + (size_t(by) * blocks_x + bx) * bytes;
+    switch(format)
+    {
+      case Format::eBC1:
+        encodeBlockBC1(block, quality, dst);
+        break;
+      case Format::eBC4: {
+        float values[16];
+        for(uint32_t i = 0; i < 16; i++)
+          values[i] = float(block.c[0][i]);
+        encodeBlockBC4(values, quality, dst);
+        break;
+      }
+      case Format::eBC7:
+        encodeBlockBC7(block, quality, dst);
+        break;
+    }
+  });
+}
+
+void encodeBC4(Quality quality, const float* values, uint32_t width, uint32_t height, uint8_t* blocks, uint32_t numThreads)
+{
+  const uint32_t blocks_x = (width + 3) / 4;
+  forEachBlock(width, height, numThreads, [&](uint32_t bx, uint32_t by) {
+    float block[16];
+    for(uint32_t i = 0; i < 16; i++)
+    {
+      const uint32_t x = std::min(bx * 4 + (i & 3), width - 1);
+      const uint32_t y = std::min(by * 4 + (i >> 2), height - 1);
+      block[i]         = std::clamp(values[size_t(y) * width + x], 0.0F, 1.0F) * 255.0F;
+    }
+    encodeBlockBC4(block, quality, blocks + (size_t(by) * blocks_x + bx) * 8);
+  });
+}
+
+std::vector<std::vector<uint8_t>> encodeMipChainRGBA8(Format format, Quality quality, const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t numThreads)
+{
+  std::vector<std::vector<uint8_t>> levels;
+  std::vector<uint8_t>              level(rgba, rgba + size_t(width) * height * 4);
+  std::vector<uint8_t>              next;
+  for(;;)
+  {
+    std::vector<uint8_t>& blocks = levels.emplace_back(compressedSize(format, width, height));
+    encodeRGBA8(format, quality, level.data(), width, height, blocks.data(), numThreads);
+    if(width == 1 && height == 1)
+      break;
+
+    // 2x2 box filter, the last row or column repeated when odd
+    const uint32_t w = std::max(width / 2, 1U);
+    const uint32_t h = std::max(height / 2, 1U);
+    next.resize(size_t(w) * h * 4);
+    for(uint32_t y = 0; y < h; y++)
+    {
+      const uint32_t y0 = std::min(y * 2, height - 1);
+      const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+      for(uint32_t x = 0; x < w; x++)
+      {
+        const uint32_t x0 = std::min(x * 2, width - 1);
+        const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+        for(uint32_t c = 0; c < 4; c++)
+        {
+          const uint32_t sum = level[(size_t(y0) * width + x0) * 4 + c] + level[(size_t(y0) * width + x1) * 4 + c]
+                               + level[(size_t(y1) * width + x0) * 4 + c] + level[(size_t(y1) * width + x1) * 4 + c];
+          next[(size_t(y) * w + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+      }
+    }
+    level.swap(next);
+    width  = w;
+    height = h;
+  }
+  return levels;
+}
+
+void decodeRGBA8(Format format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba, uint32_t numThreads)
+{
+  const uint32_t blocks_x = (width + 3) / 4;
+  const uint32_t bytes    = blockBytes(format);
+  forEachBlock(width, height, numThreads, [&](uint32_t bx, uint32_t by) {
+    const uint8_t* src = blocks + (size_t(by) * blocks_x + bx) * bytes;
+    uint8_t        pixels[16][4];
+    if(format == Format::eBC1)
+    {
+      decodeBlockBC1(src, pixels);
+    }
+    else if(format == Format::eBC7)
+    {
+      decodeBlockBC7(src, pixels);
+    }
+    else
+    {
+      float values[16];
+      decodeBlockBC4(src, values);
+      for(uint32_t i = 0; i < 16; i++)
+      {
+        pixels[i][0] = static_cast<uint8_t>(std::lround(values[i]));
+        pixels[i][1] = 0;
+        pixels[i][2] = 0;
+        pixels[i][3] = 255;
+      }
+    }
+    for(uint32_t i = 0; i < 16; i++)
+    {
+      const uint32_t x = bx * 4 + (i & 3);
+      const uint32_t y = by * 4 + (i >> 2);
+      if(x < width && y < height)
+        memcpy(rgba + (size_t(y) * width + x) * 4, pixels[i], 4);
+    }
+  });
+}
+
+void decodeBC4(const uint8_t* blocks, uint32_t width, uint32_t height, float* values, uint32_t numThreads)
+{
+  const uint32_t blocks_x = (width + 3) / 4;
+  forEachBlock(width, height, numThreads, [&](uint32_t bx, uint32_t by) {
+    float block[16];
+    decodeBlockBC4(blocks + (size_t(by) * blocks_x + bx) * 8, block);
+    for(uint32_t i = 0; i < 16; i++)
+    {
+      const uint32_t x = bx * 4 + (i & 3);
+      const uint32_t y = by * 4 + (i >> 2);
+      if(x < width && y < height)
+        values[size_t(y) * width + x] = block[i] / 255.0F;
+    }
+  });
+}
+
+static double psnrFromMse(double mse, double peak)
+{
+  return mse > 0.0 ? 10.0 * std::log10(peak * peak / mse) : std::numeric_limits<double>::infinity();
+}
+
+double psnrRGBA8(const uint8_t* a, const uint8_t* b, size_t numPixels, uint32_t numChannels)
+{
+  double sum = 0.0;
+  for(size_t i = 0; i < numPixels; i++)
+  {
+    for(uint32_t c = 0; c < numChannels; c++)
+    {
+      const double d = double(a[i * 4 + c]) - double(b[i * 4 + c]);
+      sum += d * d;
+    }
+  }
+  return psnrFromMse(sum / double(std::max<size_t>(numPixels * numChannels, 1)), 255.0);
+}
+
+double psnr(const float* a, const float* b, size_t count)
+{
+  double sum = 0.0;
+  for(size_t i = 0; i < count; i++)
+  {
+    const double d = double(a[i]) - double(b[i]);
+    sum += d * d;
+  }
+  return psnrFromMse(sum / double(std::max<size_t>(count, 1)), 1.0);
+}
+
+}  // namespace bc
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------------------
+// Block compression of images made at runtime, before their upload
+//
+// - BC1 : RGB, 8 bytes per 4x4 block (VK_FORMAT_BC1_RGB_UNORM_BLOCK), 1/8 of RGBA8
+// - BC4 : one channel, 8 bytes per block (VK_FORMAT_BC4_UNORM_BLOCK), 1/8 of R32F
+// - BC7 : RGBA, 16 bytes per block (VK_FORMAT_BC7_UNORM_BLOCK), 1/4 of RGBA8. Only mode 6 (one
+//         subset, 4-bit indices, RGBA endpoints of 7 bits and a p-bit) is used.
+//
+// eFast takes the endpoints from the bounding box of the block. eNormal takes them from its
+// principal axis, refines them by least squares on the chosen indices, and searches the p-bits (BC7)
+// or the endpoints around the extremes (BC4).
+//
+// The blocks are encoded on all threads, a row of blocks per task. The search of the nearest palette
+// entry, 8 pixels at a time, uses AVX2 when the compiler enables it.
+//
+// The decoders follow the hardware, to measure the error of the encoder (PSNR).
+//
+namespace bc {
+
+enum class Format
+{
+  eBC1,
+  eBC4,
+  eBC7,
+};
+
+enum class Quality
+{
+  eFast,
+  eNormal,
+};
+
+uint32_t blockBytes(Format format);
+size_t   compressedSize(Format format, uint32_t width, uint32_t height);
+
+// RGBA8 pixels, row after row, to blocks, row of blocks after row of blocks. BC4 takes the red
+// channel. numThreads 0: all cores
+void encodeRGBA8(Format format, Quality quality, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* blocks, uint32_t numThreads = 0);
+
+// Values in [0,1] to BC4
+void encodeBC4(Quality quality, const float* values, uint32_t width, uint32_t height, uint8_t* blocks, uint32_t numThreads = 0);
+
+// All mip levels of an RGBA8 image down to 1x1, box filtered, then encoded
+std::vector<std::vector<uint8_t>> encodeMipChainRGBA8(Format         format,
+                                                      Quality        quality,
+                                                      const uint8_t* rgba,
+                                                      uint32_t       width,
+                                                      uint32_t       height,
+                                                      uint32_t       numThreads = 0);
+
+// Blocks to RGBA8 pixels. BC4 goes to red, BC1 has an alpha of 255.
+void decodeRGBA8(Format format, const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* rgba, uint32_t numThreads = 0);
+
+// BC4 blocks to values in [0,1]
+void decodeBC4(const uint8_t* blocks, uint32_t width, uint32_t height, float* values, uint32_t numThreads = 0);
+
+// Peak signal-to-noise ratio in dB of the first `numChannels` channels of RGBA8 pixels
+double psnrRGBA8(const uint8_t* a, const uint8_t* b, size_t numPixels, uint32_t numChannels = 4);
+
+// Peak signal-to-noise ratio in dB of values in [0,1]
+double psnr(const float* a, const float* b, size_t count);
+
+}  // namespace bc
@@ -29,6 +29,8 @@ inline auto getInterpolated = [](const auto& v0, const auto& v1, const auto& v2,
 
 //--------------------------------------------------------------------------------------------------
 // Holds the barycentric values for each level, in the order the GPU is expecting them
+// Note: for the unit triangle, BirdCurveTables (bird_curve_tables.hpp) has the same data precomputed
+//       at compile time; this class is the reference and handles arbitrary corners.
 //
 class BirdCurveHelper
 {
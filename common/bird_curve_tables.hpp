@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include "nvmath/nvmath.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Compile-time generation of the Bird Curve tables, for subdivision level 0 to 5.
+// The barycentric coordinates are integers in 1/32 units (1 << maxLevel), which makes all
+// micro-vertices exact and allows the index lookups to be resolved at compile time.
+//
+// This produces the same data as BirdCurveHelper (the runtime reference), without allocation.
+//
+namespace bird_curve_detail {
+
+static constexpr uint32_t kMaxLevel = 5;
+static constexpr uint32_t kScale    = 1U << kMaxLevel;  // Barycentric coordinate 1.0
+
+struct Bary
+{
+  uint8_t w{0};
+  uint8_t u{0};
+  uint8_t v{0};
+};
+
+struct Triangle
+{
+  uint16_t w{0};  // Index of the micro-vertex in the Bird Curve order
+  uint16_t u{0};
+  uint16_t v{0};
+};
+
+constexpr uint32_t numMicroVertices(uint32_t level)
+{
+  return (((1 << level) + 1) * ((1 << level) + 2)) >> 1;
+}
+constexpr uint32_t numMicroTriangles(uint32_t level)
+{
+  return 1 << (level << 1u);
+}
+constexpr uint32_t numDisplacementBlocks(uint32_t level)
+{
+  return level <= 3 ? 1 : 1 << ((level - 3) << 1u);
+}
+// Offset of the first triangle of `level`, triangles of all levels being stored contiguously
+constexpr uint32_t triangleOffset(uint32_t level)
+{
+  return (numMicroTriangles(level) - 1) / 3;
+}
+// Offset of the first index of the displacement blocks of `level`
+constexpr uint32_t blockOffset(uint32_t level)
+{
+  uint32_t offset = 0;
+  for(uint32_t l = 0; l < level; l++)
+    offset += numDisplacementBlocks(l) * numMicroVertices(l < 3 ? l : 3);
+  return offset;
+}
+
+static constexpr uint32_t kNumVertices  = numMicroVertices(kMaxLevel);
+static constexpr uint32_t kNumTriangles = triangleOffset(kMaxLevel + 1);
+static constexpr uint32_t kNumBlockIdx  = blockOffset(kMaxLevel + 1);
+
+struct Tables
+{
+  std::array<Bary, kNumVertices>      vertices{};   // Micro-vertices, level N is the prefix of numMicroVertices(N)
+  std::array<Triangle, kNumTriangles> triangles{};  // Micro-triangles of all levels, starting at triangleOffset(level)
+  std::array<uint16_t, kNumBlockIdx>  blocks{};     // Displacement block indices, starting at blockOffset(level)
+  std::array<std::array<uint16_t, kScale + 1>, kScale + 1> index{};  // Micro-vertex index from (u,v)
+};
+
+// Same recursion as BirdCurveHelper::birdLevel(), on integer barycentrics
+class Builder
+{
+public:
+  constexpr Tables build()
+  {
+    const Bary w{kScale, 0, 0};
+    const Bary u{0, kScale, 0};
+    const Bary v{0, 0, kScale};
+
+    push(0, w);
+    push(0, u);
+    push(0, v);
+    birdLevel(1, true, true, w, u, v);
+
+    // Final level N == level 0 + level 1 + .. + level N
+    uint32_t count = 0;
+    for(uint32_t level = 0; level <= kMaxLevel; level++)
+    {
+      for(uint32_t i = 0; i < m_levelCount[level]; i++)
+        m_tables.vertices[count++] = m_levelVertices[level][i];
+    }
+
+    // Index of each micro-vertex, from its (u,v) coordinates
+    for(uint32_t i = 0; i < kNumVertices; i++)
+      m_tables.index[m_tables.vertices[i].u][m_tables.vertices[i].v] = static_cast<uint16_t>(i);
+
+    for(uint32_t t = 0; t < kNumTriangles; t++)
+    {
+      m_tables.triangles[t] = {indexOf(m_triBary[t][0]), indexOf(m_triBary[t][1]), indexOf(m_triBary[t][2])};
+    }
+
+    buildDisplacementBlocks();
+    return m_tables;
+  }
+
+private:
+  static constexpr Bary mid(const Bary& a, const Bary& b)
+  {
+    return {static_cast<uint8_t>((a.w + b.w) / 2), static_cast<uint8_t>((a.u + b.u) / 2), static_cast<uint8_t>((a.v + b.v) / 2)};
+  }
+
+  constexpr void push(uint32_t level, const Bary& b) { m_levelVertices[level][m_levelCount[level]++] = b; }
+
+  constexpr uint16_t indexOf(const Bary& b) const { return m_tables.index[b.u][b.v]; }
+
+  constexpr void birdLevel(uint32_t level, bool triPointUp, bool counterClockwise, const Bary& w, const Bary& u, const Bary& v)
+  {
+    m_triBary[triangleOffset(level - 1) + m_triCount[level - 1]++] = {w, u, v};
+
+    if(level > kMaxLevel)
+      return;
+
+    const Bary vw = mid(v, w);
+    const Bary uv = mid(u, v);
+    const Bary uw = mid(w, u);
+
+    if(triPointUp)  // Store mid-points only triangles pointing up
+    {
+      if(counterClockwise)
+      {
+        push(level, vw);
+        push(level, uv);
+        push(level, uw);
+      }
+      else
+      {
+        push(level, uv);
+        push(level, vw);
+        push(level, uw);
+      }
+    }
+
+    birdLevel(level + 1, triPointUp, counterClockwise, w, uw, vw);
+    birdLevel(level + 1, !triPointUp, !counterClockwise, vw, uv, uw);
+    birdLevel(level + 1, triPointUp, counterClockwise, uw, u, uv);
+    birdLevel(level + 1, triPointUp, !counterClockwise, uv, vw, v);
+  }
+
+  // Same as BirdCurveHelper::createDisplacementBlocks(): level 0..3 are linear, level 4 and 5 are made
+  // of the level-3 vertices of each of the 4 (or 16) sub-triangles.
+  constexpr void buildDisplacementBlocks()
+  {
+    for(uint32_t level = 0; level <= kMaxLevel; level++)
+    {
+      uint32_t offset = blockOffset(level);
+      if(level <= 3)
+      {
+        for(uint32_t i = 0; i < numMicroVertices(level); i++)
+          m_tables.blocks[offset + i] = static_cast<uint16_t>(i);
+        continue;
+      }
+
+      std::array<std::array<Bary, 3>, 16> sub_triangles{};
+      uint32_t                            num_sub = split({kScale, 0, 0}, {0, kScale, 0}, {0, 0, kScale}, sub_triangles.data());
+      if(level == 5)
+      {
+        std::array<std::array<Bary, 3>, 16> level4 = sub_triangles;
+        num_sub                                    = 0;
+        for(uint32_t i = 0; i < 4; i++)
+          num_sub += split(level4[i][0], level4[i][1], level4[i][2], sub_triangles.data() + num_sub);
+      }
+
+      // Level-3 micro-vertices of the sub-triangle, expressed in the base triangle
+      for(uint32_t s = 0; s < num_sub; s++)
+      {
+        const auto& tri = sub_triangles[s];
+        for(uint32_t i = 0; i < numMicroVertices(3); i++)
+        {
+          const Bary& b = m_tables.vertices[i];
+          const Bary  p{static_cast<uint8_t>((tri[0].w * b.w + tri[1].w * b.u + tri[2].w * b.v) / kScale),
+                       static_cast<uint8_t>((tri[0].u * b.w + tri[1].u * b.u + tri[2].u * b.v) / kScale),
+                       static_cast<uint8_t>((tri[0].v * b.w + tri[1].v * b.u + tri[2].v * b.v) / kScale)};
+          m_tables.blocks[offset++] = indexOf(p);
+        }
+      }
+    }
+  }
+
+  // Split the triangle in four, like BirdCurveHelper::splitTriangles()
+  static constexpr uint32_t split(const Bary& w, const Bary& u, const Bary& v, std::array<Bary, 3>* dst)
+  {
+    const Bary vw = mid(v, w);
+    const Bary uv = mid(u, v);
+    const Bary uw = mid(w, u);
+    dst[0]        = {w, uw, vw};
+    dst[1]        = {vw, uv, uw};
+    dst[2]        = {uw, u, uv};
+    dst[3]        = {uv, vw, v};
+    return 4;
+  }
+
+  Tables                                                    m_tables{};
+  std::array<std::array<Bary, kNumVertices>, kMaxLevel + 1> m_levelVertices{};  // Micro-vertices added by each level
+  std::array<uint32_t, kMaxLevel + 1>                       m_levelCount{};
+  std::array<std::array<Bary, 3>, kNumTriangles>            m_triBary{};  // Sub-triangle coordinates of all levels
+  std::array<uint32_t, kMaxLevel + 1>                       m_triCount{};
+};
+
+inline constexpr Tables kTables = Builder().build();
+
+}  // namespace bird_curve_detail
+
+
+//--------------------------------------------------------------------------------------------------
+// Access to the precomputed Bird Curve tables, see bird_curve_detail
+//
+class BirdCurveTables
+{
+public:
+  using Bary     = bird_curve_detail::Bary;
+  using Triangle = bird_curve_detail::Triangle;
+
+  static constexpr uint32_t kMaxLevel = bird_curve_detail::kMaxLevel;
+  static constexpr uint32_t kScale    = bird_curve_detail::kScale;
+
+  static constexpr uint32_t getNumMicroVertices(uint32_t level) { return bird_curve_detail::numMicroVertices(level); }
+  static constexpr uint32_t getNumMicroTriangles(uint32_t level) { return bird_curve_detail::numMicroTriangles(level); }
+  static constexpr uint32_t getNumDisplacementBlocks(uint32_t level)
+  {
+    return bird_curve_detail::numDisplacementBlocks(level);
+  }
+
+  // All micro-vertex barycentric coordinates of `level`, in Bird Curve order
+  static constexpr std::span<const Bary> getVertexCoord(uint32_t level)
+  {
+    return {bird_curve_detail::kTables.vertices.data(), getNumMicroVertices(level)};
+  }
+
+  // Triplet of micro-vertex indices making the sub-triangles of `level`
+  static constexpr std::span<const Triangle> getTriangleIndices(uint32_t level)
+  {
+    return {bird_curve_detail::kTables.triangles.data() + bird_curve_detail::triangleOffset(level), getNumMicroTriangles(level)};
+  }
+
+  // Indices of the micro-vertices stored in the displacement `block` (64_TRIANGLES_64_BYTES format)
+  static constexpr std::span<const uint16_t> getDisplacementBlock(uint32_t level, uint32_t block)
+  {
+    const uint32_t size = getNumMicroVertices(level < 3 ? level : 3);
+    return {bird_curve_detail::kTables.blocks.data() + bird_curve_detail::blockOffset(level) + block * size, size};
+  }
+
+  // Index of the micro-vertex at (u,v), in 1/kScale units. Valid for any level, as level N is the
+  // prefix of level N+1.
+  static constexpr uint16_t getVertexIndex(uint32_t u, uint32_t v) { return bird_curve_detail::kTables.index[u][v]; }
+
+  static nvmath::vec3f toFloat(const Bary& b)
+  {
+    constexpr float scale = 1.0F / static_cast<float>(kScale);
+    return {b.w * scale, b.u * scale, b.v * scale};
+  }
+};
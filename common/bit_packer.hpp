@@ -19,46 +19,370 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BIT_PACKER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BIT_PACKER_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BIT_PACKER_NEON 1
+#endif
 
 // Set the float value on 11 bit for packing
 inline auto floatToR11 = [](float val) { return static_cast<uint16_t>(val * ((1 << 11) - 1)); };  // Mult by 2047
 
 
+//--------------------------------------------------------------------------------------------------
+// Kernels packing a fixed number of values in full 32-bit words, LSB first.
+// - pack1  : 32 values of 1 bit  -> 1 word
+// - pack2  : 16 values of 2 bits -> 1 word
+// - pack11 : 32 values of 11 bits -> 11 words
+// Values are masked to their width. Each kernel has a scalar reference and, when available,
+// an SSE2, AVX2 or NEON version selected at compile time.
+//
+namespace bitpack {
+
+static constexpr uint32_t kGroupSize1   = 32;  // Values consumed by pack1
+static constexpr uint32_t kGroupSize2   = 16;  // Values consumed by pack2
+static constexpr uint32_t kGroupSize11  = 32;  // Values consumed by pack11
+static constexpr uint32_t kGroupWords11 = 11;  // Words produced by pack11
+
+inline uint32_t pack1Scalar(const uint32_t* in)
+{
+  uint32_t word = 0;
+  for(uint32_t i = 0; i < 32; i++)
+    word |= (in[i] & 1U) << i;
+  return word;
+}
+
+inline uint32_t pack2Scalar(const uint32_t* in)
+{
+  uint32_t word = 0;
+  for(uint32_t i = 0; i < 16; i++)
+    word |= (in[i] & 3U) << (i * 2);
+  return word;
+}
+
+inline void pack11Scalar(const uint32_t* in, uint32_t* out)
+{
+  uint64_t acc  = 0;
+  uint32_t bits = 0;
+  for(uint32_t i = 0; i < 32; i++)
+  {
+    acc |= static_cast<uint64_t>(in[i] & 0x7FFU) << bits;
+    bits += 11;
+    if(bits >= 32)
+    {
+      *out++ = static_cast<uint32_t>(acc);
+      acc >>= 32;
+      bits -= 32;
+    }
+  }
+}
+
+// Interleave the bits of `x` with zeros: abcd -> 0a0b0c0d
+inline uint32_t part1By1(uint32_t x)
+{
+  x &= 0x0000FFFF;
+  x = (x | (x << 8)) & 0x00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  return x;
+}
+
+// Append a 44-bit chunk (4 values of 11 bits) to a little-endian byte stream
+inline void store44(uint8_t* dst, uint32_t bitOffset, uint64_t chunk)
+{
+  // bitOffset is 0 or 4 in a 11-byte (88 bits) group
+  uint64_t cur = 0;
+  std::memcpy(&cur, dst, 6);
+  cur |= chunk << bitOffset;
+  std::memcpy(dst, &cur, 6);
+}
+
+#if defined(BIT_PACKER_AVX2)
+
+inline uint32_t pack1(const uint32_t* in)
+{
+  uint32_t word = 0;
+  for(uint32_t i = 0; i < 4; i++)
+  {
+    __m256i v = _mm256_slli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 8)), 31);
+    word |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(v))) << (i * 8);
+  }
+  return word;
+}
+
+inline uint32_t pack2(const uint32_t* in)
+{
+  const __m256i mask   = _mm256_set1_epi32(3);
+  const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+  const __m256i v0 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in)), mask);
+  const __m256i v1 = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 8)), mask);
+  // Values 0..7 in bits 0..15, values 8..15 in bits 16..31
+  __m256i v = _mm256_or_si256(_mm256_sllv_epi32(v0, shifts), _mm256_slli_epi32(_mm256_sllv_epi32(v1, shifts), 16));
+  // Horizontal OR of the 8 lanes (bits are disjoint)
+  __m128i r = _mm_or_si128(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  r         = _mm_or_si128(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2)));
+  r         = _mm_or_si128(r, _mm_shuffle_epi32(r, _MM_SHUFFLE(2, 3, 0, 1)));
+  return static_cast<uint32_t>(_mm_cvtsi128_si32(r));
+}
+
+inline void pack11(const uint32_t* in, uint32_t* out)
+{
+  const __m256i mask = _mm256_set1_epi32(0x7FF);
+  const __m256i low  = _mm256_set1_epi64x(0xFFFFFFFF);
+  uint8_t       bytes[kGroupWords11 * 4 + 2]{};
+  for(uint32_t g = 0; g < 4; g++)  // 4 groups of 8 values (88 bits)
+  {
+    __m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + g * 8)), mask);
+    // 64-bit lanes: v[2i] | v[2i+1] << 11
+    __m256i pair = _mm256_or_si256(_mm256_and_si256(v, low), _mm256_srli_epi64(v, 21));
+    // Low 64-bit lane of each 128-bit half: pair[0] | pair[1] << 22
+    __m256i quad = _mm256_or_si256(pair, _mm256_slli_epi64(_mm256_srli_si256(pair, 8), 22));
+    uint64_t c0  = static_cast<uint64_t>(_mm256_extract_epi64(quad, 0)) & 0xFFFFFFFFFFFULL;
+    uint64_t c1  = static_cast<uint64_t>(_mm256_extract_epi64(quad, 2)) & 0xFFFFFFFFFFFULL;
+    store44(bytes + g * 11, 0, c0);
+    store44(bytes + g * 11 + 5, 4, c1);
+  }
+  std::memcpy(out, bytes, kGroupWords11 * 4);
+}
+
+#elif defined(BIT_PACKER_SSE2)
+
+inline uint32_t pack1(const uint32_t* in)
+{
+  uint32_t word = 0;
+  for(uint32_t i = 0; i < 8; i++)
+  {
+    __m128i v = _mm_slli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4)), 31);
+    word |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(v))) << (i * 4);
+  }
+  return word;
+}
+
+inline uint32_t pack2(const uint32_t* in)
+{
+  // Gather bit 0 and bit 1 of each value in two 16-bit masks, then interleave them
+  uint32_t m0 = 0;
+  uint32_t m1 = 0;
+  for(uint32_t i = 0; i < 4; i++)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4));
+    m0 |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(v, 31)))) << (i * 4);
+    m1 |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(v, 30)))) << (i * 4);
+  }
+  return part1By1(m0) | (part1By1(m1) << 1);
+}
+
+inline void pack11(const uint32_t* in, uint32_t* out)
+{
+  const __m128i mask = _mm_set1_epi32(0x7FF);
+  const __m128i low  = _mm_set_epi32(0, -1, 0, -1);
+  uint8_t       bytes[kGroupWords11 * 4 + 2]{};
+  for(uint32_t g = 0; g < 8; g++)  // 8 groups of 4 values (44 bits)
+  {
+    __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + g * 4)), mask);
+    // 64-bit lanes: v[2i] | v[2i+1] << 11
+    __m128i pair = _mm_or_si128(_mm_and_si128(v, low), _mm_srli_epi64(v, 21));
+    // Low 64-bit lane: pair[0] | pair[1] << 22
+    __m128i  quad = _mm_or_si128(pair, _mm_slli_epi64(_mm_srli_si128(pair, 8), 22));
+    uint64_t c    = 0;
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(&c), quad);
+    store44(bytes + (g / 2) * 11 + (g & 1) * 5, (g & 1) * 4, c & 0xFFFFFFFFFFFULL);
+  }
+  std::memcpy(out, bytes, kGroupWords11 * 4);
+}
+
+#elif defined(BIT_PACKER_NEON)
+
+inline uint32_t pack1(const uint32_t* in)
+{
+  const int32_t    shifts_data[4] = {0, 1, 2, 3};
+  const int32x4_t  shifts         = vld1q_s32(shifts_data);
+  const uint32x4_t one            = vdupq_n_u32(1);
+  uint32_t         word           = 0;
+  for(uint32_t i = 0; i < 8; i++)
+  {
+    uint32x4_t v = vshlq_u32(vandq_u32(vld1q_u32(in + i * 4), one), shifts);
+    word |= vaddvq_u32(v) << (i * 4);
+  }
+  return word;
+}
+
+inline uint32_t pack2(const uint32_t* in)
+{
+  const int32_t    shifts_data[4] = {0, 2, 4, 6};
+  const int32x4_t  shifts         = vld1q_s32(shifts_data);
+  const uint32x4_t mask           = vdupq_n_u32(3);
+  uint32_t         word           = 0;
+  for(uint32_t i = 0; i < 4; i++)
+  {
+    uint32x4_t v = vshlq_u32(vandq_u32(vld1q_u32(in + i * 4), mask), shifts);
+    word |= vaddvq_u32(v) << (i * 8);
+  }
+  return word;
+}
+
+inline void pack11(const uint32_t* in, uint32_t* out)
+{
+  const int64_t    lo_shift_data[2] = {0, 11};
+  const int64_t    hi_shift_data[2] = {22, 33};
+  const int64x2_t  lo_shift         = vld1q_s64(lo_shift_data);
+  const int64x2_t  hi_shift         = vld1q_s64(hi_shift_data);
+  const uint32x4_t mask             = vdupq_n_u32(0x7FF);
+  uint8_t          bytes[kGroupWords11 * 4 + 2]{};
+  for(uint32_t g = 0; g < 8; g++)  // 8 groups of 4 values (44 bits)
+  {
+    uint32x4_t v  = vandq_u32(vld1q_u32(in + g * 4), mask);
+    uint64x2_t lo = vshlq_u64(vmovl_u32(vget_low_u32(v)), lo_shift);
+    uint64x2_t hi = vshlq_u64(vmovl_u32(vget_high_u32(v)), hi_shift);
+    uint64_t   c  = vaddvq_u64(vorrq_u64(lo, hi));
+    store44(bytes + (g / 2) * 11 + (g & 1) * 5, (g & 1) * 4, c);
+  }
+  std::memcpy(out, bytes, kGroupWords11 * 4);
+}
+
+#else
+
+inline uint32_t pack1(const uint32_t* in)
+{
+  return pack1Scalar(in);
+}
+inline uint32_t pack2(const uint32_t* in)
+{
+  return pack2Scalar(in);
+}
+inline void pack11(const uint32_t* in, uint32_t* out)
+{
+  pack11Scalar(in, out);
+}
+
+#endif
+
+}  // namespace bitpack
+
+
 //--------------------------------------------------------------------------------------------------
 // The BitPacker will store a value on n-bits, each push will append the next value.
 // This is particular useful with the 11 bit packing
+//
+// Values are shifted into a 64-bit accumulator and only full 32-bit words are written to memory.
+// The remaining bits are written by flush(), which is also called by the destructor. Only the bytes
+// covered by the pushed bits are modified; the bits following the last value are preserved.
+// flush() keeps the pending bits in the accumulator, so pushing after it continues at the next bit
+// and the following word rewrites them.
 class BitPacker
 {
 public:
   explicit BitPacker(void* data)
-      : m_data(static_cast<uint32_t*>(data))
+      : m_data(static_cast<uint8_t*>(data))
   {
   }
+  ~BitPacker() { flush(); }
+
+  BitPacker(const BitPacker&)            = delete;
+  BitPacker& operator=(const BitPacker&) = delete;
 
-  void setData(void* data) { m_data = static_cast<uint32_t*>(data); }
+  // Flush the pending bits and restart packing at the beginning of `data`
+  void setData(void* data)
+  {
+    flush();
+    m_data    = static_cast<uint8_t*>(data);
+    m_curBit  = 0;
+    m_acc     = 0;
+    m_accBits = 0;
+  }
 
+  // Append the `bits` lower bits of `value` (bits <= 32)
   void push(uint32_t value, uint32_t bits)
   {
-    for(uint32_t b = 0; b < bits; b++)
+    if(bits < 32)
+      value &= (1U << bits) - 1U;
+    m_acc |= static_cast<uint64_t>(value) << m_accBits;
+    m_accBits += bits;
+    if(m_accBits >= 32)
+      storeWord();
+  }
+
+  // Append `count` values of `bits` each. Widths of 1, 2 and 11 bits use the SIMD kernels.
+  void pushSpan(const uint32_t* values, size_t count, uint32_t bits)
+  {
+    size_t i = 0;
+    switch(bits)
+    {
+      case 1:
+        for(; i + bitpack::kGroupSize1 <= count; i += bitpack::kGroupSize1)
+          pushWord(bitpack::pack1(values + i));
+        break;
+      case 2:
+        for(; i + bitpack::kGroupSize2 <= count; i += bitpack::kGroupSize2)
+          pushWord(bitpack::pack2(values + i));
+        break;
+      case 11:
+        for(; i + bitpack::kGroupSize11 <= count; i += bitpack::kGroupSize11)
+        {
+          uint32_t words[bitpack::kGroupWords11];
+          bitpack::pack11(values + i, words);
+          for(uint32_t w : words)
+            pushWord(w);
+        }
+        break;
+      default:
+        break;
+    }
+    for(; i < count; i++)
+      push(values[i], bits);
+  }
+
+  // Write the pending bits, modifying only the bytes they cover. They stay pending: m_curBit remains
+  // on a word boundary and the next full word is stored over them.
+  void flush() const
+  {
+    if(m_accBits == 0)
+      return;
+    uint32_t num_bytes = (m_accBits + 7) / 8;
+    uint8_t* dst       = m_data + m_curBit / 8;
+    for(uint32_t b = 0; b < num_bytes; b++)
     {
-      uint32_t& word = m_data[m_curBit / (8 * sizeof(uint32_t))];
-      uint32_t  mask = 1 << (m_curBit % 32);
-      if((value & (1 << b)) != 0U)
-      {
-        word |= mask;
-      }
-      else
-      {
-        word &= ~mask;
-      }
-      m_curBit++;
+      uint32_t bits_in_byte = m_accBits - b * 8 < 8 ? m_accBits - b * 8 : 8;
+      uint8_t  mask         = static_cast<uint8_t>((1U << bits_in_byte) - 1U);
+      uint8_t  value        = static_cast<uint8_t>(m_acc >> (b * 8));
+      dst[b]                = static_cast<uint8_t>((dst[b] & ~mask) | (value & mask));
     }
   }
 
+  // Number of bits pushed so far
+  uint32_t bitCount() const { return m_curBit + m_accBits; }
+
 private:
-  uint32_t* m_data;
-  uint32_t  m_curBit{0};
+  void pushWord(uint32_t word)
+  {
+    m_acc |= static_cast<uint64_t>(word) << m_accBits;
+    m_accBits += 32;
+    storeWord();
+  }
+
+  void storeWord()
+  {
+    uint32_t word = static_cast<uint32_t>(m_acc);
+    std::memcpy(m_data + m_curBit / 8, &word, sizeof(uint32_t));
+    m_curBit += 32;
+    m_acc >>= 32;
+    m_accBits -= 32;
+  }
+
+  uint8_t* m_data;
+  uint32_t m_curBit{0};   // Bits already written to m_data, always a multiple of 32
+  uint64_t m_acc{0};      // Pending bits, LSB first
+  uint32_t m_accBits{0};  // Number of pending bits, always < 32 between calls
 };
 
 //--------------------------------------------------------------------------------------------------
@@ -71,4 +395,39 @@ public:
       : BitPacker(data){};
   void push(uint32_t value) { BitPacker::push(value, 11); };
   void push(float value) { BitPacker::push(floatToR11(value), 11); };
+  void pushSpan(const uint32_t* values, size_t count) { BitPacker::pushSpan(values, count, 11); }
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// Reads back values written by the BitPacker, used to validate the packing
+//
+class BitUnpacker
+{
+public:
+  explicit BitUnpacker(const void* data)
+      : m_data(static_cast<const uint8_t*>(data))
+  {
+  }
+
+  // Return the next value stored on `bits` (bits <= 32)
+  uint32_t pull(uint32_t bits)
+  {
+    uint64_t window = 0;
+    uint32_t shift  = m_curBit % 8;
+    std::memcpy(&window, m_data + m_curBit / 8, (shift + bits + 7) / 8);
+    m_curBit += bits;
+    window >>= shift;
+    return bits < 32 ? static_cast<uint32_t>(window & ((1ULL << bits) - 1ULL)) : static_cast<uint32_t>(window);
+  }
+
+  void pullSpan(uint32_t* values, size_t count, uint32_t bits)
+  {
+    for(size_t i = 0; i < count; i++)
+      values[i] = pull(bits);
+  }
+
+private:
+  const uint8_t* m_data;
+  uint32_t       m_curBit{0};
 };
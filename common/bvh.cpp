@@ -0,0 +1,836 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+
+#include "bvh.hpp"
+#include "nvh/parallel_work.hpp"
+
+
+namespace bvh {
+
+namespace {
+
+constexpr float    kTraversalCost = 1.0F;
+constexpr float    kIntersectCost = 1.0F;
+constexpr uint32_t kMaxBins       = 64;
+constexpr uint32_t kMedianDepth   = 64;         // Deeper nodes are split at the median of their primitives
+constexpr uint32_t kStackSize     = 128;        // kMedianDepth plus the 32 levels of median splits at most
+constexpr uint32_t kChunkSize     = 64 * 1024;  // Primitives per task, when all threads work on one node
+
+double msSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+nvmath::vec3f minOf(const nvmath::vec3f& a, const nvmath::vec3f& b)
+{
+  return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+
+nvmath::vec3f maxOf(const nvmath::vec3f& a, const nvmath::vec3f& b)
+{
+  return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+
+uint32_t numChunks(uint32_t count)
+{
+  return (count + kChunkSize - 1) / kChunkSize;
+}
+
+// Entry distance of the ray in the box, false if it misses it in [tMin, tMax]
+inline bool hitBox(const Node& node, const nvmath::vec3f& origin, const nvmath::vec3f& invDir, float tMin, float tMax, float& tEntry)
+{
+  const float tx0    = (node.bmin.x - origin.x) * invDir.x;
+  const float tx1    = (node.bmax.x - origin.x) * invDir.x;
+  const float ty0    = (node.bmin.y - origin.y) * invDir.y;
+  const float ty1    = (node.bmax.y - origin.y) * invDir.y;
+  const float tz0    = (node.bmin.z - origin.z) * invDir.z;
+  const float tz1    = (node.bmax.z - origin.z) * invDir.z;
+  const float t_near = std::max({std::min(tx0, tx1), std::min(ty0, ty1), std::min(tz0, tz1), tMin});
+  const float t_far  = std::min({std::max(tx0, tx1), std::max(ty0, ty1), std::max(tz0, tz1), tMax});
+  tEntry             = t_near;
+  return t_near <= t_far;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Visits the leaves hit by the ray, the nearest children first. leaf(first, count, tMax) tests the
+// primitives of a leaf and lowers tMax on a hit, returning true; nodes beyond tMax are skipped.
+//
+template <typename LeafFunc>
+bool traverse(const std::vector<Node>& nodes, const Ray& ray, float& tMax, LeafFunc&& leaf)
+{
+  if(nodes.empty())
+    return false;
+
+  const nvmath::vec3f inv_dir(1.0F / ray.dir.x, 1.0F / ray.dir.y, 1.0F / ray.dir.z);
+  float               t_entry = 0.0F;
+  if(!hitBox(nodes[0], ray.origin, inv_dir, ray.tMin, tMax, t_entry))
+    return false;
+
+  struct Entry
+  {
+    uint32_t node;
+    float    t;
+  };
+  std::array<Entry, kStackSize> stack;
+  uint32_t                      stack_size = 0;
+  uint32_t                      current    = 0;
+  bool                          hit        = false;
+  for(;;)
+  {
+    const Node& node = nodes[current];
+    if(node.count > 0)
+    {
+      hit |= leaf(node.first, node.count, tMax);
+    }
+    else
+    {
+      float      t_left    = 0.0F;
+      float      t_right   = 0.0F;
+      const bool hit_left  = hitBox(nodes[node.first], ray.origin, inv_dir, ray.tMin, tMax, t_left);
+      const bool hit_right = hitBox(nodes[node.first + 1], ray.origin, inv_dir, ray.tMin, tMax, t_right);
+      if(hit_left && hit_right)
+      {
+        const bool left_first = t_left <= t_right;
+        stack[stack_size++]   = left_first ? Entry{node.first + 1, t_right} : Entry{node.first, t_left};
+        current               = left_first ? node.first : node.first + 1;
+        continue;
+      }
+      if(hit_left || hit_right)
+      {
+        current = hit_left ? node.first : node.first + 1;
+        continue;
+      }
+    }
+
+    // Next node on the stack still in front of the closest hit
+    do
+    {
+      if(stack_size == 0)
+        return hit;
+      stack_size--;
+    } while(stack[stack_size].t > tMax);
+    current = stack[stack_size].node;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Top-down SAH builder over the bounding boxes of the primitives.
+// Nodes of more than subtreeSize primitives are split one at a time, the threads sharing the work
+// on their primitives. The smaller ones are built each by a thread, in a tree of its own, then
+// copied after the top nodes.
+//
+class Builder
+{
+public:
+  Builder(const std::vector<Aabb>& boxes, const BuildOptions& options)
+      : m_boxes(boxes)
+      , m_numThreads(options.numThreads != 0 ? options.numThreads : std::thread::hardware_concurrency())
+      , m_numBins(std::clamp(options.numBins, 2U, kMaxBins))
+      , m_maxLeafSize(std::max(options.maxLeafSize, 1U))
+  {
+  }
+
+  void build(std::vector<Node>& nodes, std::vector<uint32_t>& order, BuildStats& stats)
+  {
+    const auto num_prims = static_cast<uint32_t>(m_boxes.size());
+    stats                = {};
+    stats.primitives     = num_prims;
+    nodes.clear();
+    order.clear();
+    if(num_prims == 0)
+      return;
+
+    m_refs.resize(num_prims);
+    m_temp.resize(num_prims);
+    nvh::parallel_batches<4096>(
+        num_prims,
+        [&](uint64_t i) {
+          m_refs[i] = {m_boxes[i].bmin, static_cast<uint32_t>(i), m_boxes[i].bmax};
+        },
+        m_numThreads);
+
+    // Top of the tree, splitting a node with all threads
+    const uint32_t    subtree_size = m_numThreads > 1 ? std::max(num_prims / (m_numThreads * 8), 4096U) : num_prims;
+    std::vector<Task> stack{{0, 0, num_prims, 0}};
+    std::vector<Task> subtrees;
+    Bins              bins;
+    nodes.resize(1);
+    while(!stack.empty())
+    {
+      const Task task = stack.back();
+      stack.pop_back();
+      if(task.end - task.begin <= subtree_size)
+      {
+        subtrees.push_back(task);
+        continue;
+      }
+      nodes[task.node] = splitNode(task, stack, static_cast<uint32_t>(nodes.size()), true, bins);
+      if(nodes[task.node].count == 0)
+        nodes.resize(nodes.size() + 2);
+      stats.maxDepth = std::max(stats.maxDepth, task.depth);
+    }
+
+    // Subtrees, one per thread
+    std::vector<std::vector<Node>> subtree_nodes(subtrees.size());
+    std::vector<uint32_t>          subtree_depth(subtrees.size(), 0);
+    nvh::parallel_batches<1>(
+        subtrees.size(), [&](uint64_t i) { buildSubtree(subtrees[i], subtree_nodes[i], subtree_depth[i]); }, m_numThreads);
+
+    // The root of a subtree goes in the node reserved by its parent, the others after the top nodes
+    std::vector<uint32_t> offsets(subtrees.size());
+    auto                  num_nodes = static_cast<uint32_t>(nodes.size());
+    for(size_t i = 0; i < subtrees.size(); i++)
+    {
+      offsets[i] = num_nodes - 1;
+      num_nodes += static_cast<uint32_t>(subtree_nodes[i].size()) - 1;
+      stats.maxDepth = std::max(stats.maxDepth, subtree_depth[i]);
+    }
+    nodes.resize(num_nodes);
+    nvh::parallel_batches<1>(
+        subtrees.size(),
+        [&](uint64_t i) {
+          const std::vector<Node>& src = subtree_nodes[i];
+          for(size_t j = 0; j < src.size(); j++)
+          {
+            Node node = src[j];
+            if(node.count == 0)
+              node.first += offsets[i];
+            nodes[j == 0 ? subtrees[i].node : offsets[i] + j] = node;
+          }
+        },
+        m_numThreads);
+
+    // Cost of the tree: probability of visiting each node, from its area relative to the root
+    const float root_area = std::max(area(nodes[0]), FLT_MIN);
+    double      sah_cost  = 0.0;
+    for(const Node& node : nodes)
+    {
+      const double p = area(node) / root_area;
+      sah_cost += node.count == 0 ? p * kTraversalCost : p * node.count * kIntersectCost;
+      stats.leaves += node.count > 0 ? 1 : 0;
+    }
+    stats.nodes   = num_nodes;
+    stats.sahCost = sah_cost;
+
+    order.resize(num_prims);
+    nvh::parallel_batches<4096>(
+        num_prims, [&](uint64_t i) { order[i] = m_refs[i].prim; }, m_numThreads);
+  }
+
+private:
+  // Primitive being sorted in the nodes, with its box: the first levels move all of them
+  struct PrimRef
+  {
+    nvmath::vec3f bmin;
+    uint32_t      prim{0};
+    nvmath::vec3f bmax;
+
+    nvmath::vec3f center() const { return (bmin + bmax) * 0.5F; }
+  };
+
+  static void extend(Aabb& box, const PrimRef& ref)
+  {
+    box.bmin = minOf(box.bmin, ref.bmin);
+    box.bmax = maxOf(box.bmax, ref.bmax);
+  }
+
+  // The primitives [begin, end) of m_refs, for the node
+  struct Task
+  {
+    uint32_t node{0};
+    uint32_t begin{0};
+    uint32_t end{0};
+    uint32_t depth{0};
+  };
+
+  struct Bin
+  {
+    Aabb     box;
+    uint32_t count{0};
+  };
+  // numBins per axis, the axes one after the other
+  using Bins = std::vector<Bin>;
+
+  // Bin of a center, the same for the binning and the partition
+  struct BinMapping
+  {
+    nvmath::vec3f origin;
+    nvmath::vec3f scale;  // 0 on the axes where all centers are equal
+    uint32_t      numBins{0};
+
+    BinMapping(const Aabb& centers, uint32_t bins)
+        : origin(centers.bmin)
+        , numBins(bins)
+    {
+      for(int a = 0; a < 3; a++)
+      {
+        const float extent = centers.bmax[a] - centers.bmin[a];
+        scale[a]           = extent > 0.0F ? static_cast<float>(bins) / extent : 0.0F;
+      }
+    }
+    uint32_t bin(const nvmath::vec3f& center, int axis) const
+    {
+      const auto b = static_cast<uint32_t>((center[axis] - origin[axis]) * scale[axis]);
+      return std::min(b, numBins - 1);
+    }
+  };
+
+  struct Split
+  {
+    int      axis{-1};
+    uint32_t bin{0};  // Centers in lower bins go left
+    float    cost{FLT_MAX};
+  };
+
+  static float area(const Node& node)
+  {
+    const nvmath::vec3f d = node.bmax - node.bmin;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+
+  void bounds(uint32_t begin, uint32_t end, Aabb& box, Aabb& centers) const
+  {
+    for(uint32_t i = begin; i < end; i++)
+    {
+      extend(box, m_refs[i]);
+      centers.extend(m_refs[i].center());
+    }
+  }
+
+  void binCenters(uint32_t begin, uint32_t end, const BinMapping& mapping, Bins& bins) const
+  {
+    for(uint32_t i = begin; i < end; i++)
+    {
+      const PrimRef&      ref    = m_refs[i];
+      const nvmath::vec3f center = ref.center();
+      for(int a = 0; a < 3; a++)
+      {
+        Bin& bin = bins[a * mapping.numBins + mapping.bin(center, a)];
+        extend(bin.box, ref);
+        bin.count++;
+      }
+    }
+  }
+
+  // Lowest SAH cost among the boundaries of the bins, on the three axes
+  Split findSplit(const Bins& bins, const BinMapping& mapping, float nodeArea) const
+  {
+    const float inv_area = nodeArea > 0.0F ? 1.0F / nodeArea : 0.0F;
+    Split       best;
+    for(int a = 0; a < 3; a++)
+    {
+      if(mapping.scale[a] == 0.0F)
+        continue;
+
+      // Area and count on the left of each boundary, then sweep from the right
+      const Bin*                     axis_bins = &bins[a * mapping.numBins];
+      std::array<float, kMaxBins>    left_area;
+      std::array<uint32_t, kMaxBins> left_count;
+      Aabb                           box;
+      uint32_t                       count = 0;
+      for(uint32_t b = 0; b < mapping.numBins - 1; b++)
+      {
+        box.extend(axis_bins[b].box);
+        count += axis_bins[b].count;
+        left_area[b]  = box.area();
+        left_count[b] = count;
+      }
+      box   = {};
+      count = 0;
+      for(uint32_t b = mapping.numBins - 1; b > 0; b--)
+      {
+        box.extend(axis_bins[b].box);
+        count += axis_bins[b].count;
+        if(count == 0 || left_count[b - 1] == 0)
+          continue;
+        const float cost =
+            kTraversalCost + kIntersectCost * (left_area[b - 1] * left_count[b - 1] + box.area() * count) * inv_area;
+        if(cost < best.cost)
+          best = {a, b, cost};
+      }
+    }
+    return best;
+  }
+
+  // Splits at the median along the largest extent of the centers, for the nodes without a better split
+  uint32_t medianSplit(uint32_t begin, uint32_t end, const Aabb& centers)
+  {
+    const nvmath::vec3f d    = centers.bmax - centers.bmin;
+    const int           axis = d.x >= d.y && d.x >= d.z ? 0 : (d.y >= d.z ? 1 : 2);
+    const uint32_t      mid  = begin + (end - begin) / 2;
+    std::nth_element(m_refs.begin() + begin, m_refs.begin() + mid, m_refs.begin() + end,
+                     [&](const PrimRef& a, const PrimRef& b) { return a.bmin[axis] + a.bmax[axis] < b.bmin[axis] + b.bmax[axis]; });
+    return mid;
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Returns the node of the task, a leaf or an inner node whose children are firstChild and the one
+  // after, with their tasks pushed on `stack`. `bins` is scratch memory, kept between the calls.
+  //
+  Node splitNode(const Task& task, std::vector<Task>& stack, uint32_t firstChild, bool parallel, Bins& bins)
+  {
+    const uint32_t count = task.end - task.begin;
+    Aabb           box;
+    Aabb           centers;
+    if(parallel)
+    {
+      std::vector<Aabb> chunk_boxes(numChunks(count));
+      std::vector<Aabb> chunk_centers(chunk_boxes.size());
+      nvh::parallel_batches<1>(
+          chunk_boxes.size(),
+          [&](uint64_t c) {
+            const uint32_t begin = task.begin + static_cast<uint32_t>(c) * kChunkSize;
+            bounds(begin, std::min(begin + kChunkSize, task.end), chunk_boxes[c], chunk_centers[c]);
+          },
+          m_numThreads);
+      for(size_t c = 0; c < chunk_boxes.size(); c++)
+      {
+        box.extend(chunk_boxes[c]);
+        centers.extend(chunk_centers[c]);
+      }
+    }
+    else
+    {
+      bounds(task.begin, task.end, box, centers);
+    }
+
+    Node node;
+    node.bmin  = box.bmin;
+    node.bmax  = box.bmax;
+    node.first = task.begin;
+    node.count = count;
+    if(count <= 1)
+      return node;
+
+    uint32_t mid = task.end;
+    if(task.depth >= kMedianDepth)
+    {
+      if(count > m_maxLeafSize)
+        mid = medianSplit(task.begin, task.end, centers);
+    }
+    else
+    {
+      // Fewer bins than primitives would leave most of them empty
+      const BinMapping mapping(centers, std::min(m_numBins, std::max(count, 4U)));
+      bins.assign(3 * mapping.numBins, Bin{});
+      if(parallel)
+      {
+        std::vector<Bins> chunk_bins(numChunks(count), bins);
+        nvh::parallel_batches<1>(
+            chunk_bins.size(),
+            [&](uint64_t c) {
+              const uint32_t begin = task.begin + static_cast<uint32_t>(c) * kChunkSize;
+              binCenters(begin, std::min(begin + kChunkSize, task.end), mapping, chunk_bins[c]);
+            },
+            m_numThreads);
+        for(const Bins& chunk : chunk_bins)
+        {
+          for(size_t b = 0; b < bins.size(); b++)
+          {
+            bins[b].box.extend(chunk[b].box);
+            bins[b].count += chunk[b].count;
+          }
+        }
+      }
+      else
+      {
+        binCenters(task.begin, task.end, mapping, bins);
+      }
+
+      const Split split = findSplit(bins, mapping, box.area());
+      if(split.axis < 0)
+      {
+        // All centers at the same place: any half is as good
+        if(count > m_maxLeafSize)
+          mid = task.begin + count / 2;
+      }
+      else if(split.cost < static_cast<float>(count) * kIntersectCost || count > m_maxLeafSize)
+      {
+        auto goes_left = [&](const PrimRef& ref) { return mapping.bin(ref.center(), split.axis) < split.bin; };
+        mid = parallel ? partitionParallel(task.begin, task.end, goes_left) :
+                         static_cast<uint32_t>(std::partition(m_refs.begin() + task.begin, m_refs.begin() + task.end, goes_left)
+                                               - m_refs.begin());
+      }
+    }
+
+    if(mid == task.end)
+      return node;  // Leaf
+
+    node.first = firstChild;
+    node.count = 0;
+    stack.push_back({firstChild, task.begin, mid, task.depth + 1});
+    stack.push_back({firstChild + 1, mid, task.end, task.depth + 1});
+    return node;
+  }
+
+  // Stable partition by chunks: each chunk counts its primitives going left, then writes them at
+  // their place in m_temp, copied back to m_refs
+  template <typename Pred>
+  uint32_t partitionParallel(uint32_t begin, uint32_t end, Pred&& goesLeft)
+  {
+    const uint32_t        num_chunks = numChunks(end - begin);
+    std::vector<uint32_t> lefts(num_chunks, 0);
+    nvh::parallel_batches<1>(
+        num_chunks,
+        [&](uint64_t c) {
+          const uint32_t chunk_begin = begin + static_cast<uint32_t>(c) * kChunkSize;
+          const uint32_t chunk_end   = std::min(chunk_begin + kChunkSize, end);
+          for(uint32_t i = chunk_begin; i < chunk_end; i++)
+            lefts[c] += goesLeft(m_refs[i]) ? 1 : 0;
+        },
+        m_numThreads);
+
+    std::vector<uint32_t> left_offset(num_chunks);
+    std::vector<uint32_t> right_offset(num_chunks);
+    uint32_t              num_left = 0;
+    for(uint32_t c = 0; c < num_chunks; c++)
+    {
+      left_offset[c] = begin + num_left;
+      num_left += lefts[c];
+    }
+    uint32_t num_right = 0;
+    for(uint32_t c = 0; c < num_chunks; c++)
+    {
+      right_offset[c] = begin + num_left + num_right;
+      num_right += std::min(kChunkSize, end - begin - c * kChunkSize) - lefts[c];
+    }
+
+    nvh::parallel_batches<1>(
+        num_chunks,
+        [&](uint64_t c) {
+          const uint32_t chunk_begin = begin + static_cast<uint32_t>(c) * kChunkSize;
+          const uint32_t chunk_end   = std::min(chunk_begin + kChunkSize, end);
+          uint32_t       left        = left_offset[c];
+          uint32_t       right       = right_offset[c];
+          for(uint32_t i = chunk_begin; i < chunk_end; i++)
+          {
+            m_temp[goesLeft(m_refs[i]) ? left++ : right++] = m_refs[i];
+          }
+        },
+        m_numThreads);
+    nvh::parallel_batches<1>(
+        num_chunks,
+        [&](uint64_t c) {
+          const uint32_t chunk_begin = begin + static_cast<uint32_t>(c) * kChunkSize;
+          const uint32_t chunk_end   = std::min(chunk_begin + kChunkSize, end);
+          std::copy(m_temp.begin() + chunk_begin, m_temp.begin() + chunk_end, m_refs.begin() + chunk_begin);
+        },
+        m_numThreads);
+    return begin + num_left;
+  }
+
+  // Nodes of the subtree of the task, its root first, the children relative to it
+  void buildSubtree(const Task& root, std::vector<Node>& nodes, uint32_t& maxDepth)
+  {
+    std::vector<Task> stack{{0, root.begin, root.end, root.depth}};
+    Bins              bins;
+    nodes.resize(1);
+    while(!stack.empty())
+    {
+      const Task task = stack.back();
+      stack.pop_back();
+      nodes[task.node] = splitNode(task, stack, static_cast<uint32_t>(nodes.size()), false, bins);
+      if(nodes[task.node].count == 0)
+        nodes.resize(nodes.size() + 2);
+      maxDepth = std::max(maxDepth, task.depth);
+    }
+  }
+
+  const std::vector<Aabb>& m_boxes;
+  std::vector<PrimRef>     m_refs;  // Grouped by node
+  std::vector<PrimRef>     m_temp;  // For the parallel partition
+  uint32_t                 m_numThreads{1};
+  uint32_t                 m_numBins{16};
+  uint32_t                 m_maxLeafSize{8};
+};
+
+}  // namespace
+
+
+//--------------------------------------------------------------------------------------------------
+//
+//
+void Aabb::extend(const nvmath::vec3f& p)
+{
+  bmin = minOf(bmin, p);
+  bmax = maxOf(bmax, p);
+}
+
+void Aabb::extend(const Aabb& box)
+{
+  bmin = minOf(bmin, box.bmin);
+  bmax = maxOf(bmax, box.bmax);
+}
+
+float Aabb::area() const
+{
+  if(!valid())
+    return 0.0F;
+  const nvmath::vec3f d = bmax - bmin;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Counts and times are summed, the SAH cost is averaged by primitives
+void BuildStats::add(const BuildStats& other)
+{
+  const uint32_t total = primitives + other.primitives;
+  if(total > 0)
+    sahCost = (sahCost * primitives + other.sahCost * other.primitives) / total;
+  buildMs += other.buildMs;
+  primitives = total;
+  nodes += other.nodes;
+  leaves += other.leaves;
+  maxDepth = std::max(maxDepth, other.maxDepth);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Mesh
+//
+void MeshBvh::build(const nvh::PrimitiveMesh& mesh, const BuildOptions& options, BuildStats* stats)
+{
+  const auto     t0          = std::chrono::steady_clock::now();
+  const auto     num_tri     = static_cast<uint32_t>(mesh.triangles.size());
+  const uint32_t num_threads = options.numThreads != 0 ? options.numThreads : std::thread::hardware_concurrency();
+
+  std::vector<Aabb> boxes(num_tri);
+  nvh::parallel_batches<4096>(
+      num_tri,
+      [&](uint64_t i) {
+        for(int k = 0; k < 3; k++)
+          boxes[i].extend(mesh.vertices[mesh.triangles[i].v[k]].p);
+      },
+      num_threads);
+
+  BuildStats            build_stats;
+  std::vector<uint32_t> order;
+  Builder(boxes, options).build(m_nodes, order, build_stats);
+
+  // The triangles in the order of the leaves
+  m_triangles.resize(num_tri);
+  nvh::parallel_batches<4096>(
+      num_tri,
+      [&](uint64_t i) {
+        const nvh::PrimitiveTriangle& tri = mesh.triangles[order[i]];
+        const nvmath::vec3f&          v0  = mesh.vertices[tri.v[0]].p;
+        m_triangles[i]                    = {v0, mesh.vertices[tri.v[1]].p - v0, mesh.vertices[tri.v[2]].p - v0};
+      },
+      num_threads);
+  m_triangleIndex = std::move(order);
+
+  m_bounds = {};
+  if(!m_nodes.empty())
+  {
+    m_bounds.bmin = m_nodes[0].bmin;
+    m_bounds.bmax = m_nodes[0].bmax;
+  }
+
+  build_stats.buildMs = msSince(t0);
+  if(stats)
+    *stats = build_stats;
+}
+
+bool MeshBvh::hitTriangle(const Triangle& tri, const Ray& ray, float tMax, float& t, nvmath::vec2f& bary)
+{
+  const nvmath::vec3f p   = nvmath::cross(ray.dir, tri.e2);
+  const float         det = nvmath::dot(tri.e1, p);
+  if(det == 0.0F)
+    return false;
+  const float         inv_det = 1.0F / det;
+  const nvmath::vec3f s       = ray.origin - tri.v0;
+  const float         u       = nvmath::dot(s, p) * inv_det;
+  if(u < 0.0F || u > 1.0F)
+    return false;
+  const nvmath::vec3f q = nvmath::cross(s, tri.e1);
+  const float         v = nvmath::dot(ray.dir, q) * inv_det;
+  if(v < 0.0F || u + v > 1.0F)
+    return false;
+  t = nvmath::dot(tri.e2, q) * inv_det;
+  if(t < ray.tMin || t >= tMax)
+    return false;
+  bary = {u, v};
+  return true;
+}
+
+bool MeshBvh::intersect(const Ray& ray, Hit& hit) const
+{
+  float         t_max = ray.tMax;
+  uint32_t      best  = Hit::kInvalid;
+  nvmath::vec2f bary;
+  traverse(m_nodes, ray, t_max, [&](uint32_t first, uint32_t count, float& tMax) {
+    bool found = false;
+    for(uint32_t i = first; i < first + count; i++)
+    {
+      float         t = 0.0F;
+      nvmath::vec2f uv;
+      if(!hitTriangle(m_triangles[i], ray, tMax, t, uv))
+        continue;
+      tMax  = t;
+      best  = i;
+      bary  = uv;
+      found = true;
+    }
+    return found;
+  });
+
+  if(best == Hit::kInvalid)
+    return false;
+  hit.t        = t_max;
+  hit.triangle = m_triangleIndex[best];
+  hit.bary     = bary;
+  return true;
+}
+
+// A tMax below any distance of the stack ends the traversal
+bool MeshBvh::occluded(const Ray& ray) const
+{
+  float t_max = ray.tMax;
+  return traverse(m_nodes, ray, t_max, [&](uint32_t first, uint32_t count, float& tMax) {
+    for(uint32_t i = first; i < first + count; i++)
+    {
+      float         t = 0.0F;
+      nvmath::vec2f uv;
+      if(hitTriangle(m_triangles[i], ray, tMax, t, uv))
+      {
+        tMax = -FLT_MAX;
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+size_t MeshBvh::memoryBytes() const
+{
+  return m_nodes.size() * sizeof(Node) + m_triangles.size() * sizeof(Triangle) + m_triangleIndex.size() * sizeof(uint32_t);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Scene
+//
+void SceneBvh::build(const std::vector<nvh::PrimitiveMesh>& meshes,
+                     const std::vector<nvh::Node>&          nodes,
+                     const BuildOptions&                    options,
+                     BuildStats*                            meshStats,
+                     BuildStats*                            sceneStats)
+{
+  // The meshes one after the other, each with all threads
+  BuildStats mesh_stats;
+  m_meshes.assign(meshes.size(), {});
+  for(size_t i = 0; i < meshes.size(); i++)
+  {
+    BuildStats stats;
+    m_meshes[i].build(meshes[i], options, &stats);
+    mesh_stats.add(stats);
+  }
+
+  // Instances: world bounds of their mesh, from its 8 corners
+  const auto        t0 = std::chrono::steady_clock::now();
+  std::vector<Aabb> boxes;
+  m_instances.clear();
+  for(size_t i = 0; i < nodes.size(); i++)
+  {
+    const nvh::Node& node = nodes[i];
+    if(node.mesh < 0 || static_cast<size_t>(node.mesh) >= m_meshes.size() || !m_meshes[node.mesh].bounds().valid())
+      continue;
+
+    const nvmath::mat4f world  = node.localMatrix();
+    const Aabb&         bounds = m_meshes[node.mesh].bounds();
+    Aabb                box;
+    for(int c = 0; c < 8; c++)
+    {
+      const nvmath::vec3f corner((c & 1) != 0 ? bounds.bmax.x : bounds.bmin.x, (c & 2) != 0 ? bounds.bmax.y : bounds.bmin.y,
+                                 (c & 4) != 0 ? bounds.bmax.z : bounds.bmin.z);
+      box.extend(nvmath::vec3f(world * nvmath::vec4f(corner, 1.0F)));
+    }
+    boxes.push_back(box);
+    m_instances.push_back({nvmath::invert(world), static_cast<uint32_t>(node.mesh), static_cast<uint32_t>(i)});
+  }
+
+  BuildStats scene_stats;
+  Builder(boxes, options).build(m_nodes, m_instanceIndex, scene_stats);
+  scene_stats.buildMs = msSince(t0);
+
+  if(meshStats)
+    *meshStats = mesh_stats;
+  if(sceneStats)
+    *sceneStats = scene_stats;
+}
+
+Ray SceneBvh::toLocal(const Instance& instance, const Ray& ray, float tMax)
+{
+  Ray local;
+  local.origin = nvmath::vec3f(instance.toObject * nvmath::vec4f(ray.origin, 1.0F));
+  local.dir    = nvmath::vec3f(instance.toObject * nvmath::vec4f(ray.dir, 0.0F));
+  local.tMin   = ray.tMin;
+  local.tMax   = tMax;
+  return local;
+}
+
+bool SceneBvh::intersect(const Ray& ray, Hit& hit) const
+{
+  float t_max = ray.tMax;
+  return traverse(m_nodes, ray, t_max, [&](uint32_t first, uint32_t count, float& tMax) {
+    bool found = false;
+    for(uint32_t i = first; i < first + count; i++)
+    {
+      const Instance& instance = m_instances[m_instanceIndex[i]];
+      if(m_meshes[instance.mesh].intersect(toLocal(instance, ray, tMax), hit))
+      {
+        tMax         = hit.t;
+        hit.instance = instance.node;
+        found        = true;
+      }
+    }
+    return found;
+  });
+}
+
+bool SceneBvh::occluded(const Ray& ray) const
+{
+  float t_max = ray.tMax;
+  return traverse(m_nodes, ray, t_max, [&](uint32_t first, uint32_t count, float& tMax) {
+    for(uint32_t i = first; i < first + count; i++)
+    {
+      const Instance& instance = m_instances[m_instanceIndex[i]];
+      if(m_meshes[instance.mesh].occluded(toLocal(instance, ray, tMax)))
+      {
+        tMax = -FLT_MAX;
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+size_t SceneBvh::memoryBytes() const
+{
+  size_t bytes = m_nodes.size() * sizeof(Node) + m_instances.size() * sizeof(Instance) + m_instanceIndex.size() * sizeof(uint32_t);
+  for(const MeshBvh& mesh : m_meshes)
+    bytes += mesh.memoryBytes();
+  return bytes;
+}
+
+}  // namespace bvh
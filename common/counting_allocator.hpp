@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------------------
+// Allocator of std::vector counting the allocations it makes, for the storage benchmarks of the
+// micromap samples. The count lives outside the allocator, so the copies of the allocator, and
+// the rebinds of the nested vectors, all add to the same counter.
+//
+template <typename T>
+struct CountingAllocator
+{
+  using value_type = T;
+
+  size_t* count{nullptr};
+
+  explicit CountingAllocator(size_t* count_)
+      : count(count_)
+  {
+  }
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>& other)
+      : count(other.count)
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    (*count)++;
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T* p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U>& other) const
+  {
+    return count == other.count;
+  }
+};
+
+template <typename T>
+using CountedVector = std::vector<T, CountingAllocator<T>>;
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+#include "mesh_optimizer.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
+
+
+namespace meshopt {
+
+namespace {
+
+constexpr uint32_t kNone = ~0U;
+
+double msSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// FIFO post-transform cache: a vertex is in it while fewer than `size` misses happened since its own
+class FifoCache
+{
+public:
+  FifoCache(size_t numVertices, uint32_t size)
+      : m_time(numVertices, 0)
+      , m_size(size)
+      , m_stamp(size + 1)
+  {
+  }
+
+  // Misses of the vertices of the triangle
+  uint32_t access(const nvh::PrimitiveTriangle& tri)
+  {
+    uint32_t misses = 0;
+    for(int k = 0; k < 3; k++)
+    {
+      const uint32_t v = tri.v[k];
+      if(m_stamp - m_time[v] > m_size)
+      {
+        m_time[v] = m_stamp++;
+        misses++;
+      }
+    }
+    return misses;
+  }
+
+  // Everything out, for a new simulation
+  void flush() { m_stamp += m_size + 1; }
+
+private:
+  std::vector<uint32_t> m_time;  // Stamp of the last miss of each vertex
+  uint32_t              m_size;
+  uint32_t              m_stamp;
+};
+
+// Triangles using each vertex, CSR layout
+struct Adjacency
+{
+  std::vector<uint32_t> offsets;    // Per vertex, and one past the last
+  std::vector<uint32_t> triangles;  // From offsets[v] to offsets[v + 1]
+
+  explicit Adjacency(const nvh::PrimitiveMesh& mesh)
+      : offsets(mesh.vertices.size() + 1, 0)
+      , triangles(mesh.triangles.size() * 3)
+  {
+    for(const nvh::PrimitiveTriangle& tri : mesh.triangles)
+    {
+      for(int k = 0; k < 3; k++)
+        offsets[tri.v[k] + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t t = 0; t < mesh.triangles.size(); t++)
+    {
+      for(int k = 0; k < 3; k++)
+        triangles[fill[mesh.triangles[t].v[k]]++] = static_cast<uint32_t>(t);
+    }
+  }
+};
+
+}  // namespace
+
+
+CacheStats analyzeVertexCache(const nvh::PrimitiveMesh& mesh, uint32_t cacheSize)
+{
+  CacheStats stats;
+  if(mesh.triangles.empty())
+    return stats;
+
+  FifoCache         cache(mesh.vertices.size(), cacheSize);
+  std::vector<bool> used(mesh.vertices.size(), false);
+  uint32_t          num_used = 0;
+  for(const nvh::PrimitiveTriangle& tri : mesh.triangles)
+  {
+    stats.invocations += cache.access(tri);
+    for(int k = 0; k < 3; k++)
+    {
+      num_used += used[tri.v[k]] ? 0 : 1;
+      used[tri.v[k]] = true;
+    }
+  }
+  stats.acmr = static_cast<float>(stats.invocations) / static_cast<float>(mesh.triangles.size());
+  stats.atvr = static_cast<float>(stats.invocations) / static_cast<float>(num_used);
+  return stats;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Tipsify: emits all the triangles around a fanning vertex, then moves to the neighbor that will
+// still be in the cache after its own remaining triangles, the oldest one first. Without such a
+// neighbor, to the most recent vertex with triangles left (dead-end stack), else the next one in
+// the input order.
+//
+void optimizeVertexCache(nvh::PrimitiveMesh& mesh, uint32_t cacheSize)
+{
+  const uint32_t num_vertices = static_cast<uint32_t>(mesh.vertices.size());
+  if(mesh.triangles.empty())
+    return;
+
+  const Adjacency       adjacency(mesh);
+  std::vector<uint32_t> live(num_vertices);  // Triangles not emitted yet
+  for(uint32_t v = 0; v < num_vertices; v++)
+    live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+  std::vector<uint32_t>               cache_time(num_vertices, 0);
+  uint32_t                            stamp = cacheSize + 1;
+  std::vector<bool>                   emitted(mesh.triangles.size(), false);
+  std::vector<uint32_t>               dead_end;
+  std::vector<uint32_t>               candidates;
+  std::vector<nvh::PrimitiveTriangle> output;
+  output.reserve(mesh.triangles.size());
+  dead_end.reserve(mesh.triangles.size() * 3);
+
+  uint32_t cursor        = 0;  // Vertices before it have no triangle left
+  auto     skip_dead_end = [&]() {
+    while(!dead_end.empty())
+    {
+      const uint32_t v = dead_end.back();
+      dead_end.pop_back();
+      if(live[v] > 0)
+        return v;
+    }
+    for(; cursor < num_vertices; cursor++)
+    {
+      if(live[cursor] > 0)
+        return cursor;
+    }
+    return kNone;
+  };
+
+  uint32_t fanning = skip_dead_end();
+  while(fanning != kNone)
+  {
+    candidates.clear();
+    for(uint32_t a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++)
+    {
+      const uint32_t t = adjacency.triangles[a];
+      if(emitted[t])
+        continue;
+      emitted[t] = true;
+
+      const nvh::PrimitiveTriangle& tri = mesh.triangles[t];
+      output.push_back(tri);
+      for(int k = 0; k < 3; k++)
+      {
+        const uint32_t v = tri.v[k];
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if(stamp - cache_time[v] > cacheSize)
+          cache_time[v] = stamp++;
+      }
+    }
+
+    // Next fanning vertex
+    fanning           = kNone;
+    int64_t best_prio = -1;
+    for(uint32_t v : candidates)
+    {
+      if(live[v] == 0)
+        continue;
+      // Only the vertices still in the cache once their triangles are emitted get a priority, their age
+      int64_t prio = 0;
+      if(stamp - cache_time[v] + 2 * live[v] <= cacheSize)
+        prio = stamp - cache_time[v];
+      if(prio > best_prio)
+      {
+        best_prio = prio;
+        fanning   = v;
+      }
+    }
+    if(fanning == kNone)
+      fanning = skip_dead_end();
+  }
+
+  mesh.triangles = std::move(output);
+}
+
+//--------------------------------------------------------------------------------------------------
+// The Tipsify order is cut in clusters:
+// - where the cache starts over, all three vertices of a triangle missing it
+// - inside these, where the ACMR of the triangles since the previous cut is already good enough
+// Clusters can then be drawn in any order for little loss: those facing away from the center of
+// the mesh are more likely to be in front, and are drawn first.
+//
+void optimizeOverdraw(nvh::PrimitiveMesh& mesh, float threshold, uint32_t cacheSize)
+{
+  const size_t num_triangles = mesh.triangles.size();
+  if(num_triangles == 0)
+    return;
+
+  // Hard boundaries
+  std::vector<uint32_t> hard{0};
+  {
+    FifoCache cache(mesh.vertices.size(), cacheSize);
+    for(uint32_t t = 0; t < num_triangles; t++)
+    {
+      if(cache.access(mesh.triangles[t]) == 3 && t > 0)
+        hard.push_back(t);
+    }
+    hard.push_back(static_cast<uint32_t>(num_triangles));
+  }
+
+  // Soft boundaries, each cluster simulated from an empty cache
+  std::vector<uint32_t> clusters;
+  FifoCache             cache(mesh.vertices.size(), cacheSize);
+  for(size_t h = 0; h + 1 < hard.size(); h++)
+  {
+    const uint32_t begin = hard[h];
+    const uint32_t end   = hard[h + 1];
+
+    cache.flush();
+    uint32_t misses = 0;
+    for(uint32_t t = begin; t < end; t++)
+      misses += cache.access(mesh.triangles[t]);
+    const float cluster_threshold = threshold * static_cast<float>(misses) / static_cast<float>(end - begin);
+
+    clusters.push_back(begin);
+    cache.flush();
+    uint32_t running_misses = 0;
+    uint32_t running_begin  = begin;
+    for(uint32_t t = begin; t < end; t++)
+    {
+      running_misses += cache.access(mesh.triangles[t]);
+      const float running_acmr = static_cast<float>(running_misses) / static_cast<float>(t + 1 - running_begin);
+      if(running_acmr <= cluster_threshold && t + 1 < end)
+      {
+        clusters.push_back(t + 1);
+        running_begin  = t + 1;
+        running_misses = 0;
+        cache.flush();
+      }
+    }
+  }
+  clusters.push_back(static_cast<uint32_t>(num_triangles));
+
+  // Centroids and normals weighted by the area
+  const size_t               num_clusters = clusters.size() - 1;
+  std::vector<nvmath::vec3f> centroids(num_clusters, nvmath::vec3f(0.0F));
+  std::vector<nvmath::vec3f> normals(num_clusters, nvmath::vec3f(0.0F));
+  std::vector<float>         areas(num_clusters, 0.0F);
+  nvmath::vec3f              mesh_centroid(0.0F);
+  float                      mesh_area = 0.0F;
+  for(size_t c = 0; c < num_clusters; c++)
+  {
+    for(uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+    {
+      const nvh::PrimitiveTriangle& tri = mesh.triangles[t];
+      const nvmath::vec3f&          p0  = mesh.vertices[tri.v[0]].p;
+      const nvmath::vec3f&          p1  = mesh.vertices[tri.v[1]].p;
+      const nvmath::vec3f&          p2  = mesh.vertices[tri.v[2]].p;
+      const nvmath::vec3f           n   = nvmath::cross(p1 - p0, p2 - p0);  // Twice the area
+      const float                   a   = nvmath::length(n);
+      centroids[c] += (p0 + p1 + p2) * (a / 3.0F);
+      normals[c] += n;
+      areas[c] += a;
+    }
+    mesh_centroid += centroids[c];
+    mesh_area += areas[c];
+    centroids[c] = areas[c] > 0.0F ? centroids[c] / areas[c] : mesh.vertices[mesh.triangles[clusters[c]].v[0]].p;
+  }
+  mesh_centroid = mesh_area > 0.0F ? mesh_centroid / mesh_area : nvmath::vec3f(0.0F);
+
+  std::vector<float> facing(num_clusters);
+  for(size_t c = 0; c < num_clusters; c++)
+  {
+    const float n_len = nvmath::length(normals[c]);
+    facing[c]         = n_len > 0.0F ? nvmath::dot(centroids[c] - mesh_centroid, normals[c] / n_len) : 0.0F;
+  }
+
+  std::vector<uint32_t> order(num_clusters);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return facing[a] > facing[b]; });
+
+  std::vector<nvh::PrimitiveTriangle> output;
+  output.reserve(num_triangles);
+  for(uint32_t c : order)
+    output.insert(output.end(), mesh.triangles.begin() + clusters[c], mesh.triangles.begin() + clusters[c + 1]);
+  mesh.triangles = std::move(output);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Vertices in the order the triangles reach them, so the fetches of consecutive triangles are
+// close in memory
+//
+void optimizeVertexFetch(nvh::PrimitiveMesh& mesh)
+{
+  std::vector<uint32_t>             remap(mesh.vertices.size(), kNone);
+  std::vector<nvh::PrimitiveVertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for(nvh::PrimitiveTriangle& tri : mesh.triangles)
+  {
+    for(int k = 0; k < 3; k++)
+    {
+      uint32_t& index = remap[tri.v[k]];
+      if(index == kNone)
+      {
+        index = static_cast<uint32_t>(vertices.size());
+        vertices.push_back(mesh.vertices[tri.v[k]]);
+      }
+      tri.v[k] = index;
+    }
+  }
+  mesh.vertices = std::move(vertices);
+}
+
+Report optimizeMesh(nvh::PrimitiveMesh& mesh, const Options& options)
+{
+  Report     report;
+  const auto t0 = std::chrono::steady_clock::now();
+  report.before = analyzeVertexCache(mesh, options.cacheSize);
+
+  // Tipsify is greedy: on a mesh already in a good order, such as the rows of a grid, it can miss
+  // more than the original, so that order is restored when the new one isn't better
+  const std::vector<nvh::PrimitiveTriangle> original = mesh.triangles;
+  optimizeVertexCache(mesh, options.cacheSize);
+  if(options.overdraw)
+    optimizeOverdraw(mesh, options.overdrawThreshold, options.cacheSize);
+  report.reordered = analyzeVertexCache(mesh, options.cacheSize).acmr < report.before.acmr;
+  if(!report.reordered)
+    mesh.triangles = original;
+  optimizeVertexFetch(mesh);
+
+  report.after      = analyzeVertexCache(mesh, options.cacheSize);
+  report.optimizeMs = msSince(t0);
+  return report;
+}
+
+std::vector<Report> optimizeMeshes(std::vector<nvh::PrimitiveMesh>& meshes, const Options& options)
+{
+  std::vector<Report> reports(meshes.size());
+  const uint32_t      num_threads = options.numThreads != 0 ? options.numThreads : std::thread::hardware_concurrency();
+  nvh::parallel_batches<1>(
+      meshes.size(), [&](uint64_t i) { reports[i] = optimizeMesh(meshes[i], options); }, num_threads);
+
+  for(size_t i = 0; i < meshes.size(); i++)
+  {
+    const Report& r = reports[i];
+    LOGI("Mesh %zu, %zu triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %.2f ms%s\n", i, meshes[i].triangles.size(),
+         r.before.acmr, r.after.acmr, r.before.atvr, r.after.atvr, r.optimizeMs, r.reordered ? "" : ", order kept");
+  }
+  return reports;
+}
+
+}  // namespace meshopt
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "nvh/primitives.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Reordering of an nvh::PrimitiveMesh before it is uploaded, so the GPU runs the vertex shader
+// fewer times and reads the vertices from fewer cache lines. The shape doesn't change, only the
+// order of the triangles and of the vertices.
+//
+// - optimizeVertexCache: the triangles in the order of Tipsify (Sander, Nehab and Barczak,
+//   "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007), linear in the
+//   number of triangles
+// - optimizeOverdraw: the clusters of the Tipsify order are sorted so that those facing out of the
+//   mesh are drawn first, giving up a little of the vertex reuse
+// - optimizeVertexFetch: the vertices in the order of their first use, unused ones removed
+//
+// The post-transform cache is modeled as a FIFO of `cacheSize` vertices:
+// - ACMR: average cache miss ratio, vertex shader invocations per triangle (0.5 at best, 3 at worst)
+// - ATVR: average transformed vertex ratio, vertex shader invocations per vertex (1 at best)
+//
+namespace meshopt {
+
+constexpr uint32_t kDefaultCacheSize = 16;
+
+struct CacheStats
+{
+  uint32_t invocations{0};  // Cache misses of the vertex shader
+  float    acmr{0.0F};
+  float    atvr{0.0F};
+};
+
+CacheStats analyzeVertexCache(const nvh::PrimitiveMesh& mesh, uint32_t cacheSize = kDefaultCacheSize);
+
+void optimizeVertexCache(nvh::PrimitiveMesh& mesh, uint32_t cacheSize = kDefaultCacheSize);
+// After optimizeVertexCache; threshold: ACMR accepted for the clusters, relative to the Tipsify order
+void optimizeOverdraw(nvh::PrimitiveMesh& mesh, float threshold = 1.05F, uint32_t cacheSize = kDefaultCacheSize);
+void optimizeVertexFetch(nvh::PrimitiveMesh& mesh);
+
+struct Options
+{
+  uint32_t cacheSize{kDefaultCacheSize};
+  bool     overdraw{false};           // Also sort the clusters for the overdraw
+  float    overdrawThreshold{1.05F};  // Loss of ACMR accepted for the overdraw
+  uint32_t numThreads{0};             // optimizeMeshes, one mesh per thread, 0: all cores
+};
+
+struct Report
+{
+  CacheStats before;
+  CacheStats after;
+  double     optimizeMs{0.0};
+  bool       reordered{false};  // False when the new triangle order had no fewer misses and the original was kept
+};
+
+// All the stages of the options, then the analysis. The triangles keep their original order when
+// the reordering doesn't lower the ACMR; the vertices are reordered in any case.
+Report optimizeMesh(nvh::PrimitiveMesh& mesh, const Options& options = {});
+// The meshes in parallel, and one log line for each
+std::vector<Report> optimizeMeshes(std::vector<nvh::PrimitiveMesh>& meshes, const Options& options = {});
+
+}  // namespace meshopt
@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "nvh/parallel_work.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PERLIN_NOISE_AVX2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PERLIN_NOISE_NEON 1
+#endif
+
+
+//--------------------------------------------------------------------------------------------------
+// Classic 3D Perlin noise (Stefan Gustavson), the same function as glm::perlin() and the
+// perlin() of the texture_3d compute shader, evaluated on groups of points.
+//
+// - perlin8 / fbm8 : 8 points per call, one point per SIMD lane (AVX2: 1 x 8 lanes, NEON: 2 x 4 lanes,
+//                    scalar otherwise, selected at compile time)
+// - fbm            : any number of points, in groups of 8
+// - fillFbmVolume  : a whole volume, multithreaded over the rows, written in z/y/x order
+//
+// The `seed` offsets the lattice hash: the same seed always gives the same noise, and seed 0 is
+// the noise of the shader.
+//
+namespace noise {
+
+static constexpr uint32_t kGroupSize = 8;  // Points evaluated by perlin8 and fbm8
+
+// Sum of `octave` noises, the frequency doubling and the amplitude divided by `power` at each octave
+struct FbmSettings
+{
+  int      octave{3};
+  float    power{1.0F};
+  float    frequency{1.0F};
+  uint32_t seed{0};
+};
+
+namespace detail {
+
+// The kernel is written once, over these lane operations. set1() broadcasts, the type being given by
+// its first argument.
+inline float set1(float, float v)
+{
+  return v;
+}
+inline float add(float a, float b)
+{
+  return a + b;
+}
+inline float sub(float a, float b)
+{
+  return a - b;
+}
+inline float mul(float a, float b)
+{
+  return a * b;
+}
+inline float div(float a, float b)
+{
+  return a / b;
+}
+inline float vfloor(float a)
+{
+  return std::floor(a);
+}
+inline float vabs(float a)
+{
+  return std::abs(a);
+}
+// GLSL step(edge, x): 1 when x >= edge
+inline float step(float edge, float x)
+{
+  return x >= edge ? 1.0F : 0.0F;
+}
+
+#if PERLIN_NOISE_AVX2
+inline __m256 set1(__m256, float v)
+{
+  return _mm256_set1_ps(v);
+}
+inline __m256 add(__m256 a, __m256 b)
+{
+  return _mm256_add_ps(a, b);
+}
+inline __m256 sub(__m256 a, __m256 b)
+{
+  return _mm256_sub_ps(a, b);
+}
+inline __m256 mul(__m256 a, __m256 b)
+{
+  return _mm256_mul_ps(a, b);
+}
+inline __m256 div(__m256 a, __m256 b)
+{
+  return _mm256_div_ps(a, b);
+}
+inline __m256 vfloor(__m256 a)
+{
+  return _mm256_floor_ps(a);
+}
+inline __m256 vabs(__m256 a)
+{
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0F), a);
+}
+inline __m256 step(__m256 edge, __m256 x)
+{
+  return _mm256_and_ps(_mm256_cmp_ps(x, edge, _CMP_GE_OQ), _mm256_set1_ps(1.0F));
+}
+#elif PERLIN_NOISE_NEON
+inline float32x4_t set1(float32x4_t, float v)
+{
+  return vdupq_n_f32(v);
+}
+inline float32x4_t add(float32x4_t a, float32x4_t b)
+{
+  return vaddq_f32(a, b);
+}
+inline float32x4_t sub(float32x4_t a, float32x4_t b)
+{
+  return vsubq_f32(a, b);
+}
+inline float32x4_t mul(float32x4_t a, float32x4_t b)
+{
+  return vmulq_f32(a, b);
+}
+inline float32x4_t div(float32x4_t a, float32x4_t b)
+{
+  return vdivq_f32(a, b);
+}
+inline float32x4_t vfloor(float32x4_t a)
+{
+  return vrndmq_f32(a);
+}
+inline float32x4_t vabs(float32x4_t a)
+{
+  return vabsq_f32(a);
+}
+inline float32x4_t step(float32x4_t edge, float32x4_t x)
+{
+  return vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(x, edge), vreinterpretq_u32_f32(vdupq_n_f32(1.0F))));
+}
+#endif
+
+template <class V>
+inline V fract(V a)
+{
+  return sub(a, vfloor(a));
+}
+template <class V>
+inline V mix(V a, V b, V t)
+{
+  return add(a, mul(sub(b, a), t));
+}
+template <class V>
+inline V dot3(V ax, V ay, V az, V bx, V by, V bz)
+{
+  return add(add(mul(ax, bx), mul(ay, by)), mul(az, bz));
+}
+template <class V>
+inline V mod289(V x)
+{
+  const V k289 = set1(x, 289.0F);
+  return sub(x, mul(vfloor(mul(x, set1(x, 1.0F / 289.0F))), k289));
+}
+template <class V>
+inline V permute(V x)
+{
+  return mod289(mul(add(mul(x, set1(x, 34.0F)), set1(x, 1.0F)), x));
+}
+template <class V>
+inline V fade(V t)
+{
+  // t * t * t * (t * (t * 6.0 - 15.0) + 10.0)
+  const V poly = add(mul(t, sub(mul(t, set1(t, 6.0F)), set1(t, 15.0F))), set1(t, 10.0F));
+  return mul(mul(mul(t, t), t), poly);
+}
+
+// Gradient of a lattice corner from its hash, normalized, dotted with the offset to the corner
+template <class V>
+inline V gradientDot(V hash, V fx, V fy, V fz)
+{
+  V gx = div(hash, set1(hash, 7.0F));
+  V gy = sub(fract(div(vfloor(gx), set1(hash, 7.0F))), set1(hash, 0.5F));
+  gx   = fract(gx);
+  V gz = sub(sub(set1(hash, 0.5F), vabs(gx)), vabs(gy));
+  V sz = step(gz, set1(hash, 0.0F));
+  gx   = sub(gx, mul(sz, sub(step(set1(hash, 0.0F), gx), set1(hash, 0.5F))));
+  gy   = sub(gy, mul(sz, sub(step(set1(hash, 0.0F), gy), set1(hash, 0.5F))));
+
+  // taylorInvSqrt(dot(g, g))
+  const V norm = sub(set1(hash, 1.79284291400159F), mul(set1(hash, 0.85373472095314F), dot3(gx, gy, gz, gx, gy, gz)));
+  return mul(dot3(gx, gy, gz, fx, fy, fz), norm);
+}
+
+// Noise of one point per lane
+template <class V>
+inline V perlinKernel(V px, V py, V pz, V seed)
+{
+  const V one = set1(px, 1.0F);
+
+  // Integer part, for the lattice hash
+  const V fx0 = vfloor(px);
+  const V fy0 = vfloor(py);
+  const V fz0 = vfloor(pz);
+  const V ix0 = mod289(add(fx0, seed));
+  const V ix1 = mod289(add(add(fx0, one), seed));
+  const V iy0 = mod289(fy0);
+  const V iy1 = mod289(add(fy0, one));
+  const V iz0 = mod289(fz0);
+  const V iz1 = mod289(add(fz0, one));
+
+  // Fractional part, for the interpolation
+  const V pfx0 = sub(px, fx0);
+  const V pfy0 = sub(py, fy0);
+  const V pfz0 = sub(pz, fz0);
+  const V pfx1 = sub(pfx0, one);
+  const V pfy1 = sub(pfy0, one);
+  const V pfz1 = sub(pfz0, one);
+
+  const V px0 = permute(ix0);
+  const V px1 = permute(ix1);
+  const V h00 = permute(add(px0, iy0));
+  const V h10 = permute(add(px1, iy0));
+  const V h01 = permute(add(px0, iy1));
+  const V h11 = permute(add(px1, iy1));
+
+  const V n000 = gradientDot(permute(add(h00, iz0)), pfx0, pfy0, pfz0);
+  const V n100 = gradientDot(permute(add(h10, iz0)), pfx1, pfy0, pfz0);
+  const V n010 = gradientDot(permute(add(h01, iz0)), pfx0, pfy1, pfz0);
+  const V n110 = gradientDot(permute(add(h11, iz0)), pfx1, pfy1, pfz0);
+  const V n001 = gradientDot(permute(add(h00, iz1)), pfx0, pfy0, pfz1);
+  const V n101 = gradientDot(permute(add(h10, iz1)), pfx1, pfy0, pfz1);
+  const V n011 = gradientDot(permute(add(h01, iz1)), pfx0, pfy1, pfz1);
+  const V n111 = gradientDot(permute(add(h11, iz1)), pfx1, pfy1, pfz1);
+
+  const V fade_x = fade(pfx0);
+  const V fade_y = fade(pfy0);
+  const V fade_z = fade(pfz0);
+  const V nz00   = mix(n000, n001, fade_z);
+  const V nz10   = mix(n100, n101, fade_z);
+  const V nz01   = mix(n010, n011, fade_z);
+  const V nz11   = mix(n110, n111, fade_z);
+  const V nyz0   = mix(nz00, nz01, fade_y);
+  const V nyz1   = mix(nz10, nz11, fade_y);
+  return mul(set1(px, 2.2F), mix(nyz0, nyz1, fade_x));
+}
+
+template <class V>
+inline V fbmKernel(V px, V py, V pz, const FbmSettings& settings)
+{
+  const V seed  = set1(px, static_cast<float>(settings.seed % 289));
+  V       v     = set1(px, 0.0F);
+  float   scale = settings.power;
+  float   freq  = settings.frequency;
+  for(int oct = 0; oct < settings.octave; oct++)
+  {
+    const V f = set1(px, freq);
+    v         = add(v, div(perlinKernel(mul(px, f), mul(py, f), mul(pz, f), seed), set1(px, scale)));
+    freq *= 2.0F;             // Double the frequency
+    scale *= settings.power;  // Next power of b
+  }
+  return v;
+}
+
+}  // namespace detail
+
+
+// Noise at one point, scalar reference
+inline float perlin(float x, float y, float z, uint32_t seed = 0)
+{
+  return detail::perlinKernel(x, y, z, static_cast<float>(seed % 289));
+}
+
+// Fractal sum at one point, scalar reference
+inline float fbm(float x, float y, float z, const FbmSettings& settings)
+{
+  return detail::fbmKernel(x, y, z, settings);
+}
+
+// Fractal sum of kGroupSize points
+inline void fbm8(const float* x, const float* y, const float* z, float* out, const FbmSettings& settings)
+{
+#if PERLIN_NOISE_AVX2
+  _mm256_storeu_ps(out, detail::fbmKernel(_mm256_loadu_ps(x), _mm256_loadu_ps(y), _mm256_loadu_ps(z), settings));
+#elif PERLIN_NOISE_NEON
+  for(uint32_t i = 0; i < kGroupSize; i += 4)
+    vst1q_f32(out + i, detail::fbmKernel(vld1q_f32(x + i), vld1q_f32(y + i), vld1q_f32(z + i), settings));
+#else
+  for(uint32_t i = 0; i < kGroupSize; i++)
+    out[i] = detail::fbmKernel(x[i], y[i], z[i], settings);
+#endif
+}
+
+// Noise of kGroupSize points
+inline void perlin8(const float* x, const float* y, const float* z, float* out, uint32_t seed = 0)
+{
+  fbm8(x, y, z, out, {1, 1.0F, 1.0F, seed});
+}
+
+// Fractal sum of `count` points, the last group being padded
+inline void fbm(const float* x, const float* y, const float* z, float* out, size_t count, const FbmSettings& settings)
+{
+  size_t i = 0;
+  for(; i + kGroupSize <= count; i += kGroupSize)
+    fbm8(x + i, y + i, z + i, out + i, settings);
+
+  if(i < count)
+  {
+    float tx[kGroupSize]{}, ty[kGroupSize]{}, tz[kGroupSize]{}, tout[kGroupSize];
+    std::copy(x + i, x + count, tx);
+    std::copy(y + i, y + count, ty);
+    std::copy(z + i, z + count, tz);
+    fbm8(tx, ty, tz, tout, settings);
+    std::copy(tout, tout + (count - i), out + i);
+  }
+}
+
+// Fill the `width` x `height` x `depth` volume `dst` (x being contiguous, z the slowest) with the
+// fractal sum at the integer voxel coordinates. Rows are distributed over the threads.
+inline void fillFbmVolume(float* dst, uint32_t width, uint32_t height, uint32_t depth, const FbmSettings& settings)
+{
+  const uint64_t num_rows = static_cast<uint64_t>(height) * depth;
+  nvh::parallel_batches<8>(
+      num_rows,
+      [&](uint64_t row) {
+        const auto y = static_cast<float>(row % height);
+        const auto z = static_cast<float>(row / height);
+
+        float vx[kGroupSize], vy[kGroupSize], vz[kGroupSize];
+        std::fill_n(vy, kGroupSize, y);
+        std::fill_n(vz, kGroupSize, z);
+
+        float* out = dst + row * width;
+        for(uint32_t x = 0; x < width; x += kGroupSize)
+        {
+          const uint32_t count = std::min(kGroupSize, width - x);
+          for(uint32_t i = 0; i < kGroupSize; i++)
+            vx[i] = static_cast<float>(x + i);
+          if(count == kGroupSize)
+          {
+            fbm8(vx, vy, vz, out + x, settings);
+          }
+          else
+          {
+            float tail[kGroupSize];
+            fbm8(vx, vy, vz, tail, settings);
+            std::copy(tail, tail + count, out + x);
+          }
+        }
+      },
+      std::thread::hardware_concurrency());
+}
+
+}  // namespace noise
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include "quantized_vertex.hpp"
+
+
+namespace quant {
+
+namespace {
+
+constexpr float kMaxPosition   = 65535.0F;
+constexpr float kMaxOctahedral = 127.0F;
+
+float signNotZero(float v)
+{
+  return v >= 0.0F ? 1.0F : -1.0F;
+}
+
+uint16_t packOctahedral(int x, int y)
+{
+  return static_cast<uint16_t>((static_cast<uint8_t>(static_cast<int8_t>(x)))
+                               | (static_cast<uint8_t>(static_cast<int8_t>(y)) << 8));
+}
+
+}  // namespace
+
+
+nvmath::mat4f QuantizedMesh::dequantize() const
+{
+  return nvmath::translation_mat4(bmin) * nvmath::scale_mat4(scale);
+}
+
+//--------------------------------------------------------------------------------------------------
+// The normal is projected on the octahedron |x| + |y| + |z| = 1, whose lower half is folded over
+// the upper one, then flattened on the xy plane. Of the four roundings of the two coordinates,
+// the one decoding closest to the normal is kept: the largest error goes from 0.95 to 0.64 degrees.
+//
+uint16_t encodeOctahedral(const nvmath::vec3f& normal)
+{
+  const float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  if(l1 == 0.0F)
+    return packOctahedral(0, 0);
+
+  float px = normal.x / l1;
+  float py = normal.y / l1;
+  if(normal.z < 0.0F)
+  {
+    const float fx = (1.0F - std::abs(py)) * signNotZero(px);
+    const float fy = (1.0F - std::abs(px)) * signNotZero(py);
+    px             = fx;
+    py             = fy;
+  }
+
+  const nvmath::vec3f n       = normal / nvmath::length(normal);
+  const int           base_x  = static_cast<int>(std::floor(px * kMaxOctahedral));
+  const int           base_y  = static_cast<int>(std::floor(py * kMaxOctahedral));
+  uint16_t            best    = 0;
+  float               best_nd = -FLT_MAX;
+  for(int i = 0; i < 4; i++)
+  {
+    const int      x       = std::clamp(base_x + (i & 1), -127, 127);
+    const int      y       = std::clamp(base_y + (i >> 1), -127, 127);
+    const uint16_t encoded = packOctahedral(x, y);
+    const float    nd      = nvmath::dot(decodeOctahedral(encoded), n);
+    if(nd > best_nd)
+    {
+      best_nd = nd;
+      best    = encoded;
+    }
+  }
+  return best;
+}
+
+nvmath::vec3f decodeOctahedral(uint16_t octahedral)
+{
+  const float   x = static_cast<float>(static_cast<int8_t>(octahedral & 0xFF)) / kMaxOctahedral;
+  const float   y = static_cast<float>(static_cast<int8_t>(octahedral >> 8)) / kMaxOctahedral;
+  nvmath::vec3f n(x, y, 1.0F - std::abs(x) - std::abs(y));
+  const float   t = std::max(-n.z, 0.0F);
+  n.x += n.x >= 0.0F ? -t : t;
+  n.y += n.y >= 0.0F ? -t : t;
+  return n / nvmath::length(n);
+}
+
+// Rounded to the nearest, ties to even
+uint16_t floatToHalf(float value)
+{
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto     sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  const uint32_t abs  = bits & 0x7FFFFFFF;
+
+  if(abs >= 0x7F800000)  // Inf and NaN
+    return sign | (abs > 0x7F800000 ? 0x7E00 : 0x7C00);
+  if(abs >= 0x477FF000)  // Rounds above the largest half, 65504
+    return sign | 0x7C00;
+  if(abs < 0x38800000)  // Below the smallest normal half, 2^-14: multiple of 2^-24
+  {
+    float a = 0.0F;
+    std::memcpy(&a, &abs, sizeof(a));
+    return sign | static_cast<uint16_t>(std::nearbyint(a * 16777216.0F));
+  }
+
+  uint32_t       half = (abs - 0x38000000) >> 13;  // Exponent bias from 127 to 15
+  const uint32_t rest = abs & 0x1FFF;
+  if(rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0))
+    half++;
+  return sign | static_cast<uint16_t>(half);
+}
+
+float halfToFloat(uint16_t value)
+{
+  const uint32_t sign     = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1F;
+  const uint32_t mantissa = value & 0x3FF;
+
+  if(exponent == 0)  // Zero and subnormals
+    return std::copysign(static_cast<float>(mantissa) / 16777216.0F, sign != 0 ? -1.0F : 1.0F);
+
+  uint32_t bits = sign | ((exponent + 112) << 23) | (mantissa << 13);  // Exponent bias from 15 to 127
+  if(exponent == 31)                                                 // Inf and NaN
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  float result = 0.0F;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+QuantizedMesh quantizeMesh(const nvh::PrimitiveMesh& mesh)
+{
+  QuantizedMesh result;
+  nvmath::vec3f bmax(-FLT_MAX);
+  result.bmin = nvmath::vec3f(FLT_MAX);
+  for(const nvh::PrimitiveVertex& v : mesh.vertices)
+  {
+    result.bmin = nvmath::nv_min(result.bmin, v.p);
+    bmax        = nvmath::nv_max(bmax, v.p);
+  }
+  if(mesh.vertices.empty())
+  {
+    result.bmin = nvmath::vec3f(0.0F);
+    bmax        = nvmath::vec3f(0.0F);
+  }
+  const nvmath::vec3f extent = bmax - result.bmin;
+  result.scale               = extent / kMaxPosition;
+
+  result.vertices.resize(mesh.vertices.size());
+  for(size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    const nvh::PrimitiveVertex& v = mesh.vertices[i];
+    QuantizedVertex&            q = result.vertices[i];
+    for(int k = 0; k < 3; k++)
+    {
+      // Flat axis: everything at bmin
+      const float rel = extent[k] > 0.0F ? (v.p[k] - result.bmin[k]) / extent[k] : 0.0F;
+      q.position[k]   = static_cast<uint16_t>(std::lround(std::clamp(rel, 0.0F, 1.0F) * kMaxPosition));
+    }
+    q.normal = encodeOctahedral(v.n);
+    q.uv[0]  = floatToHalf(v.t.x);
+    q.uv[1]  = floatToHalf(v.t.y);
+  }
+  return result;
+}
+
+nvh::PrimitiveVertex decodeVertex(const QuantizedMesh& mesh, const QuantizedVertex& vertex)
+{
+  nvh::PrimitiveVertex v;
+  const nvmath::vec3f  q(vertex.position[0], vertex.position[1], vertex.position[2]);
+  v.p = mesh.bmin + q * mesh.scale;
+  v.n = decodeOctahedral(vertex.normal);
+  v.t = nvmath::vec2f(halfToFloat(vertex.uv[0]), halfToFloat(vertex.uv[1]));
+  return v;
+}
+
+QuantizationError measureError(const nvh::PrimitiveMesh& mesh, const QuantizedMesh& quantized)
+{
+  QuantizationError error;
+  if(mesh.vertices.empty())
+    return error;
+
+  const float diagonal    = nvmath::length(quantized.scale * kMaxPosition);
+  double      sum_pos     = 0.0;
+  double      sum_angle   = 0.0;
+  size_t      num_normals = 0;
+  for(size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    const nvh::PrimitiveVertex& v = mesh.vertices[i];
+    const nvh::PrimitiveVertex  d = decodeVertex(quantized, quantized.vertices[i]);
+
+    const float pos   = diagonal > 0.0F ? nvmath::length(d.p - v.p) / diagonal : 0.0F;
+    error.maxPosition = std::max(error.maxPosition, pos);
+    sum_pos += pos;
+
+    const float n_len = nvmath::length(v.n);
+    if(n_len > 0.0F)
+    {
+      const float angle  = std::acos(std::clamp(nvmath::dot(v.n / n_len, d.n), -1.0F, 1.0F)) * 180.0F / nv_pi;
+      error.maxNormalDeg = std::max(error.maxNormalDeg, angle);
+      sum_angle += angle;
+      num_normals++;
+    }
+
+    error.maxUv = std::max({error.maxUv, std::abs(d.t.x - v.t.x), std::abs(d.t.y - v.t.y)});
+  }
+  error.meanPosition  = static_cast<float>(sum_pos / static_cast<double>(mesh.vertices.size()));
+  error.meanNormalDeg = num_normals > 0 ? static_cast<float>(sum_angle / static_cast<double>(num_normals)) : 0.0F;
+  return error;
+}
+
+}  // namespace quant
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "nvh/primitives.hpp"
+#include "nvmath/nvmath.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Compact vertices for the raster pipelines, 12 bytes instead of the 32 of nvh::PrimitiveVertex:
+//
+// - position: 3 x 16 bits, unsigned and relative to the bounding box of the mesh. The box goes into
+//   the transformation of the instance (QuantizedMesh::dequantize), so the shader only converts
+//   the integers to floats.
+// - normal: octahedral mapping, 2 x 8 bits signed, the rounding chosen for the smallest angle
+// - texture coordinates: 2 half floats
+//
+// The vertex input is two attributes, both formats having mandatory support for vertex buffers:
+//   location 0: VK_FORMAT_R16G16B16A16_UINT  at 0, xyz the position, w the normal
+//   location 1: VK_FORMAT_R16G16_SFLOAT      at 8, the texture coordinates
+//
+namespace quant {
+
+struct QuantizedVertex
+{
+  uint16_t position[3];
+  uint16_t normal;  // Octahedral x in the low byte, y in the high one
+  uint16_t uv[2];   // Half floats
+};
+static_assert(sizeof(QuantizedVertex) == 12, "Layout of the vertex input");
+
+struct QuantizedMesh
+{
+  std::vector<QuantizedVertex> vertices;
+  nvmath::vec3f                bmin;
+  nvmath::vec3f                scale;  // Extent of the box over 65535
+
+  // To multiply the transformation of the instances with, from the quantized to the mesh positions
+  nvmath::mat4f dequantize() const;
+};
+
+// The triangles are unchanged: the vertices keep their order
+QuantizedMesh quantizeMesh(const nvh::PrimitiveMesh& mesh);
+
+// As the vertex shader decodes it
+nvh::PrimitiveVertex decodeVertex(const QuantizedMesh& mesh, const QuantizedVertex& vertex);
+
+uint16_t      encodeOctahedral(const nvmath::vec3f& normal);
+nvmath::vec3f decodeOctahedral(uint16_t octahedral);
+uint16_t      floatToHalf(float value);
+float         halfToFloat(uint16_t value);
+
+// Difference with the original vertices
+struct QuantizationError
+{
+  float maxPosition{0.0F};   // Relative to the diagonal of the box
+  float meanPosition{0.0F};  // Same
+  float maxNormalDeg{0.0F};
+  float meanNormalDeg{0.0F};
+  float maxUv{0.0F};
+};
+QuantizationError measureError(const nvh::PrimitiveMesh& mesh, const QuantizedMesh& quantized);
+
+}  // namespace quant
@@ -157,4 +157,18 @@ float3 simpleShading(float3 viewDir, float3 lightDir, float3 normal, float3 colo
   return color;
 }
 
+//-----------------------------------------------------------------------
+// Normal from its octahedral mapping: two signed bytes, x in the lowest
+// one, as encoded by quant::encodeOctahedral (common/quantized_vertex.hpp)
+//-----------------------------------------------------------------------
+float3 decodeOctahedral(uint packed)
+{
+  float2 f = float2(int2(int(packed << 24), int(packed << 16)) >> 24) / 127.0F;
+  float3 n = float3(f, 1.0F - abs(f.x) - abs(f.y));
+  float t = max(-n.z, 0.0F);
+  n.x += n.x >= 0.0F ? -t : t;
+  n.y += n.y >= 0.0F ? -t : t;
+  return normalize(n);
+}
+
 #endif
\ No newline at end of file
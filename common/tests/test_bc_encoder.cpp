@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+//--------------------------------------------------------------------------------------------------
+// Quality of the BC encoders, measured through their decoders: the PSNR of smooth and noisy images
+// stays above a floor for each format, eNormal is never worse than eFast, per BC4 block as well as
+// overall, and constant blocks are exact.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bc_encoder.hpp"
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if(!(cond))                                                                                                        \
+    {                                                                                                                  \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);                                                               \
+      std::printf(__VA_ARGS__);                                                                                        \
+      std::printf("\n");                                                                                               \
+      s_failures++;                                                                                                    \
+    }                                                                                                                  \
+  } while(false)
+
+constexpr uint32_t kSize = 64;
+
+// Smooth waves, with `noise` in [0,1] of uniform noise added
+static std::vector<float> makeValues(std::mt19937& rng, float noise)
+{
+  std::uniform_real_distribution<float> dist(-0.5F, 0.5F);
+  std::vector<float>                    values(kSize * kSize);
+  for(uint32_t y = 0; y < kSize; y++)
+  {
+    for(uint32_t x = 0; x < kSize; x++)
+    {
+      const float v = 0.5F + 0.35F * std::sin(float(x) * 0.21F) * std::cos(float(y) * 0.13F) + noise * dist(rng);
+      values[y * kSize + x] = std::min(std::max(v, 0.0F), 1.0F);
+    }
+  }
+  return values;
+}
+
+static std::vector<uint8_t> makeRGBA8(std::mt19937& rng, float noise)
+{
+  std::vector<uint8_t> rgba(kSize * kSize * 4);
+  for(uint32_t c = 0; c < 4; c++)
+  {
+    const std::vector<float> values = makeValues(rng, noise);
+    for(size_t i = 0; i < values.size(); i++)
+      rgba[i * 4 + c] = static_cast<uint8_t>(std::lround(values[i] * 255.0F));
+  }
+  return rgba;
+}
+
+// Squared error of each block of BC4 values
+static std::vector<double> blockErrors(const std::vector<float>& a, const std::vector<float>& b)
+{
+  const uint32_t      blocks = kSize / 4;
+  std::vector<double> errors(blocks * blocks, 0.0);
+  for(uint32_t i = 0; i < a.size(); i++)
+  {
+    const uint32_t x = i % kSize;
+    const uint32_t y = i / kSize;
+    const double   d = (double(a[i]) - double(b[i])) * 255.0;
+    errors[(y / 4) * blocks + x / 4] += d * d;
+  }
+  return errors;
+}
+
+static void testBC4(std::mt19937& rng)
+{
+  struct Case
+  {
+    const char* name;
+    float       noise;
+    double      minPsnr;  // eNormal
+  };
+  for(const Case& c : {Case{"smooth", 0.0F, 44.0}, Case{"noisy", 0.1F, 42.0}, Case{"noise", 1.0F, 30.0}})
+  {
+    const std::vector<float> values = makeValues(rng, c.noise);
+    std::vector<uint8_t>     blocks(bc::compressedSize(bc::Format::eBC4, kSize, kSize));
+    std::vector<float>       fast(values.size());
+    std::vector<float>       normal(values.size());
+
+    bc::encodeBC4(bc::Quality::eFast, values.data(), kSize, kSize, blocks.data());
+    bc::decodeBC4(blocks.data(), kSize, kSize, fast.data());
+    bc::encodeBC4(bc::Quality::eNormal, values.data(), kSize, kSize, blocks.data());
+    bc::decodeBC4(blocks.data(), kSize, kSize, normal.data());
+
+    const double psnr_fast   = bc::psnr(values.data(), fast.data(), values.size());
+    const double psnr_normal = bc::psnr(values.data(), normal.data(), values.size());
+    std::printf("BC4 %-6s: eFast %6.2f dB, eNormal %6.2f dB\n", c.name, psnr_fast, psnr_normal);
+    CHECK(psnr_normal >= c.minPsnr, "BC4 %s: PSNR %.2f dB below %.2f dB", c.name, psnr_normal, c.minPsnr);
+    CHECK(psnr_normal >= psnr_fast, "BC4 %s: eNormal %.2f dB worse than eFast %.2f dB", c.name, psnr_normal, psnr_fast);
+
+    // eNormal starts from the endpoints of eFast and only keeps better ones
+    const std::vector<double> errors_fast   = blockErrors(values, fast);
+    const std::vector<double> errors_normal = blockErrors(values, normal);
+    for(size_t b = 0; b < errors_fast.size(); b++)
+      CHECK(errors_normal[b] <= errors_fast[b] + 1e-6, "BC4 %s: block %zu, eNormal error %g above eFast %g", c.name, b,
+            errors_normal[b], errors_fast[b]);
+  }
+}
+
+// A block of a single value decodes to it, at both ends of the range
+static void testBC4Constant()
+{
+  for(uint32_t v : {0U, 1U, 128U, 254U, 255U})
+  {
+    const std::vector<float> values(16, float(v) / 255.0F);
+    uint8_t                  block[8];
+    std::vector<float>       decoded(16);
+    for(bc::Quality quality : {bc::Quality::eFast, bc::Quality::eNormal})
+    {
+      bc::encodeBC4(quality, values.data(), 4, 4, block);
+      bc::decodeBC4(block, 4, 4, decoded.data());
+      for(float d : decoded)
+        CHECK(std::lround(d * 255.0F) == long(v), "BC4 constant %u decodes to %g", v, d * 255.0F);
+    }
+  }
+}
+
+static void testRGBA8(std::mt19937& rng)
+{
+  struct Case
+  {
+    bc::Format  format;
+    const char* name;
+    uint32_t    channels;
+    double      minPsnr;  // eNormal, smooth image
+  };
+  for(const Case& c : {Case{bc::Format::eBC1, "BC1", 3, 37.0}, Case{bc::Format::eBC7, "BC7", 4, 50.0}})
+  {
+    const std::vector<uint8_t> rgba = makeRGBA8(rng, 0.0F);
+    std::vector<uint8_t>       blocks(bc::compressedSize(c.format, kSize, kSize));
+    std::vector<uint8_t>       decoded(rgba.size());
+
+    double psnr[2]{};
+    for(bc::Quality quality : {bc::Quality::eFast, bc::Quality::eNormal})
+    {
+      bc::encodeRGBA8(c.format, quality, rgba.data(), kSize, kSize, blocks.data());
+      bc::decodeRGBA8(c.format, blocks.data(), kSize, kSize, decoded.data());
+      psnr[int(quality)] = bc::psnrRGBA8(rgba.data(), decoded.data(), kSize * kSize, c.channels);
+    }
+    std::printf("%s smooth: eFast %6.2f dB, eNormal %6.2f dB\n", c.name, psnr[0], psnr[1]);
+    CHECK(psnr[1] >= c.minPsnr, "%s: PSNR %.2f dB below %.2f dB", c.name, psnr[1], c.minPsnr);
+    CHECK(psnr[1] >= psnr[0], "%s: eNormal %.2f dB worse than eFast %.2f dB", c.name, psnr[1], psnr[0]);
+  }
+}
+
+int main()
+{
+  std::mt19937 rng(12345);
+
+  testBC4(rng);
+  testBC4Constant();
+  testRGBA8(rng);
+
+  if(s_failures != 0)
+  {
+    std::printf("test_bc_encoder: %d failure(s)\n", s_failures);
+    return 1;
+  }
+  std::printf("test_bc_encoder: passed\n");
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+//--------------------------------------------------------------------------------------------------
+// The compile-time BirdCurveTables against the runtime BirdCurveHelper, for level 0 to 5: the
+// micro-vertex coordinates, the micro-triangle indices, the displacement blocks and the (u,v) lookup.
+// The coordinates are multiples of 1/32, exact in float, so they are compared with ==.
+//
+
+#include <cstdio>
+
+#include "bird_curve_helper.hpp"
+#include "bird_curve_tables.hpp"
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if(!(cond))                                                                                                        \
+    {                                                                                                                  \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);                                                               \
+      std::printf(__VA_ARGS__);                                                                                        \
+      std::printf("\n");                                                                                               \
+      s_failures++;                                                                                                    \
+    }                                                                                                                  \
+  } while(false)
+
+// The tables are usable in constant expressions
+static_assert(BirdCurveTables::getVertexCoord(5).size() == BirdCurveTables::getNumMicroVertices(5));
+static_assert(BirdCurveTables::getTriangleIndices(5).size() == BirdCurveTables::getNumMicroTriangles(5));
+static_assert(BirdCurveTables::getVertexCoord(0)[1].u == BirdCurveTables::kScale);
+static_assert(BirdCurveTables::getVertexIndex(0, 0) == 0 && BirdCurveTables::getVertexIndex(BirdCurveTables::kScale, 0) == 1);
+
+static void testVertices(BirdCurveHelper& helper, uint32_t level)
+{
+  const auto& ref    = helper.getVertexCoord(static_cast<uint16_t>(level));
+  const auto  tables = BirdCurveTables::getVertexCoord(level);
+  CHECK(ref.size() == tables.size(), "level %u: %zu vertices, expected %zu", level, tables.size(), ref.size());
+  if(ref.size() != tables.size())
+    return;
+
+  for(size_t i = 0; i < ref.size(); i++)
+  {
+    nvmath::vec3f c = BirdCurveTables::toFloat(tables[i]);
+    CHECK(c == ref[i], "level %u: vertex %zu is (%g, %g, %g), expected (%g, %g, %g)", level, i, c.x, c.y, c.z, ref[i].x,
+          ref[i].y, ref[i].z);
+    CHECK(BirdCurveTables::getVertexIndex(tables[i].u, tables[i].v) == i, "level %u: lookup of vertex %zu", level, i);
+  }
+}
+
+static void testTriangles(BirdCurveHelper& helper, uint32_t level)
+{
+  const auto& ref    = helper.getTriangleIndices(static_cast<uint16_t>(level));
+  const auto  tables = BirdCurveTables::getTriangleIndices(level);
+  CHECK(ref.size() == tables.size(), "level %u: %zu triangles, expected %zu", level, tables.size(), ref.size());
+  if(ref.size() != tables.size())
+    return;
+
+  for(size_t t = 0; t < ref.size(); t++)
+  {
+    const auto& tri = tables[t];
+    CHECK(tri.w == ref[t].x && tri.u == ref[t].y && tri.v == ref[t].z,
+          "level %u: triangle %zu is (%u, %u, %u), expected (%d, %d, %d)", level, t, tri.w, tri.u, tri.v, ref[t].x,
+          ref[t].y, ref[t].z);
+  }
+}
+
+static void testDisplacementBlocks(BirdCurveHelper& helper, uint32_t level)
+{
+  const BirdCurveHelper::DisplacementBlocks ref = helper.createDisplacementBlocks(level);
+  CHECK(ref.size() == BirdCurveTables::getNumDisplacementBlocks(level), "level %u: %u blocks, expected %zu", level,
+        BirdCurveTables::getNumDisplacementBlocks(level), ref.size());
+  if(ref.size() != BirdCurveTables::getNumDisplacementBlocks(level))
+    return;
+
+  for(uint32_t b = 0; b < static_cast<uint32_t>(ref.size()); b++)
+  {
+    const auto block = BirdCurveTables::getDisplacementBlock(level, b);
+    CHECK(block.size() == ref[b].size(), "level %u block %u: %zu indices, expected %zu", level, b, block.size(),
+          ref[b].size());
+    if(block.size() != ref[b].size())
+      continue;
+    for(size_t i = 0; i < block.size(); i++)
+      CHECK(block[i] == ref[b][i], "level %u block %u: index %zu is %u, expected %u", level, b, i, block[i], ref[b][i]);
+  }
+}
+
+int main()
+{
+  BirdCurveHelper helper(BirdCurveTables::kMaxLevel);
+
+  for(uint32_t level = 0; level <= BirdCurveTables::kMaxLevel; level++)
+  {
+    testVertices(helper, level);
+    testTriangles(helper, level);
+    testDisplacementBlocks(helper, level);
+  }
+
+  if(s_failures != 0)
+  {
+    std::printf("test_bird_curve_tables: %d failure(s)\n", s_failures);
+    return 1;
+  }
+  std::printf("test_bird_curve_tables: passed\n");
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+//--------------------------------------------------------------------------------------------------
+// Round trip of the BitPacker through the BitUnpacker: single pushes of every width, the SIMD
+// kernels of pushSpan against their scalar reference, flush() in the middle of a stream and the
+// preservation of the bits following the last value.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bit_packer.hpp"
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if(!(cond))                                                                                                        \
+    {                                                                                                                  \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);                                                               \
+      std::printf(__VA_ARGS__);                                                                                        \
+      std::printf("\n");                                                                                               \
+      s_failures++;                                                                                                    \
+    }                                                                                                                  \
+  } while(false)
+
+static uint32_t maskBits(uint32_t value, uint32_t bits)
+{
+  return bits < 32 ? value & ((1U << bits) - 1U) : value;
+}
+
+// Random widths from 1 to 32 bits, pushed one at a time
+static void testPush(std::mt19937& rng)
+{
+  std::vector<uint32_t> values(4096);
+  std::vector<uint32_t> widths(values.size());
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    values[i] = rng();
+    widths[i] = 1 + rng() % 32;
+  }
+
+  std::vector<uint32_t> buffer(values.size() + 2, 0);
+  uint32_t              total_bits = 0;
+  {
+    BitPacker packer(buffer.data());
+    for(size_t i = 0; i < values.size(); i++)
+      packer.push(values[i], widths[i]);
+    total_bits = packer.bitCount();
+  }
+
+  BitUnpacker unpacker(buffer.data());
+  uint32_t    expected_bits = 0;
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    uint32_t v = unpacker.pull(widths[i]);
+    CHECK(v == maskBits(values[i], widths[i]), "push: value %zu on %u bits: %08x != %08x", i, widths[i], v,
+          maskBits(values[i], widths[i]));
+    expected_bits += widths[i];
+  }
+  CHECK(total_bits == expected_bits, "push: bitCount %u != %u", total_bits, expected_bits);
+}
+
+// The SIMD kernels produce the same words as the scalar ones
+static void testKernels(std::mt19937& rng)
+{
+  uint32_t in[32];
+  for(int iter = 0; iter < 1000; iter++)
+  {
+    for(uint32_t& v : in)
+      v = rng();
+
+    CHECK(bitpack::pack1(in) == bitpack::pack1Scalar(in), "pack1 differs from the scalar kernel");
+    CHECK(bitpack::pack2(in) == bitpack::pack2Scalar(in), "pack2 differs from the scalar kernel");
+
+    uint32_t simd[bitpack::kGroupWords11]{};
+    uint32_t scalar[bitpack::kGroupWords11]{};
+    bitpack::pack11(in, simd);
+    bitpack::pack11Scalar(in, scalar);
+    for(uint32_t w = 0; w < bitpack::kGroupWords11; w++)
+      CHECK(simd[w] == scalar[w], "pack11 differs from the scalar kernel at word %u", w);
+  }
+}
+
+// pushSpan with the SIMD widths, starting at every alignment and with counts that leave a tail
+static void testPushSpan(std::mt19937& rng)
+{
+  const uint32_t widths[] = {1, 2, 11, 7};
+  for(uint32_t bits : widths)
+  {
+    for(uint32_t lead = 0; lead < 32; lead++)
+    {
+      std::vector<uint32_t> values(100 + rng() % 100);
+      for(uint32_t& v : values)
+        v = rng();
+
+      std::vector<uint32_t> buffer(values.size() + 4, 0);
+      {
+        BitPacker packer(buffer.data());
+        packer.push(0x5A5A5A5A, lead);  // Unaligned start
+        packer.pushSpan(values.data(), values.size(), bits);
+      }
+
+      BitUnpacker unpacker(buffer.data());
+      CHECK(unpacker.pull(lead) == maskBits(0x5A5A5A5A, lead), "pushSpan: lead of %u bits", lead);
+      for(size_t i = 0; i < values.size(); i++)
+      {
+        uint32_t v = unpacker.pull(bits);
+        CHECK(v == maskBits(values[i], bits), "pushSpan: %u bits, lead %u, value %zu: %08x != %08x", bits, lead, i, v,
+              maskBits(values[i], bits));
+      }
+    }
+  }
+}
+
+// flush() writes the pending bits but packing continues after it at the next bit
+static void testFlushAndContinue(std::mt19937& rng)
+{
+  std::vector<uint32_t> values(512);
+  std::vector<uint32_t> widths(values.size());
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    values[i] = rng();
+    widths[i] = 1 + rng() % 13;
+  }
+
+  std::vector<uint32_t> buffer(values.size(), 0);
+  {
+    BitPacker packer(buffer.data());
+    for(size_t i = 0; i < values.size(); i++)
+    {
+      packer.push(values[i], widths[i]);
+      if(i % 3 == 0)
+        packer.flush();
+    }
+  }
+
+  BitUnpacker unpacker(buffer.data());
+  for(size_t i = 0; i < values.size(); i++)
+  {
+    uint32_t v = unpacker.pull(widths[i]);
+    CHECK(v == maskBits(values[i], widths[i]), "flush: value %zu on %u bits: %08x != %08x", i, widths[i], v,
+          maskBits(values[i], widths[i]));
+  }
+}
+
+// The bits following the last value are left untouched, in the last byte and after it
+static void testPreservesTail()
+{
+  for(uint32_t num_bits = 1; num_bits <= 96; num_bits++)
+  {
+    uint8_t buffer[16];
+    std::memset(buffer, 0xFF, sizeof(buffer));
+    {
+      BitPacker packer(buffer);
+      for(uint32_t b = 0; b < num_bits; b++)
+        packer.push(0, 1);
+    }
+
+    for(uint32_t b = 0; b < sizeof(buffer) * 8; b++)
+    {
+      uint32_t bit = (buffer[b / 8] >> (b % 8)) & 1U;
+      CHECK(bit == (b < num_bits ? 0U : 1U), "tail: %u bits pushed, bit %u is %u", num_bits, b, bit);
+    }
+  }
+}
+
+// setData() resets the stream, the second buffer starts at bit 0
+static void testSetData()
+{
+  uint32_t first[2]{};
+  uint32_t second[2]{};
+  {
+    BitPacker packer(first);
+    packer.push(0x7, 3);
+    packer.setData(second);
+    packer.push(0x5, 3);
+  }
+  CHECK(first[0] == 0x7, "setData: first buffer %08x", first[0]);
+  CHECK(second[0] == 0x5, "setData: second buffer %08x", second[0]);
+}
+
+int main()
+{
+  std::mt19937 rng(12345);
+
+  testPush(rng);
+  testKernels(rng);
+  testPushSpan(rng);
+  testFlushAndContinue(rng);
+  testPreservesTail();
+  testSetData();
+
+  if(s_failures != 0)
+  {
+    std::printf("test_bit_packer: %d failure(s)\n", s_failures);
+    return 1;
+  }
+  std::printf("test_bit_packer: passed\n");
+  return 0;
+}
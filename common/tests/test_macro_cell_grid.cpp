@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+//--------------------------------------------------------------------------------------------------
+// MacroCellGrid of texture_3d against brute force on a small synthetic volume, for the three edge
+// modes: the range of each cell is the min/max of its voxels and one around them, every filtered
+// sample of a cell is within its range, widen() and countEmpty(), and rayMarch() skipping the empty
+// cells finds the same hits as a march taking every step.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "macro_cell_grid.hpp"
+
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if(!(cond))                                                                                                        \
+    {                                                                                                                  \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);                                                               \
+      std::printf(__VA_ARGS__);                                                                                        \
+      std::printf("\n");                                                                                               \
+      s_failures++;                                                                                                    \
+    }                                                                                                                  \
+  } while(false)
+
+constexpr uint32_t kSize      = 20;  // Not a multiple of the cell size: the last cells are partial
+constexpr uint32_t kCellSize  = 6;
+constexpr float    kThreshold = 0.5F;
+
+static const char* edgeName(MacroCellGrid::Edge edge)
+{
+  return edge == MacroCellGrid::Edge::eClamp ? "clamp" : edge == MacroCellGrid::Edge::eRepeat ? "repeat" : "border";
+}
+
+// Low noise everywhere, and two blobs above the threshold, one of them touching the border
+static std::vector<float> createVolume(std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> noise(0.0F, 0.2F);
+  std::vector<float>                    volume(kSize * kSize * kSize);
+  for(uint32_t z = 0; z < kSize; z++)
+  {
+    for(uint32_t y = 0; y < kSize; y++)
+    {
+      for(uint32_t x = 0; x < kSize; x++)
+      {
+        const float d1 = std::hypot(x - 6.0F, y - 13.0F, z - 7.0F);
+        const float d2 = std::hypot(x - 19.0F, y - 3.0F, z - 15.0F);
+        const float v  = std::max(1.0F - d1 / 4.0F, 0.9F - d2 / 3.0F);
+        volume[(z * kSize + y) * kSize + x] = std::max(v, 0.0F) + noise(rng);
+      }
+    }
+  }
+  return volume;
+}
+
+// Voxel with the addressing mode of the sampler, written independently of the grid
+static float fetch(const std::vector<float>& volume, MacroCellGrid::Edge edge, int x, int y, int z)
+{
+  const int s   = static_cast<int>(kSize);
+  auto      map = [&](int i) {
+    if(edge == MacroCellGrid::Edge::eRepeat)
+      return ((i % s) + s) % s;
+    if(edge == MacroCellGrid::Edge::eBorder)
+      return (i < 0 || i >= s) ? -1 : i;
+    return std::clamp(i, 0, s - 1);
+  };
+  x = map(x);
+  y = map(y);
+  z = map(z);
+  if(x < 0 || y < 0 || z < 0)
+    return 0.0F;
+  return volume[(static_cast<size_t>(z) * s + y) * s + x];
+}
+
+// Trilinear filtering at p in [0,1]^3, texel centers at (i + 0.5) / size
+static float sampleLinear(const std::vector<float>& volume, MacroCellGrid::Edge edge, const nvmath::vec3f& p)
+{
+  const float q[3] = {p.x * kSize - 0.5F, p.y * kSize - 0.5F, p.z * kSize - 0.5F};
+  const int   b[3] = {static_cast<int>(std::floor(q[0])), static_cast<int>(std::floor(q[1])), static_cast<int>(std::floor(q[2]))};
+  float       value = 0.0F;
+  for(int corner = 0; corner < 8; corner++)
+  {
+    float w = 1.0F;
+    for(int a = 0; a < 3; a++)
+    {
+      const float f = q[a] - b[a];
+      w *= (corner >> a) & 1 ? f : 1.0F - f;
+    }
+    value += w * fetch(volume, edge, b[0] + (corner & 1), b[1] + ((corner >> 1) & 1), b[2] + ((corner >> 2) & 1));
+  }
+  return value;
+}
+
+// Min/max of the voxels of each cell and one around them, not further than the border
+static void testBuild(const std::vector<float>& volume, MacroCellGrid::Edge edge, const MacroCellGrid& grid)
+{
+  const uint32_t n = MacroCellGrid::cellsPerAxis(kSize, kCellSize);
+  CHECK(grid.getCellsPerAxis() == n && grid.getNumCells() == n * n * n, "%s: %u cells per axis, expected %u", edgeName(edge),
+        grid.getCellsPerAxis(), n);
+  if(grid.getCellsPerAxis() != n)
+    return;
+
+  const int s = static_cast<int>(kSize);
+  const int c = static_cast<int>(kCellSize);
+  for(uint32_t cz = 0; cz < n; cz++)
+  {
+    for(uint32_t cy = 0; cy < n; cy++)
+    {
+      for(uint32_t cx = 0; cx < n; cx++)
+      {
+        const int ox = static_cast<int>(cx) * c;
+        const int oy = static_cast<int>(cy) * c;
+        const int oz = static_cast<int>(cz) * c;
+        float     lo = 1e30F;
+        float     hi = -1e30F;
+        for(int z = oz - 1; z <= std::min(oz + c, s); z++)
+        {
+          for(int y = oy - 1; y <= std::min(oy + c, s); y++)
+          {
+            for(int x = ox - 1; x <= std::min(ox + c, s); x++)
+            {
+              lo = std::min(lo, fetch(volume, edge, x, y, z));
+              hi = std::max(hi, fetch(volume, edge, x, y, z));
+            }
+          }
+        }
+        const nvmath::vec2f& range = grid.getRange(cx, cy, cz);
+        CHECK(range.x == lo && range.y == hi, "%s: cell (%u, %u, %u) is [%g, %g], expected [%g, %g]", edgeName(edge), cx, cy,
+              cz, range.x, range.y, lo, hi);
+      }
+    }
+  }
+}
+
+// The filtered samples taken in a cell, as the ray-marching locates them, are within its range
+static void testSamplesInRange(const std::vector<float>& volume, MacroCellGrid::Edge edge, const MacroCellGrid& grid, std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> uniform(0.0F, 1.0F);
+  const int                             n = static_cast<int>(grid.getCellsPerAxis());
+  for(int i = 0; i < 20000; i++)
+  {
+    const nvmath::vec3f p(uniform(rng), uniform(rng), uniform(rng));
+    int                 cell[3];
+    for(int a = 0; a < 3; a++)
+    {
+      const float q = std::clamp(p[a] * kSize - 0.5F, -0.5F, kSize - 0.5F);
+      cell[a]       = std::clamp(static_cast<int>(std::floor(q / kCellSize)), 0, n - 1);
+    }
+    const nvmath::vec2f& range = grid.getRange(cell[0], cell[1], cell[2]);
+    const float          v     = sampleLinear(volume, edge, p);
+    CHECK(v >= range.x - 1e-5F && v <= range.y + 1e-5F, "%s: sample %g at (%g, %g, %g) outside [%g, %g] of its cell",
+          edgeName(edge), v, p.x, p.y, p.z, range.x, range.y);
+  }
+}
+
+static void testWidenAndCount(const MacroCellGrid& grid)
+{
+  for(float threshold : {0.1F, 0.25F, kThreshold, 1.5F})
+  {
+    const auto expected = static_cast<uint32_t>(std::count_if(grid.getRanges().begin(), grid.getRanges().end(),
+                                                              [&](const nvmath::vec2f& r) { return r.y <= threshold; }));
+    CHECK(grid.countEmpty(threshold) == expected, "countEmpty(%g) is %u, expected %u", threshold, grid.countEmpty(threshold), expected);
+  }
+  CHECK(grid.countEmpty(kThreshold) > 0 && grid.countEmpty(kThreshold) < grid.getNumCells(),
+        "the volume must have empty and non-empty cells, %u of %u empty", grid.countEmpty(kThreshold), grid.getNumCells());
+
+  MacroCellGrid wide = grid;
+  wide.widen(0.125F);
+  for(size_t i = 0; i < grid.getRanges().size(); i++)
+  {
+    const nvmath::vec2f& a = grid.getRanges()[i];
+    const nvmath::vec2f& b = wide.getRanges()[i];
+    CHECK(b.x == a.x - 0.125F && b.y == a.y + 0.125F, "widen: cell %zu is [%g, %g], expected [%g, %g]", i, b.x, b.y,
+          a.x - 0.125F, a.y + 0.125F);
+  }
+  CHECK(wide.countEmpty(kThreshold) <= grid.countEmpty(kThreshold), "widen: more empty cells");
+}
+
+// Every step of raster.frag, without skipping
+static RayMarchResult bruteForceMarch(const std::vector<float>& volume, MacroCellGrid::Edge edge, const nvmath::vec3f& p1,
+                                      const nvmath::vec3f& p2, int numSteps)
+{
+  const nvmath::vec3f step_size((p2.x - p1.x) / numSteps, (p2.y - p1.y) / numSteps, (p2.z - p1.z) / numSteps);
+  auto point = [&](int i) { return nvmath::vec3f(p1.x + step_size.x * i, p1.y + step_size.y * i, p1.z + step_size.z * i); };
+
+  RayMarchResult result;
+  float          prev_value = sampleLinear(volume, edge, p1);
+  result.numSamples         = 1;
+  if(prev_value > kThreshold)
+  {
+    result.hit      = true;
+    result.hitPoint = p1;
+    return result;
+  }
+  for(int i = 1; i <= numSteps; i++)
+  {
+    const float value = sampleLinear(volume, edge, point(i));
+    result.numSamples++;
+    if(value > kThreshold && i < numSteps)
+    {
+      const nvmath::vec3f a = point(i - 1);
+      const nvmath::vec3f b = point(i);
+      const float         t = std::clamp((kThreshold - prev_value) / (value - prev_value), 0.0F, 1.0F);
+      result.hit            = true;
+      result.hitPoint       = nvmath::vec3f(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+      return result;
+    }
+    prev_value = value;
+  }
+  return result;
+}
+
+// Rays between two faces of the unit cube
+static void testRayMarch(const std::vector<float>& volume, MacroCellGrid::Edge edge, const MacroCellGrid& grid, std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> uniform(0.0F, 1.0F);
+  uint64_t                              brute_samples{0};
+  uint64_t                              skip_samples{0};
+  uint32_t                              hits{0};
+  for(int r = 0; r < 4000; r++)
+  {
+    nvmath::vec3f p1(uniform(rng), uniform(rng), uniform(rng));
+    nvmath::vec3f p2(uniform(rng), uniform(rng), uniform(rng));
+    p1[rng() % 3]       = static_cast<float>(rng() % 2);
+    p2[rng() % 3]       = static_cast<float>(rng() % 2);
+    const int num_steps = 20 + static_cast<int>(rng() % 200);
+
+    const RayMarchResult ref  = bruteForceMarch(volume, edge, p1, p2, num_steps);
+    const RayMarchResult full = rayMarch(volume.data(), kSize, edge, nullptr, p1, p2, num_steps, kThreshold);
+    const RayMarchResult skip = rayMarch(volume.data(), kSize, edge, &grid, p1, p2, num_steps, kThreshold);
+    brute_samples += ref.numSamples;
+    skip_samples += skip.numSamples;
+    hits += ref.hit ? 1 : 0;
+
+    for(const RayMarchResult* res : {&full, &skip})
+    {
+      const char* name = res == &full ? "without grid" : "with grid";
+      CHECK(res->hit == ref.hit, "%s: ray %d %s, hit %d, expected %d", edgeName(edge), r, name, res->hit, ref.hit);
+      if(res->hit && ref.hit)
+      {
+        const float d = std::max({std::abs(res->hitPoint.x - ref.hitPoint.x), std::abs(res->hitPoint.y - ref.hitPoint.y),
+                                  std::abs(res->hitPoint.z - ref.hitPoint.z)});
+        CHECK(d <= 1e-5F, "%s: ray %d %s, hit point off by %g", edgeName(edge), r, name, d);
+      }
+    }
+  }
+  CHECK(hits > 0, "%s: no ray hits the volume", edgeName(edge));
+  CHECK(skip_samples < brute_samples, "%s: %llu samples with the grid, %llu without", edgeName(edge),
+        static_cast<unsigned long long>(skip_samples), static_cast<unsigned long long>(brute_samples));
+}
+
+int main()
+{
+  std::mt19937             rng(4321);
+  const std::vector<float> volume = createVolume(rng);
+
+  for(MacroCellGrid::Edge edge : {MacroCellGrid::Edge::eClamp, MacroCellGrid::Edge::eRepeat, MacroCellGrid::Edge::eBorder})
+  {
+    MacroCellGrid grid;
+    grid.build(volume.data(), kSize, kCellSize, edge);
+
+    testBuild(volume, edge, grid);
+    testSamplesInRange(volume, edge, grid, rng);
+    testWidenAndCount(grid);
+    testRayMarch(volume, edge, grid, rng);
+  }
+
+  if(s_failures != 0)
+  {
+    std::printf("test_macro_cell_grid: %d failure(s)\n", s_failures);
+    return 1;
+  }
+  std::printf("test_macro_cell_grid: passed\n");
+  return 0;
+}
@@ -38,6 +38,7 @@
 #define IMGUI_DEFINE_MATH_OPERATORS
 
 #include "imgui/imgui_camera_widget.h"
+#include "mesh_optimizer.hpp"
 #include "nvh/primitives.hpp"
 #include "nvvk/commands_vk.hpp"
 #include "nvvk/debug_util_vk.hpp"
@@ -235,6 +236,7 @@ private:
     m_meshes.emplace_back(nvh::createOctahedron());
     m_meshes.emplace_back(nvh::createIcosahedron());
     m_meshes.emplace_back(nvh::createConeMesh());
+    meshopt::optimizeMeshes(m_meshes);  // Vertex cache and fetch, before the upload
     const int num_meshes = static_cast<int>(m_meshes.size());
 
     // Materials (colorful)
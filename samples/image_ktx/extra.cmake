@@ -1,3 +1,12 @@
+# Mesh optimization, shared with other samples
+set(COMMON_SRC
+	${SAMPLES_COMMON_DIR}/mesh_optimizer.cpp
+	${SAMPLES_COMMON_DIR}/mesh_optimizer.hpp
+	)
+target_sources(${PROJECT_NAME} PRIVATE ${COMMON_SRC})
+source_group(common FILES ${COMMON_SRC})
+
+
 # HLSL
 if(USE_HLSL) 
   compile_hlsl_file(
@@ -34,8 +34,9 @@ static const int BKtxTex       = 1;
 
 struct PushConstant
 {
-  mat4 transfo;
-  vec4 color;
+  mat4  transfo;
+  vec4  color;
+  float minLod;  // First mip level uploaded, the larger ones are still streaming
 };
 
 struct FrameInfo
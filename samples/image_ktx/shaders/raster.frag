@@ -67,6 +67,8 @@ void main()
 {
   vec3 toEye = frameInfo.camPos - inFragPos;
   vec3 color = simpleShading(toEye, inFragNrm) * pushC.color.xyz;
-  color *= texture(inTexture, inFragUv).xyz;
+  // Never sample the levels not uploaded yet
+  float lod = max(textureQueryLod(inTexture, inFragUv).x, pushC.minLod);
+  color *= textureLod(inTexture, inFragUv, lod).xyz;
   outColor = vec4(color, pushC.color.w);
 }
\ No newline at end of file
@@ -77,7 +77,9 @@ PSout fragmentMain(PSin stage)
 {
   float3 V = normalize(frameInfo.camPos - stage.position);
   float3 color = simpleShading(V, V, stage.normal);
-  color *= myTexture.Sample(mySampler, stage.uv).xyz;
+  // Never sample the levels not uploaded yet
+  float lod = max(myTexture.CalculateLevelOfDetail(mySampler, stage.uv), pushConst.minLod);
+  color *= myTexture.SampleLevel(mySampler, stage.uv, lod).xyz;
   
   PSout output;
   output.color = float4(color, pushConst.color.w);
@@ -37,6 +37,9 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include <array>
+#include <chrono>
+#include <filesystem>
+#include <thread>
 #include <vulkan/vulkan_core.h>
 
 #define VMA_IMPLEMENTATION
@@ -78,6 +81,9 @@ const auto& vert_shd = std::vector<uint32_t>{std::begin(raster_vert), std::end(r
 const auto& frag_shd = std::vector<uint32_t>{std::begin(raster_frag), std::end(raster_frag)};
 #endif  // USE_HLSL
 
+#include "ktx2_stream.hpp"
+#include "ktx2_transcode.hpp"
+#include "mesh_optimizer.hpp"
 #include "shaders/device_host.h"
 
 
@@ -87,30 +93,56 @@ static std::string g_img_file = R"(media/fruit.ktx2)";
 
 constexpr bool g_use_tm_compute = true;
 
+static bool isFormatSampled(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+  VkImageFormatProperties prop{};
+  return vkGetPhysicalDeviceImageFormatProperties(physicalDevice, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+                                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0, &prop)
+         == VK_SUCCESS;
+}
+
 // Texture wrapper class which load an KTX image
 struct TextureKtx
 {
 
-  TextureKtx(nvvk::Context* c, nvvkhl::AllocVma* a, const std::string& filename)
+  TextureKtx(nvvk::Context* c, nvvkhl::AllocVma* a, const std::string& filename, RssTracker* rss = nullptr)
       : m_ctx(c)
       , m_alloc(a)
   {
-    nv_ktx::KTXImage           ktx_image;
-    const nv_ktx::ReadSettings ktx_read_settings;
-    nv_ktx::ErrorWithText      maybe_error = ktx_image.readFromFile(filename.c_str(), ktx_read_settings);
-    if(maybe_error.has_value())
+    nv_ktx::KTXImage ktx_image;
+    Ktx2File         ktx2;
+    if(std::filesystem::path(filename).extension() == ".ktx2" && ktx2.open(filename) && ktx2::needsTranscoding(ktx2))
+    {
+      // Supercompressed or Basis Universal: the levels are decoded on all cores, to BC7 when possible
+      const ktx2::Target target = isFormatSampled(c->m_physicalDevice, VK_FORMAT_BC7_UNORM_BLOCK) ? ktx2::Target::eBC7 :
+                                                                                                      ktx2::Target::eRGBA8;
+      ktx2::TranscodeStats stats;
+      if(!ktx2::transcode(ktx2, target, ktx_image, &stats))
+        return;
+      LOGI("Transcoded %s: %.2f ms inflating, %.2f ms transcoding, %u threads\n", filename.c_str(), stats.inflateMs,
+           stats.transcodeMs, stats.numThreads);
+    }
+    else
     {
-      LOGE("KTX Error: %s\n", maybe_error->c_str());
+      const nv_ktx::ReadSettings ktx_read_settings;
+      nv_ktx::ErrorWithText      maybe_error = ktx_image.readFromFile(filename.c_str(), ktx_read_settings);
+      if(maybe_error.has_value())
+      {
+        LOGE("KTX Error: %s\n", maybe_error->c_str());
+      }
     }
+    if(rss != nullptr)
+      rss->sample();
     m_dutil = std::make_unique<nvvk::DebugUtil>(c->m_device);  // Debug utility
 
     // Check if format is supported
-    VkImageFormatProperties prop{};
-    vkGetPhysicalDeviceImageFormatProperties(c->m_physicalDevice, ktx_image.format, VK_IMAGE_TYPE_2D,
-                                             VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, 0, &prop);
-    assert(prop.maxResourceSize != 0);
+    if(!isFormatSampled(c->m_physicalDevice, ktx_image.format))
+    {
+      LOGE("KTX format %d not supported by the device\n", ktx_image.format);
+      return;
+    }
 
-    create(ktx_image);
+    create(ktx_image, rss);
   }
 
   ~TextureKtx()
@@ -122,7 +154,7 @@ struct TextureKtx
   }
 
   // Create the image, the sampler and the image view + generate the mipmap level for all
-  void create(nv_ktx::KTXImage& ktximage)
+  void create(nv_ktx::KTXImage& ktximage, RssTracker* rss = nullptr)
   {
     const VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
     const VkFormat            format = ktximage.format;
@@ -170,7 +202,10 @@ struct TextureKtx
     m_dutil->DBG_NAME(m_texture.image);
     m_dutil->DBG_NAME(m_texture.descriptor.sampler);
 
+    if(rss != nullptr)
+      rss->sample();
     cpool.submitAndWait(cmd);
+    m_alloc->finalizeAndReleaseStaging();
   }
 
   [[nodiscard]] bool                         valid() const { return m_texture.image != VK_NULL_HANDLE; }
@@ -205,10 +240,9 @@ public:
 
     // Find image file
     const std::vector<std::string> default_search_paths = {".", "..", "../..", "../../.."};
-    const std::string              img_file             = nvh::findFile(g_img_file, default_search_paths, true);
-    assert(!img_file.empty());
-    m_texture = std::make_shared<TextureKtx>(m_app->getContext().get(), m_alloc.get(), img_file);
-    assert(m_texture->valid());
+    m_imgFile                                           = nvh::findFile(g_img_file, default_search_paths, true);
+    assert(!m_imgFile.empty());
+    loadTexture();
 
     createScene();
     createVkBuffers();
@@ -284,6 +318,31 @@ public:
       {
         m_tonemapper->onUI();
       }
+      if(ImGui::CollapsingHeader("Loading", ImGuiTreeNodeFlags_DefaultOpen))
+      {
+        ImGui::Checkbox("Memory-mapped streaming", &m_streaming);
+        ImGui::SliderInt("Budget per frame (KB)", &m_streamBudgetKb, 1, 4096);
+        if(ImGui::Button("Reload"))
+        {
+          vkDeviceWaitIdle(m_device);
+          loadTexture();
+          writeTextureDescriptor();
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Memory Report"))
+        {
+          reportLoadMemory();
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Transcode Report"))
+        {
+          reportTranscoding();
+        }
+        if(m_streamTexture)
+          ImGui::Text("Levels resident: %.0f to %u", m_streamTexture->minLod(), m_streamTexture->numLevels() - 1);
+        else
+          ImGui::Text("All levels loaded at once");
+      }
       ImGui::End();
     }
 
@@ -317,15 +376,151 @@ public:
     finfo.camPos              = CameraManip.getEye();
     vkCmdUpdateBuffer(cmd, m_frameInfo.buffer, 0, sizeof(FrameInfo), &finfo);
 
+    // Next levels of the texture, submitted before this frame
+    m_pushConst.minLod = 0.0F;
+    if(m_streamTexture)
+    {
+      m_streamTexture->update();
+      m_pushConst.minLod = m_streamTexture->minLod();
+    }
+
     renderScene(cmd);  // Render to GBuffer-1
     renderPost(cmd);   // Use GBuffer-1 and render to GBuffer-0
   }
 
 
 private:
+  // Streams the levels from the mapped file when possible, otherwise loads all levels at once
+  void loadTexture()
+  {
+    m_texture.reset();
+    m_streamTexture.reset();
+    if(m_streaming)
+    {
+      m_streamTexture = std::make_shared<Ktx2StreamTexture>(m_app->getContext().get(), m_alloc.get(), m_imgFile,
+                                                            VkDeviceSize(m_streamBudgetKb) << 10);
+      if(m_streamTexture->valid())
+        return;
+      LOGI("%s can't be streamed, loading all levels at once\n", m_imgFile.c_str());
+      m_streamTexture.reset();
+    }
+    m_texture = std::make_shared<TextureKtx>(m_app->getContext().get(), m_alloc.get(), m_imgFile);
+    assert(m_texture->valid());
+  }
+
+  const VkDescriptorImageInfo& textureDescriptor() const
+  {
+    return m_streamTexture ? m_streamTexture->descriptorImage() : m_texture->descriptorImage();
+  }
+
+  void writeTextureDescriptor()
+  {
+    const VkWriteDescriptorSet write = m_dset->makeWrite(0, BKtxTex, &textureDescriptor());
+    vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Loads the image with both paths and logs the largest growth of the resident memory of each: the
+  // whole file and all its levels in memory with TextureKtx, the pages of the level being copied when mapped.
+  //
+  void reportLoadMemory()
+  {
+    vkDeviceWaitIdle(m_device);
+    auto release_staging = [&]() {
+      m_alloc->finalizeAndReleaseStaging();
+      m_alloc->getStaging()->freeUnused();
+    };
+    auto ms_since = [](std::chrono::high_resolution_clock::time_point t0) {
+      return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    };
+    release_staging();
+
+    double ktx_ms  = 0.0;
+    size_t ktx_rss = 0;
+    {
+      RssTracker rss;
+      const auto t0 = std::chrono::high_resolution_clock::now();
+      TextureKtx texture(m_app->getContext().get(), m_alloc.get(), m_imgFile, &rss);
+      ktx_ms  = ms_since(t0);
+      ktx_rss = rss.peakDelta();
+    }
+    release_staging();
+
+    double stream_ms  = 0.0;
+    double first_ms   = 0.0;
+    size_t stream_rss = 0;
+    bool   streamed   = false;
+    {
+      RssTracker        rss;
+      const auto        t0 = std::chrono::high_resolution_clock::now();
+      Ktx2StreamTexture texture(m_app->getContext().get(), m_alloc.get(), m_imgFile, VkDeviceSize(m_streamBudgetKb) << 10);
+      streamed = texture.valid();
+      while(streamed && !texture.done())
+      {
+        texture.update(&rss);
+        texture.finish();  // As if a frame had passed
+        if(first_ms == 0.0)
+          first_ms = ms_since(t0);
+      }
+      stream_ms  = ms_since(t0);
+      stream_rss = rss.peakDelta();
+    }
+    release_staging();
+
+    LOGI("KTX loading: %s\n", m_imgFile.c_str());
+    LOGI(" - All levels      : peak RSS +%8.1f KB, %8.2f ms\n", ktx_rss / 1024.0, ktx_ms);
+    if(streamed)
+      LOGI(" - Memory-mapped    : peak RSS +%8.1f KB, %8.2f ms, first levels in %.2f ms (%d KB per frame)\n",
+           stream_rss / 1024.0, stream_ms, first_ms, m_streamBudgetKb);
+    else
+      LOGI(" - Memory-mapped    : not streamable\n");
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Decodes the levels of the image on one thread and on all, to each target, and logs the throughput
+  //
+  void reportTranscoding()
+  {
+    Ktx2File file;
+    if(!file.open(m_imgFile))
+      return;
+    if(!ktx2::needsTranscoding(file))
+    {
+      LOGI("%s: nothing to transcode, no supercompression or one read by nv_ktx\n", m_imgFile.c_str());
+      return;
+    }
+
+    uint64_t file_bytes = 0;
+    for(uint32_t mip = 0; mip < file.numLevels; mip++)
+      file_bytes += file.level(mip).byteLength;
+    LOGI("KTX2 transcoding: %s, %ux%u, %u levels, %.2f MB in the file\n", m_imgFile.c_str(), file.width, file.height,
+         file.numLevels, double(file_bytes) / (1024.0 * 1024.0));
+    LOGI("  %-7s %8s %12s %16s %12s %16s %10s\n", "Target", "Threads", "Inflate ms", "MB/s per core", "Transcode ms",
+         "MB/s per core", "Output MB");
+    const uint32_t num_threads[] = {1, std::thread::hardware_concurrency()};
+    // Only Basis Universal files have a choice of target, the others keep their format
+    const bool basis = ktx2::targetFormat(file, ktx2::Target::eBC7) != file.format;
+    for(ktx2::Target target : {ktx2::Target::eBC7, ktx2::Target::eRGBA8})
+    {
+      if(!basis && target != ktx2::Target::eBC7)
+        continue;
+      for(uint32_t threads : num_threads)
+      {
+        nv_ktx::KTXImage     image;
+        ktx2::TranscodeStats stats;
+        if(!ktx2::transcode(file, target, image, &stats, threads))
+          return;
+        const char* name = !basis ? "-" : target == ktx2::Target::eBC7 ? "BC7" : "RGBA8";
+        LOGI("  %-7s %8u %12.2f %16.1f %12.2f %16.1f %10.2f\n", name, threads, stats.inflateMs, stats.inflateMBpsPerCore(),
+             stats.transcodeMs, stats.transcodeMBpsPerCore(), double(stats.outputBytes) / (1024.0 * 1024.0));
+      }
+    }
+  }
+
   void createScene()
   {
     m_meshes.emplace_back(nvh::createSphereUv());
+    meshopt::optimizeMeshes(m_meshes);  // Vertex cache and fetch, before the upload
     m_materials.push_back({vec4(1)});
     nvh::Node& n = m_nodes.emplace_back();
     n.mesh       = 0;
@@ -410,7 +605,7 @@ private:
     const VkDescriptorBufferInfo      dbi_unif{m_frameInfo.buffer, 0, VK_WHOLE_SIZE};
     std::vector<VkWriteDescriptorSet> writes;
     writes.emplace_back(m_dset->makeWrite(0, 0, &dbi_unif));
-    writes.emplace_back(m_dset->makeWrite(0, BKtxTex, &m_texture->descriptorImage()));
+    writes.emplace_back(m_dset->makeWrite(0, BKtxTex, &textureDescriptor()));
     vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 
     const VkPushConstantRange push_constant_ranges = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
@@ -483,6 +678,7 @@ private:
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
 
     m_texture.reset();
+    m_streamTexture.reset();
 
     for(PrimitiveMeshVk& m : m_meshVk)
     {
@@ -531,8 +727,12 @@ private:
   std::vector<nvh::Node>                         m_nodes;
   std::vector<Material>                          m_materials;
   std::shared_ptr<TextureKtx>                    m_texture;
-  std::unique_ptr<nvvk::DescriptorSetContainer>  m_dset;  // Descriptor set
+  std::shared_ptr<Ktx2StreamTexture>             m_streamTexture;  // Instead of m_texture when streaming
+  std::unique_ptr<nvvk::DescriptorSetContainer>  m_dset;           // Descriptor set
   std::unique_ptr<nvvkhl::TonemapperPostProcess> m_tonemapper;
+  std::string                                    m_imgFile;
+  bool                                           m_streaming{true};
+  int                                            m_streamBudgetKb{256};
 
 
   // Pipeline
@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef NVP_SUPPORTS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "ktx2_stream.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvvk/error_vk.hpp"
+#include "nvvk/images_vk.hpp"
+#include "nvvkhl/application.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// MappedFile
+//
+bool MappedFile::open(const std::string& filename)
+{
+  close();
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+  m_file = file;
+
+  LARGE_INTEGER size{};
+  if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+  {
+    close();
+    return false;
+  }
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if(m_mapping == nullptr)
+  {
+    close();
+    return false;
+  }
+  m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  m_size = static_cast<size_t>(size.QuadPart);
+#else
+  m_fd = ::open(filename.c_str(), O_RDONLY);
+  if(m_fd < 0)
+    return false;
+
+  struct stat st = {};
+  if(fstat(m_fd, &st) != 0 || st.st_size == 0)
+  {
+    close();
+    return false;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+  m_data     = data != MAP_FAILED ? static_cast<const uint8_t*>(data) : nullptr;
+  m_size     = static_cast<size_t>(st.st_size);
+#endif
+  if(m_data == nullptr)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+  if(m_data != nullptr)
+    UnmapViewOfFile(m_data);
+  if(m_mapping != nullptr)
+    CloseHandle(m_mapping);
+  if(m_file != nullptr)
+    CloseHandle(m_file);
+  m_mapping = nullptr;
+  m_file    = nullptr;
+#else
+  if(m_data != nullptr)
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+  if(m_fd >= 0)
+    ::close(m_fd);
+  m_fd = -1;
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+void MappedFile::release(size_t offset, size_t size)
+{
+  if(m_data == nullptr || offset >= m_size)
+    return;
+
+  // Only the pages entirely in the range
+#ifdef _WIN32
+  SYSTEM_INFO info{};
+  GetSystemInfo(&info);
+  const size_t page = info.dwPageSize;
+#else
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+  const size_t begin = (offset + page - 1) / page * page;
+  const size_t end   = std::min(offset + size, m_size) / page * page;
+  if(end <= begin)
+    return;
+
+  void* ptr = const_cast<uint8_t*>(m_data + begin);
+#ifdef _WIN32
+  VirtualUnlock(ptr, end - begin);  // Pages not locked are removed from the working set
+#else
+  madvise(ptr, end - begin, MADV_DONTNEED);
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Ktx2File
+//
+
+// Bytes and texels of a block of `format`, for the formats a KTX2 file can hold without being
+// transcoded: 8 to 128-bit uncompressed color, BC, ETC2/EAC and ASTC LDR. False for the others.
+static bool getTexelBlock(VkFormat format, uint32_t& bytes, uint32_t& blockWidth, uint32_t& blockHeight)
+{
+  struct Range
+  {
+    VkFormat first;
+    VkFormat last;
+    uint32_t bytes;
+  };
+  static const Range uncompressed[] = {
+      {VK_FORMAT_R4G4_UNORM_PACK8, VK_FORMAT_R4G4_UNORM_PACK8, 1},
+      {VK_FORMAT_R4G4B4A4_UNORM_PACK16, VK_FORMAT_A1R5G5B5_UNORM_PACK16, 2},
+      {VK_FORMAT_R8_UNORM, VK_FORMAT_R8_SRGB, 1},
+      {VK_FORMAT_R8G8_UNORM, VK_FORMAT_R8G8_SRGB, 2},
+      {VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_B8G8R8_SRGB, 3},
+      {VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_A2B10G10R10_SINT_PACK32, 4},
+      {VK_FORMAT_R16_UNORM, VK_FORMAT_R16_SFLOAT, 2},
+      {VK_FORMAT_R16G16_UNORM, VK_FORMAT_R16G16_SFLOAT, 4},
+      {VK_FORMAT_R16G16B16_UNORM, VK_FORMAT_R16G16B16_SFLOAT, 6},
+      {VK_FORMAT_R16G16B16A16_UNORM, VK_FORMAT_R16G16B16A16_SFLOAT, 8},
+      {VK_FORMAT_R32_UINT, VK_FORMAT_R32_SFLOAT, 4},
+      {VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32_SFLOAT, 8},
+      {VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32_SFLOAT, 12},
+      {VK_FORMAT_R32G32B32A32_UINT, VK_FORMAT_R32G32B32A32_SFLOAT, 16},
+      {VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, 4},
+  };
+  static const Range block4x4[] = {
+      {VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 8},
+      {VK_FORMAT_BC2_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, 16},
+      {VK_FORMAT_BC4_UNORM_BLOCK, VK_FORMAT_BC4_SNORM_BLOCK, 8},
+      {VK_FORMAT_BC5_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK, 16},
+      {VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK, 8},
+      {VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, 16},
+      {VK_FORMAT_EAC_R11_UNORM_BLOCK, VK_FORMAT_EAC_R11_SNORM_BLOCK, 8},
+      {VK_FORMAT_EAC_R11G11_UNORM_BLOCK, VK_FORMAT_EAC_R11G11_SNORM_BLOCK, 16},
+  };
+  // ASTC: UNORM and SRGB of each footprint, 16 bytes
+  static const uint32_t astc[][2] = {{4, 4},  {5, 4},  {5, 5},  {6, 5},   {6, 6},   {8, 5},   {8, 6},
+                                     {8, 8},  {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}};
+
+  for(const Range& r : uncompressed)
+  {
+    if(format >= r.first && format <= r.last)
+    {
+      bytes       = r.bytes;
+      blockWidth  = 1;
+      blockHeight = 1;
+      return true;
+    }
+  }
+  for(const Range& r : block4x4)
+  {
+    if(format >= r.first && format <= r.last)
+    {
+      bytes       = r.bytes;
+      blockWidth  = 4;
+      blockHeight = 4;
+      return true;
+    }
+  }
+  if(format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+  {
+    const auto footprint = static_cast<uint32_t>(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+    bytes               = 16;
+    blockWidth          = astc[footprint][0];
+    blockHeight         = astc[footprint][1];
+    return true;
+  }
+  return false;
+}
+
+bool Ktx2File::open(const std::string& filename)
+{
+  static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+  static_assert(sizeof(Level) == 24, "Level must match the KTX2 level index");
+
+  if(!m_file.open(filename))
+  {
+    LOGE("Can't map %s\n", filename.c_str());
+    return false;
+  }
+
+  // Identifier, header (9 x uint32_t), index (4 x uint32_t, 2 x uint64_t), then the level index
+  const uint8_t* data = m_file.data();
+  if(m_file.size() < 80 || memcmp(data, identifier, sizeof(identifier)) != 0)
+  {
+    LOGE("%s is not a KTX2 file\n", filename.c_str());
+    return false;
+  }
+
+  uint32_t header[9];
+  memcpy(header, data + 12, sizeof(header));
+  format           = static_cast<VkFormat>(header[0]);
+  width            = header[2];
+  height           = header[3];
+  depth            = header[4];
+  numLayers        = header[5];
+  numFaces         = header[6];
+  numLevels        = std::max(header[7], 1U);  // 0: the mipmaps are to be generated
+  supercompression = header[8];
+
+  // Basic descriptor block of the DFD: total size, then 2 words before the color model
+  uint32_t dfd[2];
+  memcpy(dfd, data + 48, sizeof(dfd));
+  if(dfd[1] >= 16 && size_t(dfd[0]) + dfd[1] <= m_file.size())
+  {
+    colorModel       = data[dfd[0] + 12];
+    transferFunction = data[dfd[0] + 14];
+  }
+
+  if(80 + size_t(numLevels) * sizeof(Level) > m_file.size())
+  {
+    LOGE("%s: level index out of the file\n", filename.c_str());
+    return false;
+  }
+  m_levels.resize(numLevels);
+  memcpy(m_levels.data(), data + 80, numLevels * sizeof(Level));
+
+  // The sizes of a level are used to size the copies: the stored and inflated sizes must agree with
+  // the size of the level in the format, which the image copy reads
+  uint32_t block_bytes{0};
+  uint32_t block_width{1};
+  uint32_t block_height{1};
+  const bool known_format = getTexelBlock(format, block_bytes, block_width, block_height);
+  if(format != VK_FORMAT_UNDEFINED && !known_format)
+  {
+    LOGE("%s: format %d not supported\n", filename.c_str(), format);
+    return false;
+  }
+  // UASTC (of undefined format) is read by the transcoder as 4x4 blocks of 16 bytes
+  const bool uastc = colorModel == eModelUASTC;
+  if(uastc)
+  {
+    block_bytes  = 16;
+    block_width  = 4;
+    block_height = 4;
+  }
+
+  for(uint32_t mip = 0; mip < numLevels; mip++)
+  {
+    const Level& level = m_levels[mip];
+    if(level.byteOffset > m_file.size() || level.byteLength > m_file.size() - level.byteOffset)
+    {
+      LOGE("%s: level %u out of the file\n", filename.c_str(), mip);
+      return false;
+    }
+    if(supercompression == eNone && level.uncompressedByteLength != level.byteLength)
+    {
+      LOGE("%s: level %u of %llu bytes, %llu uncompressed\n", filename.c_str(), mip,
+           static_cast<unsigned long long>(level.byteLength), static_cast<unsigned long long>(level.uncompressedByteLength));
+      return false;
+    }
+    if(known_format || uastc)
+    {
+      const VkExtent2D extent   = mipExtent(mip);
+      const uint64_t   blocks_x = (extent.width + block_width - 1) / block_width;
+      const uint64_t   blocks_y = (extent.height + block_height - 1) / block_height;
+      const uint64_t   images   = uint64_t(std::max(1U, depth >> mip)) * std::max(1U, numLayers) * std::max(1U, numFaces);
+      const uint64_t   bytes    = blocks_x * blocks_y * block_bytes * images;
+      if(level.uncompressedByteLength != bytes)
+      {
+        LOGE("%s: level %u of %llu bytes, expected %llu for its format and extent\n", filename.c_str(), mip,
+             static_cast<unsigned long long>(level.uncompressedByteLength), static_cast<unsigned long long>(bytes));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool Ktx2File::streamable() const
+{
+  bool supported = supercompression == eNone;
+#ifdef NVP_SUPPORTS_ZSTD
+  supported = supported || supercompression == eZstd;
+#endif
+  return supported && format != VK_FORMAT_UNDEFINED && depth <= 1 && numLayers <= 1 && numFaces == 1;
+}
+
+VkExtent2D Ktx2File::mipExtent(uint32_t mip) const
+{
+  return {std::max(1U, width >> mip), std::max(1U, height >> mip)};
+}
+
+bool Ktx2File::readLevel(uint32_t mip, void* dst) const
+{
+  const Level& level = m_levels[mip];
+  if(supercompression == eNone)
+  {
+    memcpy(dst, levelData(mip), level.byteLength);
+    return true;
+  }
+#ifdef NVP_SUPPORTS_ZSTD
+  if(supercompression == eZstd)
+  {
+    const size_t result = ZSTD_decompress(dst, level.uncompressedByteLength, levelData(mip), level.byteLength);
+    if(ZSTD_isError(result) || result != level.uncompressedByteLength)
+    {
+      LOGE("KTX2 level %u: %s\n", mip, ZSTD_isError(result) ? ZSTD_getErrorName(result) : "wrong size");
+      return false;
+    }
+    return true;
+  }
+#endif
+  return false;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// RssTracker
+//
+size_t RssTracker::current()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return counters.WorkingSetSize;
+  return 0;
+#else
+  // Second field of statm: resident pages
+  size_t pages = 0;
+  FILE*  file  = fopen("/proc/self/statm", "r");
+  if(file != nullptr)
+  {
+    if(fscanf(file, "%*s %zu", &pages) != 1)
+      pages = 0;
+    fclose(file);
+  }
+  return pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Ktx2StreamTexture
+//
+static void levelBarrier(VkCommandBuffer      cmd,
+                         VkImage              image,
+                         uint32_t             baseLevel,
+                         uint32_t             levelCount,
+                         VkImageLayout        oldLayout,
+                         VkImageLayout        newLayout,
+                         VkPipelineStageFlags srcStage,
+                         VkAccessFlags        srcAccess,
+                         VkPipelineStageFlags dstStage,
+                         VkAccessFlags        dstAccess)
+{
+  VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.srcAccessMask       = srcAccess;
+  barrier.dstAccessMask       = dstAccess;
+  barrier.oldLayout           = oldLayout;
+  barrier.newLayout           = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image               = image;
+  barrier.subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1};
+  vkCmdPipelineBarrier(cmd, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+Ktx2StreamTexture::Ktx2StreamTexture(nvvk::Context* ctx, nvvkhl::AllocVma* alloc, const std::string& filename, VkDeviceSize frameBudget)
+    : m_ctx(ctx)
+    , m_alloc(alloc)
+    , m_device(ctx->m_device)
+    , m_frameBudget(frameBudget)
+{
+  if(!m_ktx.open(filename) || !m_ktx.streamable())
+    return;
+
+  VkImageFormatProperties prop{};
+  if(vkGetPhysicalDeviceImageFormatProperties(ctx->m_physicalDevice, m_ktx.format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+                                              VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0, &prop)
+     != VK_SUCCESS)
+  {
+    LOGE("KTX2 format %d not supported\n", m_ktx.format);
+    return;
+  }
+
+  VkCommandPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_info.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_info.queueFamilyIndex = m_ctx->m_queueGCT.familyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_device, &pool_info, nullptr, &m_cmdPool));
+
+  // All levels are allocated, none is written
+  VkImageCreateInfo img_info = nvvk::makeImage2DCreateInfo(size(), m_ktx.format, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+  img_info.mipLevels         = m_ktx.numLevels;
+  const nvvk::Image image    = m_alloc->createImage(img_info);
+
+  const VkSamplerCreateInfo   sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  const VkImageViewCreateInfo iv_info = nvvk::makeImageViewCreateInfo(image.image, img_info);
+  m_texture                           = m_alloc->createTexture(image, iv_info, sampler_info);
+  m_residentLevel                     = m_ktx.numLevels;
+}
+
+Ktx2StreamTexture::~Ktx2StreamTexture()
+{
+  retireBatches(true);
+  if(m_cmdPool != VK_NULL_HANDLE)
+    vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+  if(!valid())
+    return;
+
+  // Destroying in next frame, avoid deleting while using
+  nvvkhl::Application::submitResourceFree([tex = m_texture, a = m_alloc]() {
+    auto t = tex;
+    a->destroy(t);
+  });
+}
+
+//--------------------------------------------------------------------------------------------------
+// Uploads the levels following the last one resident, towards level 0, as many as the budget allows
+// but at least one. The copies are submitted on the queue of the frames, before the frame using them:
+// the barriers order them after the frames sampling the image and before the next one.
+//
+bool Ktx2StreamTexture::update(RssTracker* rss)
+{
+  retireBatches(false);
+  if(!valid() || done())
+    return false;
+
+  const uint32_t last  = m_residentLevel - 1;
+  uint32_t       first = last;
+  VkDeviceSize   bytes = m_ktx.level(last).uncompressedByteLength;
+  while(first > 0 && bytes + m_ktx.level(first - 1).uncompressedByteLength <= m_frameBudget)
+  {
+    first--;
+    bytes += m_ktx.level(first).uncompressedByteLength;
+  }
+
+  Batch                       batch;
+  VkCommandBufferAllocateInfo alloc_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  alloc_info.commandPool        = m_cmdPool;
+  alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = 1;
+  NVVK_CHECK(vkAllocateCommandBuffers(m_device, &alloc_info, &batch.cmd));
+  VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+  NVVK_CHECK(vkCreateFence(m_device, &fence_info, nullptr, &batch.fence));
+
+  VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  NVVK_CHECK(vkBeginCommandBuffer(batch.cmd, &begin_info));
+
+  // The first batch transitions all levels: the view is then in a valid layout from the first frame,
+  // the levels not written yet being excluded by the LOD clamp.
+  const bool     first_batch = m_residentLevel == m_ktx.numLevels;
+  const uint32_t base        = first_batch ? 0 : first;
+  const uint32_t count       = first_batch ? m_ktx.numLevels : last - first + 1;
+  const VkImage  image       = m_texture.image;
+  levelBarrier(batch.cmd, image, base, count, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+  nvvk::StagingMemoryManager* staging = m_alloc->getStaging();
+  for(uint32_t mip = last + 1; mip-- > first;)
+  {
+    const Ktx2File::Level&   level  = m_ktx.level(mip);
+    const VkExtent2D         extent = m_ktx.mipExtent(mip);
+    VkImageSubresourceLayers subresource{};
+    subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource.mipLevel   = mip;
+    subresource.layerCount = 1;
+
+    // The level goes from the mapping to the staging memory, no copy in between
+    void* dst = staging->cmdToImage(batch.cmd, image, {0, 0, 0}, {extent.width, extent.height, 1}, subresource,
+                                    level.uncompressedByteLength, nullptr);
+    if(!m_ktx.readLevel(mip, dst))
+      memset(dst, 0, level.uncompressedByteLength);
+
+    if(rss != nullptr)
+      rss->sample();
+    m_ktx.file().release(level.byteOffset, level.byteLength);
+  }
+
+  levelBarrier(batch.cmd, image, base, count, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+               VK_ACCESS_SHADER_READ_BIT);
+  NVVK_CHECK(vkEndCommandBuffer(batch.cmd));
+
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers    = &batch.cmd;
+  NVVK_CHECK(vkQueueSubmit(m_ctx->m_queueGCT.queue, 1, &submit_info, batch.fence));
+  m_alloc->finalizeStaging(batch.fence);
+  m_batches.push_back(batch);
+
+  m_residentLevel = first;
+  if(done())
+    m_ktx.file().close();  // Everything is in the staging memory
+  return true;
+}
+
+void Ktx2StreamTexture::finish()
+{
+  retireBatches(true);
+}
+
+void Ktx2StreamTexture::retireBatches(bool wait)
+{
+  size_t num_done = 0;
+  for(const Batch& batch : m_batches)
+  {
+    if(wait)
+      NVVK_CHECK(vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX));
+    else if(vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS)
+      break;
+    num_done++;
+  }
+  if(num_done == 0)
+    return;
+
+  // The staging memory is released on the status of the fences, before they are destroyed
+  m_alloc->releaseStaging();
+  for(size_t i = 0; i < num_done; i++)
+  {
+    vkFreeCommandBuffers(m_device, m_cmdPool, 1, &m_batches.front().cmd);
+    vkDestroyFence(m_device, m_batches.front().fence, nullptr);
+    m_batches.pop_front();
+  }
+}
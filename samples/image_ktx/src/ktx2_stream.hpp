@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "nvvk/context_vk.hpp"
+#include "nvvkhl/alloc_vma.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Read-only mapping of a whole file
+//
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile() { close(); }
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const std::string& filename);
+  void close();
+
+  // Lets the OS drop the pages of a range already consumed, they are read again from the file if needed
+  void release(size_t offset, size_t size);
+
+  [[nodiscard]] const uint8_t* data() const { return m_data; }
+  [[nodiscard]] size_t         size() const { return m_size; }
+
+private:
+  const uint8_t* m_data{nullptr};
+  size_t         m_size{0};
+#ifdef _WIN32
+  void* m_file{nullptr};
+  void* m_mapping{nullptr};
+#else
+  int m_fd{-1};
+#endif
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// KTX2 file, the header and the level index are read in place from the mapping
+// See https://github.khronos.org/KTX-Specification
+//
+class Ktx2File
+{
+public:
+  enum Supercompression : uint32_t
+  {
+    eNone    = 0,
+    eBasisLZ = 1,
+    eZstd    = 2,
+    eZlib    = 3,
+  };
+
+  // From the data format descriptor
+  enum ColorModel : uint32_t
+  {
+    eModelETC1S = 163,
+    eModelUASTC = 166,
+  };
+  enum TransferFunction : uint32_t
+  {
+    eTransferLinear = 1,
+    eTransferSRGB   = 2,
+  };
+
+  struct Level
+  {
+    uint64_t byteOffset{0};
+    uint64_t byteLength{0};
+    uint64_t uncompressedByteLength{0};
+  };
+
+  // Maps the file and reads the header and the level index. Fails when a level is out of the file, or
+  // when its stored, uncompressed and format sizes disagree (the format must be known, or undefined).
+  // UASTC levels, of undefined format, are checked as 4x4 blocks of 16 bytes.
+  bool open(const std::string& filename);
+
+  // 2D, one layer, one face, in a Vulkan format, without or with Zstd supercompression
+  [[nodiscard]] bool streamable() const;
+
+  [[nodiscard]] VkExtent2D     mipExtent(uint32_t mip) const;
+  [[nodiscard]] const Level&   level(uint32_t mip) const { return m_levels[mip]; }
+  [[nodiscard]] const uint8_t* levelData(uint32_t mip) const { return m_file.data() + m_levels[mip].byteOffset; }
+  // Copies the level to `dst`, of level(mip).uncompressedByteLength bytes, inflating it if needed
+  bool readLevel(uint32_t mip, void* dst) const;
+
+  MappedFile& file() { return m_file; }
+
+  VkFormat format{VK_FORMAT_UNDEFINED};
+  uint32_t width{0};
+  uint32_t height{0};
+  uint32_t depth{0};
+  uint32_t numLayers{0};
+  uint32_t numFaces{0};
+  uint32_t numLevels{0};
+  uint32_t supercompression{eNone};
+  uint32_t colorModel{0};
+  uint32_t transferFunction{eTransferLinear};
+
+private:
+  MappedFile         m_file;
+  std::vector<Level> m_levels;  // 24 bytes per level, copied out of the index for alignment
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// Resident set size of the process, to compare the memory of the loading paths
+//
+struct RssTracker
+{
+  static size_t current();  // Bytes
+
+  RssTracker() { base = peak = current(); }
+  void   sample() { peak = std::max(peak, current()); }
+  size_t peakDelta() const { return peak - base; }
+
+  size_t base{0};
+  size_t peak{0};
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// Texture uploaded from a memory-mapped KTX2 file, from the smallest mip to the largest
+//
+// The image is created with all its levels, and update() submits the next levels, within a byte
+// budget per call, without waiting. It must be called once before the image is sampled, which uploads
+// the smallest levels and puts the image in a valid layout. Each level is copied (or inflated) straight from the mapping into
+// the staging memory; no part of the file is read into a buffer of its own. The levels not uploaded
+// yet must not be sampled: minLod() is the first one resident, the shader clamps the LOD to it.
+//
+class Ktx2StreamTexture
+{
+public:
+  Ktx2StreamTexture(nvvk::Context* ctx, nvvkhl::AllocVma* alloc, const std::string& filename, VkDeviceSize frameBudget = 256 << 10);
+  ~Ktx2StreamTexture();
+
+  // Main thread, once per frame: submits the next levels, returns true when new levels are visible
+  bool update(RssTracker* rss = nullptr);
+  // Waits for the copies in flight and releases their staging memory
+  void finish();
+
+  [[nodiscard]] bool                         valid() const { return m_texture.image != VK_NULL_HANDLE; }
+  [[nodiscard]] bool                         done() const { return m_residentLevel == 0; }
+  [[nodiscard]] float                        minLod() const { return static_cast<float>(m_residentLevel); }
+  [[nodiscard]] uint32_t                     numLevels() const { return m_ktx.numLevels; }
+  [[nodiscard]] VkExtent2D                   size() const { return {m_ktx.width, m_ktx.height}; }
+  [[nodiscard]] const VkDescriptorImageInfo& descriptorImage() const { return m_texture.descriptor; }
+
+private:
+  struct Batch
+  {
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+    VkFence         fence{VK_NULL_HANDLE};
+  };
+
+  void retireBatches(bool wait);
+
+  nvvk::Context*    m_ctx{nullptr};
+  nvvkhl::AllocVma* m_alloc{nullptr};
+  VkDevice          m_device{VK_NULL_HANDLE};
+  VkDeviceSize      m_frameBudget{0};
+
+  Ktx2File          m_ktx;
+  nvvk::Texture     m_texture;
+  VkCommandPool     m_cmdPool{VK_NULL_HANDLE};
+  std::deque<Batch> m_batches;           // Submitted, oldest first
+  uint32_t          m_residentLevel{0};  // First level uploaded, numLevels when none
+};
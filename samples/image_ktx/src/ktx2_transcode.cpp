@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef NVP_SUPPORTS_BASISU
+#include <basisu_transcoder.h>
+#endif
+
+#include "ktx2_transcode.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
+
+namespace ktx2 {
+
+static constexpr uint32_t kBlockRowsPerTask = 16;  // Of 4x4 blocks
+
+static double msSince(std::chrono::high_resolution_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+}
+
+static double mbPerSecond(uint64_t bytes, double ms, uint32_t numThreads)
+{
+  return ms > 0.0 ? double(bytes) / (1024.0 * 1024.0) / (ms / 1000.0) / std::max(numThreads, 1U) : 0.0;
+}
+
+double TranscodeStats::inflateMBpsPerCore() const
+{
+  return mbPerSecond(inflatedBytes, inflateMs, numThreads);
+}
+
+double TranscodeStats::transcodeMBpsPerCore() const
+{
+  return mbPerSecond(outputBytes, transcodeMs, numThreads);
+}
+
+static bool isBasis(const Ktx2File& file)
+{
+  return file.supercompression == Ktx2File::eBasisLZ || file.colorModel == Ktx2File::eModelETC1S
+         || file.colorModel == Ktx2File::eModelUASTC;
+}
+
+bool needsTranscoding(const Ktx2File& file)
+{
+  // Only the supercompressions readLevel() inflates, the others (Zlib) are left to nv_ktx
+  bool readable = file.supercompression == Ktx2File::eNone || file.supercompression == Ktx2File::eBasisLZ;
+#ifdef NVP_SUPPORTS_ZSTD
+  readable = readable || file.supercompression == Ktx2File::eZstd;
+#endif
+  return readable && (file.supercompression != Ktx2File::eNone || isBasis(file));
+}
+
+VkFormat targetFormat(const Ktx2File& file, Target target)
+{
+  if(!isBasis(file))
+    return file.format;
+  const bool srgb = file.transferFunction == Ktx2File::eTransferSRGB;
+  if(target == Target::eBC7)
+    return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+  return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+static uint64_t levelSize(VkExtent2D extent, Target target)
+{
+  if(target == Target::eBC7)
+    return uint64_t((extent.width + 3) / 4) * ((extent.height + 3) / 4) * 16;
+  return uint64_t(extent.width) * extent.height * 4;
+}
+
+#ifdef NVP_SUPPORTS_BASISU
+static void initBasis()
+{
+  static std::once_flag once;
+  std::call_once(once, []() { basist::basisu_transcoder_init(); });
+}
+
+//--------------------------------------------------------------------------------------------------
+// UASTC blocks of the rows [rowBegin, rowEnd) to BC7 blocks or RGBA8 pixels
+//
+static bool transcodeUastcRows(const uint8_t* src, VkExtent2D extent, Target target, uint32_t rowBegin, uint32_t rowEnd, uint8_t* dst)
+{
+  const uint32_t blocks_x = (extent.width + 3) / 4;
+  bool           ok       = true;
+  for(uint32_t by = rowBegin; by < rowEnd; by++)
+  {
+    for(uint32_t bx = 0; bx < blocks_x; bx++)
+    {
+      const size_t        index = size_t(by) * blocks_x + bx;
+      basist::uastc_block block;
+      memcpy(&block, src + index * 16, 16);
+
+      if(target == Target::eBC7)
+      {
+        ok = basist::transcode_uastc_to_bc7(block, dst + index * 16) && ok;
+        continue;
+      }
+
+      basist::color32 pixels[16];
+      ok = basist::unpack_uastc(block, pixels, false) && ok;
+      for(uint32_t y = 0; y < 4 && by * 4 + y < extent.height; y++)
+      {
+        for(uint32_t x = 0; x < 4 && bx * 4 + x < extent.width; x++)
+        {
+          memcpy(dst + (size_t(by * 4 + y) * extent.width + bx * 4 + x) * 4, &pixels[y * 4 + x], 4);
+        }
+      }
+    }
+  }
+  return ok;
+}
+#endif
+
+bool transcode(Ktx2File& file, Target target, nv_ktx::KTXImage& image, TranscodeStats* stats, uint32_t numThreads)
+{
+  if(file.depth > 1 || file.numLayers > 1 || file.numFaces != 1)
+  {
+    LOGE("KTX2 transcoding: only 2D images of one layer\n");
+    return false;
+  }
+  const bool uastc = file.colorModel == Ktx2File::eModelUASTC;
+  const bool etc1s = !uastc && isBasis(file);
+#ifndef NVP_SUPPORTS_BASISU
+  if(uastc || etc1s)
+  {
+    LOGE("KTX2 transcoding: Basis Universal not supported in this build\n");
+    return false;
+  }
+#endif
+  if(!isBasis(file) && file.format == VK_FORMAT_UNDEFINED)
+  {
+    LOGE("KTX2 transcoding: unknown format\n");
+    return false;
+  }
+
+  if(numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  const uint32_t num_levels = file.numLevels;
+
+  if(image.allocate(num_levels, 1, 1).has_value())
+    return false;
+  image.mip_0_width  = file.width;
+  image.mip_0_height = file.height;
+  image.mip_0_depth  = 1;
+  image.format       = targetFormat(file, target);
+
+  TranscodeStats  local_stats;
+  TranscodeStats& st = stats != nullptr ? *stats : local_stats;
+  st                 = {};
+  st.numThreads      = numThreads;
+  for(uint32_t mip = 0; mip < num_levels; mip++)
+  {
+    st.fileBytes += file.level(mip).byteLength;
+    st.inflatedBytes += file.level(mip).uncompressedByteLength;
+  }
+
+  std::atomic<bool> ok{true};
+
+  //--------------------------------------------------------------------------------------------------
+  // Step 1, one level per task, the largest first. Without transcoding to follow, the levels are
+  // inflated directly in the image.
+  //
+  std::vector<std::vector<uint8_t>> inflated(uastc ? num_levels : 0);
+  auto                              t0 = std::chrono::high_resolution_clock::now();
+#ifdef NVP_SUPPORTS_BASISU
+  if(etc1s)
+  {
+    initBasis();
+    basist::ktx2_transcoder transcoder;
+    if(!transcoder.init(file.file().data(), static_cast<uint32_t>(file.file().size())) || !transcoder.start_transcoding())
+    {
+      LOGE("KTX2 transcoding: invalid ETC1S file\n");
+      return false;
+    }
+    // A transcoder state per level: they are transcoded in parallel
+    std::vector<basist::ktx2_transcoder_state> states(num_levels);
+    const basist::transcoder_texture_format format =
+        target == Target::eBC7 ? basist::transcoder_texture_format::cTFBC7_RGBA : basist::transcoder_texture_format::cTFRGBA32;
+    nvh::parallel_batches<1>(
+        num_levels,
+        [&](uint64_t i) {
+          const uint32_t     mip    = static_cast<uint32_t>(i);
+          const VkExtent2D   extent = file.mipExtent(mip);
+          std::vector<char>& dst    = image.subresource(mip);
+          dst.resize(levelSize(extent, target));
+          const uint32_t size = target == Target::eBC7 ? static_cast<uint32_t>(dst.size() / 16) : extent.width * extent.height;
+          if(!transcoder.transcode_image_level(mip, 0, 0, dst.data(), size, format, 0, 0, 0, -1, -1, &states[mip]))
+            ok = false;
+        },
+        std::min(numThreads, num_levels));
+    st.transcodeMs = msSince(t0);
+  }
+  else
+#endif
+  {
+    nvh::parallel_batches<1>(
+        num_levels,
+        [&](uint64_t i) {
+          const uint32_t mip = static_cast<uint32_t>(i);
+          if(uastc && file.supercompression == Ktx2File::eNone)
+            return;  // Transcoded straight from the mapping
+          const uint64_t size = file.level(mip).uncompressedByteLength;
+          void*          dst  = nullptr;
+          if(uastc)
+          {
+            inflated[mip].resize(size);
+            dst = inflated[mip].data();
+          }
+          else
+          {
+            image.subresource(mip).resize(size);
+            dst = image.subresource(mip).data();
+          }
+          if(!file.readLevel(mip, dst))
+            ok = false;
+        },
+        std::min(numThreads, num_levels));
+    st.inflateMs = msSince(t0);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Step 2, UASTC: ranges of block rows of all levels, so the large levels are spread on all threads
+  //
+#ifdef NVP_SUPPORTS_BASISU
+  if(uastc)
+  {
+    struct Task
+    {
+      uint32_t mip;
+      uint32_t rowBegin;
+      uint32_t rowEnd;
+    };
+    std::vector<Task> tasks;
+    for(uint32_t mip = 0; mip < num_levels; mip++)
+    {
+      const VkExtent2D extent   = file.mipExtent(mip);
+      const uint32_t   blocks_y = (extent.height + 3) / 4;
+      image.subresource(mip).resize(levelSize(extent, target));
+      for(uint32_t row = 0; row < blocks_y; row += kBlockRowsPerTask)
+        tasks.push_back({mip, row, std::min(row + kBlockRowsPerTask, blocks_y)});
+    }
+
+    initBasis();
+    t0 = std::chrono::high_resolution_clock::now();
+    nvh::parallel_batches<1>(
+        tasks.size(),
+        [&](uint64_t i) {
+          const Task&    task = tasks[i];
+          const uint8_t* src  = inflated[task.mip].empty() ? file.levelData(task.mip) : inflated[task.mip].data();
+          uint8_t*       dst  = reinterpret_cast<uint8_t*>(image.subresource(task.mip).data());
+          if(!transcodeUastcRows(src, file.mipExtent(task.mip), target, task.rowBegin, task.rowEnd, dst))
+            ok = false;
+        },
+        std::min(numThreads, static_cast<uint32_t>(tasks.size())));
+    st.transcodeMs = msSince(t0);
+  }
+#endif
+
+  for(uint32_t mip = 0; mip < num_levels; mip++)
+    st.outputBytes += image.subresource(mip).size();
+
+  if(!ok)
+    LOGE("KTX2 transcoding: some levels failed\n");
+  return ok;
+}
+
+}  // namespace ktx2
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <cstdint>
+#include <vulkan/vulkan_core.h>
+
+#include "fileformats/nv_ktx.h"
+#include "ktx2_stream.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Turns a supercompressed or Basis Universal KTX2 file into levels the device can sample, on all cores
+//
+// 1. Per level: Zstd is inflated, and ETC1S (BasisLZ) transcoded with the Basis Universal transcoder
+// 2. Per range of block rows: UASTC is transcoded to BC7, or unpacked to RGBA8
+//
+// The levels are returned in a nv_ktx::KTXImage, as if the file had been read by nv_ktx.
+//
+namespace ktx2 {
+
+enum class Target
+{
+  eBC7,    // When the device samples BC7
+  eRGBA8,  // Otherwise
+};
+
+struct TranscodeStats
+{
+  uint32_t numThreads{0};
+  uint64_t fileBytes{0};      // Levels in the file
+  uint64_t inflatedBytes{0};  // After Zstd, the input of the transcoding
+  uint64_t outputBytes{0};    // Levels to upload
+  double   inflateMs{0.0};    // Step 1
+  double   transcodeMs{0.0};  // Step 2
+
+  // Megabytes produced per second and per thread
+  double inflateMBpsPerCore() const;
+  double transcodeMBpsPerCore() const;
+};
+
+// Supercompressed (BasisLZ, or Zstd with NVP_SUPPORTS_ZSTD), or in a Basis Universal format. Zlib is
+// left to nv_ktx.
+bool needsTranscoding(const Ktx2File& file);
+// Format of the transcoded levels
+VkFormat targetFormat(const Ktx2File& file, Target target);
+// Returns false, and logs, when the file can't be transcoded. numThreads 0: all cores
+bool transcode(Ktx2File& file, Target target, nv_ktx::KTXImage& image, TranscodeStats* stats = nullptr, uint32_t numThreads = 0);
+
+}  // namespace ktx2
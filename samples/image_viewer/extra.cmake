@@ -1,3 +1,11 @@
+# Block compression shared with other samples
+set(COMMON_SRC
+	${SAMPLES_COMMON_DIR}/bc_encoder.cpp
+	${SAMPLES_COMMON_DIR}/bc_encoder.hpp
+	)
+target_sources(${PROJECT_NAME} PRIVATE ${COMMON_SRC})
+source_group(common FILES ${COMMON_SRC})
+
 
 # HLSL
 if(USE_HLSL) 
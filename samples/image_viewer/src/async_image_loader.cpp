@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "async_image_loader.hpp"
+#include "bc_encoder.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvvk/error_vk.hpp"
+#include "nvvk/images_vk.hpp"
+#include "stb_image.h"
+
+
+static double nowMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static constexpr VkFormat kFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+// Levels copied from the staging ring: all when compressed, otherwise the first, the others being generated
+static uint32_t numCopiedLevels(const AsyncImageLoader::Decoded& image)
+{
+  return image.levels.empty() ? 1 : static_cast<uint32_t>(image.levels.size());
+}
+
+// Rows of pixels, or rows of blocks when compressed
+static uint32_t numRows(const AsyncImageLoader::Decoded& image, uint32_t level)
+{
+  const uint32_t height = std::max(image.height >> level, 1U);
+  return image.levels.empty() ? height : (height + 3) / 4;
+}
+
+static VkDeviceSize rowBytes(const AsyncImageLoader::Decoded& image, uint32_t level)
+{
+  return image.levels.empty() ? VkDeviceSize(image.width) * 4 : image.levels[level].size() / numRows(image, level);
+}
+
+AsyncImageLoader::AsyncImageLoader(nvvk::Context* ctx, nvvkhl::AllocVma* alloc, const Settings& settings)
+    : m_ctx(ctx)
+    , m_alloc(alloc)
+    , m_device(ctx->m_device)
+    , m_settings(settings)
+{
+  m_settings.numSlots = std::max(m_settings.numSlots, 1U);
+
+  // Persistently mapped staging ring, one region per slot
+  m_staging = m_alloc->createBuffer(m_settings.slotSize * m_settings.numSlots, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  m_mapped  = static_cast<uint8_t*>(m_alloc->map(m_staging));
+
+  VkCommandPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_info.queueFamilyIndex = m_ctx->m_queueGCT.familyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_device, &pool_info, nullptr, &m_cmdPool));
+
+  m_slots.resize(m_settings.numSlots);
+  for(size_t i = 0; i < m_slots.size(); i++)
+  {
+    Slot& slot  = m_slots[i];
+    slot.offset = m_settings.slotSize * i;
+
+    VkCommandBufferAllocateInfo alloc_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    alloc_info.commandPool        = m_cmdPool;
+    alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    NVVK_CHECK(vkAllocateCommandBuffers(m_device, &alloc_info, &slot.cmd));
+
+    VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    NVVK_CHECK(vkCreateFence(m_device, &fence_info, nullptr, &slot.fence));
+  }
+
+  uint32_t num_threads = m_settings.numThreads;
+  if(num_threads == 0)
+  {
+    num_threads = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+  }
+  for(uint32_t i = 0; i < num_threads; i++)
+  {
+    m_workers.emplace_back(&AsyncImageLoader::workerLoop, this);
+  }
+}
+
+AsyncImageLoader::~AsyncImageLoader()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_queue.clear();
+  }
+  m_cv.notify_all();
+  for(std::thread& worker : m_workers)
+  {
+    worker.join();
+  }
+
+  // The copies in flight use the staging buffer and the images
+  for(Slot& slot : m_slots)
+  {
+    if(slot.inFlight)
+      NVVK_CHECK(vkWaitForFences(m_device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+    vkDestroyFence(m_device, slot.fence, nullptr);
+  }
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+
+  for(Upload& upload : m_uploads)
+    m_alloc->destroy(upload.texture);
+  for(auto& [id, upload] : m_finishing)
+    m_alloc->destroy(upload.texture);
+
+  m_alloc->unmap(m_staging);
+  m_alloc->destroy(m_staging);
+}
+
+uint32_t AsyncImageLoader::request(const std::string& filename)
+{
+  uint32_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    id = m_nextId++;
+    m_queue.emplace_back(id, filename);
+  }
+  m_requestTimes[id] = nowMs();
+  m_cv.notify_one();
+  return id;
+}
+
+std::vector<uint32_t> AsyncImageLoader::cancelQueued()
+{
+  std::vector<uint32_t> ids;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& job : m_queue)
+      ids.push_back(job.first);
+    m_queue.clear();
+  }
+  for(uint32_t id : ids)
+    m_requestTimes.erase(id);
+  return ids;
+}
+
+AsyncImageLoader::Decoded AsyncImageLoader::decode(const std::string& filename)
+{
+  const double start = nowMs();
+
+  Decoded decoded;
+  decoded.filename = filename;
+
+  // Always 4 channels: RGB8 is rarely a sampled format
+  int      w    = 0;
+  int      h    = 0;
+  int      comp = 0;
+  stbi_uc* data = stbi_load(filename.c_str(), &w, &h, &comp, 4);
+  if(data != nullptr && w > 0 && h > 0)
+  {
+    decoded.width    = static_cast<uint32_t>(w);
+    decoded.height   = static_cast<uint32_t>(h);
+    decoded.channels = comp;
+    decoded.pixels   = {data, stbi_image_free};
+  }
+  else if(data != nullptr)
+  {
+    stbi_image_free(data);
+  }
+
+  decoded.decodeMs = nowMs() - start;
+  return decoded;
+}
+
+VkFormat AsyncImageLoader::getFormat(Compression compression)
+{
+  switch(compression)
+  {
+    case Compression::eBC1:
+      return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case Compression::eBC7:
+    case Compression::eBC7Fast:
+      return VK_FORMAT_BC7_UNORM_BLOCK;
+    default:
+      return kFormat;
+  }
+}
+
+void AsyncImageLoader::compress(Decoded& decoded, Compression compression, uint32_t numThreads)
+{
+  if(compression == Compression::eNone || !decoded.pixels)
+    return;
+
+  const double      start   = nowMs();
+  const bc::Format  format  = compression == Compression::eBC1 ? bc::Format::eBC1 : bc::Format::eBC7;
+  const bc::Quality quality = compression == Compression::eBC7Fast ? bc::Quality::eFast : bc::Quality::eNormal;
+  decoded.levels = bc::encodeMipChainRGBA8(format, quality, decoded.pixels.get(), decoded.width, decoded.height, numThreads);
+  decoded.format = getFormat(compression);
+  decoded.pixels.reset();
+  decoded.compressMs = nowMs() - start;
+}
+
+VkDeviceSize AsyncImageLoader::imageBytes(VkFormat format, VkExtent2D size)
+{
+  VkDeviceSize bytes = 0;
+  for(;;)
+  {
+    if(format == VK_FORMAT_BC1_RGB_UNORM_BLOCK)
+      bytes += bc::compressedSize(bc::Format::eBC1, size.width, size.height);
+    else if(format == VK_FORMAT_BC7_UNORM_BLOCK)
+      bytes += bc::compressedSize(bc::Format::eBC7, size.width, size.height);
+    else
+      bytes += VkDeviceSize(size.width) * size.height * 4;
+    if(size.width == 1 && size.height == 1)
+      return bytes;
+    size = {std::max(size.width / 2, 1U), std::max(size.height / 2, 1U)};
+  }
+}
+
+void AsyncImageLoader::workerLoop()
+{
+  for(;;)
+  {
+    std::pair<uint32_t, std::string> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+      if(m_stop)
+        return;
+      job = std::move(m_queue.front());
+      m_queue.pop_front();
+      m_decoding++;
+    }
+
+    // Compressed on this thread only: the images are already spread on the workers
+    Decoded decoded = decode(job.second);
+    decoded.id      = job.first;
+    compress(decoded, m_settings.compression, 1);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_decoded.emplace_back(std::move(decoded));
+      m_decoding--;
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Retires the slots whose copy is done, then fills the free slots with the next rows of the decoded
+// images, within the budget of the frame. Nothing here waits for the GPU.
+//
+std::vector<AsyncImageLoader::Result> AsyncImageLoader::update()
+{
+  const double start = nowMs();
+
+  std::vector<Result> results;
+  auto                makeResult = [&](uint32_t id, const Decoded& image, nvvk::Texture texture, bool valid) {
+    Result result;
+    result.id         = id;
+    result.filename   = image.filename;
+    result.valid      = valid;
+    result.size       = {image.width, image.height};
+    result.texture    = texture;
+    result.format     = image.format;
+    result.bytes      = valid ? imageBytes(image.format, result.size) : 0;
+    result.decodeMs   = image.decodeMs;
+    result.compressMs = image.compressMs;
+    result.latencyMs  = nowMs() - m_requestTimes[id];
+    m_requestTimes.erase(id);
+    results.emplace_back(std::move(result));
+  };
+
+  // Copies done: the slot is free, and the image ready when it was its last rows
+  for(Slot& slot : m_slots)
+  {
+    if(!slot.inFlight || vkGetFenceStatus(m_device, slot.fence) != VK_SUCCESS)
+      continue;
+    NVVK_CHECK(vkResetFences(m_device, 1, &slot.fence));
+    slot.inFlight = false;
+    if(slot.lastOf != 0)
+    {
+      auto it = m_finishing.find(slot.lastOf);
+      makeResult(it->first, it->second.image, it->second.texture, true);
+      m_finishing.erase(it);
+      slot.lastOf = 0;
+    }
+  }
+
+  // Images decoded since the last frame
+  std::vector<Decoded> decoded;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    decoded.swap(m_decoded);
+  }
+  for(Decoded& image : decoded)
+  {
+    if((!image.pixels && image.levels.empty()) || rowBytes(image, 0) > m_settings.slotSize)
+    {
+      LOGE("Can't load %s\n", image.filename.c_str());
+      makeResult(image.id, image, {}, false);
+      continue;
+    }
+    Upload upload;
+    upload.image = std::move(image);
+    m_uploads.emplace_back(std::move(upload));
+  }
+
+  // Rows of the first image to the free slots, at least one row per slot
+  VkDeviceSize budget = m_settings.frameBudget;
+  while(!m_uploads.empty() && budget > 0)
+  {
+    Slot* slot = acquireSlot();
+    if(slot == nullptr)
+      break;
+
+    Upload& upload = m_uploads.front();
+    if(upload.texture.image == VK_NULL_HANDLE)
+    {
+      createImage(upload);
+    }
+
+    const VkDeviceSize bytes = recordRows(upload, *slot, std::min(m_settings.slotSize, budget));
+    budget -= std::min(budget, bytes);
+
+    if(upload.nextLevel == numCopiedLevels(upload.image))
+    {
+      // The pixels are in the staging ring, only the fence of the last slot is left
+      const uint32_t id = upload.image.id;
+      slot->lastOf      = id;
+      upload.image.pixels.reset();
+      upload.image.levels.clear();
+      m_finishing.emplace(id, std::move(upload));
+      m_uploads.pop_front();
+    }
+  }
+
+  m_lastUpdateMs = nowMs() - start;
+  m_maxUpdateMs  = std::max(m_maxUpdateMs, m_lastUpdateMs);
+  return results;
+}
+
+// Next slot of the ring, if its copy is done
+AsyncImageLoader::Slot* AsyncImageLoader::acquireSlot()
+{
+  Slot& slot = m_slots[m_nextSlot];
+  if(slot.inFlight)
+    return nullptr;
+  m_nextSlot = (m_nextSlot + 1) % static_cast<uint32_t>(m_slots.size());
+  return &slot;
+}
+
+void AsyncImageLoader::createImage(Upload& upload)
+{
+  const VkExtent2D  size{upload.image.width, upload.image.height};
+  VkImageCreateInfo create_info = nvvk::makeImage2DCreateInfo(size, upload.image.format, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+  create_info.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;  // Copies
+  if(upload.image.levels.empty())
+    create_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;  // Mipmaps
+
+  const VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  nvvk::Image               image = m_alloc->createImage(create_info);
+  upload.texture   = m_alloc->createTexture(image, nvvk::makeImageViewCreateInfo(image.image, create_info), sampler_info);
+  upload.mipLevels = create_info.mipLevels;
+}
+
+// Copies rows to the slot, up to `maxBytes` but at least one, and submits their copy to the image.
+// Compressed, the rows of blocks of the next levels follow in the same slot. The first rows transition
+// the image; after the last ones the mipmaps are generated, or all levels transitioned, which leaves
+// it in SHADER_READ_ONLY_OPTIMAL. Returns the bytes copied.
+VkDeviceSize AsyncImageLoader::recordRows(Upload& upload, Slot& slot, VkDeviceSize maxBytes)
+{
+  const Decoded& image      = upload.image;
+  const bool     compressed = !image.levels.empty();
+  const uint32_t num_levels = numCopiedLevels(image);
+
+  VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  NVVK_CHECK(vkBeginCommandBuffer(slot.cmd, &begin_info));
+
+  if(upload.nextLevel == 0 && upload.nextRow == 0)
+  {
+    nvvk::cmdBarrierImageLayout(slot.cmd, upload.texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  }
+
+  std::vector<VkBufferImageCopy> regions;
+  VkDeviceSize                   used = 0;
+  while(upload.nextLevel < num_levels)
+  {
+    const uint32_t     level      = upload.nextLevel;
+    const VkExtent2D   extent     = {std::max(image.width >> level, 1U), std::max(image.height >> level, 1U)};
+    const uint32_t     rows       = numRows(image, level);
+    const uint32_t     row_height = compressed ? 4 : 1;  // In pixels
+    const VkDeviceSize row_bytes  = rowBytes(image, level);
+    const uint8_t*     src        = compressed ? image.levels[level].data() : image.pixels.get();
+    const VkDeviceSize room       = maxBytes - std::min(maxBytes, used);
+    auto               num_rows   = static_cast<uint32_t>(std::min<VkDeviceSize>(rows - upload.nextRow, room / row_bytes));
+    if(num_rows == 0)
+    {
+      if(!regions.empty())
+        break;
+      num_rows = 1;  // Fits the slot, checked in update()
+    }
+    std::memcpy(m_mapped + slot.offset + used, src + upload.nextRow * row_bytes, num_rows * row_bytes);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset     = slot.offset + used;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    region.imageOffset      = {0, static_cast<int32_t>(upload.nextRow * row_height), 0};
+    region.imageExtent      = {extent.width, std::min(num_rows * row_height, extent.height - upload.nextRow * row_height), 1};
+    regions.push_back(region);
+    used += num_rows * row_bytes;
+
+    upload.nextRow += num_rows;
+    if(upload.nextRow < rows)
+      break;  // The slot is full
+    upload.nextLevel++;
+    upload.nextRow = 0;
+  }
+  vkCmdCopyBufferToImage(slot.cmd, m_staging.buffer, upload.texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         static_cast<uint32_t>(regions.size()), regions.data());
+
+  if(upload.nextLevel == num_levels)
+  {
+    // The barriers also wait for the rows of the previous submissions
+    if(compressed)
+    {
+      nvvk::cmdBarrierImageLayout(slot.cmd, upload.texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    else
+    {
+      nvvk::cmdGenerateMipmaps(slot.cmd, upload.texture.image, kFormat, {image.width, image.height}, upload.mipLevels, 1,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    }
+  }
+  NVVK_CHECK(vkEndCommandBuffer(slot.cmd));
+
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers    = &slot.cmd;
+  NVVK_CHECK(vkQueueSubmit(m_ctx->m_queueGCT.queue, 1, &submit_info, slot.fence));
+  slot.inFlight = true;
+  return used;
+}
+
+AsyncImageLoader::Stats AsyncImageLoader::getStats() const
+{
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.queued    = static_cast<uint32_t>(m_queue.size());
+    stats.decoding  = m_decoding;
+    stats.uploading = static_cast<uint32_t>(m_decoded.size());
+  }
+  stats.uploading += static_cast<uint32_t>(m_uploads.size() + m_finishing.size());
+  stats.lastUpdateMs = m_lastUpdateMs;
+  stats.maxUpdateMs  = m_maxUpdateMs;
+  return stats;
+}
+
+bool AsyncImageLoader::isIdle() const
+{
+  const Stats stats = getStats();
+  return stats.queued == 0 && stats.decoding == 0 && stats.uploading == 0;
+}
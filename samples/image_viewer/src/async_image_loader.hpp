@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "nvvk/context_vk.hpp"
+#include "nvvkhl/alloc_vma.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Loads images without blocking the frame:
+// - request() queues a file, decoded with stb_image by a pool of worker threads
+// - update(), called once per frame on the main thread, copies the decoded rows to a ring of
+//   persistently mapped staging slots and submits their copy to the image, without waiting. The
+//   mipmaps are generated after the last rows. A slot is reused once its fence is signaled.
+// - with Settings::compression, the workers also encode the mip chain in BC1 or BC7 (bc_encoder.hpp),
+//   and the rows of blocks of all levels are streamed instead, with no mipmap generation.
+// - the images whose upload is done are returned by update(), ready to be sampled.
+//
+// Large images are streamed over several frames: the bytes copied per update() are bounded by
+// Settings::frameBudget, so the cost on the frame doesn't depend on the size of the image.
+//
+class AsyncImageLoader
+{
+public:
+  enum class Compression
+  {
+    eNone,     // RGBA8, the mipmaps generated on the GPU
+    eBC1,      // RGB, 1/8 of the memory
+    eBC7,      // RGBA, 1/4 of the memory
+    eBC7Fast,  // BC7, endpoints from the bounding box of the blocks
+  };
+
+  struct Settings
+  {
+    uint32_t     numThreads{0};             // Decoding threads, 0: all cores but one
+    uint32_t     numSlots{4};               // Staging slots in flight
+    VkDeviceSize slotSize{8ULL << 20};      // Bytes per slot, at least one row of the widest image
+    VkDeviceSize frameBudget{16ULL << 20};  // Bytes copied to the staging ring per update()
+    Compression  compression{Compression::eNone};
+  };
+
+  // Decoded pixels, RGBA8, or their block-compressed mip chain
+  struct Decoded
+  {
+    uint32_t                                  id{0};
+    std::string                               filename;
+    uint32_t                                  width{0};
+    uint32_t                                  height{0};
+    int                                       channels{0};  // In the file
+    std::unique_ptr<uint8_t, void (*)(void*)> pixels{nullptr, nullptr};
+    VkFormat                                  format{VK_FORMAT_R8G8B8A8_UNORM};
+    std::vector<std::vector<uint8_t>>         levels;  // Compressed, all mip levels; pixels is then released
+    double                                    decodeMs{0.0};
+    double                                    compressMs{0.0};
+  };
+
+  // Image uploaded, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with all its mipmaps
+  struct Result
+  {
+    uint32_t      id{0};
+    std::string   filename;
+    bool          valid{false};  // False when the file couldn't be decoded
+    VkExtent2D    size{0, 0};
+    nvvk::Texture texture;  // Owned by the caller
+    VkFormat      format{VK_FORMAT_UNDEFINED};
+    VkDeviceSize  bytes{0};  // All mip levels
+    double        decodeMs{0.0};
+    double        compressMs{0.0};
+    double        latencyMs{0.0};  // From request() to the end of the upload
+  };
+
+  struct Stats
+  {
+    uint32_t queued{0};     // Waiting for a decoding thread
+    uint32_t decoding{0};   // Being decoded
+    uint32_t uploading{0};  // Decoded, rows being streamed or waiting for the fence
+    double   lastUpdateMs{0.0};
+    double   maxUpdateMs{0.0};
+  };
+
+  AsyncImageLoader(nvvk::Context* ctx, nvvkhl::AllocVma* alloc, const Settings& settings = {});
+  ~AsyncImageLoader();
+
+  // Queues a file, returns the id of its Result
+  uint32_t request(const std::string& filename);
+  // Removes the files not being decoded yet, returns their id
+  std::vector<uint32_t> cancelQueued();
+
+  // Main thread, once per frame: streams the decoded images and returns the ones ready
+  std::vector<Result> update();
+
+  Stats getStats() const;
+  bool  isIdle() const;
+
+  // Decodes a file to RGBA8 on the calling thread; no pixels on failure
+  static Decoded decode(const std::string& filename);
+  // Replaces the pixels by their compressed mip chain. numThreads 0: all cores
+  static void         compress(Decoded& decoded, Compression compression, uint32_t numThreads);
+  static VkFormat     getFormat(Compression compression);
+  static VkDeviceSize imageBytes(VkFormat format, VkExtent2D size);  // With all its mip levels
+
+private:
+  struct Upload
+  {
+    Decoded       image;
+    nvvk::Texture texture;
+    uint32_t      mipLevels{1};
+    uint32_t      nextLevel{0};  // Compressed: level being copied
+    uint32_t      nextRow{0};    // First row, or row of blocks, not copied to the staging ring
+  };
+
+  struct Slot
+  {
+    VkDeviceSize    offset{0};  // In the staging buffer
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+    VkFence         fence{VK_NULL_HANDLE};
+    bool            inFlight{false};
+    uint32_t        lastOf{0};  // Id of the upload finished by this slot, 0 if none
+  };
+
+  void         workerLoop();
+  Slot*        acquireSlot();
+  void         createImage(Upload& upload);
+  VkDeviceSize recordRows(Upload& upload, Slot& slot, VkDeviceSize maxBytes);
+
+  nvvk::Context*    m_ctx{nullptr};
+  nvvkhl::AllocVma* m_alloc{nullptr};
+  VkDevice          m_device{VK_NULL_HANDLE};
+  Settings          m_settings;
+
+  // Decoding threads
+  std::vector<std::thread>                     m_workers;
+  mutable std::mutex                           m_mutex;
+  std::condition_variable                      m_cv;
+  std::deque<std::pair<uint32_t, std::string>> m_queue;    // Files to decode
+  std::vector<Decoded>                         m_decoded;  // Decoded, not yet uploading
+  uint32_t                                     m_decoding{0};
+  uint32_t                                     m_nextId{1};
+  bool                                         m_stop{false};
+
+  // Upload, main thread only
+  nvvk::Buffer                         m_staging;
+  uint8_t*                             m_mapped{nullptr};
+  VkCommandPool                        m_cmdPool{VK_NULL_HANDLE};
+  std::vector<Slot>                    m_slots;
+  uint32_t                             m_nextSlot{0};
+  std::deque<Upload>                   m_uploads;       // Rows to stream, the first one in progress
+  std::unordered_map<uint32_t, Upload> m_finishing;     // All rows submitted, waiting for the last slot
+  std::unordered_map<uint32_t, double> m_requestTimes;  // Of the requests not returned yet
+  double                               m_lastUpdateMs{0.0};
+  double                               m_maxUpdateMs{0.0};
+};
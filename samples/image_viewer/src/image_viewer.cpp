@@ -25,6 +25,8 @@
  - The image is applied as a texture on a quad.
  - It is possible to change the sampling filters on the fly (using 2 sets) (see m_frame)
  - Zoom and pan the image under the cursor
+ - Browse a folder: the images are decoded on worker threads and streamed to the GPU (see AsyncImageLoader)
+- The images can be block compressed (BC1, BC7) on the CPU before their upload (see bc_encoder.hpp)
 
 */
 //////////////////////////////////////////////////////////////////////////
@@ -33,7 +35,12 @@
 #define IM_VEC2_CLASS_EXTRA ImVec2(const nvmath::vec2f& f) {x = f.x; y = f.y;} operator nvmath::vec2f() const { return nvmath::vec2f(x, y); }
 // clang-format on
 
+#include <algorithm>
 #include <array>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <map>
 #include "nvmath/nvmath.h"
 #include <imgui.h>
 #include <vulkan/vulkan_core.h>
@@ -42,7 +49,11 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "async_image_loader.hpp"
+#include "bc_encoder.hpp"
 #include "nvh/fileoperations.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
 #include "nvvk/commands_vk.hpp"
 #include "nvvk/debug_util_vk.hpp"
 #include "nvvk/descriptorsets_vk.hpp"
@@ -87,23 +98,36 @@ struct SampleTexture
     create(4, data.data());
   }
 
-  SampleTexture(nvvk::Context* c, nvvkhl::AllocVma* a, const std::string& filename)
+  SampleTexture(nvvk::Context*                c,
+                nvvkhl::AllocVma*             a,
+                const std::string&            filename,
+                AsyncImageLoader::Compression compression = AsyncImageLoader::Compression::eNone)
       : m_ctx(c)
       , m_alloc(a)
   {
-    int      w        = 0;
-    int      h        = 0;
-    int      comp     = 0;
-    int      req_comp = 4;
-    stbi_uc* data     = stbi_load(filename.c_str(), &w, &h, &comp, req_comp);
-    if((data != nullptr) && w > 1 && h > 1)
+    AsyncImageLoader::Decoded decoded = AsyncImageLoader::decode(filename);
+    if(decoded.pixels && decoded.width > 1 && decoded.height > 1)
     {
-      m_size = {static_cast<uint32_t>(w), static_cast<uint32_t>(h)};
-      create(w * h * req_comp, data);
-      stbi_image_free(data);
+      m_size = {decoded.width, decoded.height};
+      AsyncImageLoader::compress(decoded, compression, 0);  // On all cores
+      if(decoded.levels.empty())
+        create(m_size.width * m_size.height * 4, decoded.pixels.get());
+      else
+        createCompressed(decoded.format, decoded.levels);
     }
   }
 
+  // Takes the ownership of an image loaded elsewhere, see AsyncImageLoader
+  SampleTexture(nvvk::Context* c, nvvkhl::AllocVma* a, const nvvk::Texture& texture, const VkExtent2D& size, VkFormat format)
+      : m_size(size)
+      , m_format(format)
+      , m_texture(texture)
+      , m_descriptor(texture.descriptor)
+      , m_ctx(c)
+      , m_alloc(a)
+  {
+  }
+
   ~SampleTexture()
   {  // Destroying in next frame, avoid deleting while using
     nvvkhl::Application::submitResourceFree(
@@ -120,21 +144,51 @@ struct SampleTexture
     nvvk::CommandPool cpool(m_ctx->m_device, m_ctx->m_queueGCT.familyIndex);
     VkCommandBuffer   cmd = cpool.createCommandBuffer();
     m_texture             = m_alloc->createTexture(cmd, bufsize, data, create_info, sampler_info);
+    m_descriptor          = m_texture.descriptor;
     nvvk::cmdGenerateMipmaps(cmd, m_texture.image, format, m_size, create_info.mipLevels);
     cpool.submitAndWait(cmd);
   }
 
-  void               setSampler(const VkSampler& sampler) { m_texture.descriptor.sampler = sampler; }
+  // Block-compressed mip chain, all levels copied as they are
+  void createCompressed(VkFormat format, const std::vector<std::vector<uint8_t>>& levels)
+  {
+    const VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    const VkImageCreateInfo   create_info = nvvk::makeImage2DCreateInfo(m_size, format, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+    m_format                              = format;
+
+    nvvk::CommandPool cpool(m_ctx->m_device, m_ctx->m_queueGCT.familyIndex);
+    VkCommandBuffer   cmd   = cpool.createCommandBuffer();
+    const nvvk::Image image = m_alloc->createImage(create_info);
+    nvvk::cmdBarrierImageLayout(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    for(uint32_t mip = 0; mip < static_cast<uint32_t>(levels.size()); mip++)
+    {
+      const VkExtent3D extent{std::max(m_size.width >> mip, 1U), std::max(m_size.height >> mip, 1U), 1};
+      m_alloc->getStaging()->cmdToImage(cmd, image.image, {0, 0, 0}, extent, {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1},
+                                        levels[mip].size(), levels[mip].data());
+    }
+    nvvk::cmdBarrierImageLayout(cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    m_texture    = m_alloc->createTexture(image, nvvk::makeImageViewCreateInfo(image.image, create_info), sampler_info);
+    m_descriptor = m_texture.descriptor;
+    cpool.submitAndWait(cmd);
+    m_alloc->finalizeAndReleaseStaging();
+  }
+
+  // The sampler of the texture stays the one released with it
+  void               setSampler(const VkSampler& sampler) { m_descriptor.sampler = sampler; }
   [[nodiscard]] bool isValid() const { return m_texture.image != nullptr; }
-  [[nodiscard]] const VkDescriptorImageInfo& descriptor() const { return m_texture.descriptor; }
+  [[nodiscard]] const VkDescriptorImageInfo& descriptor() const { return m_descriptor; }
   [[nodiscard]] const VkExtent2D&            getSize() const { return m_size; }
   [[nodiscard]] float getAspect() const { return static_cast<float>(m_size.width) / static_cast<float>(m_size.height); }
+  [[nodiscard]] VkFormat     getFormat() const { return m_format; }
+  [[nodiscard]] VkDeviceSize getBytes() const { return AsyncImageLoader::imageBytes(m_format, m_size); }
 
 private:
-  VkExtent2D        m_size{0, 0};
-  nvvk::Texture     m_texture;
-  nvvk::Context*    m_ctx{nullptr};
-  nvvkhl::AllocVma* m_alloc{nullptr};
+  VkExtent2D            m_size{0, 0};
+  VkFormat              m_format{VK_FORMAT_R8G8B8A8_UNORM};
+  nvvk::Texture         m_texture;
+  VkDescriptorImageInfo m_descriptor{};  // Texture with the sampler of the viewer
+  nvvk::Context*        m_ctx{nullptr};
+  nvvkhl::AllocVma*     m_alloc{nullptr};
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -153,6 +207,9 @@ public:
     m_alloc = std::make_unique<nvvkhl::AllocVma>(m_app->getContext().get());  // Allocator
     m_dset  = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
 
+    // Block compression, when the device samples the formats of the encoder
+    m_bcSupported = isFormatSampled(VK_FORMAT_BC1_RGB_UNORM_BLOCK) && isFormatSampled(VK_FORMAT_BC7_UNORM_BLOCK);
+
     // Find image file
     const std::vector<std::string> default_search_paths = {".", "..", "../..", "../../.."};
     const std::string              img_file = nvh::findFile(R"(media/fruit.jpg)", default_search_paths, true);
@@ -160,6 +217,21 @@ public:
     m_texture = std::make_shared<SampleTexture>(m_app->getContext().get(), m_alloc.get(), img_file);
     assert(m_texture->isValid());
 
+    // The other images of its folder are loaded in the background
+    m_loader = std::make_unique<AsyncImageLoader>(m_app->getContext().get(), m_alloc.get());
+    const std::string folder = std::filesystem::path(img_file).parent_path().string();
+    snprintf(m_folder.data(), m_folder.size(), "%s", folder.c_str());
+    listFolder(folder);
+    for(size_t i = 0; i < m_files.size(); i++)
+    {
+      std::error_code ec;
+      if(std::filesystem::equivalent(m_files[i], img_file, ec))
+      {
+        m_current          = static_cast<int>(i);
+        m_cache[m_current] = m_texture;
+      }
+    }
+
     createSamplers();
     createPipeline();
     createVkBuffers();
@@ -200,6 +272,8 @@ public:
 
   void onUIRender() override
   {
+    processLoadedImages();
+
     // Setting menu
     {
       ImGui::Begin("Settings");
@@ -207,14 +281,15 @@ public:
       ImGui::SliderFloat2("Pan", &m_pan.x, -1.F, 1.0F);
 
       {  // Sampling filters
-        static int mode   = 0;
-        bool       change = false;
-        change |= ImGui::RadioButton("Nearest", &mode, 0);
+        bool change = false;
+        change |= ImGui::RadioButton("Nearest", &m_filterMode, 0);
         ImGui::SameLine();
-        change |= ImGui::RadioButton("Linear", &mode, 1);
+        change |= ImGui::RadioButton("Linear", &m_filterMode, 1);
         if(change)
         {
-          m_texture->setSampler(m_samplers[mode]);
+          m_texture->setSampler(m_samplers[m_filterMode]);
+          for(auto& [index, texture] : m_cache)
+            texture->setSampler(m_samplers[m_filterMode]);
           updateTexture();
         }
       }
@@ -230,6 +305,59 @@ public:
         m_pan  = {0, 0};
       }
 
+      // Folder browsing
+      ImGui::Separator();
+      ImGui::InputText("Folder", m_folder.data(), m_folder.size());
+      if(ImGui::Button("Open"))
+      {
+        openFolder(m_folder.data());
+      }
+      ImGui::BeginDisabled(m_files.empty());
+      ImGui::SameLine();
+      // The arrows move the cursor while typing the folder, they only browse otherwise
+      const bool arrow_keys = !ImGui::GetIO().WantTextInput;
+      if(ImGui::Button("<") || (arrow_keys && ImGui::IsKeyPressed(ImGuiKey_LeftArrow)))
+      {
+        showImage(m_current - 1);
+      }
+      ImGui::SameLine();
+      if(ImGui::Button(">") || (arrow_keys && ImGui::IsKeyPressed(ImGuiKey_RightArrow)))
+      {
+        showImage(m_current + 1);
+      }
+      ImGui::SameLine();
+      ImGui::Text("%d / %d", m_current + 1, static_cast<int>(m_files.size()));
+      if(ImGui::Button("Benchmark Folder"))
+      {
+        benchmarkFolder();
+      }
+      ImGui::EndDisabled();
+      if(m_current >= 0 && m_current < static_cast<int>(m_files.size()))
+      {
+        ImGui::TextWrapped("%s", std::filesystem::path(m_files[m_current]).filename().string().c_str());
+      }
+      ImGui::TextDisabled("%ux%u %s, %.2f MB", m_texture->getSize().width, m_texture->getSize().height,
+                          formatName(m_texture->getFormat()), double(m_texture->getBytes()) / (1024.0 * 1024.0));
+
+      // Block compression, on the decoding threads
+      ImGui::Separator();
+      ImGui::BeginDisabled(!m_bcSupported);
+      if(ImGui::Combo("Compression", &m_compression, "None\0BC1\0BC7\0BC7 Fast\0"))
+      {
+        setCompression();
+      }
+      ImGui::EndDisabled();
+      ImGui::BeginDisabled(m_current < 0);
+      if(ImGui::Button("Compression Report"))
+      {
+        reportCompression();
+      }
+      ImGui::EndDisabled();
+
+      const AsyncImageLoader::Stats stats = m_loader->getStats();
+      ImGui::TextDisabled("Queued %u, decoding %u, uploading %u", stats.queued, stats.decoding, stats.uploading);
+      ImGui::TextDisabled("Loader: %.2f ms per frame (max %.2f)", stats.lastUpdateMs, stats.maxUpdateMs);
+
       ImGui::End();
     }
 
@@ -413,6 +541,249 @@ private:
     vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Folder browsing: the image shown and its two neighbors are kept, or requested to the loader. The
+  // previous image stays on screen until the new one is uploaded.
+  //
+  void listFolder(const std::string& folder)
+  {
+    static const std::array<const char*, 8> extensions = {".jpg", ".jpeg", ".png", ".bmp", ".tga", ".gif", ".psd", ".hdr"};
+
+    m_files.clear();
+    std::error_code ec;
+    for(const auto& entry : std::filesystem::directory_iterator(folder, ec))
+    {
+      std::string ext = entry.path().extension().string();
+      std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+      if(entry.is_regular_file() && std::find(extensions.begin(), extensions.end(), ext) != extensions.end())
+      {
+        m_files.push_back(entry.path().string());
+      }
+    }
+    std::sort(m_files.begin(), m_files.end());
+  }
+
+  void openFolder(const std::string& folder)
+  {
+    for(uint32_t id : m_loader->cancelQueued())
+      m_pending.erase(id);
+    m_pending.clear();  // The images being decoded or uploaded are dropped when done
+    m_cache.clear();
+    m_current = -1;
+
+    listFolder(folder);
+    if(m_files.empty())
+    {
+      LOGE("No image in %s\n", folder.c_str());
+      return;
+    }
+    showImage(0);
+  }
+
+  void showImage(int index)
+  {
+    if(m_files.empty())
+      return;
+    m_current = std::clamp(index, 0, static_cast<int>(m_files.size()) - 1);
+
+    // Browsing quickly, only the images where it stops are decoded
+    for(uint32_t id : m_loader->cancelQueued())
+      m_pending.erase(id);
+
+    // The current image first, then its neighbors
+    for(int i : {m_current, m_current + 1, m_current - 1})
+    {
+      if(i < 0 || i >= static_cast<int>(m_files.size()) || m_cache.count(i) != 0)
+        continue;
+      const bool pending = std::any_of(m_pending.begin(), m_pending.end(), [i](const auto& p) { return p.second == i; });
+      if(!pending)
+        m_pending[m_loader->request(m_files[i])] = i;
+    }
+
+    for(auto it = m_cache.begin(); it != m_cache.end();)
+      it = std::abs(it->first - m_current) > 1 ? m_cache.erase(it) : std::next(it);
+
+    if(m_cache.count(m_current) != 0)
+    {
+      m_texture = m_cache[m_current];
+      updateTexture();
+    }
+  }
+
+  // Images uploaded by the loader: swapped in if current, kept if neighbor
+  void processLoadedImages()
+  {
+    for(AsyncImageLoader::Result& result : m_loader->update())
+    {
+      auto it = m_pending.find(result.id);
+      if(it == m_pending.end() || !result.valid)
+      {
+        m_alloc->destroy(result.texture);  // Never used by a frame
+        if(it != m_pending.end())
+          m_pending.erase(it);
+        continue;
+      }
+      const int index = it->second;
+      m_pending.erase(it);
+
+      auto texture = std::make_shared<SampleTexture>(m_app->getContext().get(), m_alloc.get(), result.texture, result.size,
+                                                     result.format);
+      texture->setSampler(m_samplers[m_filterMode]);
+      if(std::abs(index - m_current) > 1)
+        continue;
+
+      m_cache[index] = texture;
+      if(index == m_current)
+      {
+        LOGI("%s: %ux%u, decoded in %.1f ms, compressed in %.1f ms, shown %.1f ms after the request\n",
+             result.filename.c_str(), result.size.width, result.size.height, result.decodeMs, result.compressMs, result.latencyMs);
+        m_texture = texture;
+        updateTexture();
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Loads all images of the folder: decoding on this thread as SampleTexture does, then on all cores,
+  // and finally through the loader, whose cost per update() is what a frame would pay.
+  //
+  void benchmarkFolder()
+  {
+    using clock = std::chrono::high_resolution_clock;
+    const size_t num_files = m_files.size();
+
+    std::vector<uint64_t> pixels(num_files, 0);
+    auto                  t0 = clock::now();
+    for(size_t i = 0; i < num_files; i++)
+    {
+      const AsyncImageLoader::Decoded decoded = AsyncImageLoader::decode(m_files[i]);
+      pixels[i]                               = uint64_t(decoded.width) * decoded.height;
+    }
+    auto t1 = clock::now();
+    nvh::parallel_batches<1>(
+        num_files, [&](uint64_t i) { AsyncImageLoader::decode(m_files[i]); }, std::thread::hardware_concurrency());
+    auto t2 = clock::now();
+
+    // Decoding, upload and mipmaps, with a loader of its own
+    double max_update_ms = 0.0;
+    {
+      AsyncImageLoader loader(m_app->getContext().get(), m_alloc.get());
+      for(const std::string& file : m_files)
+        loader.request(file);
+      while(!loader.isIdle())
+      {
+        for(AsyncImageLoader::Result& result : loader.update())
+          m_alloc->destroy(result.texture);
+        max_update_ms = std::max(max_update_ms, loader.getStats().lastUpdateMs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    auto t3 = clock::now();
+
+    double mpixels = 0.0;
+    for(uint64_t p : pixels)
+      mpixels += double(p) / 1e6;
+    const double seq_ms      = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    const double parallel_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    const double loader_ms   = std::chrono::duration<double, std::milli>(t3 - t2).count();
+    LOGI("Folder benchmark: %zu images, %.1f MPixels\n", num_files, mpixels);
+    LOGI(" - Decode, 1 thread   : %8.2f ms (%.1f MPixels/s)\n", seq_ms, mpixels * 1000.0 / std::max(seq_ms, 1e-6));
+    LOGI(" - Decode, %2u threads : %8.2f ms (%.1f MPixels/s, x%.1f)\n", std::thread::hardware_concurrency(), parallel_ms,
+         mpixels * 1000.0 / std::max(parallel_ms, 1e-6), seq_ms / std::max(parallel_ms, 1e-6));
+    LOGI(" - Async loader       : %8.2f ms to the GPU, at most %.2f ms per update()\n", loader_ms, max_update_ms);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Block compression: the loader encodes on its decoding threads, so it is replaced by one with the
+  // new setting and the images are loaded again. The image shown stays until the new one is ready.
+  //
+  [[nodiscard]] AsyncImageLoader::Compression getCompression() const
+  {
+    return static_cast<AsyncImageLoader::Compression>(m_compression);
+  }
+
+  void setCompression()
+  {
+    m_pending.clear();
+    m_cache.clear();
+    AsyncImageLoader::Settings settings;
+    settings.compression = getCompression();
+    m_loader             = std::make_unique<AsyncImageLoader>(m_app->getContext().get(), m_alloc.get(), settings);
+    showImage(m_current);
+  }
+
+  bool isFormatSampled(VkFormat format) const
+  {
+    VkFormatProperties props{};
+    vkGetPhysicalDeviceFormatProperties(m_app->getPhysicalDevice(), format, &props);
+    return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+  }
+
+  static const char* formatName(VkFormat format)
+  {
+    switch(format)
+    {
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        return "BC1";
+      case VK_FORMAT_BC7_UNORM_BLOCK:
+        return "BC7";
+      default:
+        return "RGBA8";
+    }
+  }
+
+  // Encodes the current image in each mode, on this thread then on all cores, and decodes it back to
+  // measure the error: PSNR of RGB for BC1, of RGBA for BC7
+  void reportCompression()
+  {
+    using clock = std::chrono::high_resolution_clock;
+    const AsyncImageLoader::Decoded decoded = AsyncImageLoader::decode(m_files[m_current]);
+    if(!decoded.pixels)
+    {
+      LOGE("Can't load %s\n", m_files[m_current].c_str());
+      return;
+    }
+
+    struct Mode
+    {
+      const char* name;
+      bc::Format  format;
+      bc::Quality quality;
+    };
+    const std::array<Mode, 4> modes = {{{"BC1 Fast", bc::Format::eBC1, bc::Quality::eFast},
+                                        {"BC1", bc::Format::eBC1, bc::Quality::eNormal},
+                                        {"BC7 Fast", bc::Format::eBC7, bc::Quality::eFast},
+                                        {"BC7", bc::Format::eBC7, bc::Quality::eNormal}}};
+
+    const uint32_t width       = decoded.width;
+    const uint32_t height      = decoded.height;
+    const size_t   num_pixels  = size_t(width) * height;
+    const double   mpixels     = double(num_pixels) / 1e6;
+    const uint32_t num_threads = std::thread::hardware_concurrency();
+    LOGI("Compression of %s: %ux%u, %.2f MB in RGBA8\n", std::filesystem::path(m_files[m_current]).filename().string().c_str(),
+         width, height, double(num_pixels * 4) / (1024.0 * 1024.0));
+    LOGI(" Mode     | Ratio | PSNR (dB) | 1 thread (MPixels/s) | %2u threads (MPixels/s)\n", num_threads);
+
+    std::vector<uint8_t> pixels(num_pixels * 4);
+    for(const Mode& mode : modes)
+    {
+      std::vector<uint8_t> blocks(bc::compressedSize(mode.format, width, height));
+      auto                 t0 = clock::now();
+      bc::encodeRGBA8(mode.format, mode.quality, decoded.pixels.get(), width, height, blocks.data(), 1);
+      auto t1 = clock::now();
+      bc::encodeRGBA8(mode.format, mode.quality, decoded.pixels.get(), width, height, blocks.data(), num_threads);
+      auto t2 = clock::now();
+
+      bc::decodeRGBA8(mode.format, blocks.data(), width, height, pixels.data());
+      const uint32_t channels    = mode.format == bc::Format::eBC1 ? 3 : 4;
+      const double   psnr        = bc::psnrRGBA8(decoded.pixels.get(), pixels.data(), num_pixels, channels);
+      const double   seq_ms      = std::chrono::duration<double, std::milli>(t1 - t0).count();
+      const double   parallel_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+      LOGI(" %-8s | %4.1fx | %9.2f | %20.1f | %22.1f\n", mode.name, double(num_pixels * 4) / double(blocks.size()), psnr,
+           mpixels * 1000.0 / std::max(seq_ms, 1e-6), mpixels * 1000.0 / std::max(parallel_ms, 1e-6));
+    }
+  }
+
   void createGbuffers(const nvmath::vec2f& size)
   {
     m_viewSize = size;
@@ -470,7 +841,9 @@ private:
     m_vertices = {};
     m_indices  = {};
 
+    m_cache.clear();
     m_texture.reset();
+    m_loader.reset();
     m_dset->deinit();
     m_gBuffers.reset();
   }
@@ -499,6 +872,17 @@ private:
   float                          m_zoom{1};
   nvmath::vec2f                  m_pan{0, 0};
   std::shared_ptr<SampleTexture> m_texture;  // Loaded image and displayed
+  int                            m_filterMode{0};
+  int                            m_compression{0};  // AsyncImageLoader::Compression
+  bool                           m_bcSupported{false};
+
+  // Folder browsing
+  std::unique_ptr<AsyncImageLoader>             m_loader;
+  std::array<char, 512>                         m_folder{};
+  std::vector<std::string>                      m_files;  // Images of the folder
+  int                                           m_current{-1};
+  std::map<int, std::shared_ptr<SampleTexture>> m_cache;    // Current image and its neighbors, by index in m_files
+  std::map<uint32_t, int>                       m_pending;  // Requests to the loader, to the index in m_files
 
   // Pipeline
   PushConstant     m_pushConst;                          // Information sent to the shader
@@ -2,7 +2,10 @@
 set(COMMON_SRC
 	${SAMPLES_COMMON_DIR}/bird_curve_helper.cpp 
 	${SAMPLES_COMMON_DIR}/bird_curve_helper.hpp
+	${SAMPLES_COMMON_DIR}/bird_curve_tables.hpp
 	${SAMPLES_COMMON_DIR}/bit_packer.hpp
+	${SAMPLES_COMMON_DIR}/counting_allocator.hpp
+	${SAMPLES_COMMON_DIR}/perlin_noise.hpp
 	)
 target_sources(${PROJECT_NAME} PRIVATE ${COMMON_SRC})
 source_group(common FILES ${COMMON_SRC})
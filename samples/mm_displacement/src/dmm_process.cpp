@@ -18,13 +18,21 @@
  */
 
 #define _USE_MATH_DEFINES
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <map>
 #include <cmath>
+#include <unordered_map>
 #include <glm/glm.hpp>
-#include <glm/gtc/noise.hpp>  // Perlin noise
 #include "dmm_process.hpp"
 #include "bird_curve_helper.hpp"
+#include "bird_curve_tables.hpp"
 #include "bit_packer.hpp"
+#include "counting_allocator.hpp"
+#include "perlin_noise.hpp"
+#include "nvh/nvprint.hpp"
 #include "nvh/parallel_work.hpp"
 #include "nvh/timesampler.hpp"
 #include "nvvk/buffers_vk.hpp"
@@ -34,6 +42,8 @@
 MicromapProcess::MicromapProcess(nvvk::Context* ctx, nvvk::ResourceAllocator* allocator)
     : m_device(ctx->m_device)
     , m_alloc(allocator)
+    , m_queue(ctx->m_queueGCT.queue)
+    , m_queueFamilyIndex(ctx->m_queueGCT.familyIndex)
 {
 }
 
@@ -52,10 +62,16 @@ MicromapProcess::~MicromapProcess()
 //--------------------------------------------------------------------------------------------------
 // Create the data for displacement
 // - Get a vector of displacement values per triangle
+// - Optionally lower the subdivision level of the triangles that don't need it
 // - Pack the data to 11 bit (64_TRIANGLES_64_BYTES format)
 // - Get the usage
 // - Create the vector of VkMicromapTriangleEXT
-bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const Terrain& terrain)
+bool MicromapProcess::createMicromapData(VkCommandBuffer           cmd,
+                                         const nvh::PrimitiveMesh& mesh,
+                                         uint16_t                  subdivLevel,
+                                         const Terrain&            terrain,
+                                         const AdaptiveLevel&      adaptive,
+                                         const Streaming&          streaming)
 {
   nvh::ScopedTimer stimer("Create Micromap Data");
 
@@ -65,60 +81,69 @@ bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::Primiti
   m_alloc->destroy(m_microData);
   m_alloc->destroy(m_trianglesBuffer);
 
+  // The chunked version doesn't keep all values in memory, which the adaptive levels need to balance
+  // the neighbors.
+  if(streaming.enable && !adaptive.enable)
+  {
+    m_primitiveFlagsData.clear();
+    if(!streamMicromapData(mesh, subdivLevel, terrain, streaming))
+      return false;
+    barrier(cmd);
+    buildMicromap(cmd);
+    return true;
+  }
+
   // Get an array of displacement per triangle
-  MicroDistances micro_dist = createDisplacements(mesh, subdivLevel, terrain);
+  MicroDistances micro_dist;
+  {
+    nvh::ScopedTimer stimer("Create Displacements");
+    micro_dist = createDisplacements(mesh, subdivLevel, terrain);
+  }
 
-  const auto num_tri = static_cast<uint32_t>(micro_dist.rawTriangles.size());
+  const auto num_tri = static_cast<uint32_t>(micro_dist.size());
+
+  // Each triangle gets the lowest level reproducing its values, the edges shared with a lower level
+  // triangle are flagged for decimation.
+  m_primitiveFlagsData.clear();
+  if(adaptive.enable)
+    m_primitiveFlagsData = adaptSubdivLevels(mesh, micro_dist, adaptive.maxError);
 
 
   // This is for VK_DISPLACEMENT_MICROMAP_FORMAT_64_TRIANGLES_64_BYTES_NV: uncompressed data but packed.
   // In this sample, it is the only supported format, as it other format requires compression and is out
   // of scope for this simple version. The micro-mesh SDK have functions that helps compressing and
   // optimize the data.
+  const VkDisplacementMicromapFormatNV format = VK_DISPLACEMENT_MICROMAP_FORMAT_64_TRIANGLES_64_BYTES_NV;
   if(subdivLevel <= 5)
   {
-
     // Find the displacement blocks for the subdivision. There is only one displacement block for level0..3,
     // as up to 64 triangles can fit. For higher levels, the triangle need to be subdivided in blocks of 64
     // triangles, therefore level-4 have 4 blocks and level-5 have 16 blocks. Each block contains the
     // indices the Bird-Curve subdivided sub-triangle. The indices refer to the indices of the subdivided
     // triangle.
-    BirdCurveHelper                     barycentrics(subdivLevel);
-    BirdCurveHelper::DisplacementBlocks blocks     = barycentrics.createDisplacementBlocks(subdivLevel);
-    uint32_t                            num_blocks = static_cast<uint32_t>(blocks.size());
+    // Triangles are stored one after the other, each taking 64 bytes * number of displacement blocks of its level.
+    std::vector<uint64_t> offsets(num_tri + 1, 0);
+    for(uint32_t tri_index = 0U; tri_index < num_tri; tri_index++)
+      offsets[tri_index + 1] = offsets[tri_index] + getTriangleBytes(micro_dist.subdivLevels[tri_index]);
+
+    // VkMicromapTriangleEXT::dataOffset is 32 bits
+    if(offsets[num_tri] > UINT32_MAX)
+    {
+      LOGE("Displacement data of %llu bytes, above the 4 GiB addressed by VkMicromapTriangleEXT::dataOffset\n",
+           static_cast<unsigned long long>(offsets[num_tri]));
+      return false;
+    }
 
     {
-      // Allocate the array to push on the GPU. This correspond to 64 bytes per triangle * number of displacement blocks
-      std::vector<uint8_t> packed_data(64ULL * num_tri * num_blocks);
+      // Allocate the array to push on the GPU
+      std::vector<uint8_t> packed_data(offsets[num_tri]);
 
       // Loop over all triangles of the mesh
       for(uint32_t tri_index = 0U; tri_index < num_tri; tri_index++)
       {
         // The offset from the start of packed_data, must be a multiple of 64 bit
-        uint32_t offset = 64U * tri_index * num_blocks;
-
-        // Access to all displacement values
-        const std::vector<float>& values = micro_dist.rawTriangles[tri_index].values;
-
-        // Loop for all block of 64 triangles
-        for(uint32_t block_idx = 0U; block_idx < num_blocks; block_idx++)
-        {
-          // The BitPacker will store contiguously unorm11 (float normalized on 11 bit), from the beginning of the
-          // triangle (offset), plus each extra block
-          BitPacker11 packer11(&packed_data[offset + 64U * block_idx]);
-
-          // Get the number of indices in the Block. Subdivision Level 3 and up will always have
-          // 45 sub-triangle indices, and less for lower subdivision levels
-          uint32_t num_tri_idx = static_cast<uint32_t>(blocks[block_idx].size());
-
-          // Each block stores displacements for up to 45 micro-vertices. Find the value index within
-          // the base triangle that corresponds to the barycentric location within the current block.
-          for(uint32_t block_tri_idx = 0U; block_tri_idx < num_tri_idx; block_tri_idx++)
-          {
-            uint32_t value_idx = blocks[block_idx][block_tri_idx];
-            packer11.push(values[value_idx]);
-          }
-        }
+        uint64_t offset = offsets[tri_index];
+        packTriangle(micro_dist.triangle(tri_index), &packed_data[offset]);
       }
 
       m_inputData = m_alloc->createBuffer(
@@ -128,13 +153,13 @@ bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::Primiti
 
     // Micromap Triangle
     {
-      // Each triangle is stored every 64 bytes * number of displacement blocks, see above, and all are using the same subdivision level
+      // Each triangle is stored at the offset computed above, with its own subdivision level
       std::vector<VkMicromapTriangleEXT> micromap_triangles;
       micromap_triangles.reserve(num_tri);
       for(uint32_t tri_index = 0; tri_index < num_tri; tri_index++)
       {
-        uint32_t offset = 64U * tri_index * num_blocks;  // Same offset as when storing the data
-        micromap_triangles.push_back({offset, subdivLevel, VK_DISPLACEMENT_MICROMAP_FORMAT_64_TRIANGLES_64_BYTES_NV});
+        auto level = static_cast<uint16_t>(micro_dist.subdivLevels[tri_index]);
+        micromap_triangles.push_back({static_cast<uint32_t>(offsets[tri_index]), level, static_cast<uint16_t>(format)});
       }
       m_trianglesBuffer = m_alloc->createBuffer(cmd, micromap_triangles,
                                                 VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT
@@ -145,14 +170,26 @@ bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::Primiti
     // Micromesh Usage
     {
       // The usage is like an histogram; how many triangles, using a `format` and a `subdivisionLevel`.
-      // Since all our triangles have the same subdivision level, and the same storage format, there is only
-      // one usage.
-      m_usages.resize(1);
-      m_usages[0].count            = num_tri;
-      m_usages[0].format           = VK_DISPLACEMENT_MICROMAP_FORMAT_64_TRIANGLES_64_BYTES_NV;
-      m_usages[0].subdivisionLevel = subdivLevel;
-    }
-  }
+      std::map<std::pair<uint32_t, uint32_t>, uint32_t> histogram;  // (level, format) -> count
+      for(uint32_t tri_index = 0; tri_index < num_tri; tri_index++)
+        histogram[{micro_dist.subdivLevels[tri_index], format}]++;
+
+      m_usages.clear();
+      for(const auto& [key, count] : histogram)
+      {
+        VkMicromapUsageEXT usage{};
+        usage.count            = count;
+        usage.subdivisionLevel = key.first;
+        usage.format           = key.second;
+        m_usages.push_back(usage);
+        LOGI("  Level %u, format %u: %u triangles\n", key.first, key.second, count);
+      }
+
+      const uint64_t uniform_bytes = 64ULL * num_tri * BirdCurveTables::getNumDisplacementBlocks(subdivLevel);
+      LOGI("Displacement data: %llu bytes, uniform level %u: %llu bytes (saved %.1f%%)\n",
+           static_cast<unsigned long long>(offsets[num_tri]), subdivLevel,
+           static_cast<unsigned long long>(uniform_bytes), 100.0 * (1.0 - double(offsets[num_tri]) / double(uniform_bytes)));
+    }  }
 
   barrier(cmd);
 
@@ -161,6 +198,279 @@ bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::Primiti
   return true;
 }
 
+//--------------------------------------------------------------------------------------------------
+// Pack the values of a triangle in the 64_TRIANGLES_64_BYTES format, to 64 bytes * number of displacement
+// blocks of its level
+//
+void MicromapProcess::packTriangle(const RawTriangle& triangle, uint8_t* dst)
+{
+  // Access to all displacement values
+  std::span<const float> values     = triangle.values;
+  uint32_t               num_blocks = BirdCurveTables::getNumDisplacementBlocks(triangle.subdivLevel);
+
+  // Loop for all block of 64 triangles
+  for(uint32_t block_idx = 0U; block_idx < num_blocks; block_idx++)
+  {
+    // The BitPacker will store contiguously unorm11 (float normalized on 11 bit), from the beginning of the
+    // triangle, plus each extra block
+    BitPacker11 packer11(dst + 64U * block_idx);
+
+    // Get the indices in the Block. Subdivision Level 3 and up will always have
+    // 45 sub-triangle indices, and less for lower subdivision levels
+    std::span<const uint16_t> block       = BirdCurveTables::getDisplacementBlock(triangle.subdivLevel, block_idx);
+    uint32_t                  num_tri_idx = static_cast<uint32_t>(block.size());
+
+    // Each block stores displacements for up to 45 micro-vertices. Find the value index within
+    // the base triangle that corresponds to the barycentric location within the current block.
+    std::array<uint32_t, 45> unorm11{};
+    for(uint32_t block_tri_idx = 0U; block_tri_idx < num_tri_idx; block_tri_idx++)
+    {
+      uint32_t value_idx     = block[block_tri_idx];
+      unorm11[block_tri_idx] = floatToR11(values[value_idx]);
+    }
+    packer11.pushSpan(unorm11.data(), num_tri_idx);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Chunked version of createMicromapData(): the triangles are generated, packed and copied to a ring of
+// staging buffers, `chunk` triangles at a time. The copy of a chunk is submitted without waiting, so
+// the GPU upload overlaps the generation of the next chunk, and a staging buffer is only reused once
+// its copy is done (fence).
+// The host memory is bounded by the ring and the values of one chunk, not by the size of the mesh.
+//
+bool MicromapProcess::streamMicromapData(const nvh::PrimitiveMesh& mesh,
+                                         uint16_t                  subdivLevel,
+                                         const Terrain&            terrain,
+                                         const Streaming&          streaming)
+{
+  nvh::ScopedTimer stimer("Stream Micromap Data");
+
+  // Same limit as createMicromapData(), the Bird Curve tables stop at level 5
+  if(subdivLevel > 5)
+  {
+    LOGE("Streaming: subdivision level %u is above the maximum of 5\n", subdivLevel);
+    return false;
+  }
+
+  const auto     num_tri    = static_cast<uint32_t>(mesh.triangles.size());
+  const uint32_t ring_size  = std::max(streaming.ringSize, 1U);
+  const auto     format     = VK_DISPLACEMENT_MICROMAP_FORMAT_64_TRIANGLES_64_BYTES_NV;
+  const uint32_t max_bytes  = getTriangleBytes(subdivLevel);
+  const uint64_t value_size = BirdCurveTables::getNumMicroVertices(subdivLevel) * sizeof(float);
+
+  // Triangles per chunk: each staging buffer holds the packed data and the VkMicromapTriangleEXT of a chunk
+  const uint64_t staging_per_tri = max_bytes + sizeof(VkMicromapTriangleEXT);
+  const uint64_t budget          = static_cast<uint64_t>(streaming.memoryBudgetMB) << 20;
+  const uint64_t per_tri         = ring_size * staging_per_tri + value_size;
+  const auto     chunk           = static_cast<uint32_t>(std::clamp<uint64_t>(budget / per_tri, 1, num_tri));
+  const uint32_t num_chunks      = (num_tri + chunk - 1) / chunk;
+
+  // Each chunk starts on a 128 bytes boundary. VkMicromapTriangleEXT::dataOffset is 32 bits: 10M
+  // triangles at level 5 (1024 bytes each) don't fit.
+  const uint64_t data_size = static_cast<uint64_t>(max_bytes) * num_tri + 128ULL * num_chunks;
+  if(data_size > UINT32_MAX)
+  {
+    LOGE("Streaming: %llu bytes of displacement data, above the 4 GiB addressed by VkMicromapTriangleEXT::dataOffset\n",
+         static_cast<unsigned long long>(data_size));
+    return false;
+  }
+
+  // Destination buffers
+  const VkBufferUsageFlags usage = VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                   | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  m_inputData       = m_alloc->createBuffer(data_size, usage);
+  m_trianglesBuffer = m_alloc->createBuffer(sizeof(VkMicromapTriangleEXT) * num_tri, usage);
+
+  // Ring of staging buffers, each with its command buffer and fence
+  struct Slot
+  {
+    nvvk::Buffer    staging;
+    uint8_t*        mapped{nullptr};
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+    VkFence         fence{VK_NULL_HANDLE};
+    bool            inFlight{false};
+  };
+  std::vector<Slot> ring(ring_size);
+
+  VkCommandPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_info.queueFamilyIndex = m_queueFamilyIndex;
+  VkCommandPool cmd_pool{VK_NULL_HANDLE};
+  NVVK_CHECK(vkCreateCommandPool(m_device, &pool_info, nullptr, &cmd_pool));
+
+  const VkDeviceSize staging_size = staging_per_tri * chunk;
+  for(Slot& slot : ring)
+  {
+    slot.staging = m_alloc->createBuffer(staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    slot.mapped  = static_cast<uint8_t*>(m_alloc->map(slot.staging));
+
+    VkCommandBufferAllocateInfo alloc_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    alloc_info.commandPool        = cmd_pool;
+    alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    NVVK_CHECK(vkAllocateCommandBuffers(m_device, &alloc_info, &slot.cmd));
+
+    VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    NVVK_CHECK(vkCreateFence(m_device, &fence_info, nullptr, &slot.fence));
+  }
+
+  std::map<std::pair<uint32_t, uint32_t>, uint32_t> histogram;  // (level, format) -> count
+  uint64_t                                          data_offset{0};
+  double                                            wait_ms{0.0};
+
+  for(uint32_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++)
+  {
+    const uint32_t first_tri = chunk_idx * chunk;
+
+    // Generate while the previous chunks are uploading
+    MicroDistances micro_dist = createDisplacements(mesh, subdivLevel, terrain, first_tri, chunk);
+    const auto count = static_cast<uint32_t>(micro_dist.size());
+
+    // Wait for the staging buffer to be free
+    Slot& slot = ring[chunk_idx % ring_size];
+    if(slot.inFlight)
+    {
+      auto t0 = std::chrono::high_resolution_clock::now();
+      NVVK_CHECK(vkWaitForFences(m_device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+      NVVK_CHECK(vkResetFences(m_device, 1, &slot.fence));
+      wait_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    }
+
+    // Pack to the staging buffer: data first, then the triangles
+    const uint64_t chunk_offset = data_offset;
+    uint32_t       local_offset = 0;
+    auto*          triangles    = reinterpret_cast<VkMicromapTriangleEXT*>(slot.mapped + static_cast<size_t>(max_bytes) * chunk);
+    for(uint32_t i = 0; i < count; i++)
+    {
+      const uint32_t level = micro_dist.subdivLevels[i];
+      const uint32_t size  = getTriangleBytes(level);
+
+      // Multiple of 64 bytes in the destination buffer; chunk_offset is a multiple of 128
+      std::memset(slot.mapped + local_offset, 0, size);
+      packTriangle(micro_dist.triangle(i), slot.mapped + local_offset);
+
+      // Below 4 GiB, checked with data_size
+      triangles[i] = {static_cast<uint32_t>(chunk_offset + local_offset), static_cast<uint16_t>(level), static_cast<uint16_t>(format)};
+      histogram[{level, format}]++;
+      local_offset += size;
+    }
+    data_offset += (local_offset + 127U) & ~127U;
+
+    // Upload
+    VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    NVVK_CHECK(vkBeginCommandBuffer(slot.cmd, &begin_info));
+    const VkBufferCopy data_copy{0, chunk_offset, local_offset};
+    const VkBufferCopy tri_copy{static_cast<VkDeviceSize>(max_bytes) * chunk, sizeof(VkMicromapTriangleEXT) * first_tri,
+                                sizeof(VkMicromapTriangleEXT) * count};
+    if(local_offset > 0)
+      vkCmdCopyBuffer(slot.cmd, slot.staging.buffer, m_inputData.buffer, 1, &data_copy);
+    vkCmdCopyBuffer(slot.cmd, slot.staging.buffer, m_trianglesBuffer.buffer, 1, &tri_copy);
+    NVVK_CHECK(vkEndCommandBuffer(slot.cmd));
+
+    VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers    = &slot.cmd;
+    NVVK_CHECK(vkQueueSubmit(m_queue, 1, &submit_info, slot.fence));
+    slot.inFlight = true;
+  }
+
+  // All copies must be done before the micromap build, and before releasing the ring
+  for(Slot& slot : ring)
+  {
+    if(slot.inFlight)
+      NVVK_CHECK(vkWaitForFences(m_device, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+    m_alloc->unmap(slot.staging);
+    m_alloc->destroy(slot.staging);
+    vkDestroyFence(m_device, slot.fence, nullptr);
+  }
+  vkDestroyCommandPool(m_device, cmd_pool, nullptr);
+
+  m_usages.clear();
+  for(const auto& [key, count] : histogram)
+  {
+    VkMicromapUsageEXT usage{};
+    usage.count            = count;
+    usage.subdivisionLevel = key.first;
+    usage.format           = key.second;
+    m_usages.push_back(usage);
+  }
+
+  LOGI("Streamed %u triangles in %u chunks of %u, staging %u x %.1f MB, data %llu bytes, waited %.2f ms on uploads\n",
+       num_tri, num_chunks, chunk, ring_size, staging_size / (1024.0 * 1024.0), static_cast<unsigned long long>(data_offset), wait_ms);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Micro-benchmark of the storage of the raw values: one vector per triangle (previous layout) against
+// a single array, the storage of MicroDistances. Both are filled and then read in triangle order, like
+// createMicromapData() does. The vectors use a CountingAllocator, the allocations reported are the
+// ones made.
+//
+void MicromapProcess::benchmarkStorage(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel)
+{
+  using clock = std::chrono::high_resolution_clock;
+
+  const size_t num_tri    = mesh.triangles.size();
+  const size_t num_values = BirdCurveTables::getNumMicroVertices(subdivLevel);
+  auto         value      = [](size_t tri, size_t i) { return static_cast<float>((tri + i) & 1023) / 1023.0F; };
+
+  // Previous layout
+  size_t vector_allocs{0};
+  auto   t0 = clock::now();
+  struct VectorTriangle
+  {
+    uint32_t             subdivLevel{0};
+    CountedVector<float> values;
+  };
+  const CountingAllocator<float> vector_alloc(&vector_allocs);
+  CountedVector<VectorTriangle>  per_triangle(vector_alloc);
+  per_triangle.reserve(num_tri);
+  for(size_t t = 0; t < num_tri; t++)
+  {
+    per_triangle.push_back({subdivLevel, CountedVector<float>(vector_alloc)});
+    per_triangle[t].values.resize(num_values);
+    for(size_t i = 0; i < num_values; i++)
+      per_triangle[t].values[i] = value(t, i);
+  }
+  auto   t1         = clock::now();
+  double vector_sum = 0.0;
+  for(const VectorTriangle& triangle : per_triangle)
+  {
+    for(float v : triangle.values)
+      vector_sum += v;
+  }
+  auto t2 = clock::now();
+
+  // Single array, as MicroDistances
+  size_t                         arena_allocs{0};
+  const CountingAllocator<float> arena_alloc(&arena_allocs);
+  CountedVector<uint32_t>        arena_levels(num_tri, subdivLevel, arena_alloc);
+  CountedVector<float>           arena_values(num_tri * num_values, 0.0F, arena_alloc);
+  for(size_t t = 0; t < num_tri; t++)
+  {
+    for(size_t i = 0; i < num_values; i++)
+      arena_values[t * num_values + i] = value(t, i);
+  }
+  auto   t3        = clock::now();
+  double arena_sum = 0.0;
+  for(size_t t = 0; t < num_tri; t++)
+  {
+    const std::span<const float> values(arena_values.data() + t * num_values, BirdCurveTables::getNumMicroVertices(arena_levels[t]));
+    for(float v : values)
+      arena_sum += v;
+  }
+  auto t4 = clock::now();
+
+  auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+  LOGI("Storage benchmark: %zu triangles, level %d, %zu values each\n", num_tri, subdivLevel, num_values);
+  LOGI(" - Vector per triangle : %zu allocations, fill %8.2f ms, read %8.2f ms\n", vector_allocs, ms(t0, t1), ms(t1, t2));
+  LOGI(" - Single array        : %zu allocations, fill %8.2f ms, read %8.2f ms\n", arena_allocs, ms(t2, t3), ms(t3, t4));
+  LOGI(" - Identical           : %s\n", vector_sum == arena_sum ? "yes" : "NO");
+}
+
 //--------------------------------------------------------------------------------------------------
 // Building the micromap using: triangle data, input data (values), usage
 //
@@ -260,10 +570,12 @@ void MicromapProcess::createMicromapBuffers(VkCommandBuffer cmd, const nvh::Prim
   }
 
 
-  // // Primitive flags [unused for now, since all triangles have the same subdivision level]
+  // Primitive flags: edge decimation, only needed when neighbor triangles have different subdivision levels
   {
-    std::vector<uint8_t> primitive_flags;
-    if(!primitive_flags.empty())
+    const std::vector<uint8_t>& primitive_flags = m_primitiveFlagsData;
+    bool                        has_decimation  = std::any_of(primitive_flags.begin(), primitive_flags.end(),
+                                                              [](uint8_t flags) { return flags != 0; });
+    if(has_decimation)
     {
       m_primitiveFlags = m_alloc->createBuffer(cmd, primitive_flags,
                                                VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT
@@ -292,55 +604,175 @@ void MicromapProcess::barrier(VkCommandBuffer cmd)
 
 //--------------------------------------------------------------------------------------------------
 // Get the displacement values per triangle; UV distance from [0.5,0.5]
-// -
-MicromapProcess::MicroDistances MicromapProcess::createDisplacements(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const Terrain& terrain)
+// - Only the `numTriangles` from `firstTriangle` are computed, triangle(0) being `firstTriangle`
+MicromapProcess::MicroDistances MicromapProcess::createDisplacements(const nvh::PrimitiveMesh& mesh,
+                                                                     uint16_t                  subdivLevel,
+                                                                     const Terrain&            terrain,
+                                                                     uint32_t                  firstTriangle,
+                                                                     uint32_t                  numTriangles)
 {
-  nvh::ScopedTimer stimer("Create Displacements");
-
   MicroDistances displacements;  // Return of displacement values for all triangles
 
-  // Utility to get the barycentric values
-  BirdCurveHelper                         barycentrics(subdivLevel);
-  const BirdCurveHelper::BaryCoordinates& bvalues = barycentrics.getVertexCoord(subdivLevel);
+  // Barycentric values of the micro-vertices, in Bird Curve order
+  std::span<const BirdCurveTables::Bary> bvalues = BirdCurveTables::getVertexCoord(subdivLevel);
 
-  auto num_tri = static_cast<uint32_t>(mesh.triangles.size());
-  displacements.rawTriangles.resize(num_tri);
+  auto num_tri = std::min(numTriangles, static_cast<uint32_t>(mesh.triangles.size()) - firstTriangle);
+  displacements.stride = bvalues.size();
+  displacements.subdivLevels.assign(num_tri, subdivLevel);
+  displacements.values.resize(num_tri * displacements.stride);
 
   // Find the distances in parallel
   // Faster than : for(size_t tri_index = 0; tri_index < num_tri; tri_index++)
   nvh::parallel_batches<32>(
       num_tri,
-      [&](uint64_t tri_index) {
+      [&](uint64_t local_index) {
         // Retrieve the UV of the triangle
-        nvmath::vec2f t0 = mesh.vertices[mesh.triangles[tri_index].v[0]].t;
-        nvmath::vec2f t1 = mesh.vertices[mesh.triangles[tri_index].v[1]].t;
-        nvmath::vec2f t2 = mesh.vertices[mesh.triangles[tri_index].v[2]].t;
+        const uint64_t tri_index = firstTriangle + local_index;
+        nvmath::vec2f  t0        = mesh.vertices[mesh.triangles[tri_index].v[0]].t;
+        nvmath::vec2f  t1        = mesh.vertices[mesh.triangles[tri_index].v[1]].t;
+        nvmath::vec2f  t2        = mesh.vertices[mesh.triangles[tri_index].v[2]].t;
 
         // Working on this triangle
-        RawTriangle& triangle = displacements.rawTriangles[tri_index];
-        triangle.values.resize(bvalues.size());
-        triangle.subdivLevel = subdivLevel;
+        float* values = displacements.values.data() + local_index * displacements.stride;
 
+        // UV of the micro-vertices, the noise being evaluated on all of them at once
+        std::array<float, BirdCurveTables::getNumMicroVertices(BirdCurveTables::kMaxLevel)> u, v, w;
         for(size_t index = 0; index < bvalues.size(); index++)
         {
-          nvmath::vec2f uv = getInterpolated(t0, t1, t2, bvalues[index]);
-
-          // Simple perlin noise
-          float v     = 0.0F;
-          float scale = terrain.power;
-          float freq  = terrain.freq;
-          for(int oct = 0; oct < terrain.octave; oct++)
-          {
-            v += glm::perlin(glm::vec3(uv.x, uv.y, terrain.seed) * freq) / scale;
-            freq *= 2.0F;            // Double the frequency
-            scale *= terrain.power;  // Next power of b
-          }
-
-          // Adjusting the value
-          triangle.values[index] = nvmath::clamp((1.0F + v) * 0.5F, 0.0F, 1.0F);
+          nvmath::vec2f uv = getInterpolated(t0, t1, t2, BirdCurveTables::toFloat(bvalues[index]));
+          u[index]         = uv.x;
+          v[index]         = uv.y;
+          w[index]         = terrain.seed;
         }
+
+        // Simple perlin noise
+        noise::fbm(u.data(), v.data(), w.data(), values, bvalues.size(), {terrain.octave, terrain.power, terrain.freq});
+
+        // Adjusting the value
+        for(size_t index = 0; index < bvalues.size(); index++)
+          values[index] = nvmath::clamp((1.0F + values[index]) * 0.5F, 0.0F, 1.0F);
       },
       std::thread::hardware_concurrency());
 
   return displacements;
 }
+
+
+//--------------------------------------------------------------------------------------------------
+// Largest difference between the values of `maxLevel` and the same values linearly interpolated
+// from the micro-triangles of `level`. The micro-vertices of `level` are the first ones of `maxLevel`.
+//
+static float interpolationError(std::span<const float> values, uint32_t level, uint32_t maxLevel)
+{
+  constexpr uint32_t scale = BirdCurveTables::kScale;
+
+  std::span<const BirdCurveTables::Bary> bvalues = BirdCurveTables::getVertexCoord(maxLevel);
+
+  const uint32_t step = scale >> level;  // Size of the micro-triangles of `level`
+  const float    inv  = 1.0F / static_cast<float>(step);
+  auto           at   = [&](uint32_t u, uint32_t v) { return values[BirdCurveTables::getVertexIndex(u, v)]; };
+
+  float max_error = 0.0F;
+  for(size_t index = BirdCurveTables::getNumMicroVertices(level); index < bvalues.size(); index++)
+  {
+    const uint32_t u  = bvalues[index].u;
+    const uint32_t v  = bvalues[index].v;
+    const uint32_t iu = (u / step) * step;
+    const uint32_t iv = (v / step) * step;
+    const float    fu = static_cast<float>(u - iu) * inv;
+    const float    fv = static_cast<float>(v - iv) * inv;
+
+    float value{0.0F};
+    if(fu + fv <= 1.0F)  // Micro-triangle pointing up
+      value = at(iu, iv) * (1.0F - fu - fv) + at(iu + step, iv) * fu + at(iu, iv + step) * fv;
+    else  // Pointing down
+      value = at(iu + step, iv + step) * (fu + fv - 1.0F) + at(iu + step, iv) * (1.0F - fv) + at(iu, iv + step) * (1.0F - fu);
+
+    max_error = std::max(max_error, std::abs(value - values[index]));
+  }
+  return max_error;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Lower the subdivision level of each triangle to the lowest one reproducing its values within
+// `maxError`. Adjacent triangles are kept within one level of each other, which is what edge
+// decimation can stitch without cracks.
+// Returns the primitive flags: bit `e` is set when the neighbor across edge `e` (v0v1, v1v2, v2v0)
+// has a lower level.
+//
+std::vector<uint8_t> MicromapProcess::adaptSubdivLevels(const nvh::PrimitiveMesh& mesh, MicroDistances& microDist, float maxError)
+{
+  nvh::ScopedTimer stimer("Adapt Subdivision Levels");
+
+  auto num_tri = static_cast<uint32_t>(microDist.size());
+
+  // Lowest level for each triangle, in parallel
+  std::vector<uint32_t> levels(num_tri);
+  nvh::parallel_batches<32>(
+      num_tri,
+      [&](uint64_t tri_index) {
+        const RawTriangle triangle = microDist.triangle(tri_index);
+
+        uint32_t level = 0;
+        while(level < triangle.subdivLevel && interpolationError(triangle.values, level, triangle.subdivLevel) > maxError)
+          level++;
+        levels[tri_index] = level;
+      },
+      std::thread::hardware_concurrency());
+
+  // Neighbor across each edge, from the shared vertex indices
+  std::vector<std::array<int32_t, 3>>    neighbors(num_tri, {-1, -1, -1});
+  std::unordered_map<uint64_t, uint32_t> edges;  // Edge key -> (triangle * 3 + edge)
+  edges.reserve(num_tri * 3ULL);
+  for(uint32_t t = 0; t < num_tri; t++)
+  {
+    for(uint32_t e = 0; e < 3; e++)
+    {
+      uint32_t a   = mesh.triangles[t].v[e];
+      uint32_t b   = mesh.triangles[t].v[(e + 1) % 3];
+      uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+
+      auto [it, inserted] = edges.try_emplace(key, t * 3 + e);
+      if(!inserted)
+      {
+        uint32_t other                  = it->second;
+        neighbors[t][e]                 = static_cast<int32_t>(other / 3);
+        neighbors[other / 3][other % 3] = static_cast<int32_t>(t);
+      }
+    }
+  }
+
+  // Raise the levels until no neighbors are more than one level apart (levels only increase, so this ends)
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+    for(uint32_t t = 0; t < num_tri; t++)
+    {
+      for(int32_t n : neighbors[t])
+      {
+        if(n >= 0 && levels[n] > levels[t] + 1)
+        {
+          levels[t] = levels[n] - 1;
+          changed   = true;
+        }
+      }
+    }
+  }
+
+  // The values of the selected level are the first ones of the Bird Curve, changing the level is enough
+  std::vector<uint8_t> primitive_flags(num_tri, 0);
+  for(uint32_t t = 0; t < num_tri; t++)
+  {
+    microDist.subdivLevels[t] = levels[t];
+
+    for(uint32_t e = 0; e < 3; e++)
+    {
+      int32_t n = neighbors[t][e];
+      if(n >= 0 && levels[n] < levels[t])
+        primitive_flags[t] |= static_cast<uint8_t>(1U << e);
+    }
+  }
+
+  return primitive_flags;
+}
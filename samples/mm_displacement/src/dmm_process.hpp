@@ -17,12 +17,14 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <span>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
 #include "nvvk/context_vk.hpp"
 #include "nvvk/resourceallocator_vk.hpp"
 #include "nvh/primitives.hpp"
+#include "bird_curve_tables.hpp"
 
 // Setting for the terrain generator
 struct Terrain
@@ -33,6 +35,22 @@ struct Terrain
   int   octave{4};
 };
 
+// Setting for the per-triangle subdivision level
+struct AdaptiveLevel
+{
+  bool  enable{false};
+  float maxError{0.005F};  // Largest (normalized) displacement error allowed when lowering the level of a triangle
+};
+
+// Setting for the chunked build: triangles are generated, packed and uploaded a chunk at a time,
+// through a ring of staging buffers, bounding the host memory whatever the size of the mesh.
+struct Streaming
+{
+  bool     enable{false};
+  uint32_t memoryBudgetMB{64};  // Staging ring + values of the chunk being generated
+  uint32_t ringSize{3};         // Number of staging buffers in flight
+};
+
 
 class MicromapProcess
 {
@@ -41,10 +59,18 @@ public:
   MicromapProcess(nvvk::Context* ctx, nvvk::ResourceAllocator* allocator);
   ~MicromapProcess();
 
-  bool createMicromapData(VkCommandBuffer cmd, const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const Terrain& terrain);
+  bool createMicromapData(VkCommandBuffer           cmd,
+                          const nvh::PrimitiveMesh& mesh,
+                          uint16_t                  subdivLevel,
+                          const Terrain&            terrain,
+                          const AdaptiveLevel&      adaptive  = {},
+                          const Streaming&          streaming = {});
   void createMicromapBuffers(VkCommandBuffer cmd, const nvh::PrimitiveMesh& mesh, const nvmath::vec2f& biasScale);
   void cleanBuildData();
 
+  // Compare the single array storage of the raw values against one vector per triangle, logs the results
+  static void benchmarkStorage(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel);
+
   const nvvk::Buffer&                    primitiveFlags() { return m_primitiveFlags; }
   const nvvk::Buffer&                    displacementDirections() { return m_displacementDirections; }
   const nvvk::Buffer&                    displacementBiasAndScale() { return m_displacementBiasAndScale; }
@@ -59,25 +85,50 @@ private:
     std::vector<VkMicromapUsageEXT>    usages;
   };
 
-  // Raw values per triangles
+  // Raw values of a triangle, view on MicroDistances
   struct RawTriangle
   {
-    uint32_t           subdivLevel{0};
-    std::vector<float> values;
+    uint32_t               subdivLevel{0};
+    std::span<const float> values;
   };
 
+  // Raw values of all triangles, in a single array instead of one allocation per triangle.
+  // All triangles are generated at the same level: the values of triangle `i` start at `i * stride`.
+  // Lowering the level of a triangle keeps the prefix of its values (Bird Curve order).
   struct MicroDistances
   {
-    std::vector<RawTriangle> rawTriangles;
+    std::vector<uint32_t> subdivLevels;
+    std::vector<float>    values;
+    size_t                stride{0};
+
+    size_t      size() const { return subdivLevels.size(); }
+    RawTriangle triangle(size_t i) const
+    {
+      return {subdivLevels[i], {values.data() + i * stride, BirdCurveTables::getNumMicroVertices(subdivLevels[i])}};
+    }
   };
 
 
   bool        buildMicromap(VkCommandBuffer cmd);
+  bool        streamMicromapData(const nvh::PrimitiveMesh& mesh,
+                                 uint16_t                  subdivLevel,
+                                 const Terrain&            terrain,
+                                 const Streaming&          streaming);
+  static void packTriangle(const RawTriangle& triangle, uint8_t* dst);
+  // Bytes of a triangle in the 64_TRIANGLES_64_BYTES format: one 64-byte block per 64 micro-triangles
+  static uint32_t getTriangleBytes(uint32_t subdivLevel) { return 64U * BirdCurveTables::getNumDisplacementBlocks(subdivLevel); }
   static void barrier(VkCommandBuffer cmd);
-  static MicroDistances createDisplacements(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const Terrain& terrain);
+  static MicroDistances createDisplacements(const nvh::PrimitiveMesh& mesh,
+                                            uint16_t                  subdivLevel,
+                                            const Terrain&            terrain,
+                                            uint32_t                  firstTriangle = 0,
+                                            uint32_t                  numTriangles  = ~0U);
+  static std::vector<uint8_t> adaptSubdivLevels(const nvh::PrimitiveMesh& mesh, MicroDistances& microDist, float maxError);
 
   VkDevice                 m_device;
   nvvk::ResourceAllocator* m_alloc;
+  VkQueue                  m_queue{VK_NULL_HANDLE};  // Used by the streaming uploads
+  uint32_t                 m_queueFamilyIndex{0};
 
   nvvk::Buffer m_inputData;
   nvvk::Buffer m_microData;
@@ -89,4 +140,5 @@ private:
 
   VkMicromapEXT                   m_micromap{VK_NULL_HANDLE};
   std::vector<VkMicromapUsageEXT> m_usages;
+  std::vector<uint8_t>            m_primitiveFlagsData;  // Edge decimation, per triangle
 };
@@ -124,6 +124,8 @@ class MicromeshDisplacement : public nvvkhl::IAppElement
     int           subdivlevel{3};
     nvmath::vec2f dispBiasScale{-0.3F, 1.0F};
     Terrain       terrain{};
+    AdaptiveLevel adaptive{};
+    Streaming     streaming{};
     bool          showWireframe{true};
   } m_settings;
 
@@ -159,7 +161,8 @@ public:
     {
       nvh::ScopedTimer stimer("Create Micromesh");
       VkCommandBuffer  cmd = m_app->createTempCmdBuffer();
-      m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, m_settings.terrain);
+      m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, m_settings.terrain, m_settings.adaptive,
+                                     m_settings.streaming);
       m_micromap->createMicromapBuffers(cmd, m_meshes[0], m_settings.dispBiasScale);
       m_app->submitAndWaitTempCmdBuffer(cmd);
       m_micromap->cleanBuildData();
@@ -205,12 +208,33 @@ public:
       bool bias_scale_changed{false};
       level_changed |= PropertyEditor::entry("Subdivision Level",
                                              [&] { return ImGui::SliderInt("#1", &m_settings.subdivlevel, 0, 5); });
+      level_changed |= PropertyEditor::entry("Adaptive Level",
+                                             [&] { return ImGui::Checkbox("##ll", &m_settings.adaptive.enable); });
+      if(m_settings.adaptive.enable)
+      {
+        level_changed |= PropertyEditor::entry("Max Error", [&] {
+          return ImGui::SliderFloat("#1", &m_settings.adaptive.maxError, 0.0F, 0.05F, "%.4f");
+        });
+      }
+      level_changed |= PropertyEditor::entry("Streaming",
+                                             [&] { return ImGui::Checkbox("##ll", &m_settings.streaming.enable); });
+      if(m_settings.streaming.enable)
+      {
+        level_changed |= PropertyEditor::entry("Memory Budget (MB)", [&] {
+          return ImGui::SliderInt("#1", (int*)&m_settings.streaming.memoryBudgetMB, 1, 1024);
+        });
+      }
       bias_scale_changed |= PropertyEditor::entry("Displacement Bias", [&] {
         return ImGui::SliderFloat("#1", &m_settings.dispBiasScale.x, -1.0F, 1.0F);
       });
       bias_scale_changed |= PropertyEditor::entry("Displacement Scale", [&] {
         return ImGui::SliderFloat("#1", &m_settings.dispBiasScale.y, 0.0F, 2.0F);
       });
+      if(PropertyEditor::entry("Raw Values", [&] { return ImGui::Button("Storage Benchmark"); }))
+      {
+        // Dense plane, to compare the single array of values against a vector per triangle
+        MicromapProcess::benchmarkStorage(nvh::createPlane(256, 1.0F, 1.0F), m_settings.subdivlevel);
+      }
       if(PropertyEditor::treeNode("Terrain"))
       {
         PropertyEditor::entry("Show Wireframe", [&] { return ImGui::Checkbox("##ll", &m_settings.showWireframe); });
@@ -236,11 +260,12 @@ public:
 
         if(level_changed)
         {  // Recreate all values
-          m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, m_settings.terrain);
+          m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, m_settings.terrain, m_settings.adaptive,
+                                         m_settings.streaming);
         }
 
-        if(bias_scale_changed)
-        {  // Recreate the buffers attached to the BLAS
+        if(bias_scale_changed || level_changed)
+        {  // Recreate the buffers attached to the BLAS (the primitive flags depend on the levels)
           m_micromap->createMicromapBuffers(cmd, m_meshes[0], m_settings.dispBiasScale);
         }
         m_app->submitAndWaitTempCmdBuffer(cmd);
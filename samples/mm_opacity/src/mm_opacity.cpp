@@ -36,6 +36,8 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include <array>
+#include <cfloat>
+#include <memory>
 #include <glm/detail/type_half.hpp>  // for half float
 
 #include <vulkan/vulkan_core.h>
@@ -104,6 +106,14 @@ const auto& rahit_shd = std::vector<uint32_t>{std::begin(raytrace_rahit), std::e
 /// </summary> Ray trace multiple primitives
 class MicomapOpacity : public nvvkhl::IAppElement
 {
+  // Where the opacity comes from, all giving the disc of `radius` tested by the any-hit shader
+  enum OpacitySourceType
+  {
+    eCircle,        // Analytic test of the positions
+    eAlphaTexture,  // 8-bit alpha texture over the texture coordinates
+    eSdfGrid,       // Signed distance grid over the bounding box of the mesh
+  };
+
   struct Settings
   {
     float intensity{5.0F};
@@ -117,6 +127,8 @@ class MicomapOpacity : public nvvkhl::IAppElement
     float    radius{0.5F};
     bool     useAnyHit{true};
     uint16_t micromapFormat{VK_OPACITY_MICROMAP_FORMAT_4_STATE_EXT};
+    bool     adaptiveLevel{true};
+    int      opacitySource{eCircle};
   } m_settings;
 
 
@@ -152,7 +164,8 @@ public:
     {
       nvh::ScopedTimer stimer("Create MICROMAP");
       VkCommandBuffer  cmd = m_app->createTempCmdBuffer();
-      m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, m_settings.radius, m_settings.micromapFormat);
+      m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, *createOpacitySource(m_meshes[0]),
+                                     m_settings.micromapFormat, m_settings.adaptiveLevel);
       m_app->submitAndWaitTempCmdBuffer(cmd);
       m_micromap->cleanBuildData();
     }
@@ -200,6 +213,9 @@ public:
 
       subdiv_changed |=
           PropertyEditor::entry("Radius", [&] { return ImGui::SliderFloat("#1", &m_settings.radius, 0.0F, 1.0F); });
+      subdiv_changed |= PropertyEditor::entry("Opacity Source", [&] {
+        return ImGui::Combo("##1", &m_settings.opacitySource, "Circle\0Alpha Texture\0SDF Grid\0");
+      });
 
       subdiv_changed |= PropertyEditor::entry("Micro-map format", [&] {
         return ImGui::RadioButton("2-States", (int*)&m_settings.micromapFormat, VK_OPACITY_MICROMAP_FORMAT_2_STATE_EXT);
@@ -207,9 +223,17 @@ public:
       subdiv_changed |= PropertyEditor::entry("", [&] {
         return ImGui::RadioButton("4-States", (int*)&m_settings.micromapFormat, VK_OPACITY_MICROMAP_FORMAT_4_STATE_EXT);
       });
+      subdiv_changed |= PropertyEditor::entry("Adaptive Level",
+                                              [&] { return ImGui::Checkbox("##ll", &m_settings.adaptiveLevel); });
 
       PropertyEditor::entry("Show Wireframe", [&] { return ImGui::Checkbox("##ll", &m_settings.showWireframe); });
       PropertyEditor::entry("Use AnyHit", [&] { return ImGui::Checkbox("##ll", &m_settings.useAnyHit); });
+      if(PropertyEditor::entry("Classification", [&] { return ImGui::Button("Benchmark"); }))
+      {
+        // Dense plane, to compare the hierarchical classification against testing each micro-triangle
+        const nvh::PrimitiveMesh plane = nvh::createPlane(128, 1.0F, 1.0F);
+        MicromapProcess::benchmarkOpacity(plane, m_settings.subdivlevel, *createOpacitySource(plane));
+      }
 
       if(subdiv_changed)
       {
@@ -219,7 +243,8 @@ public:
         VkCommandBuffer cmd = m_app->createTempCmdBuffer();
 
         // Recreate all values
-        m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, m_settings.radius, m_settings.micromapFormat);
+        m_micromap->createMicromapData(cmd, m_meshes[0], m_settings.subdivlevel, *createOpacitySource(m_meshes[0]),
+                                       m_settings.micromapFormat, m_settings.adaptiveLevel);
 
         m_app->submitAndWaitTempCmdBuffer(cmd);
         m_micromap->cleanBuildData();
@@ -321,6 +346,60 @@ private:
   }
 
 
+  //--------------------------------------------------------------------------------------------------
+  // #MICROMAP
+  // The selected opacity source, for the disc of `radius` around the origin. The texture and the grid
+  // are sampled from the disc, so the micromap stays consistent with the any-hit shader.
+  std::unique_ptr<OpacitySource> createOpacitySource(const nvh::PrimitiveMesh& mesh) const
+  {
+    const float radius = m_settings.radius;
+    switch(m_settings.opacitySource)
+    {
+      case eAlphaTexture: {
+        // The plane maps [0,1] texture coordinates on its unit size: the disc is centered on (0.5, 0.5)
+        const uint32_t       size = 512;
+        std::vector<uint8_t> alpha(static_cast<size_t>(size) * size);
+        for(uint32_t y = 0; y < size; y++)
+        {
+          for(uint32_t x = 0; x < size; x++)
+          {
+            const nvmath::vec2f uv{(static_cast<float>(x) + 0.5F) / size - 0.5F, (static_cast<float>(y) + 0.5F) / size - 0.5F};
+            alpha[static_cast<size_t>(y) * size + x] = nvmath::length(uv) <= radius ? 255 : 0;
+          }
+        }
+        return std::make_unique<AlphaTextureOpacitySource>(size, size, alpha.data());
+      }
+      case eSdfGrid: {
+        // Distance to the sphere of `radius`, on a grid over the bounding box of the mesh
+        nvmath::vec3f bbox_min{FLT_MAX, FLT_MAX, FLT_MAX};
+        nvmath::vec3f bbox_max{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for(const auto& v : mesh.vertices)
+        {
+          bbox_min = nvmath::nv_min(bbox_min, v.p);
+          bbox_max = nvmath::nv_max(bbox_max, v.p);
+        }
+        const nvmath::vec3i dim{65, bbox_max.y > bbox_min.y ? 65 : 1, 65};
+        std::vector<float>  distances(static_cast<size_t>(dim.x) * dim.y * dim.z);
+        for(int z = 0; z < dim.z; z++)
+        {
+          for(int y = 0; y < dim.y; y++)
+          {
+            for(int x = 0; x < dim.x; x++)
+            {
+              const nvmath::vec3f t{static_cast<float>(x) / std::max(dim.x - 1, 1), static_cast<float>(y) / std::max(dim.y - 1, 1),
+                                    static_cast<float>(z) / std::max(dim.z - 1, 1)};
+              const nvmath::vec3f p = bbox_min + (bbox_max - bbox_min) * t;
+              distances[(static_cast<size_t>(z) * dim.y + y) * dim.x + x] = nvmath::length(p) - radius;
+            }
+          }
+        }
+        return std::make_unique<SdfGridOpacitySource>(dim, bbox_min, bbox_max, std::move(distances));
+      }
+      default:
+        return std::make_unique<CircleOpacitySource>(nvmath::vec3f{0.0F, 0.0F, 0.0F}, radius);
+    }
+  }
+
   void createGbuffers(const nvmath::vec2f& size)
   {
     // Rendering image targets
@@ -31,9 +31,16 @@
 #include "mm_process.hpp"
 #include "bird_curve_helper.hpp"
 #include "bit_packer.hpp"
+#include "counting_allocator.hpp"
 #include "nvh/alignment.hpp"
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <unordered_map>
 #include "nvh/timesampler.hpp"
+#include "nvh/nvprint.hpp"
 
 MicromapProcess::MicromapProcess(nvvk::Context* ctx, nvvk::ResourceAllocator* allocator)
     : m_device(ctx->m_device)
@@ -61,7 +68,22 @@ MicromapProcess::~MicromapProcess()
 // - Pack the data to 11 bit (64_TRIANGLES_64_BYTES format)
 // - Get the usage
 // - Create the vector of VkMicromapTriangleEXT
-bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, float radius, uint16_t micromapFormat)
+bool MicromapProcess::createMicromapData(VkCommandBuffer           cmd,
+                                         const nvh::PrimitiveMesh& mesh,
+                                         uint16_t                  subdivLevel,
+                                         float                     radius,
+                                         uint16_t                  micromapFormat,
+                                         bool                      adaptiveLevel)
+{
+  return createMicromapData(cmd, mesh, subdivLevel, CircleOpacitySource({0.0F, 0.0F, 0.0F}, radius), micromapFormat, adaptiveLevel);
+}
+
+bool MicromapProcess::createMicromapData(VkCommandBuffer           cmd,
+                                         const nvh::PrimitiveMesh& mesh,
+                                         uint16_t                  subdivLevel,
+                                         const OpacitySource&      source,
+                                         uint16_t                  micromapFormat,
+                                         bool                      adaptiveLevel)
 {
   nvh::ScopedTimer stimer("Create Micromap Data");
 
@@ -73,107 +95,140 @@ bool MicromapProcess::createMicromapData(VkCommandBuffer cmd, const nvh::Primiti
   m_alloc->destroy(m_indexBuffer);
 
   // Get an array of displacement per triangle
-  MicroOpacity micro_dist = createOpacity(mesh, subdivLevel, radius);
+  MicroOpacity micro_dist = createOpacity(mesh, subdivLevel, source);
 
-  // Number of triangles in the mesh and number of micro-triangles in a triangle
-  const auto num_tri       = static_cast<uint32_t>(micro_dist.rawTriangles.size());
-  const auto num_micro_tri = BirdCurveHelper::getNumMicroTriangles(subdivLevel);
-
-  // Micromesh Usage
+  // The 2-state format cannot store unknown, which is then opaque
+  if(micromapFormat == VK_OPACITY_MICROMAP_FORMAT_2_STATE_EXT)
   {
-    // The usage is like an histogram; how many triangles, using a `format` and a `subdivisionLevel`.
-    // Since all our triangles have the same subdivision level, and the same storage format, there is only
-    // one usage.
-    m_usages.resize(1);
-    m_usages[0].count            = num_tri;
-    m_usages[0].format           = micromapFormat;
-    m_usages[0].subdivisionLevel = subdivLevel;
+    std::replace_if(micro_dist.states.begin(), micro_dist.states.end(), [](uint8_t s) { return s != 0; }, uint8_t(1));
   }
 
-  // Can store 8 triangle info per byte for VK_OPACITY_MICROMAP_FORMAT_2_STATE_EXT
-  uint32_t storage_byte = (num_micro_tri + 7) / 8;
-  if(micromapFormat == VK_OPACITY_MICROMAP_FORMAT_4_STATE_EXT)
-  {
-    storage_byte *= 2;  // Need twice as much for the 4 state
-  }
+  // Each triangle gets the lowest subdivision level having the same opacity
+  if(adaptiveLevel)
+    adaptSubdivLevels(micro_dist);
+
+  // Number of triangles in the mesh
+  const auto num_tri = static_cast<uint32_t>(micro_dist.size());
 
-  // Micromesh Input Values
+  // Can store 8 triangle info per byte for VK_OPACITY_MICROMAP_FORMAT_2_STATE_EXT, and
+  // twice as much is needed for the 4 state
+  const uint32_t num_bits     = micromapFormat == VK_OPACITY_MICROMAP_FORMAT_2_STATE_EXT ? 1 : 2;
+  auto           storage_byte = [num_bits](uint32_t level) {
+    return (BirdCurveHelper::getNumMicroTriangles(level) * num_bits + 7) / 8;
+  };
+
+  // Special index of a triangle having the same state everywhere, no micromap data is needed
+  auto special_index = [](uint32_t state) {
+    switch(state)
+    {
+      case 0:
+        return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT;
+      case 1:
+        return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_OPAQUE_EXT;
+      default:
+        return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_UNKNOWN_OPAQUE_EXT;
+    }
+  };
+
+  // Micromesh Input Values and Micromap Triangles
+  // Many triangles share the same pattern (tiled foliage, fences, ..): the packed payloads are hashed
+  // and each unique one is stored once, with its own VkMicromapTriangleEXT. Mesh triangles refer to it
+  // through the index buffer.
+  std::vector<uint8_t>                      packed_data;
+  std::vector<VkMicromapTriangleEXT>        micromap_triangles;
+  std::vector<int32_t>                      index(num_tri);  // Micromap triangle, or special index, per mesh triangle
+  std::unordered_map<std::string, uint32_t> unique_payloads;  // Level + packed states -> micromap triangle
+  uint32_t                                  num_special{0};
+  uint64_t                                  referenced_bytes{0};  // Without deduplication
   {
-    // Allocate the array to push on the GPU.
-    std::vector<uint8_t> packed_data(storage_byte * num_tri);
-    memset(packed_data.data(), 0U, static_cast<unsigned long long>(storage_byte) * num_tri * sizeof(uint8_t));
+    // The per-triangle states to pack
+    std::vector<uint32_t> states(BirdCurveHelper::getNumMicroTriangles(subdivLevel));
 
     // Loop over all triangles of the mesh
     for(uint32_t tri_index = 0U; tri_index < num_tri; tri_index++)
     {
-      // The offset from the start of packed_data, must be a multiple of 64 bit
-      uint32_t offset = storage_byte * tri_index;
+      // Access to all opacity values
+      const RawTriangle               triangle = micro_dist.triangle(tri_index);
+      const std::span<const uint8_t>  values   = triangle.values;
 
-      // Access to all displacement values
-      const std::vector<int>& values = micro_dist.rawTriangles[tri_index].values;
+      // The 2-state values are already 0 or 1, unknown is stored as unknown-opaque in 4-state
+      for(size_t i = 0; i < values.size(); i++)
+      {
+        states[i] = values[i] <= 1 ? values[i] : 3;
+      }
 
-      // The BitPacker will store contiguously unorm11 (float normalized on 11 bit), from the beginning of the
-      // triangle (offset), plus each extra block
-      BitPacker packer(&packed_data[offset]);
+      // Uniform triangle: special index
+      if(std::all_of(states.begin(), states.begin() + values.size(), [&](uint32_t s) { return s == states[0]; }))
+      {
+        index[tri_index] = special_index(states[0]);
+        num_special++;
+        continue;
+      }
 
-      // Loop for all block of 64 triangles
-      for(const auto& value : values)
+      // The payload key is the subdivision level, followed by the packed states
+      const uint32_t num_bytes = storage_byte(triangle.subdivLevel);
+      std::string    payload(1 + num_bytes, '\0');
+      payload[0] = static_cast<char>(triangle.subdivLevel);
       {
-        if(micromapFormat == VK_OPACITY_MICROMAP_FORMAT_2_STATE_EXT)
-        {
-          if(value == VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT)
-          {
-            packer.push(0, 1);
-          }
-          else
-          {
-            packer.push(1, 1);
-          }
-        }
-        else
-        {
-          if(value == VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT)
-          {
-            packer.push(0, 2);
-          }
-          else if(value == VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_OPAQUE_EXT)
-          {
-            packer.push(1, 2);
-          }
-          else
-          {
-            packer.push(3, 2);
-          }
-        }
+        BitPacker packer(reinterpret_cast<uint8_t*>(payload.data() + 1));
+        packer.pushSpan(states.data(), values.size(), num_bits);
       }
-    }
+      referenced_bytes += num_bytes;
 
-    m_inputData = m_alloc->createBuffer(
-        cmd, packed_data, VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
-  }
+      auto [it, inserted] = unique_payloads.try_emplace(std::move(payload), static_cast<uint32_t>(micromap_triangles.size()));
+      if(inserted)
+      {
+        auto offset = static_cast<uint32_t>(packed_data.size());
+        micromap_triangles.push_back({offset, static_cast<uint16_t>(triangle.subdivLevel), micromapFormat});
+        packed_data.insert(packed_data.end(), it->first.begin() + 1, it->first.end());
+      }
+      index[tri_index] = static_cast<int32_t>(it->second);
+    }
 
-  // Micromap Triangle
-  {
-    std::vector<VkMicromapTriangleEXT> micromap_triangles;
-    micromap_triangles.reserve(num_tri);
-    for(uint32_t tri_index = 0; tri_index < num_tri; tri_index++)
+    // The micromap cannot be empty, even when all triangles use special indices
+    if(micromap_triangles.empty())
     {
-      uint32_t offset = storage_byte * tri_index;  // Same offset as when storing the data
-      micromap_triangles.push_back({offset, subdivLevel, micromapFormat});
+      micromap_triangles.push_back({0, 0, micromapFormat});
+      packed_data.push_back(0);
     }
+
+    m_inputData = m_alloc->createBuffer(
+        cmd, packed_data, VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
     m_trianglesBuffer = m_alloc->createBuffer(cmd, micromap_triangles,
                                               VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT
                                                   | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
   }
 
-  // Index buffer: referencing the Micromap Triangle buffer
+  // Micromesh Usage
   {
-    std::vector<uint32_t> index(num_tri);
-    int                   cnt{0};
-    for(auto& i : index)
+    // The usage is like an histogram; how many micromap triangles, using a `format` and a `subdivisionLevel`.
+    // All triangles have the same storage format, therefore there is one usage per subdivision level in use.
+    std::array<uint32_t, 13> histogram{};  // Up to VkPhysicalDeviceOpacityMicromapPropertiesEXT::maxOpacity4StateSubdivisionLevel
+    for(const VkMicromapTriangleEXT& triangle : micromap_triangles)
+      histogram[triangle.subdivisionLevel]++;
+
+    m_usages.clear();
+    for(uint32_t level = 0; level < histogram.size(); level++)
     {
-      i = cnt++;
+      if(histogram[level] == 0)
+        continue;
+      VkMicromapUsageEXT usage{};
+      usage.count            = histogram[level];
+      usage.format           = micromapFormat;
+      usage.subdivisionLevel = level;
+      m_usages.push_back(usage);
+      LOGI("  Level %u: %u triangles\n", level, histogram[level]);
     }
+
+    const uint64_t uniform_bytes = static_cast<uint64_t>(storage_byte(subdivLevel)) * num_tri;
+    LOGI("Opacity data: %zu bytes, uniform level %u: %llu bytes (saved %.1f%%)\n", packed_data.size(), subdivLevel,
+         static_cast<unsigned long long>(uniform_bytes), 100.0 * (1.0 - double(packed_data.size()) / double(uniform_bytes)));
+    LOGI("  %u triangles: %u special indices, %zu unique patterns (%llu bytes before deduplication)\n", num_tri,
+         num_special, unique_payloads.size(), static_cast<unsigned long long>(referenced_bytes));
+  }
+
+  // Index buffer: referencing the Micromap Triangle buffer, or a special index
+  {
     m_indexBuffer = m_alloc->createBuffer(
         cmd, index, VK_BUFFER_USAGE_MICROMAP_BUILD_INPUT_READ_ONLY_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
   }
@@ -324,71 +379,491 @@ uint32_t triangleCircleItersection(const std::array<nvmath::vec3f, 3>& p, const
 
 
 //--------------------------------------------------------------------------------------------------
-// Set the visibility information per micro-triangle.
-// - A micro triangle will be fully opaque if all its position are within the `radius`.
-//   fully transparent when all its position are outside and unknown if one position crosses
-//   the radius boundary.
-MicromapProcess::MicroOpacity MicromapProcess::createOpacity(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, float radius)
+// Conservative classification of a (sub-)triangle against the sphere, used to walk the hierarchy
+// Return 2 when triangle is within the sphere (all vertices inside, the sphere being convex)
+// Return 0 when the closest point of the triangle is further than `radius`
+// Return 1 otherwise, the triangle must be subdivided
+static uint32_t triangleSphereClassify(const std::array<nvmath::vec3f, 3>& p, const nvmath::vec3f& center, float radius)
+{
+  const float radiusSqr = radius * radius;
+
+  int hit = 0;
+  for(int i = 0; i < 3; i++)
+  {
+    nvmath::vec3f c = p[i] - center;
+    hit += nvmath::dot(c, c) <= radiusSqr ? 1 : 0;
+  }
+  if(hit == 3)
+    return 2;
+  if(hit > 0)
+    return 1;
+
+  // Closest point on the triangle to the center (Real-Time Collision Detection, 5.1.5)
+  const nvmath::vec3f ab = p[1] - p[0];
+  const nvmath::vec3f ac = p[2] - p[0];
+  const nvmath::vec3f ap = center - p[0];
+  const nvmath::vec3f bp = center - p[1];
+  const nvmath::vec3f cp = center - p[2];
+
+  const float d1 = nvmath::dot(ab, ap);
+  const float d2 = nvmath::dot(ac, ap);
+  const float d3 = nvmath::dot(ab, bp);
+  const float d4 = nvmath::dot(ac, bp);
+  const float d5 = nvmath::dot(ab, cp);
+  const float d6 = nvmath::dot(ac, cp);
+  const float va = d3 * d6 - d5 * d4;
+  const float vb = d5 * d2 - d1 * d6;
+  const float vc = d1 * d4 - d3 * d2;
+
+  nvmath::vec3f closest;
+  if(d1 <= 0.0F && d2 <= 0.0F)
+    closest = p[0];
+  else if(d3 >= 0.0F && d4 <= d3)
+    closest = p[1];
+  else if(d6 >= 0.0F && d5 <= d6)
+    closest = p[2];
+  else if(vc <= 0.0F && d1 >= 0.0F && d3 <= 0.0F)
+    closest = p[0] + ab * (d1 / (d1 - d3));
+  else if(vb <= 0.0F && d2 >= 0.0F && d6 <= 0.0F)
+    closest = p[0] + ac * (d2 / (d2 - d6));
+  else if(va <= 0.0F && (d4 - d3) >= 0.0F && (d5 - d6) >= 0.0F)
+    closest = p[1] + (p[2] - p[1]) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  else
+  {
+    const float denom = 1.0F / (va + vb + vc);
+    closest           = p[0] + ab * (vb * denom) + ac * (vc * denom);
+  }
+
+  const nvmath::vec3f d = closest - center;
+  return nvmath::dot(d, d) > radiusSqr ? 0 : 1;
+}
+
+static int hitToOpacity(uint32_t hit)
+{
+  switch(hit)
+  {
+    case 2:
+      return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_OPAQUE_EXT;
+    case 0:
+      return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT;
+    default:
+      return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_UNKNOWN_TRANSPARENT_EXT;
+  }
+}
+
+int CircleOpacitySource::classify(const Triangle& tri) const
+{
+  return hitToOpacity(triangleSphereClassify(tri.pos, m_center, m_radius));
+}
+
+int CircleOpacitySource::classifyLeaf(const Triangle& tri) const
+{
+  return hitToOpacity(triangleCircleItersection(tri.pos, m_center, m_radius));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Alpha texture: building the min/max pyramid, each level halving the previous one (rounding up)
+//
+AlphaTextureOpacitySource::AlphaTextureOpacitySource(uint32_t width, uint32_t height, const uint8_t* alpha, uint8_t cutoff)
+    : m_cutoff(cutoff)
+{
+  Level& base = m_levels.emplace_back();
+  base.width  = width;
+  base.height = height;
+  base.minValues.assign(alpha, alpha + static_cast<size_t>(width) * height);
+  base.maxValues = base.minValues;
+
+  while(m_levels.back().width > 1 || m_levels.back().height > 1)
+  {
+    const Level& src = m_levels.back();
+    Level        dst;
+    dst.width  = (src.width + 1) / 2;
+    dst.height = (src.height + 1) / 2;
+    dst.minValues.resize(static_cast<size_t>(dst.width) * dst.height);
+    dst.maxValues.resize(static_cast<size_t>(dst.width) * dst.height);
+    for(uint32_t y = 0; y < dst.height; y++)
+    {
+      for(uint32_t x = 0; x < dst.width; x++)
+      {
+        uint8_t mn = 255;
+        uint8_t mx = 0;
+        for(uint32_t j = 2 * y; j <= std::min(2 * y + 1, src.height - 1); j++)
+        {
+          for(uint32_t i = 2 * x; i <= std::min(2 * x + 1, src.width - 1); i++)
+          {
+            mn = std::min(mn, src.minValues[static_cast<size_t>(j) * src.width + i]);
+            mx = std::max(mx, src.maxValues[static_cast<size_t>(j) * src.width + i]);
+          }
+        }
+        dst.minValues[static_cast<size_t>(y) * dst.width + x] = mn;
+        dst.maxValues[static_cast<size_t>(y) * dst.width + x] = mx;
+      }
+    }
+    m_levels.emplace_back(std::move(dst));
+  }
+}
+
+// Min/max of the base texels [x0,x1]x[y0,y1], using the level where the rectangle covers at most 2x2 texels
+void AlphaTextureOpacitySource::minMaxRect(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, uint8_t& minValue, uint8_t& maxValue) const
+{
+  uint32_t level = 0;
+  while(level + 1 < m_levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+  {
+    level++;
+  }
+
+  const Level& lvl = m_levels[level];
+  for(uint32_t y = y0 >> level; y <= std::min(y1 >> level, lvl.height - 1); y++)
+  {
+    for(uint32_t x = x0 >> level; x <= std::min(x1 >> level, lvl.width - 1); x++)
+    {
+      minValue = std::min(minValue, lvl.minValues[static_cast<size_t>(y) * lvl.width + x]);
+      maxValue = std::max(maxValue, lvl.maxValues[static_cast<size_t>(y) * lvl.width + x]);
+    }
+  }
+}
+
+int AlphaTextureOpacitySource::classify(const Triangle& tri) const
+{
+  const uint32_t width  = m_levels[0].width;
+  const uint32_t height = m_levels[0].height;
+
+  // Texels in the footprint of the triangle, including the bilinear neighbors
+  auto texel_range = [](float a, float b, float c, uint32_t size, int64_t& t0, int64_t& t1) {
+    const float mn = std::min({a, b, c}) * static_cast<float>(size) - 0.5F;
+    const float mx = std::max({a, b, c}) * static_cast<float>(size) - 0.5F;
+    t0             = static_cast<int64_t>(std::floor(mn));
+    t1             = static_cast<int64_t>(std::floor(mx)) + 1;
+  };
+
+  // With repeat, a range is split in at most two intervals of the texture
+  auto wrap = [](int64_t t0, int64_t t1, uint32_t size, std::array<uint32_t, 4>& intervals) -> uint32_t {
+    if(t1 - t0 + 1 >= size)
+    {
+      intervals = {0, size - 1};
+      return 1;
+    }
+    const int64_t s  = static_cast<int64_t>(size);
+    const int64_t w0 = ((t0 % s) + s) % s;
+    const int64_t w1 = w0 + (t1 - t0);
+    if(w1 < s)
+    {
+      intervals = {static_cast<uint32_t>(w0), static_cast<uint32_t>(w1)};
+      return 1;
+    }
+    intervals = {static_cast<uint32_t>(w0), size - 1, 0, static_cast<uint32_t>(w1 - s)};
+    return 2;
+  };
+
+  int64_t x0, x1, y0, y1;
+  texel_range(tri.uv[0].x, tri.uv[1].x, tri.uv[2].x, width, x0, x1);
+  texel_range(tri.uv[0].y, tri.uv[1].y, tri.uv[2].y, height, y0, y1);
+
+  std::array<uint32_t, 4> ix{};
+  std::array<uint32_t, 4> iy{};
+  const uint32_t          nx = wrap(x0, x1, width, ix);
+  const uint32_t          ny = wrap(y0, y1, height, iy);
+
+  uint8_t min_value = 255;
+  uint8_t max_value = 0;
+  for(uint32_t j = 0; j < ny; j++)
+  {
+    for(uint32_t i = 0; i < nx; i++)
+    {
+      minMaxRect(ix[i * 2], ix[i * 2 + 1], iy[j * 2], iy[j * 2 + 1], min_value, max_value);
+    }
+  }
+
+  if(min_value >= m_cutoff)
+    return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_OPAQUE_EXT;
+  if(max_value < m_cutoff)
+    return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT;
+  return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_UNKNOWN_TRANSPARENT_EXT;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SDF grid: the distance at the centroid bounds the distance of the whole triangle
+//
+SdfGridOpacitySource::SdfGridOpacitySource(const nvmath::vec3i& dim,
+                                           const nvmath::vec3f& bboxMin,
+                                           const nvmath::vec3f& bboxMax,
+                                           std::vector<float>   distances,
+                                           float                lipschitz)
+    : m_dim(dim)
+    , m_bboxMin(bboxMin)
+    , m_bboxMax(bboxMax)
+    , m_distances(std::move(distances))
+    , m_lipschitz(lipschitz)
+{
+  assert(m_distances.size() == static_cast<size_t>(dim.x) * dim.y * dim.z);
+  nvmath::vec3f cell = bboxMax - bboxMin;
+  cell.x /= static_cast<float>(std::max(dim.x - 1, 1));
+  cell.y /= static_cast<float>(std::max(dim.y - 1, 1));
+  cell.z /= static_cast<float>(std::max(dim.z - 1, 1));
+  m_cellError = nvmath::length(cell) * m_lipschitz;
+}
+
+float SdfGridOpacitySource::sample(const nvmath::vec3f& pos) const
+{
+  float f[3];
+  int   i0[3];
+  int   i1[3];
+  for(int a = 0; a < 3; a++)
+  {
+    const float extent = m_bboxMax[a] - m_bboxMin[a];
+    const float g      = extent > 0.0F ? (pos[a] - m_bboxMin[a]) / extent * static_cast<float>(m_dim[a] - 1) : 0.0F;
+    i0[a]              = std::clamp(static_cast<int>(std::floor(g)), 0, m_dim[a] - 1);
+    i1[a]              = std::min(i0[a] + 1, m_dim[a] - 1);
+    f[a]               = std::clamp(g - static_cast<float>(i0[a]), 0.0F, 1.0F);
+  }
+
+  auto at = [&](int x, int y, int z) { return m_distances[(static_cast<size_t>(z) * m_dim.y + y) * m_dim.x + x]; };
+
+  const float c00 = at(i0[0], i0[1], i0[2]) * (1 - f[0]) + at(i1[0], i0[1], i0[2]) * f[0];
+  const float c10 = at(i0[0], i1[1], i0[2]) * (1 - f[0]) + at(i1[0], i1[1], i0[2]) * f[0];
+  const float c01 = at(i0[0], i0[1], i1[2]) * (1 - f[0]) + at(i1[0], i0[1], i1[2]) * f[0];
+  const float c11 = at(i0[0], i1[1], i1[2]) * (1 - f[0]) + at(i1[0], i1[1], i1[2]) * f[0];
+  const float c0  = c00 * (1 - f[1]) + c10 * f[1];
+  const float c1  = c01 * (1 - f[1]) + c11 * f[1];
+  return c0 * (1 - f[2]) + c1 * f[2];
+}
+
+int SdfGridOpacitySource::classify(const Triangle& tri) const
+{
+  const nvmath::vec3f centroid = (tri.pos[0] + tri.pos[1] + tri.pos[2]) * (1.0F / 3.0F);
+
+  // Bounding radius of the triangle around its centroid
+  float radius = 0.0F;
+  for(const auto& p : tri.pos)
+    radius = std::max(radius, nvmath::length(p - centroid));
+
+  // Outside the grid, the distance is taken at the closest grid point
+  const nvmath::vec3f inside{std::clamp(centroid.x, m_bboxMin.x, m_bboxMax.x), std::clamp(centroid.y, m_bboxMin.y, m_bboxMax.y),
+                             std::clamp(centroid.z, m_bboxMin.z, m_bboxMax.z)};
+  radius += nvmath::length(centroid - inside);
+
+  const float distance = sample(inside);
+  const float margin   = radius * m_lipschitz + m_cellError;
+  if(distance - margin > 0.0F)
+    return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT;
+  if(distance + margin < 0.0F)
+    return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_OPAQUE_EXT;
+  return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_UNKNOWN_TRANSPARENT_EXT;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Position and texture coordinates of the micro-triangle `index` of `level`
+static OpacitySource::Triangle microTriangle(const OpacitySource::Triangle& t, uint32_t index, uint32_t level)
+{
+  nvmath::vec3f uv0, uv1, uv2;
+  BirdCurveHelper::micro2bary(index, level, uv0, uv1, uv2);
+
+  OpacitySource::Triangle micro;
+  micro.pos = {getInterpolated(t.pos[0], t.pos[1], t.pos[2], uv0), getInterpolated(t.pos[0], t.pos[1], t.pos[2], uv1),
+               getInterpolated(t.pos[0], t.pos[1], t.pos[2], uv2)};
+  micro.uv  = {getInterpolated(t.uv[0], t.uv[1], t.uv[2], uv0), getInterpolated(t.uv[0], t.uv[1], t.uv[2], uv1),
+               getInterpolated(t.uv[0], t.uv[1], t.uv[2], uv2)};
+  return micro;
+}
+
+static OpacitySource::Triangle baseTriangle(const nvh::PrimitiveMesh& mesh, uint64_t triIndex)
+{
+  const nvh::PrimitiveVertex& v0 = mesh.vertices[mesh.triangles[triIndex].v[0]];
+  const nvh::PrimitiveVertex& v1 = mesh.vertices[mesh.triangles[triIndex].v[1]];
+  const nvh::PrimitiveVertex& v2 = mesh.vertices[mesh.triangles[triIndex].v[2]];
+  return {{v0.p, v1.p, v2.p}, {v0.t, v1.t, v2.t}};
+}
+
+//--------------------------------------------------------------------------------------------------
+// Special index returned by the OpacitySource, to the 4-state encoding stored in MicroOpacity
+static uint8_t toState(int specialIndex)
+{
+  return static_cast<uint8_t>(-1 - specialIndex);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Classify the node `index` of `level` in the Bird Curve hierarchy, and its children.
+// The micro-triangles of a node are contiguous: at `subdivLevel`, node `index` covers the
+// micro-triangles [index * 4^(subdivLevel-level), (index + 1) * 4^(subdivLevel-level)[
+// When a node is completely opaque or transparent, the whole range is filled without subdividing.
+static void classifyNode(const OpacitySource::Triangle& t,
+                         uint32_t                       level,
+                         uint32_t                       index,
+                         uint16_t                       subdivLevel,
+                         const OpacitySource&           source,
+                         uint8_t*                       states)
 {
-  nvh::ScopedTimer stimer("Create Displacements");
+  const OpacitySource::Triangle micro = microTriangle(t, index, level);
 
-  MicroOpacity displacements;  // Return of displacement values for all triangles
+  // Leaf: same test as the flat version
+  if(level == subdivLevel)
+  {
+    states[index] = toState(source.classifyLeaf(micro));
+    return;
+  }
+
+  const int state = source.classify(micro);
+  if(state != VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_UNKNOWN_TRANSPARENT_EXT)
+  {
+    const uint32_t count = BirdCurveHelper::getNumMicroTriangles(subdivLevel - level);
+    std::fill_n(states + static_cast<size_t>(index) * count, count, toState(state));
+    return;
+  }
+
+  for(uint32_t child = 0; child < 4; child++)
+  {
+    classifyNode(t, level + 1, index * 4 + child, subdivLevel, source, states);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set the visibility information per micro-triangle, using the opacity `source`.
+// - With the CircleOpacitySource, a micro triangle will be fully opaque if all its position are
+//   within the radius, fully transparent when all its position are outside and unknown if one
+//   position crosses the radius boundary.
+// - The base triangle is tested first, then the Bird Curve hierarchy is traversed and only the
+//   nodes of unknown state are subdivided down to the micro-triangles.
+MicromapProcess::MicroOpacity MicromapProcess::createOpacity(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const OpacitySource& source)
+{
+  nvh::ScopedTimer stimer("Create Opacity");
+
+  MicroOpacity displacements;  // Return of opacity values for all triangles
 
   const auto num_micro_tri = BirdCurveHelper::getNumMicroTriangles(subdivLevel);
 
   auto num_tri = static_cast<uint32_t>(mesh.triangles.size());
-  displacements.rawTriangles.resize(num_tri);
+  displacements.subdivLevels.assign(num_tri, subdivLevel);
+  displacements.stride = num_micro_tri;
+  displacements.states.resize(num_tri * displacements.stride);
+
+  nvh::parallel_batches<32>(
+      num_tri,
+      [&](uint64_t tri_index) {
+        // Working on this triangle
+        uint8_t* states = displacements.states.data() + tri_index * displacements.stride;
+        classifyNode(baseTriangle(mesh, tri_index), 0, 0, subdivLevel, source, states);
+      },
+      std::thread::hardware_concurrency());
+
+  return displacements;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Reference version of createOpacity(), testing every micro-triangle individually
+//
+MicromapProcess::MicroOpacity MicromapProcess::createOpacityFlat(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const OpacitySource& source)
+{
+  MicroOpacity displacements;  // Return of opacity values for all triangles
 
-  const nvmath::vec3f center{0.0F, 0.0F, 0.0F};
+  const auto num_micro_tri = BirdCurveHelper::getNumMicroTriangles(subdivLevel);
+
+  auto num_tri = static_cast<uint32_t>(mesh.triangles.size());
+  displacements.subdivLevels.assign(num_tri, subdivLevel);
+  displacements.stride = num_micro_tri;
+  displacements.states.resize(num_tri * displacements.stride);
 
   // Find the distances in parallel
   // Faster than : for(size_t tri_index = 0; tri_index < num_tri; tri_index++)
   nvh::parallel_batches<32>(
       num_tri,
       [&](uint64_t tri_index) {
-        // Retrieve the positions of the triangle
-        nvmath::vec3f t0 = mesh.vertices[mesh.triangles[tri_index].v[0]].p;
-        nvmath::vec3f t1 = mesh.vertices[mesh.triangles[tri_index].v[1]].p;
-        nvmath::vec3f t2 = mesh.vertices[mesh.triangles[tri_index].v[2]].p;
+        const OpacitySource::Triangle base = baseTriangle(mesh, tri_index);
 
         // Working on this triangle
-        RawTriangle& triangle = displacements.rawTriangles[tri_index];
-        triangle.values.resize(num_micro_tri);
-        triangle.subdivLevel = subdivLevel;
-
-        // TODO: check if the triangle is completely in or out to avoid subdividing it
-        // uint32_t hit = triangleCircleItersection({t0, t1, t2}, center, radius);
+        uint8_t* states = displacements.states.data() + tri_index * displacements.stride;
 
         for(uint32_t index = 0; index < num_micro_tri; index++)
         {
-          // Utility to get the barycentric values
-          nvmath::vec3f uv0, uv1, uv2;
-          BirdCurveHelper::micro2bary(index, subdivLevel, uv0, uv1, uv2);
+          states[index] = toState(source.classifyLeaf(microTriangle(base, index, subdivLevel)));
+        }
+      },
+      std::thread::hardware_concurrency());
 
-          // The sub-triangle position
-          nvmath::vec3f p0 = getInterpolated(t0, t1, t2, uv0);
-          nvmath::vec3f p1 = getInterpolated(t0, t1, t2, uv1);
-          nvmath::vec3f p2 = getInterpolated(t0, t1, t2, uv2);
+  return displacements;
+}
 
-          // Check how many sub-triangle vertex are within the radius
-          uint32_t hit = triangleCircleItersection({p0, p1, p2}, center, radius);
+//--------------------------------------------------------------------------------------------------
+// Lower the subdivision level of each triangle to the lowest one where every micro-triangle covers
+// children of a single state. In Bird Curve order, the children of micro-triangle `i` are the
+// consecutive range [i * 4^n, (i+1) * 4^n) of the level n below, so this is a run-length test.
+// The states of the new level are compacted at the start of the triangle's range in the array.
+//
+void MicromapProcess::adaptSubdivLevels(MicroOpacity& microOpacity)
+{
+  nvh::parallel_batches<32>(
+      microOpacity.size(),
+      [&](uint64_t tri_index) {
+        const uint32_t subdiv_level = microOpacity.subdivLevels[tri_index];
+        const size_t   num_values   = BirdCurveHelper::getNumMicroTriangles(subdiv_level);
+        uint8_t*       values       = microOpacity.states.data() + tri_index * microOpacity.stride;
 
-          // Determining the visibility of the triangle
-          switch(hit)
-          {
-            case 2:
-              triangle.values[index] = VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_OPAQUE_EXT;
-              break;
-            case 0:
-              triangle.values[index] = VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_TRANSPARENT_EXT;
-              break;
-            default:
-              triangle.values[index] = VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_UNKNOWN_TRANSPARENT_EXT;
-              break;
-          }
+        uint32_t level = 0;
+        for(; level < subdiv_level; level++)
+        {
+          const size_t span    = size_t(1) << ((subdiv_level - level) * 2);
+          bool         uniform = true;
+          for(size_t start = 0; uniform && start < num_values; start += span)
+            uniform = std::all_of(values + start + 1, values + start + span, [&](uint8_t v) { return v == values[start]; });
+          if(uniform)
+            break;
         }
+
+        // Keep one value per micro-triangle of the new level
+        const size_t span = size_t(1) << ((subdiv_level - level) * 2);
+        for(size_t i = 0; i < num_values / span; i++)
+          values[i] = values[i * span];
+        microOpacity.subdivLevels[tri_index] = level;
       },
       std::thread::hardware_concurrency());
+}
 
-  return displacements;
+//--------------------------------------------------------------------------------------------------
+// Compare the timing of the hierarchical and the flat classification, and validate that both
+// produce the same values. The states are then copied to the storage of MicroOpacity and to one
+// std::vector<int> per triangle, both with a CountingAllocator, for the allocations they make.
+//
+void MicromapProcess::benchmarkOpacity(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const OpacitySource& source)
+{
+  using clock = std::chrono::high_resolution_clock;
+
+  auto         t0   = clock::now();
+  MicroOpacity flat = createOpacityFlat(mesh, subdivLevel, source);
+  auto         t1   = clock::now();
+  MicroOpacity hier = createOpacity(mesh, subdivLevel, source);
+  auto         t2   = clock::now();
+
+  const bool identical = flat.subdivLevels == hier.subdivLevels && flat.states == hier.states;
+
+  const double flat_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+  const double hier_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+  LOGI("Opacity benchmark: %zu triangles, level %d\n", mesh.triangles.size(), subdivLevel);
+  LOGI(" - Flat         : %8.2f ms\n", flat_ms);
+  LOGI(" - Hierarchical : %8.2f ms (x%.1f)\n", hier_ms, flat_ms / std::max(hier_ms, 1e-6));
+  LOGI(" - Identical    : %s\n", identical ? "yes" : "NO");
+
+  // Single array, as MicroOpacity
+  size_t                           array_allocs{0};
+  const CountingAllocator<uint8_t> array_alloc(&array_allocs);
+  CountedVector<uint32_t>          array_levels(hier.subdivLevels.begin(), hier.subdivLevels.end(), array_alloc);
+  CountedVector<uint8_t>           array_states(hier.states.begin(), hier.states.end(), array_alloc);
+
+  // One vector of int per triangle
+  size_t                            vector_allocs{0};
+  const CountingAllocator<int>      vector_alloc(&vector_allocs);
+  CountedVector<CountedVector<int>> per_triangle(vector_alloc);
+  size_t                            vector_bytes = hier.size() * sizeof(CountedVector<int>);
+  per_triangle.reserve(hier.size());
+  for(size_t t = 0; t < hier.size(); t++)
+  {
+    const RawTriangle triangle = hier.triangle(t);
+    per_triangle.emplace_back(triangle.values.begin(), triangle.values.end(), vector_alloc);
+    vector_bytes += triangle.values.size() * sizeof(int);
+  }
+
+  const size_t array_bytes = array_levels.size() * sizeof(uint32_t) + array_states.size();
+  LOGI(" - Storage      : %zu KB in %zu allocations (%zu KB in %zu with a vector of int per triangle)\n", array_bytes / 1024,
+       array_allocs, vector_bytes / 1024, vector_allocs);
 }
@@ -17,12 +17,101 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <array>
+#include <span>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
 #include "nvvk/context_vk.hpp"
 #include "nvvk/resourceallocator_vk.hpp"
 #include "nvh/primitives.hpp"
+#include "bird_curve_helper.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Source of opacity, classifying a (micro-)triangle as opaque, transparent or unknown.
+// The classification must be conservative: a triangle is opaque or transparent only when it is
+// true for its whole surface, as it is also used to fill complete sub-trees of micro-triangles.
+//
+class OpacitySource
+{
+public:
+  struct Triangle
+  {
+    std::array<nvmath::vec3f, 3> pos;  // Object space positions
+    std::array<nvmath::vec2f, 3> uv;   // Texture coordinates
+  };
+
+  virtual ~OpacitySource() = default;
+
+  // Return VK_OPACITY_MICROMAP_SPECIAL_INDEX_FULLY_[OPAQUE|TRANSPARENT|UNKNOWN_TRANSPARENT]_EXT
+  virtual int classify(const Triangle& tri) const = 0;
+  // Classification of the micro-triangles at the requested subdivision level
+  virtual int classifyLeaf(const Triangle& tri) const { return classify(tri); }
+};
+
+// Opaque inside the sphere of `radius` around `center`
+class CircleOpacitySource : public OpacitySource
+{
+public:
+  CircleOpacitySource(const nvmath::vec3f& center, float radius)
+      : m_center(center)
+      , m_radius(radius)
+  {
+  }
+  int classify(const Triangle& tri) const override;
+  int classifyLeaf(const Triangle& tri) const override;
+
+private:
+  nvmath::vec3f m_center;
+  float         m_radius;
+};
+
+// 8-bit alpha texture sampled with the texture coordinates (repeat), opaque when alpha >= cutoff.
+// A min/max mip pyramid bounds the texels under a triangle with at most 2x2 lookups per level.
+class AlphaTextureOpacitySource : public OpacitySource
+{
+public:
+  AlphaTextureOpacitySource(uint32_t width, uint32_t height, const uint8_t* alpha, uint8_t cutoff = 128);
+  int classify(const Triangle& tri) const override;
+
+private:
+  struct Level
+  {
+    uint32_t             width{0};
+    uint32_t             height{0};
+    std::vector<uint8_t> minValues;
+    std::vector<uint8_t> maxValues;
+  };
+  void minMaxRect(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, uint8_t& minValue, uint8_t& maxValue) const;
+
+  std::vector<Level> m_levels;
+  uint8_t            m_cutoff{128};
+};
+
+// Signed distance field sampled on a grid of `dim` covering [bboxMin, bboxMax], negative inside (opaque).
+// The field is assumed `lipschitz`-continuous, which bounds the distance over a triangle.
+class SdfGridOpacitySource : public OpacitySource
+{
+public:
+  SdfGridOpacitySource(const nvmath::vec3i& dim,
+                       const nvmath::vec3f& bboxMin,
+                       const nvmath::vec3f& bboxMax,
+                       std::vector<float>   distances,
+                       float                lipschitz = 1.0F);
+  int classify(const Triangle& tri) const override;
+
+private:
+  float sample(const nvmath::vec3f& pos) const;  // Trilinear interpolation, `pos` within the bbox
+
+  nvmath::vec3i      m_dim;
+  nvmath::vec3f      m_bboxMin;
+  nvmath::vec3f      m_bboxMax;
+  std::vector<float> m_distances;
+  float              m_lipschitz{1.0F};
+  float              m_cellError{0.0F};  // Interpolation error bound, one cell diagonal
+};
+
 
 class MicromapProcess
 {
@@ -31,9 +120,24 @@ public:
   MicromapProcess(nvvk::Context* ctx, nvvk::ResourceAllocator* allocator);
   ~MicromapProcess();
 
-  bool createMicromapData(VkCommandBuffer cmd, const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, float radius, uint16_t micromapFormat);
+  // With `adaptiveLevel`, each triangle is stored at the lowest level giving the same opacity (lossless)
+  bool createMicromapData(VkCommandBuffer           cmd,
+                          const nvh::PrimitiveMesh& mesh,
+                          uint16_t                  subdivLevel,
+                          float                     radius,
+                          uint16_t                  micromapFormat,
+                          bool                      adaptiveLevel = false);
+  bool createMicromapData(VkCommandBuffer           cmd,
+                          const nvh::PrimitiveMesh& mesh,
+                          uint16_t                  subdivLevel,
+                          const OpacitySource&      source,
+                          uint16_t                  micromapFormat,
+                          bool                      adaptiveLevel = false);
   void cleanBuildData();
 
+  // Time the hierarchical classification against the flat one (per micro-triangle), logs the results
+  static void benchmarkOpacity(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const OpacitySource& source);
+
   const VkMicromapEXT&                   micromap() { return m_micromap; }
   const std::vector<VkMicromapUsageEXT>& usages() { return m_usages; }
   const nvvk::Buffer&                    indexBuffer() { return m_indexBuffer; }
@@ -46,22 +150,35 @@ private:
     std::vector<VkMicromapUsageEXT>    usages;
   };
 
-  // Raw values per triangles
+  // Raw values of a triangle, a view in MicroOpacity
   struct RawTriangle
   {
-    uint32_t         subdivLevel{0};
-    std::vector<int> values;
+    uint32_t                 subdivLevel{0};
+    std::span<const uint8_t> values;
   };
 
+  // Opacity states of all triangles in a single array, triangle `i` starting at `i * stride`.
+  // The states use the 4-state encoding (0: transparent, 1: opaque, 2: unknown transparent,
+  // 3: unknown opaque), which is -1 - the special index returned by the OpacitySource.
   struct MicroOpacity
   {
-    std::vector<RawTriangle> rawTriangles;
+    std::vector<uint32_t> subdivLevels;
+    std::vector<uint8_t>  states;
+    size_t                stride{0};
+
+    size_t      size() const { return subdivLevels.size(); }
+    RawTriangle triangle(size_t i) const
+    {
+      return {subdivLevels[i], {states.data() + i * stride, BirdCurveHelper::getNumMicroTriangles(subdivLevels[i])}};
+    }
   };
 
 
   bool                buildMicromap(VkCommandBuffer cmd, VkMicromapTypeEXT type);
   static void         barrier(VkCommandBuffer cmd);
-  static MicroOpacity createOpacity(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, float radius);
+  static MicroOpacity createOpacity(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const OpacitySource& source);
+  static MicroOpacity createOpacityFlat(const nvh::PrimitiveMesh& mesh, uint16_t subdivLevel, const OpacitySource& source);
+  static void         adaptSubdivLevels(MicroOpacity& microOpacity);
 
   VkDevice                 m_device;
   nvvk::ResourceAllocator* m_alloc;
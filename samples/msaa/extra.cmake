@@ -1,3 +1,13 @@
+# Ray casting on the CPU and mesh optimization, shared with other samples
+set(COMMON_SRC
+	${SAMPLES_COMMON_DIR}/bvh.cpp
+	${SAMPLES_COMMON_DIR}/bvh.hpp
+	${SAMPLES_COMMON_DIR}/mesh_optimizer.cpp
+	${SAMPLES_COMMON_DIR}/mesh_optimizer.hpp
+	)
+target_sources(${PROJECT_NAME} PRIVATE ${COMMON_SRC})
+source_group(common FILES ${COMMON_SRC})
+
 
 # HLSL
 if(USE_HLSL) 
@@ -28,10 +28,13 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include <array>
+#include <string>
 #include <vulkan/vulkan_core.h>
 #include <imgui.h>
 
 #define VMA_IMPLEMENTATION
+#include "bvh.hpp"
+#include "mesh_optimizer.hpp"
 #include "imgui/imgui_camera_widget.h"
 #include "nvh/primitives.hpp"
 #include "nvvk/commands_vk.hpp"
@@ -162,6 +165,10 @@ public:
         createPipeline();
       }
 
+      ImGui::Separator();
+      ImGui::Text("Picking (double-click)");
+      ImGui::Text("Last pick: %s", m_pickInfo.c_str());
+
       ImGui::End();
     }
 
@@ -169,6 +176,12 @@ public:
       ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0F, 0.0F));
       ImGui::Begin("Viewport");
 
+      // Pick under the mouse cursor
+      if(ImGui::IsWindowHovered(ImGuiFocusedFlags_RootWindow) && ImGui::IsMouseDoubleClicked(0))
+      {
+        rayPicking();
+      }
+
       // Display the G-Buffer image
       ImGui::Image(m_gBuffers->getDescriptorSet(), ImGui::GetContentRegionAvail());
 
@@ -250,6 +263,7 @@ private:
   {
     // Meshes
     m_meshes.emplace_back(nvh::createConeMesh(0.05F));
+    meshopt::optimizeMeshes(m_meshes);  // Vertex cache and fetch, before the upload and the BVH
     const int num_instances = 50;
 
     // Instances
@@ -273,11 +287,83 @@ private:
       m_materials.push_back({nvmath::vec4f(v, 1.0F)});
     }
 
+    // For the picking on the CPU
+    m_sceneBvh.build(m_meshes, m_nodes);
 
     CameraManip.setClipPlanes({0.1F, 100.0F});
     CameraManip.setLookat({0.0F, 0.0F, 1.7F}, {0.0F, 0.0F, 0.0F}, {0.0F, 1.0F, 0.0F});
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Find the 3D position under the mouse cursor and set the camera interest to this position.
+  // The ray goes through the BVH of the scene on the CPU, reading nothing back from the
+  // multi-sampled depth.
+  //
+  void rayPicking()
+  {
+    nvmath::vec2f       mouse_pos = ImGui::GetMousePos();         // Current mouse pos in window
+    const nvmath::vec2f corner    = ImGui::GetCursorScreenPos();  // Corner of the viewport
+    mouse_pos                     = mouse_pos - corner;           // Mouse pos relative to center of viewport
+
+    const VkExtent2D size = m_gBuffers->getSize();
+    if(mouse_pos.x < 0.0F || mouse_pos.y < 0.0F || mouse_pos.x >= float(size.width) || mouse_pos.y >= float(size.height))
+    {
+      return;
+    }
+
+    // Same camera as onRender
+    const nvmath::vec2f& clip = CameraManip.getClipPlanes();
+    const nvmath::mat4f  view = CameraManip.getMatrix();
+    const nvmath::mat4f  proj = nvmath::perspectiveVK(CameraManip.getFov(), m_viewSize.x / m_viewSize.y, clip.x, clip.y);
+
+    // From the near to the far plane
+    bvh::Ray ray;
+    ray.origin = unprojectScreenPosition({mouse_pos.x, mouse_pos.y, 0.0F}, view, proj, size);
+    ray.dir    = unprojectScreenPosition({mouse_pos.x, mouse_pos.y, 1.0F}, view, proj, size) - ray.origin;
+    ray.tMax   = 1.0F;
+    bvh::Hit hit;
+    if(!m_sceneBvh.intersect(ray, hit))
+    {
+      m_pickInfo = "nothing";
+      return;
+    }
+
+    nvmath::vec3f eye, center, up;
+    CameraManip.getLookat(eye, center, up);
+    CameraManip.setLookat(eye, ray.origin + ray.dir * hit.t, up, false);
+
+    std::array<char, 64> buf{};
+    snprintf(buf.data(), buf.size(), "instance %u, triangle %u", hit.instance, hit.triangle);
+    m_pickInfo = buf.data();
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Return the 3D position of the screen 2D + depth
+  //
+  static nvmath::vec3f unprojectScreenPosition(const nvmath::vec3f& screenPos,
+                                               const nvmath::mat4f& view,
+                                               const nvmath::mat4f& proj,
+                                               const VkExtent2D&    size)
+  {
+    // Transformation of normalized coordinates between -1 and 1
+    nvmath::vec4f win_norm;
+    win_norm.x = screenPos.x / static_cast<float>(size.width) * 2.0F - 1.0F;
+    win_norm.y = screenPos.y / static_cast<float>(size.height) * 2.0F - 1.0F;
+    win_norm.z = screenPos.z;
+    win_norm.w = 1.0;
+
+    // Transform to world space
+    const nvmath::mat4f mat       = proj * view;
+    const nvmath::mat4f mat_inv   = nvmath::invert(mat);
+    nvmath::vec4f       world_pos = mat_inv * win_norm;
+    world_pos.w                   = 1.0F / world_pos.w;
+    world_pos.x                   = world_pos.x * world_pos.w;
+    world_pos.y                   = world_pos.y * world_pos.w;
+    world_pos.z                   = world_pos.z * world_pos.w;
+
+    return nvmath::vec3f(world_pos);
+  }
+
   void renderScene(VkCommandBuffer cmd)
   {
     const nvvk::DebugUtil::ScopedCmdLabel sdbg = m_dutil->DBG_SCOPE(cmd);
@@ -487,6 +573,8 @@ private:
   std::vector<nvh::PrimitiveMesh> m_meshes;
   std::vector<nvh::Node>          m_nodes;
   std::vector<Material>           m_materials;
+  bvh::SceneBvh                   m_sceneBvh;  // For the picking on the CPU
+  std::string                     m_pickInfo{"none"};
 
   // Pipeline
   PushConstant     m_pushConst{};                        // Information sent to the shader
@@ -1,5 +1,13 @@
+#ifdef __cplusplus
+using vec2 = nvmath::vec2f;
+#elif defined(__hlsl) || defined(__slang)
+#define vec2 float2
+#endif  // __cplusplus
+
 struct PushConstant
 {
   float iTime;
-  float aspectRatio;
+  float aspectRatio;  // Of the whole image
+  vec2  uvOffset;     // Tiles: UV of the image = UV of the tile * uvScale + uvOffset
+  vec2  uvScale;
 };
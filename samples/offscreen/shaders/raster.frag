@@ -33,7 +33,7 @@ layout(push_constant) uniform PushConstant_
 
 void main()
 {
-  vec2 uv = outUV;
+  vec2 uv = outUV * pushC.uvScale + pushC.uvOffset;
 
   uv.x *= pushC.aspectRatio;
 
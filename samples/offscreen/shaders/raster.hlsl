@@ -59,7 +59,7 @@ VSOut vertexMain(VSIn input)
 PSOut fragmentMain(VSOut input)
 {
   PSOut output;
-  float2 uv = input.uv;
+  float2 uv = input.uv * pushConst.uvScale + pushConst.uvOffset;
   
   uv.x *= pushConst.aspectRatio;
 
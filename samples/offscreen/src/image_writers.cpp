@@ -0,0 +1,1088 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "image_writers.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
+
+
+namespace imagewriter {
+
+using Bytes = std::vector<uint8_t>;
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+uint32_t bytesPerPixel(PixelFormat format)
+{
+  return format == PixelFormat::eRGBA16F ? 8 : 4;
+}
+
+static void putBE32(Bytes& out, uint32_t v)
+{
+  const uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+  out.insert(out.end(), b, b + 4);
+}
+
+static void putLE32(Bytes& out, uint32_t v)
+{
+  const uint8_t b[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+  out.insert(out.end(), b, b + 4);
+}
+
+static void putLE64(Bytes& out, uint64_t v)
+{
+  putLE32(out, uint32_t(v));
+  putLE32(out, uint32_t(v >> 32));
+}
+
+static void putString(Bytes& out, const char* str)
+{
+  out.insert(out.end(), str, str + strlen(str) + 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Strips of rows, encoded in parallel, in the order of the file
+//
+struct Strips
+{
+  uint32_t rows{0};   // Per strip, the last one can be shorter
+  uint32_t count{0};  // Strips
+  uint32_t threads{1};
+};
+
+static Strips planStrips(const Image& image, const Options& options)
+{
+  Strips strips;
+  strips.threads = options.numThreads == 0 ? std::max(std::thread::hardware_concurrency(), 1U) : options.numThreads;
+  if(options.tileRows > 0)
+  {
+    strips.rows = options.tileRows;
+  }
+  else
+  {
+    // A few strips per thread for the balance, of at least 256 KB: the compression restarts on each strip
+    const uint64_t row_bytes = std::max<uint64_t>(uint64_t(image.width) * bytesPerPixel(image.format), 1);
+    const uint32_t min_rows  = static_cast<uint32_t>(std::max<uint64_t>((256 << 10) / row_bytes, 1));
+    strips.rows              = std::max((image.height + strips.threads * 4 - 1) / (strips.threads * 4), min_rows);
+  }
+  strips.rows  = std::max(std::min(strips.rows, image.height), 1U);
+  strips.count = (image.height + strips.rows - 1) / strips.rows;
+  return strips;
+}
+
+// Calls encode(strip, firstRow, endRow) on the threads
+template <typename F>
+static void forEachStrip(const Image& image, const Strips& strips, F&& encode)
+{
+  nvh::parallel_batches<1>(
+      strips.count,
+      [&](uint64_t s) {
+        const uint32_t strip = static_cast<uint32_t>(s);
+        encode(strip, strip * strips.rows, std::min((strip + 1) * strips.rows, image.height));
+      },
+      std::min(strips.threads, strips.count));
+}
+
+// Writes the parts one after the other
+static bool writeParts(FILE* file, const std::vector<const Bytes*>& parts, Timings& timings)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  bool       ok = true;
+  for(const Bytes* part : parts)
+  {
+    ok = ok && fwrite(part->data(), 1, part->size(), file) == part->size();
+    timings.bytes += part->size();
+  }
+  timings.writeMs += msSince(t0);
+  return ok;
+}
+
+static bool writeFile(const std::string& filename, const std::vector<const Bytes*>& parts, Timings& timings)
+{
+  FILE* file = fopen(filename.c_str(), "wb");
+  if(file == nullptr)
+  {
+    LOGE("Could not open %s for writing\n", filename.c_str());
+    return false;
+  }
+  bool       ok = writeParts(file, parts, timings);
+  const auto t0 = std::chrono::steady_clock::now();
+  ok            = (fclose(file) == 0) && ok;
+  timings.writeMs += msSince(t0);
+  if(!ok)
+  {
+    LOGE("Could not write %s\n", filename.c_str());
+  }
+  return ok;
+}
+
+static bool checkFormat(const Image& image, PixelFormat format, const char* name)
+{
+  if(image.format != format || image.pixels == nullptr || image.width == 0 || image.height == 0)
+  {
+    LOGE("%s: unsupported image\n", name);
+    return false;
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Streams writing their file in order: the header when opened, the bands, then the end
+//
+class FileStream : public Stream
+{
+public:
+  FileStream(const std::string& filename, uint32_t width, uint32_t height, PixelFormat format, const Options& options, const char* name)
+      : m_filename(filename)
+      , m_width(width)
+      , m_height(height)
+      , m_format(format)
+      , m_options(options)
+      , m_name(name)
+  {
+    m_file = fopen(filename.c_str(), "wb");
+    if(m_file == nullptr)
+    {
+      LOGE("Could not open %s for writing\n", filename.c_str());
+    }
+  }
+  ~FileStream() override
+  {
+    if(m_file != nullptr)
+      fclose(m_file);
+  }
+  bool isOpen() const { return m_file != nullptr; }
+
+protected:
+  bool checkRows(const Image& rows) const
+  {
+    if(m_file == nullptr || !checkFormat(rows, m_format, m_name))
+      return false;
+    if(rows.width != m_width || m_row + rows.height > m_height)
+    {
+      LOGE("%s: %ux%u rows don't fit at row %u of %ux%u\n", m_name, rows.width, rows.height, m_row, m_width, m_height);
+      return false;
+    }
+    return true;
+  }
+
+  // Closes the file on failure
+  bool write(const std::vector<const Bytes*>& parts)
+  {
+    if(m_file != nullptr && writeParts(m_file, parts, m_timings))
+      return true;
+    LOGE("Could not write %s\n", m_filename.c_str());
+    if(m_file != nullptr)
+      fclose(m_file);
+    m_file = nullptr;
+    return false;
+  }
+
+  bool close()
+  {
+    if(m_file == nullptr)
+      return false;
+    const auto t0 = std::chrono::steady_clock::now();
+    bool       ok = fclose(m_file) == 0;
+    m_file        = nullptr;
+    m_timings.writeMs += msSince(t0);
+    if(m_row != m_height)
+    {
+      LOGE("%s: %u rows written out of %u\n", m_filename.c_str(), m_row, m_height);
+      ok = false;
+    }
+    return ok;
+  }
+
+  std::string m_filename;
+  FILE*       m_file{nullptr};
+  uint32_t    m_width{0};
+  uint32_t    m_height{0};
+  uint32_t    m_row{0};  // Rows written
+  PixelFormat m_format{PixelFormat::eRGBA8};
+  Options     m_options;
+  const char* m_name{""};
+};
+
+template <typename T>
+static std::unique_ptr<Stream> openStream(const std::string& filename, uint32_t width, uint32_t height, const Options& options)
+{
+  auto stream = std::make_unique<T>(filename, width, height, options);
+  if(!stream->isOpen())
+    return nullptr;
+  return stream;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// JPEG: stb_image_write, one thread
+//
+static bool writeJpg(const std::string& filename, const Image& image, const Options& options, Timings& timings)
+{
+  if(!checkFormat(image, PixelFormat::eRGBA8, "JPEG"))
+    return false;
+
+  const auto t0 = std::chrono::steady_clock::now();
+  Bytes      data;
+  auto       append = [](void* context, void* bytes, int size) {
+    Bytes* out = static_cast<Bytes*>(context);
+    out->insert(out->end(), static_cast<uint8_t*>(bytes), static_cast<uint8_t*>(bytes) + size);
+  };
+  const int ok = stbi_write_jpg_to_func(append, &data, image.width, image.height, 4, image.pixels,
+                                        std::clamp(options.quality, 1, 100));
+  timings.encodeMs += msSince(t0);
+  timings.tiles = 1;
+  return ok != 0 && writeFile(filename, {&data}, timings);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Deflate, fixed Huffman codes, each strip compressed on its own.
+// The strips but the last end with an empty stored block to be byte aligned, so their streams can
+// be concatenated; their Adler-32 checksums are combined.
+//
+class BitWriter
+{
+public:
+  explicit BitWriter(Bytes& out)
+      : m_out(out)
+  {
+  }
+  void put(uint32_t value, int count)
+  {
+    m_bits |= value << m_count;
+    m_count += count;
+    while(m_count >= 8)
+    {
+      m_out.push_back(uint8_t(m_bits));
+      m_bits >>= 8;
+      m_count -= 8;
+    }
+  }
+  // Huffman codes are stored from their most significant bit
+  void putCode(uint32_t code, int count)
+  {
+    uint32_t reversed = 0;
+    for(int i = 0; i < count; i++)
+      reversed |= ((code >> i) & 1) << (count - 1 - i);
+    put(reversed, count);
+  }
+  void align()
+  {
+    if(m_count > 0)
+      m_out.push_back(uint8_t(m_bits));
+    m_bits  = 0;
+    m_count = 0;
+  }
+
+private:
+  Bytes&   m_out;
+  uint32_t m_bits{0};
+  int      m_count{0};
+};
+
+static void putLiteral(BitWriter& bits, uint32_t symbol)
+{
+  if(symbol < 144)
+    bits.putCode(0x30 + symbol, 8);
+  else if(symbol < 256)
+    bits.putCode(0x190 + symbol - 144, 9);
+  else if(symbol < 280)
+    bits.putCode(symbol - 256, 7);
+  else
+    bits.putCode(0xC0 + symbol - 280, 8);
+}
+
+static void putMatch(BitWriter& bits, uint32_t length, uint32_t distance)
+{
+  static const uint16_t s_lengthBase[29]  = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                             31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const uint8_t  s_lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const uint16_t s_distBase[30]    = {1,    2,    3,    4,    5,    7,    9,    13,    17,    25,
+                                             33,   49,   65,   97,   129,  193,  257,  385,   513,   769,
+                                             1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  static const uint8_t  s_distExtra[30]   = {0, 0, 0, 0, 1, 1, 2, 2, 3,  3,  4,  4,  5,  5,  6,
+                                             6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+  int l = 28;
+  while(s_lengthBase[l] > length)
+    l--;
+  putLiteral(bits, 257 + l);
+  bits.put(length - s_lengthBase[l], s_lengthExtra[l]);
+
+  int d = 29;
+  while(s_distBase[d] > distance)
+    d--;
+  bits.putCode(d, 5);
+  bits.put(distance - s_distBase[d], s_distExtra[d]);
+}
+
+static void deflateStrip(const Bytes& data, bool last, Bytes& out)
+{
+  constexpr int      kHashBits = 15;
+  constexpr int32_t  kWindow   = 32768;
+  constexpr uint32_t kMinMatch = 3;
+  constexpr uint32_t kMaxMatch = 258;
+  constexpr int      kMaxChain = 16;
+
+  const int32_t        size = static_cast<int32_t>(data.size());
+  std::vector<int32_t> head(size_t(1) << kHashBits, -1);
+  std::vector<int32_t> prev(data.size(), -1);
+  auto                 hash = [&](int32_t p) {
+    const uint32_t v = (uint32_t(data[p]) << 16) | (uint32_t(data[p + 1]) << 8) | data[p + 2];
+    return (v * 2654435761U) >> (32 - kHashBits);
+  };
+  auto insert = [&](int32_t p) {
+    if(p + int32_t(kMinMatch) <= size)
+    {
+      const uint32_t h = hash(p);
+      prev[p]          = head[h];
+      head[h]          = p;
+    }
+  };
+
+  out.reserve(data.size() / 2);
+  BitWriter bits(out);
+  bits.put(last ? 1 : 0, 1);  // BFINAL
+  bits.put(1, 2);             // Fixed Huffman codes
+
+  int32_t i = 0;
+  while(i < size)
+  {
+    uint32_t best_length   = 0;
+    int32_t  best_distance = 0;
+    if(i + int32_t(kMinMatch) <= size)
+    {
+      const uint32_t max_length = std::min(kMaxMatch, uint32_t(size - i));
+      int32_t        candidate  = head[hash(i)];
+      for(int chain = 0; candidate >= 0 && i - candidate <= kWindow && chain < kMaxChain; chain++)
+      {
+        uint32_t length = 0;
+        while(length < max_length && data[candidate + length] == data[i + length])
+          length++;
+        if(length > best_length)
+        {
+          best_length   = length;
+          best_distance = i - candidate;
+          if(length == max_length)
+            break;
+        }
+        candidate = prev[candidate];
+      }
+    }
+
+    if(best_length >= kMinMatch)
+    {
+      putMatch(bits, best_length, best_distance);
+      for(uint32_t k = 0; k < best_length; k++)
+        insert(i + k);
+      i += best_length;
+    }
+    else
+    {
+      putLiteral(bits, data[i]);
+      insert(i);
+      i++;
+    }
+  }
+  putLiteral(bits, 256);  // End of block
+
+  if(!last)
+  {
+    // Empty stored block: byte aligned, the next strip can follow
+    bits.put(0, 3);
+    bits.align();
+    const uint8_t stored[4] = {0x00, 0x00, 0xFF, 0xFF};
+    out.insert(out.end(), stored, stored + 4);
+  }
+  bits.align();
+}
+
+static uint32_t adler32(const uint8_t* data, size_t size)
+{
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while(size > 0)
+  {
+    const size_t n = std::min<size_t>(size, 5552);
+    for(size_t i = 0; i < n; i++)
+    {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += n;
+    size -= n;
+  }
+  return (b << 16) | a;
+}
+
+// Adler-32 of the concatenation of A and B, B being `sizeB` bytes
+static uint32_t adler32Combine(uint32_t adlerA, uint32_t adlerB, uint64_t sizeB)
+{
+  const uint64_t base = 65521;
+  const uint64_t rem  = sizeB % base;
+  uint64_t       sum1 = adlerA & 0xFFFF;
+  uint64_t       sum2 = (rem * sum1) % base;
+  sum1 += (adlerB & 0xFFFF) + base - 1;
+  sum2 += ((adlerA >> 16) & 0xFFFF) + ((adlerB >> 16) & 0xFFFF) + base - rem;
+  sum1 %= base;
+  sum2 %= base;
+  return uint32_t((sum2 << 16) | sum1);
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  static const std::array<uint32_t, 256> s_table = [] {
+    std::array<uint32_t, 256> table{};
+    for(uint32_t n = 0; n < 256; n++)
+    {
+      uint32_t c = n;
+      for(int k = 0; k < 8; k++)
+        c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+    return table;
+  }();
+
+  crc = ~crc;
+  for(size_t i = 0; i < size; i++)
+    crc = s_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// PNG: rows filtered with the filter of smallest sum, like stb_image_write, deflated by strips
+//
+static void filterRow(const uint8_t* row, const uint8_t* above, uint32_t rowBytes, Bytes& out)
+{
+  auto paeth = [](int a, int b, int c) {
+    const int p  = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+  };
+  auto filtered = [&](int filter, uint32_t x) -> uint8_t {
+    const int left       = x >= 4 ? row[x - 4] : 0;
+    const int up         = above != nullptr ? above[x] : 0;
+    const int upper_left = (x >= 4 && above != nullptr) ? above[x - 4] : 0;
+    switch(filter)
+    {
+      case 1:
+        return uint8_t(row[x] - left);
+      case 2:
+        return uint8_t(row[x] - up);
+      case 3:
+        return uint8_t(row[x] - ((left + up) >> 1));
+      case 4:
+        return uint8_t(row[x] - paeth(left, up, upper_left));
+      default:
+        return row[x];
+    }
+  };
+
+  int      best_filter = 0;
+  uint64_t best_sum    = ~0ULL;
+  for(int filter = 0; filter < 5; filter++)
+  {
+    uint64_t sum = 0;
+    for(uint32_t x = 0; x < rowBytes && sum < best_sum; x++)
+      sum += abs(int(int8_t(filtered(filter, x))));
+    if(sum < best_sum)
+    {
+      best_sum    = sum;
+      best_filter = filter;
+    }
+  }
+
+  out.push_back(uint8_t(best_filter));
+  for(uint32_t x = 0; x < rowBytes; x++)
+    out.push_back(filtered(best_filter, x));
+}
+
+class PngStream : public FileStream
+{
+public:
+  PngStream(const std::string& filename, uint32_t width, uint32_t height, const Options& options)
+      : FileStream(filename, width, height, PixelFormat::eRGBA8, options, "PNG")
+  {
+    Bytes head = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    putBE32(head, 13);
+    const size_t  ihdr_start = head.size();
+    const uint8_t ihdr[]     = {'I', 'H', 'D', 'R'};
+    head.insert(head.end(), ihdr, ihdr + 4);
+    putBE32(head, width);
+    putBE32(head, height);
+    const uint8_t ihdr_end[] = {8, 6, 0, 0, 0};  // 8 bits, RGBA, deflate, adaptive filters, no interlace
+    head.insert(head.end(), ihdr_end, ihdr_end + 5);
+    putBE32(head, crc32(0, head.data() + ihdr_start, head.size() - ihdr_start));
+    if(isOpen())
+      write({&head});
+  }
+
+  // Each band is an IDAT chunk, the first one starting the zlib stream and the last one ending it
+  bool writeRows(const Image& rows) override
+  {
+    if(!checkRows(rows))
+      return false;
+
+    const auto     t0        = std::chrono::steady_clock::now();
+    const uint32_t row_bytes = m_width * 4;
+    const bool     first     = m_row == 0;
+    const bool     last      = m_row + rows.height == m_height;
+    const Strips   strips    = planStrips(rows, m_options);
+
+    std::vector<Bytes>    compressed(strips.count);
+    std::vector<uint32_t> adlers(strips.count);
+    std::vector<uint64_t> sizes(strips.count);
+    forEachStrip(rows, strips, [&](uint32_t strip, uint32_t y0, uint32_t y1) {
+      Bytes filtered;
+      filtered.reserve(size_t(y1 - y0) * (row_bytes + 1));
+      for(uint32_t y = y0; y < y1; y++)
+      {
+        const uint8_t* row   = rows.pixels + size_t(y) * row_bytes;
+        const uint8_t* above = y > 0 ? row - row_bytes : (first ? nullptr : m_lastRow.data());
+        filterRow(row, above, row_bytes, filtered);
+      }
+      adlers[strip] = adler32(filtered.data(), filtered.size());
+      sizes[strip]  = filtered.size();
+      deflateStrip(filtered, last && strip + 1 == strips.count, compressed[strip]);
+    });
+
+    uint64_t idat_size = (first ? 2 : 0) + (last ? 4 : 0);
+    for(uint32_t s = 0; s < strips.count; s++)
+    {
+      m_adler = adler32Combine(m_adler, adlers[s], sizes[s]);
+      idat_size += compressed[s].size();
+    }
+
+    Bytes head;
+    putBE32(head, static_cast<uint32_t>(idat_size));
+    const uint8_t idat[] = {'I', 'D', 'A', 'T', 0x78, 0x01};  // The zlib header in the first chunk
+    head.insert(head.end(), idat, idat + (first ? 6 : 4));
+    uint32_t crc = crc32(0, head.data() + 4, head.size() - 4);
+    for(const Bytes& c : compressed)
+      crc = crc32(crc, c.data(), c.size());
+    Bytes tail;
+    if(last)
+      putBE32(tail, m_adler);
+    crc = crc32(crc, tail.data(), tail.size());
+    putBE32(tail, crc);
+
+    const uint8_t* last_row = rows.pixels + size_t(rows.height - 1) * row_bytes;
+    m_lastRow.assign(last_row, last_row + row_bytes);
+    m_row += rows.height;
+    m_timings.encodeMs += msSince(t0);
+    m_timings.tiles += strips.count;
+
+    std::vector<const Bytes*> parts{&head};
+    for(const Bytes& c : compressed)
+      parts.push_back(&c);
+    parts.push_back(&tail);
+    return write(parts);
+  }
+
+  bool finish() override
+  {
+    const Bytes iend = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+    return isOpen() && write({&iend}) && close();
+  }
+
+private:
+  Bytes    m_lastRow;  // Of the previous band, for the filters
+  uint32_t m_adler{1};
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// QOI, https://qoiformat.org
+// Each strip starts from the last pixel of the previous one and flushes its run at its end. Its
+// index of colors starts empty, and only gets the colors it encodes: the decoder has the same
+// colors at these positions, so the streams of the strips are concatenated as they are.
+//
+static uint32_t qoiLoad(const uint8_t* pixels, size_t i)
+{
+  uint32_t px;
+  memcpy(&px, pixels + i * 4, 4);
+  return px;
+}
+
+// `prev` is the pixel before the strip, `zeroIndex` for the first strip of the image
+static void qoiEncodeStrip(const uint8_t* pixels, size_t count, uint32_t prev, bool zeroIndex, Bytes& out)
+{
+  uint32_t index[64] = {};
+  bool     valid[64] = {};
+  if(zeroIndex)
+    std::fill(std::begin(valid), std::end(valid), true);  // The decoder starts with zeros
+
+  auto channel = [](uint32_t px, int c) { return uint8_t(px >> (c * 8)); };
+
+  uint32_t run = 0;
+  out.reserve(count * 2);
+  for(size_t i = 0; i < count; i++)
+  {
+    const uint32_t px = qoiLoad(pixels, i);
+    if(px == prev)
+    {
+      run++;
+      if(run == 62 || i + 1 == count)
+      {
+        out.push_back(uint8_t(0xC0 | (run - 1)));
+        run = 0;
+      }
+      continue;
+    }
+    if(run > 0)
+    {
+      out.push_back(uint8_t(0xC0 | (run - 1)));
+      run = 0;
+    }
+
+    const uint8_t r = channel(px, 0), g = channel(px, 1), b = channel(px, 2), a = channel(px, 3);
+    const uint8_t h = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+    if(valid[h] && index[h] == px)
+    {
+      out.push_back(h);  // QOI_OP_INDEX
+    }
+    else
+    {
+      valid[h] = true;
+      index[h] = px;
+      if(a == channel(prev, 3))
+      {
+        const int8_t vr   = int8_t(r - channel(prev, 0));
+        const int8_t vg   = int8_t(g - channel(prev, 1));
+        const int8_t vb   = int8_t(b - channel(prev, 2));
+        const int    vg_r = vr - vg;
+        const int    vg_b = vb - vg;
+        if(vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+        {
+          out.push_back(uint8_t(0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2)));  // QOI_OP_DIFF
+        }
+        else if(vg_r >= -8 && vg_r <= 7 && vg >= -32 && vg <= 31 && vg_b >= -8 && vg_b <= 7)
+        {
+          out.push_back(uint8_t(0x80 | (vg + 32)));  // QOI_OP_LUMA
+          out.push_back(uint8_t(((vg_r + 8) << 4) | (vg_b + 8)));
+        }
+        else
+        {
+          const uint8_t rgb[4] = {0xFE, r, g, b};
+          out.insert(out.end(), rgb, rgb + 4);
+        }
+      }
+      else
+      {
+        const uint8_t rgba[5] = {0xFF, r, g, b, a};
+        out.insert(out.end(), rgba, rgba + 5);
+      }
+    }
+    prev = px;
+  }
+}
+
+class QoiStream : public FileStream
+{
+public:
+  QoiStream(const std::string& filename, uint32_t width, uint32_t height, const Options& options)
+      : FileStream(filename, width, height, PixelFormat::eRGBA8, options, "QOI")
+  {
+    Bytes head = {'q', 'o', 'i', 'f'};
+    putBE32(head, width);
+    putBE32(head, height);
+    head.push_back(4);  // RGBA
+    head.push_back(0);  // sRGB with linear alpha
+    if(isOpen())
+      write({&head});
+  }
+
+  bool writeRows(const Image& rows) override
+  {
+    if(!checkRows(rows))
+      return false;
+
+    const auto         t0     = std::chrono::steady_clock::now();
+    const Strips       strips = planStrips(rows, m_options);
+    std::vector<Bytes> encoded(strips.count);
+    forEachStrip(rows, strips, [&](uint32_t strip, uint32_t y0, uint32_t y1) {
+      const size_t   begin = size_t(y0) * m_width;
+      const uint32_t prev  = begin == 0 ? m_prev : qoiLoad(rows.pixels, begin - 1);
+      qoiEncodeStrip(rows.pixels + begin * 4, size_t(y1 - y0) * m_width, prev, m_row == 0 && begin == 0, encoded[strip]);
+    });
+    m_prev = qoiLoad(rows.pixels, size_t(rows.height) * m_width - 1);
+    m_row += rows.height;
+    m_timings.encodeMs += msSince(t0);
+    m_timings.tiles += strips.count;
+
+    std::vector<const Bytes*> parts;
+    for(const Bytes& e : encoded)
+      parts.push_back(&e);
+    return write(parts);
+  }
+
+  bool finish() override
+  {
+    const Bytes tail = {0, 0, 0, 0, 0, 0, 0, 1};
+    return isOpen() && write({&tail}) && close();
+  }
+
+private:
+  uint32_t m_prev{0xFF000000U};  // Last pixel written, opaque black at first (RGBA in memory)
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// OpenEXR: half RGBA, uncompressed scanlines. The blocks have all the same size, so their offsets
+// are known before encoding, and the strips only reorder the channels (A, B, G, R by name).
+// Written little endian, as the hosts of this sample.
+//
+class ExrStream : public FileStream
+{
+public:
+  ExrStream(const std::string& filename, uint32_t width, uint32_t height, const Options& options)
+      : FileStream(filename, width, height, PixelFormat::eRGBA16F, options, "OpenEXR")
+  {
+    Bytes head = {0x76, 0x2F, 0x31, 0x01};
+    putLE32(head, 2);  // Version 2, scanlines
+    auto attribute = [&](const char* name, const char* type, uint32_t size) {
+      putString(head, name);
+      putString(head, type);
+      putLE32(head, size);
+    };
+    attribute("channels", "chlist", 4 * 18 + 1);
+    for(const char* channel : {"A", "B", "G", "R"})
+    {
+      putString(head, channel);
+      putLE32(head, 1);  // HALF
+      putLE32(head, 0);  // pLinear and reserved
+      putLE32(head, 1);  // x and y sampling
+      putLE32(head, 1);
+    }
+    head.push_back(0);
+    attribute("compression", "compression", 1);
+    head.push_back(0);  // NO_COMPRESSION
+    for(const char* window : {"dataWindow", "displayWindow"})
+    {
+      attribute(window, "box2i", 16);
+      putLE32(head, 0);
+      putLE32(head, 0);
+      putLE32(head, width - 1);
+      putLE32(head, height - 1);
+    }
+    attribute("lineOrder", "lineOrder", 1);
+    head.push_back(0);  // INCREASING_Y
+    const float one = 1.0F;
+    uint32_t    one_bits;
+    memcpy(&one_bits, &one, 4);
+    attribute("pixelAspectRatio", "float", 4);
+    putLE32(head, one_bits);
+    attribute("screenWindowCenter", "v2f", 8);
+    putLE64(head, 0);
+    attribute("screenWindowWidth", "float", 4);
+    putLE32(head, one_bits);
+    head.push_back(0);  // End of the header
+
+    // Offsets of the scanlines
+    const uint64_t first_block = head.size() + uint64_t(height) * 8;
+    for(uint32_t y = 0; y < height; y++)
+      putLE64(head, first_block + y * blockBytes());
+    if(isOpen())
+      write({&head});
+  }
+
+  bool writeRows(const Image& rows) override
+  {
+    if(!checkRows(rows))
+      return false;
+
+    const auto         t0     = std::chrono::steady_clock::now();
+    const Strips       strips = planStrips(rows, m_options);
+    std::vector<Bytes> blocks(strips.count);
+    forEachStrip(rows, strips, [&](uint32_t strip, uint32_t y0, uint32_t y1) {
+      Bytes& out = blocks[strip];
+      out.resize(size_t(y1 - y0) * blockBytes());
+      uint8_t* dst = out.data();
+      for(uint32_t y = y0; y < y1; y++)
+      {
+        const uint32_t header[2] = {m_row + y, lineBytes()};
+        memcpy(dst, header, 8);
+        dst += 8;
+        const uint16_t* src = reinterpret_cast<const uint16_t*>(rows.pixels) + size_t(y) * m_width * 4;
+        for(int c : {3, 2, 1, 0})
+        {
+          for(uint32_t x = 0; x < m_width; x++)
+            memcpy(dst + x * 2, &src[x * 4 + c], 2);
+          dst += m_width * 2;
+        }
+      }
+    });
+    m_row += rows.height;
+    m_timings.encodeMs += msSince(t0);
+    m_timings.tiles += strips.count;
+
+    std::vector<const Bytes*> parts;
+    for(const Bytes& b : blocks)
+      parts.push_back(&b);
+    return write(parts);
+  }
+
+  bool finish() override { return close(); }
+
+private:
+  uint32_t lineBytes() const { return m_width * 4 * sizeof(uint16_t); }
+  uint64_t blockBytes() const { return 8 + lineBytes(); }  // y, size, then the channels
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// Raw: the pixels with no header, for the tools reading them the same way. The file gets its size
+// when opened, then each band is copied by strips to a memory mapping of its range of the file.
+// Encoding is the copy, writing is the unmapping.
+//
+class RawStream : public Stream
+{
+public:
+  RawStream(const std::string& filename, uint32_t width, uint32_t height, const Options& options)
+      : m_filename(filename)
+      , m_width(width)
+      , m_height(height)
+      , m_options(options)
+  {
+    const uint64_t size = rowBytes() * height;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    m_granularity = info.dwAllocationGranularity;
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(m_file != INVALID_HANDLE_VALUE)
+    {
+      m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), nullptr);
+    }
+    m_open = m_mapping != nullptr;
+#else
+    m_granularity = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    m_fd          = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    m_open        = m_fd >= 0 && ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+    if(!m_open)
+    {
+      LOGE("Could not open %s for writing\n", filename.c_str());
+    }
+    m_timings.bytes = size;
+  }
+  ~RawStream() override { closeFile(); }
+  bool isOpen() const { return m_open; }
+
+  bool writeRows(const Image& rows) override
+  {
+    if(!m_open || rows.pixels == nullptr || rows.width != m_width || rows.height == 0 || m_row + rows.height > m_height)
+      return false;
+
+    // The mapping starts on a multiple of the granularity
+    const auto     t0     = std::chrono::steady_clock::now();
+    const uint64_t offset = m_row * rowBytes();
+    const uint64_t start  = offset - offset % m_granularity;
+    const uint64_t size   = offset + rows.height * rowBytes() - start;
+#ifdef _WIN32
+    void* mapped = MapViewOfFile(m_mapping, FILE_MAP_WRITE, DWORD(start >> 32), DWORD(start), SIZE_T(size));
+    if(mapped == nullptr)
+#else
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, static_cast<off_t>(start));
+    if(mapped == MAP_FAILED)
+#endif
+    {
+      LOGE("Could not map %s\n", m_filename.c_str());
+      return false;
+    }
+
+    uint8_t*     dst    = static_cast<uint8_t*>(mapped) + (offset - start);
+    const Strips strips = planStrips(rows, m_options);
+    forEachStrip(rows, strips, [&](uint32_t, uint32_t y0, uint32_t y1) {
+      memcpy(dst + y0 * rowBytes(), rows.pixels + y0 * rowBytes(), (y1 - y0) * rowBytes());
+    });
+    m_timings.encodeMs += msSince(t0);
+    m_timings.tiles += strips.count;
+
+    const auto t1 = std::chrono::steady_clock::now();
+#ifdef _WIN32
+    const bool ok = UnmapViewOfFile(mapped) != 0;
+#else
+    const bool ok = munmap(mapped, size) == 0;
+#endif
+    m_timings.writeMs += msSince(t1);
+    m_row += rows.height;
+    return ok;
+  }
+
+  bool finish() override
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    const bool ok = closeFile();
+    m_timings.writeMs += msSince(t0);
+    if(m_row != m_height)
+    {
+      LOGE("%s: %u rows written out of %u\n", m_filename.c_str(), m_row, m_height);
+      return false;
+    }
+    return ok;
+  }
+
+private:
+  uint64_t rowBytes() const { return uint64_t(m_width) * bytesPerPixel(PixelFormat::eRGBA8); }
+
+  bool closeFile()
+  {
+    bool ok = m_open;
+#ifdef _WIN32
+    if(m_mapping != nullptr)
+      CloseHandle(m_mapping);
+    if(m_file != INVALID_HANDLE_VALUE)
+      ok = CloseHandle(m_file) != 0 && ok;
+    m_mapping = nullptr;
+    m_file    = INVALID_HANDLE_VALUE;
+#else
+    if(m_fd >= 0)
+      ok = close(m_fd) == 0 && ok;
+    m_fd = -1;
+#endif
+    m_open = false;
+    return ok;
+  }
+
+  std::string m_filename;
+  uint32_t    m_width{0};
+  uint32_t    m_height{0};
+  uint32_t    m_row{0};
+  Options     m_options;
+  uint64_t    m_granularity{4096};
+  bool        m_open{false};
+#ifdef _WIN32
+  HANDLE m_file{INVALID_HANDLE_VALUE};
+  HANDLE m_mapping{nullptr};
+#else
+  int m_fd{-1};
+#endif
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// Registry
+//
+static std::vector<Writer>& registry()
+{
+  static std::vector<Writer> s_writers = {
+      {"JPEG", ".jpg .jpeg", PixelFormat::eRGBA8, writeJpg, nullptr},                 //
+      {"PNG", ".png", PixelFormat::eRGBA8, nullptr, openStream<PngStream>},           //
+      {"QOI", ".qoi", PixelFormat::eRGBA8, nullptr, openStream<QoiStream>},           //
+      {"OpenEXR", ".exr", PixelFormat::eRGBA16F, nullptr, openStream<ExrStream>},     //
+      {"Raw", ".raw", PixelFormat::eRGBA8, nullptr, openStream<RawStream>},           //
+  };
+  return s_writers;
+}
+
+bool writeImage(const Writer& writer, const std::string& filename, const Image& image, const Options& options, Timings& timings)
+{
+  if(writer.write != nullptr)
+    return writer.write(filename, image, options, timings);
+  if(writer.open == nullptr)
+    return false;
+
+  std::unique_ptr<Stream> stream = writer.open(filename, image.width, image.height, options);
+  if(stream == nullptr)
+    return false;
+  const bool ok = stream->writeRows(image) && stream->finish();
+  timings       = stream->getTimings();
+  return ok;
+}
+
+void registerWriter(const Writer& writer)
+{
+  std::vector<Writer>& writers = registry();
+  auto it = std::find_if(writers.begin(), writers.end(), [&](const Writer& w) { return w.name == writer.name; });
+  if(it != writers.end())
+    *it = writer;
+  else
+    writers.push_back(writer);
+}
+
+const std::vector<Writer>& getWriters()
+{
+  return registry();
+}
+
+const Writer* findWriter(const std::string& filename)
+{
+  const size_t dot   = filename.find_last_of('.');
+  const size_t slash = filename.find_last_of("/\\");
+  if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return nullptr;
+
+  std::string extension = filename.substr(dot);
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+  for(const Writer& writer : registry())
+  {
+    std::istringstream extensions(writer.extensions);
+    std::string        candidate;
+    while(extensions >> candidate)
+    {
+      if(candidate == extension)
+        return &writer;
+    }
+  }
+  return nullptr;
+}
+
+std::string supportedExtensions()
+{
+  std::string result;
+  for(const Writer& writer : registry())
+  {
+    result += result.empty() ? "" : " ";
+    result += writer.extensions;
+  }
+  return result;
+}
+
+}  // namespace imagewriter
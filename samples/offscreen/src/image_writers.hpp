@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------------------
+// Registry of the image writers, chosen by the extension of the output file:
+// - .jpg .jpeg  stb_image_write, lossy
+// - .png        strips filtered and deflated in parallel, their streams concatenated
+// - .qoi        "Quite OK Image", lossless and several times faster than PNG, also encoded by strips
+// - .exr        half float RGBA, uncompressed scanlines, for HDR render targets
+// - .raw        the pixels as they are, written through a memory mapping of the file
+//
+// The images are split in strips of rows (Options::tileRows) encoded by a pool of threads, so
+// the encoding of large renders scales with the cores. The time is reported per stage: encoding
+// in memory, then writing to the file.
+//
+// All formats but JPEG can also be streamed: Writer::open() returns a Stream taking the image a
+// band of rows at a time, from the top, so images larger than the memory can be written.
+//
+namespace imagewriter {
+
+enum class PixelFormat
+{
+  eRGBA8,    // VK_FORMAT_R8G8B8A8_UNORM
+  eRGBA16F,  // VK_FORMAT_R16G16B16A16_SFLOAT
+};
+uint32_t bytesPerPixel(PixelFormat format);
+
+// Pixels of the image, rows tightly packed, the first row at the top
+struct Image
+{
+  const uint8_t* pixels{nullptr};
+  uint32_t       width{0};
+  uint32_t       height{0};
+  PixelFormat    format{PixelFormat::eRGBA8};
+};
+
+struct Options
+{
+  uint32_t numThreads{0};  // Encoding the strips, 0: all cores
+  uint32_t tileRows{0};    // Rows per strip, 0: from the size of the image and the threads
+  int      quality{90};    // JPEG quality, 1-100
+};
+
+struct Timings
+{
+  double   encodeMs{0.0};
+  double   writeMs{0.0};
+  uint64_t bytes{0};  // Of the file
+  uint32_t tiles{0};  // Strips encoded
+};
+
+// Writes an image band by band, from the top
+class Stream
+{
+public:
+  virtual ~Stream() = default;
+  // The next rows: `rows` has the width of the image, and up to its remaining rows
+  virtual bool writeRows(const Image& rows) = 0;
+  // After the last rows
+  virtual bool finish() = 0;
+
+  const Timings& getTimings() const { return m_timings; }
+
+protected:
+  Timings m_timings;
+};
+
+struct Writer
+{
+  std::string name;
+  std::string extensions;  // Space separated, lower case, with the dot: ".jpg .jpeg"
+  PixelFormat format{PixelFormat::eRGBA8};
+  // Whole images, nullptr to go through open()
+  bool (*write)(const std::string& filename, const Image& image, const Options& options, Timings& timings){nullptr};
+  // Streaming, nullptr if the format can't be written by bands; nullptr on failure
+  std::unique_ptr<Stream> (*open)(const std::string& filename, uint32_t width, uint32_t height, const Options& options){nullptr};
+};
+
+// Writes a whole image with writer.write, or by one band through writer.open
+bool writeImage(const Writer& writer, const std::string& filename, const Image& image, const Options& options, Timings& timings);
+
+// Adds a writer, or replaces the one with the same name
+void                       registerWriter(const Writer& writer);
+const std::vector<Writer>& getWriters();
+// Writer of the extension of filename, case insensitive; nullptr if none
+const Writer* findWriter(const std::string& filename);
+// All extensions, for the help and the errors
+std::string supportedExtensions();
+
+}  // namespace imagewriter
@@ -22,11 +22,16 @@
  rendered image to disk.
 */
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
 
 #define VMA_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "nvmath/nvmath.h"
 #include "nvh/commandlineparser.hpp"
@@ -40,7 +45,8 @@
 #include "nvvkhl/alloc_vma.hpp"
 #include "nvvkhl/gbuffer.hpp"
 
-#include "stb_image_write.h"
+#include "image_writers.hpp"
+#include "readback_ring.hpp"
 
 // Shaders
 #include "shaders/device_host.h"
@@ -83,72 +89,270 @@ public:
   {
     const nvh::ScopedTimer s_timer("Offline rendering");
 
-    std::array<VkClearValue, 2> clear_values{};
-    clear_values[0].color        = {{0.1F, 0.1F, 0.4F, 0.F}};
-    clear_values[1].depthStencil = {1.0F, 0};
-
     // Preparing the rendering
     VkCommandBuffer cmd = m_cmdPool->createCommandBuffer();
+    recordRender(cmd, *m_gBuffers, anim_time);
+    m_cmdPool->submitAndWait(cmd);
+  }
 
-    nvvk::createRenderingInfo r_info({{0, 0}, m_gBuffers->getSize()}, {m_gBuffers->getColorImageView()},
-                                     m_gBuffers->getDepthImageView(), VK_ATTACHMENT_LOAD_OP_CLEAR,
-                                     VK_ATTACHMENT_LOAD_OP_CLEAR, m_clearColor);
+  //--------------------------------------------------------------------------------------------------
+  // Recording the rendering of the frame at `anim_time` in the frame buffer `target`. With an
+  // `imageSize`, the frame buffer is the tile at `tileOffset` of an image of that size.
+  //
+  void recordRender(VkCommandBuffer  cmd,
+                    nvvkhl::GBuffer& target,
+                    float            anim_time,
+                    VkOffset2D       tileOffset = {0, 0},
+                    VkExtent2D       imageSize  = {0, 0})
+  {
+    nvvk::createRenderingInfo r_info({{0, 0}, target.getSize()}, {target.getColorImageView()}, target.getDepthImageView(),
+                                     VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_LOAD_OP_CLEAR, m_clearColor);
     r_info.pStencilAttachment = nullptr;
 
     vkCmdBeginRendering(cmd, &r_info);
 
-    const nvmath::vec2f size_f = {static_cast<float>(m_gBuffers->getSize().width),
-                                  static_cast<float>(m_gBuffers->getSize().height)};
+    const nvmath::vec2f size_f = {static_cast<float>(target.getSize().width), static_cast<float>(target.getSize().height)};
 
     // Viewport and scissor
     const VkViewport viewport{0.0F, 0.0F, size_f.x, size_f.y, 0.0F, 1.0F};
     vkCmdSetViewport(cmd, 0, 1, &viewport);
 
-    const VkRect2D scissor{{0, 0}, m_gBuffers->getSize()};
+    const VkRect2D scissor{{0, 0}, target.getSize()};
     vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    // Rendering the full-screen pixel shader
+    // Rendering the full-screen pixel shader, over the part of the image of the tile
+    const nvmath::vec2f image_f = imageSize.width > 0 ?
+                                      nvmath::vec2f(static_cast<float>(imageSize.width), static_cast<float>(imageSize.height)) :
+                                      size_f;
     PushConstant push_c{};
-    push_c.aspectRatio = size_f.x / size_f.y;
+    push_c.aspectRatio = image_f.x / image_f.y;
     push_c.iTime       = anim_time;
+    push_c.uvOffset    = {static_cast<float>(tileOffset.x) / image_f.x, static_cast<float>(tileOffset.y) / image_f.y};
+    push_c.uvScale     = {size_f.x / image_f.x, size_f.y / image_f.y};
 
     vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &push_c);
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
     vkCmdDraw(cmd, 3, 1, 0, 0);  // No vertices, it is implicitly done in the vertex shader
 
-    // Done and submit execution
     vkCmdEndRendering(cmd);
+  }
 
-    m_cmdPool->submitAndWait(cmd);
+  //--------------------------------------------------------------------------------------------------
+  // Rendering an animation: `numFrames` frames, `fps` per second of animation from `startTime`,
+  // saved to outFilename with the frame number before the extension (result_0000.jpg, ...).
+  //
+  // Nothing waits for the GPU on this thread: the frames go through a ring of readback buffers
+  // (readback_ring.hpp), and the images are encoded by a pool of workers, one frame each. Each slot of
+  // the ring renders to a frame buffer of its own (see createRingTargets()), so frame n+1 is rendered
+  // while frame n is copied.
+  //
+  void renderSequence(uint32_t                    numFrames,
+                      float                       fps,
+                      float                       startTime,
+                      const std::string&          outFilename,
+                      const imagewriter::Writer&  writer,
+                      const imagewriter::Options& options,
+                      uint32_t                    ringSize,
+                      uint32_t                    numWorkers)
+  {
+    const nvh::ScopedTimer s_timer("Render sequence\n");
+
+    // The frames are encoded in parallel, not their strips
+    imagewriter::Options frame_options = options;
+    frame_options.numThreads           = 1;
+
+    std::mutex           timings_mutex;
+    imagewriter::Timings total;
+    const auto           write = [&](const ReadbackRing::Frame& frame) {
+      const std::string        filename = frameFilename(outFilename, frame.index);
+      const imagewriter::Image image{frame.pixels, frame.size.width, frame.size.height, writer.format};
+      imagewriter::Timings     timings;
+      imagewriter::writeImage(writer, filename, image, frame_options, timings);
+
+      std::lock_guard<std::mutex> lock(timings_mutex);
+      total.encodeMs += timings.encodeMs;
+      total.writeMs += timings.writeMs;
+      total.bytes += timings.bytes;
+    };
+
+    const auto          t0 = std::chrono::steady_clock::now();
+    ReadbackRing::Stats stats;
+    uint32_t            workers = 0;
+    {
+      ReadbackRing ring(m_ctx, m_alloc.get(), m_gBuffers->getSize(), imagewriter::bytesPerPixel(writer.format), ringSize,
+                        numWorkers, write);
+      workers = ring.numWorkers();
+      createRingTargets(ring.numSlots());
+      for(uint32_t n = 0; n < numFrames; n++)
+      {
+        VkCommandBuffer  cmd    = ring.beginFrame(n);
+        nvvkhl::GBuffer& target = ringTarget(ring.currentSlot());
+        recordRender(cmd, target, startTime + static_cast<float>(n) / fps);
+        ring.endFrame(target.getColorImage(), VK_IMAGE_LAYOUT_GENERAL);
+      }
+      ring.flush();
+      stats = ring.getStats();
+    }
+    m_ringTargets.clear();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const double frames  = std::max(stats.frames, 1U);
+
+    LOGI(" - Frames: %u, %ux%u, %s (%s)\n", stats.frames, m_gBuffers->getSize().width, m_gBuffers->getSize().height,
+         frameFilename(outFilename, 0).c_str(), writer.name.c_str());
+    LOGI(" - Ring: %u readback buffers, %u writers\n", std::max(ringSize, 1U), workers);
+    LOGI(" - Throughput: %.1f frames/s, %.1f MB/s\n", stats.frames / seconds, total.bytes / (seconds * 1024.0 * 1024.0));
+    LOGI(" - Waiting for a readback buffer: %.2f ms per frame\n", stats.slotWaitMs / frames);
+    LOGI(" - Writers waiting for the GPU: %.2f ms per frame\n", stats.gpuWaitMs / frames);
+    LOGI(" - Encoding: %.2f ms per frame\n", total.encodeMs / frames);
+    LOGI(" - Writing: %.2f ms per frame\n", total.writeMs / frames);
   }
 
   //--------------------------------------------------------------------------------------------------
-  // Save the image to disk
+  // Rendering an image larger than the frame buffer, which is one tile. Each row of tiles is
+  // rendered through the readback ring (readback_ring.hpp), the tiles copied to a band of rows by
+  // the workers, then the band is encoded and written to the stream of `writer` while the next row
+  // of tiles is rendered. The host memory is two bands and the ring, whatever the height of the
+  // image, and the device memory is one tile per slot of the ring.
   //
-  void saveImage(const std::string& outFilename)
+  bool renderTiled(float                       anim_time,
+                   VkExtent2D                  imageSize,
+                   const std::string&          outFilename,
+                   const imagewriter::Writer&  writer,
+                   const imagewriter::Options& options,
+                   uint32_t                    ringSize)
+  {
+    const nvh::ScopedTimer s_timer("Render tiles\n");
+
+    std::unique_ptr<imagewriter::Stream> stream = writer.open(outFilename, imageSize.width, imageSize.height, options);
+    if(stream == nullptr)
+      return false;
+
+    const VkExtent2D tile      = m_gBuffers->getSize();
+    const uint32_t   bpp       = imagewriter::bytesPerPixel(writer.format);
+    const uint32_t   tiles_x   = (imageSize.width + tile.width - 1) / tile.width;
+    const uint32_t   tiles_y   = (imageSize.height + tile.height - 1) / tile.height;
+    const size_t     row_bytes = size_t(imageSize.width) * bpp;
+
+    // Band being filled, set before its tiles are submitted
+    std::array<std::vector<uint8_t>, 2> bands;
+    uint8_t*                            band      = nullptr;
+    uint32_t                            band_rows = 0;
+
+    // Frame index: the column of the tile; the last ones are cropped to the image
+    const auto copy_tile = [&](const ReadbackRing::Frame& frame) {
+      const uint32_t x0      = frame.index * tile.width;
+      const size_t   columns = std::min(tile.width, imageSize.width - x0);
+      for(uint32_t y = 0; y < band_rows; y++)
+        memcpy(band + y * row_bytes + x0 * bpp, frame.pixels + size_t(y) * tile.width * bpp, columns * bpp);
+    };
+
+    const auto        t0 = std::chrono::steady_clock::now();
+    bool              ok = true;
+    std::future<bool> writing;  // Of the previous band
+    {
+      ReadbackRing ring(m_ctx, m_alloc.get(), tile, bpp, ringSize, ringSize, copy_tile);
+      createRingTargets(ring.numSlots());
+      for(uint32_t ty = 0; ty < tiles_y && ok; ty++)
+      {
+        std::vector<uint8_t>& pixels = bands[ty % 2];
+        const uint32_t        y0     = ty * tile.height;
+        pixels.resize(row_bytes * tile.height);
+        band      = pixels.data();
+        band_rows = std::min(tile.height, imageSize.height - y0);
+
+        for(uint32_t tx = 0; tx < tiles_x; tx++)
+        {
+          VkCommandBuffer  cmd    = ring.beginFrame(tx);
+          nvvkhl::GBuffer& target = ringTarget(ring.currentSlot());
+          recordRender(cmd, target, anim_time, {static_cast<int32_t>(tx * tile.width), static_cast<int32_t>(y0)}, imageSize);
+          ring.endFrame(target.getColorImage(), VK_IMAGE_LAYOUT_GENERAL);
+        }
+        ring.flush();
+
+        // The other band is free once written
+        if(writing.valid())
+          ok = writing.get();
+        const imagewriter::Image rows{band, imageSize.width, band_rows, writer.format};
+        writing = std::async(std::launch::async, [&stream, rows] { return stream->writeRows(rows); });
+      }
+      if(writing.valid())
+        ok = writing.get() && ok;
+    }
+    m_ringTargets.clear();
+    ok = ok && stream->finish();
+    if(!ok)
+    {
+      LOGE("Could not write %s\n", outFilename.c_str());
+      return false;
+    }
+
+    const double               seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const imagewriter::Timings timings = stream->getTimings();
+    const double               mb      = 1024.0 * 1024.0;
+    LOGI(" - Size: %u, %u, %s (%s)\n", imageSize.width, imageSize.height, outFilename.c_str(), writer.name.c_str());
+    LOGI(" - Tiles: %u x %u of %u x %u\n", tiles_x, tiles_y, tile.width, tile.height);
+    LOGI(" - Host memory: %.1f MB for the bands and %.1f MB for the ring, the image is %.1f MB\n",
+         2.0 * row_bytes * tile.height / mb, std::max(ringSize, 1U) * double(tile.width) * tile.height * bpp / mb,
+         double(row_bytes) * imageSize.height / mb);
+    LOGI(" - Throughput: %.1f Mpixels/s\n", double(imageSize.width) * imageSize.height / (seconds * 1e6));
+    LOGI(" - Encoding: %.2f ms, %u strips\n", timings.encodeMs, timings.tiles);
+    LOGI(" - Writing: %.2f ms, %llu bytes\n", timings.writeMs, static_cast<unsigned long long>(timings.bytes));
+    return true;
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Filename of a frame of a sequence: result.jpg -> result_0042.jpg
+  //
+  static std::string frameFilename(const std::string& outFilename, uint32_t frame)
+  {
+    char number[16];
+    snprintf(number, sizeof(number), "_%04u", frame);
+
+    const size_t dot   = outFilename.find_last_of('.');
+    const size_t slash = outFilename.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+      return outFilename + number;
+    return outFilename.substr(0, dot) + number + outFilename.substr(dot);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Save the image to disk, in the format of `writer`
+  //
+  void saveImage(const std::string& outFilename, const imagewriter::Writer& writer, const imagewriter::Options& options)
   {
     const nvh::ScopedTimer s_timer("Save Image\n");
 
     // Create a temporary buffer to hold the pixels of the image
+    const VkExtent2D         size = m_gBuffers->getSize();
     const VkBufferUsageFlags usage{VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT};
-    const VkDeviceSize buffer_size  = 4 * sizeof(uint8_t) * m_gBuffers->getSize().width * m_gBuffers->getSize().height;
+    const VkDeviceSize buffer_size  = VkDeviceSize(imagewriter::bytesPerPixel(writer.format)) * size.width * size.height;
     nvvk::Buffer       pixel_buffer = m_alloc->createBuffer(buffer_size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 
+    // The pixels are copied out of the mapped memory, uncached on some devices: the encoders read them several times
+    const auto t0 = std::chrono::steady_clock::now();
     imageToBuffer(m_gBuffers->getColorImage(), pixel_buffer.buffer);
+    std::vector<uint8_t> pixels(buffer_size);
+    memcpy(pixels.data(), m_alloc->map(pixel_buffer), buffer_size);
+    m_alloc->unmap(pixel_buffer);
+    const double readback_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
 
     // Write the buffer to disk
-    LOGI(" - Size: %d, %d\n", m_gBuffers->getSize().width, m_gBuffers->getSize().height);
-    LOGI(" - Bytes: %d\n", m_gBuffers->getSize().width * m_gBuffers->getSize().height * 4);
-    LOGI(" - Out name: %s\n", outFilename.c_str());
-    const void* data = m_alloc->map(pixel_buffer);
-    stbi_write_jpg(outFilename.c_str(), m_gBuffers->getSize().width, m_gBuffers->getSize().height, 4, data, 0);
-    m_alloc->unmap(pixel_buffer);
+    LOGI(" - Size: %d, %d\n", size.width, size.height);
+    LOGI(" - Bytes: %llu\n", static_cast<unsigned long long>(buffer_size));
+    LOGI(" - Out name: %s (%s)\n", outFilename.c_str(), writer.name.c_str());
+    const imagewriter::Image image{pixels.data(), size.width, size.height, writer.format};
+    imagewriter::Timings     timings;
+    if(imagewriter::writeImage(writer, outFilename, image, options, timings))
+    {
+      LOGI(" - Readback: %.2f ms\n", readback_ms);
+      LOGI(" - Encoding: %.2f ms, %u strips\n", timings.encodeMs, timings.tiles);
+      LOGI(" - Writing: %.2f ms, %llu bytes\n", timings.writeMs, static_cast<unsigned long long>(timings.bytes));
+    }
 
     // Destroy temporary buffer
     m_alloc->destroy(pixel_buffer);
   }
 
-
   //--------------------------------------------------------------------------------------------------
   // Copy the image to a buffer - this linearize the image memory
   //
@@ -204,6 +408,9 @@ public:
   }
 
 
+  // Format of the frame buffer and of the pipeline, before creating them
+  void setColorFormat(VkFormat format) { m_colorFormat = format; }
+
   //--------------------------------------------------------------------------------------------------
   // Creating an offscreen frame buffer and the associated render pass
   //
@@ -213,10 +420,25 @@ public:
     m_gBuffers = std::make_unique<nvvkhl::GBuffer>(m_ctx->m_device, m_alloc.get(), size, m_colorFormat, m_depthFormat);
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Frame buffers of the slots of a readback ring, the first one being the frame buffer of the sample.
+  // A slot is only reused once its copy is done, so a frame can be rendered while the frames of the
+  // other slots are still being copied.
+  //
+  void createRingTargets(uint32_t numSlots)
+  {
+    m_ringTargets.clear();
+    for(uint32_t slot = 1; slot < numSlots; slot++)
+      m_ringTargets.push_back(std::make_unique<nvvkhl::GBuffer>(m_ctx->m_device, m_alloc.get(), m_gBuffers->getSize(),
+                                                                m_colorFormat, m_depthFormat));
+  }
+  nvvkhl::GBuffer& ringTarget(uint32_t slot) { return slot == 0 ? *m_gBuffers : *m_ringTargets[slot - 1]; }
+
   void destroy()
   {
     vkDestroyPipelineLayout(m_ctx->m_device, m_pipelineLayout, nullptr);
     vkDestroyPipeline(m_ctx->m_device, m_pipeline, nullptr);
+    m_ringTargets.clear();
     m_gBuffers.reset();
     m_cmdPool.reset();
     m_alloc.reset();
@@ -228,6 +450,8 @@ private:
   std::unique_ptr<nvvk::CommandPool> m_cmdPool;
   std::unique_ptr<nvvkhl::GBuffer>   m_gBuffers;
 
+  std::vector<std::unique_ptr<nvvkhl::GBuffer>> m_ringTargets;  // Slots 1.. of the readback ring, see createRingTargets()
+
   VkClearColorValue m_clearColor{{0.1F, 0.4F, 0.1F, 1.0F}};  // Clear color
   VkPipelineLayout  m_pipelineLayout{VK_NULL_HANDLE};        // The description of the pipeline
   VkPipeline        m_pipeline{VK_NULL_HANDLE};              // The graphic pipeline to render
@@ -245,18 +469,44 @@ int main(int argc, char** argv)
   float       anim_time{0.0F};
   VkExtent2D  render_size{800, 600};
   std::string output_file{"result.jpg"};
+  uint32_t    num_frames{0};
+  float       fps{30.0F};
+  uint32_t    ring_size{3};
+  uint32_t    num_threads{0};
+  int         quality{90};
+  uint32_t    tile_rows{0};
+  uint32_t    tile_size{0};
 
   nvh::CommandLineParser parser("Offline Render");
   parser.addArgument({"-t", "--time"}, &anim_time, "Animation time");
   parser.addArgument({"-w", "--width"}, &render_size.width, "Render size width");
   parser.addArgument({"-h", "--height"}, &render_size.height, "Render size height");
-  parser.addArgument({"-o", "--output"}, &output_file, "Output filename (must end with .jpg)");
+  const std::string output_help = "Output filename, the format from its extension: " + imagewriter::supportedExtensions();
+  parser.addArgument({"-o", "--output"}, &output_file, output_help);
+  parser.addArgument({"-f", "--frames"}, &num_frames, "Batch: number of frames to render, numbered in the output filename");
+  parser.addArgument({"--fps"}, &fps, "Batch: frames per second of animation time");
+  parser.addArgument({"--ring"}, &ring_size, "Batch and tiles: readback buffers in flight");
+  parser.addArgument({"--threads"}, &num_threads, "Encoding threads: per strip, or per frame in batch; 0: all cores");
+  parser.addArgument({"-q", "--quality"}, &quality, "JPEG quality, 1-100");
+  parser.addArgument({"--tile-rows"}, &tile_rows, "Rows per strip encoded in parallel, 0: automatic");
+  parser.addArgument({"--tile"}, &tile_size, "Render in tiles of this size, streamed to the file; 0: only above the device limit");
   if(!parser.parse(argc, argv))
   {
     parser.printHelp();
     return 1;
   }
 
+  const imagewriter::Writer* writer = imagewriter::findWriter(output_file);
+  if(writer == nullptr)
+  {
+    LOGE("No image writer for %s, the extensions are: %s\n", output_file.c_str(), imagewriter::supportedExtensions().c_str());
+    return 1;
+  }
+  imagewriter::Options write_options;
+  write_options.numThreads = num_threads;
+  write_options.tileRows   = tile_rows;
+  write_options.quality    = quality;
+
   // Creating the Vulkan instance and device, with only defaults, no extension
   nvvk::Context           vkctx;
   nvvk::ContextCreateInfo vkctx_info{};
@@ -264,18 +514,62 @@ int main(int argc, char** argv)
   vkctx_info.apiMinor = 3;
   vkctx.init(vkctx_info);
 
+  // Images larger than the device can render are always tiled
+  const uint32_t max_size = vkctx.m_physicalInfo.properties10.limits.maxImageDimension2D;
+  if(tile_size == 0 && std::max(render_size.width, render_size.height) > max_size)
+  {
+    tile_size = std::min(1024U, max_size);
+    LOGI("%u x %u is larger than the device limit of %u, rendering in tiles of %u\n", render_size.width,
+         render_size.height, max_size, tile_size);
+  }
+  const bool tiled = tile_size > 0;
+
+  std::string error;
+  if(tiled && num_frames > 0)
+    error = "Tiles are not available in batch mode";
+  else if(tiled && writer->open == nullptr)
+    error = writer->name + " can't be written by tiles, use one of: .png .qoi .exr .raw";
+  else if(tiled && tile_size > max_size)
+    error = "The tiles are larger than the device limit of " + std::to_string(max_size);
+  // The batch and tiled modes signal the readbacks with a timeline semaphore (core in Vulkan 1.2)
+  else if((tiled || num_frames > 0) && vkctx.m_physicalInfo.features12.timelineSemaphore == VK_FALSE)
+    error = "Timeline semaphores are not supported, the batch and tiled modes are not available";
+  if(!error.empty())
+  {
+    LOGE("%s\n", error.c_str());
+    vkctx.deinit();
+    return 1;
+  }
 
   // Create the application
   auto app = std::make_unique<nvvkhl::OfflineRender>(&vkctx);
 
-  app->createFramebuffer(render_size);  // Framebuffer where it will render
-  app->createPipeline();                // How the quad will be rendered: shaders and more
-  app->offlineRender(anim_time);        // Rendering
-
-  app->saveImage(output_file);          // Saving rendered image
+  // Half floats for the HDR formats
+  app->setColorFormat(writer->format == imagewriter::PixelFormat::eRGBA16F ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM);
+  // Framebuffer where it will render, one tile in tiled mode
+  const VkExtent2D framebuffer_size =
+      tiled ? VkExtent2D{std::min(tile_size, render_size.width), std::min(tile_size, render_size.height)} : render_size;
+  app->createFramebuffer(framebuffer_size);
+  app->createPipeline();  // How the quad will be rendered: shaders and more
+  bool ok = true;
+  if(tiled)
+  {
+    // Rendering the tiles and streaming them to the file
+    ok = app->renderTiled(anim_time, render_size, output_file, *writer, write_options, ring_size);
+  }
+  else if(num_frames > 0)
+  {
+    // Rendering and saving the animation
+    app->renderSequence(num_frames, std::max(fps, 1e-3F), anim_time, output_file, *writer, write_options, ring_size, num_threads);
+  }
+  else
+  {
+    app->offlineRender(anim_time);                        // Rendering
+    app->saveImage(output_file, *writer, write_options);  // Saving rendered image
+  }
 
   app.reset();
   vkctx.deinit();
 
-  return 0;
+  return ok ? 0 : 1;
 }
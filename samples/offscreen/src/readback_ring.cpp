@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include "nvvk/error_vk.hpp"
+#include "nvvk/images_vk.hpp"
+#include "readback_ring.hpp"
+
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+ReadbackRing::ReadbackRing(nvvk::Context*    ctx,
+                           nvvkhl::AllocVma* alloc,
+                           VkExtent2D        size,
+                           uint32_t          bytesPerPixel,
+                           uint32_t          numSlots,
+                           uint32_t          numWorkers,
+                           WriteFunc         write)
+    : m_ctx(ctx)
+    , m_alloc(alloc)
+    , m_device(ctx->m_device)
+    , m_size(size)
+    , m_write(std::move(write))
+{
+  VkCommandPoolCreateInfo pool_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = m_ctx->m_queueGCT.familyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_device, &pool_info, nullptr, &m_cmdPool));
+
+  VkSemaphoreTypeCreateInfo type_info{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+  type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  VkSemaphoreCreateInfo semaphore_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+  semaphore_info.pNext = &type_info;
+  NVVK_CHECK(vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_timeline));
+
+  // Persistently mapped, read by the writers
+  const VkDeviceSize buffer_size = VkDeviceSize(size.width) * size.height * bytesPerPixel;
+  m_slots.resize(std::max(numSlots, 1U));
+  for(Slot& slot : m_slots)
+  {
+    slot.buffer = m_alloc->createBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    slot.mapped = static_cast<const uint8_t*>(m_alloc->map(slot.buffer));
+
+    VkCommandBufferAllocateInfo alloc_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    alloc_info.commandPool        = m_cmdPool;
+    alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    NVVK_CHECK(vkAllocateCommandBuffers(m_device, &alloc_info, &slot.cmd));
+  }
+
+  if(numWorkers == 0)
+  {
+    numWorkers = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+  }
+  for(uint32_t i = 0; i < numWorkers; i++)
+  {
+    m_workers.emplace_back(&ReadbackRing::workerLoop, this);
+  }
+}
+
+ReadbackRing::~ReadbackRing()
+{
+  // The writers finish the frames submitted before leaving
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_jobCv.notify_all();
+  for(std::thread& worker : m_workers)
+  {
+    worker.join();
+  }
+
+  for(Slot& slot : m_slots)
+  {
+    m_alloc->unmap(slot.buffer);
+    m_alloc->destroy(slot.buffer);
+  }
+  vkDestroySemaphore(m_device, m_timeline, nullptr);
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+}
+
+VkCommandBuffer ReadbackRing::beginFrame(uint32_t frameIndex)
+{
+  Slot& slot = m_slots[m_nextSlot];
+  {
+    const auto                   t0 = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_slotCv.wait(lock, [&] { return !slot.busy; });
+    m_stats.slotWaitMs += msSince(t0);
+  }
+  slot.frame = frameIndex;
+
+  // The copy of the previous frame of this slot is done: its writer waited for it
+  VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  NVVK_CHECK(vkBeginCommandBuffer(slot.cmd, &begin_info));
+  return slot.cmd;
+}
+
+void ReadbackRing::endFrame(VkImage image, VkImageLayout layout)
+{
+  const uint32_t index = m_nextSlot;
+  Slot&          slot  = m_slots[index];
+
+  const VkImageSubresourceRange subresource_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  nvvk::cmdBarrierImageLayout(slot.cmd, image, layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresource_range);
+  VkBufferImageCopy copy_region{};
+  copy_region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  copy_region.imageExtent      = {m_size.width, m_size.height, 1};
+  vkCmdCopyImageToBuffer(slot.cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &copy_region);
+  nvvk::cmdBarrierImageLayout(slot.cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout, subresource_range);
+
+  // Makes the copy visible to the host once the semaphore is signaled
+  VkMemoryBarrier host_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(slot.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0,
+                       nullptr, 0, nullptr);
+  NVVK_CHECK(vkEndCommandBuffer(slot.cmd));
+
+  slot.value = ++m_timelineValue;
+  VkTimelineSemaphoreSubmitInfo timeline_info{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+  timeline_info.signalSemaphoreValueCount = 1;
+  timeline_info.pSignalSemaphoreValues    = &slot.value;
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.pNext                = &timeline_info;
+  submit_info.commandBufferCount   = 1;
+  submit_info.pCommandBuffers      = &slot.cmd;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores    = &m_timeline;
+  NVVK_CHECK(vkQueueSubmit(m_ctx->m_queueGCT.queue, 1, &submit_info, VK_NULL_HANDLE));
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot.busy = true;
+    m_jobs.push_back(index);
+  }
+  m_jobCv.notify_one();
+  m_nextSlot = (m_nextSlot + 1) % static_cast<uint32_t>(m_slots.size());
+}
+
+void ReadbackRing::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_slotCv.wait(lock, [&] {
+    return m_jobs.empty() && std::none_of(m_slots.begin(), m_slots.end(), [](const Slot& slot) { return slot.busy; });
+  });
+}
+
+ReadbackRing::Stats ReadbackRing::getStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void ReadbackRing::workerLoop()
+{
+  for(;;)
+  {
+    uint32_t index = 0;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobCv.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+      if(m_jobs.empty())
+        return;
+      index = m_jobs.front();
+      m_jobs.pop_front();
+    }
+    const Slot& slot = m_slots[index];
+
+    const auto          t0 = std::chrono::steady_clock::now();
+    VkSemaphoreWaitInfo wait_info{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores    = &m_timeline;
+    wait_info.pValues        = &slot.value;
+    NVVK_CHECK(vkWaitSemaphores(m_device, &wait_info, UINT64_MAX));
+    const double gpu_wait_ms = msSince(t0);
+
+    const auto t1 = std::chrono::steady_clock::now();
+    m_write({slot.frame, slot.mapped, m_size});
+    const double write_ms = msSince(t1);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_slots[index].busy = false;
+      m_stats.frames++;
+      m_stats.gpuWaitMs += gpu_wait_ms;
+      m_stats.writeMs += write_ms;
+    }
+    m_slotCv.notify_all();
+  }
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "nvvk/context_vk.hpp"
+#include "nvvkhl/alloc_vma.hpp"
+
+
+//--------------------------------------------------------------------------------------------------
+// Reads rendered frames back without stalling the rendering:
+// - beginFrame() returns the command buffer of the next slot of the ring, once the slot is free
+// - endFrame() records the copy of the image to the persistently mapped buffer of the slot, and
+//   submits it, signaling a timeline semaphore with a value of its own. Nothing waits for the GPU.
+// - a pool of writers waits for that value, then calls the write function on the pixels. The slot
+//   is free again when the function returns.
+//
+// With K slots, frame n+1 is recorded while frame n is copied and up to K-1 frames are being
+// written. The GPU only renders frame n+1 while frame n is copied when they use different images:
+// the image of a slot, given to endFrame(), must not be written again before the slot comes back
+// (currentSlot() tells which one it is). The main thread only waits when all slots are in use: the
+// GPU or the writers are then the limit.
+//
+class ReadbackRing
+{
+public:
+  struct Frame
+  {
+    uint32_t       index{0};
+    const uint8_t* pixels{nullptr};  // Tightly packed rows
+    VkExtent2D     size{0, 0};
+  };
+  // Called on the writer threads, concurrently for different frames
+  using WriteFunc = std::function<void(const Frame& frame)>;
+
+  struct Stats
+  {
+    uint32_t frames{0};
+    double   slotWaitMs{0.0};  // Main thread waiting for a free slot
+    double   gpuWaitMs{0.0};   // Writers waiting for the copies, summed
+    double   writeMs{0.0};     // In the write function, summed
+  };
+
+  // numWorkers 0: all cores but one
+  ReadbackRing(nvvk::Context*    ctx,
+               nvvkhl::AllocVma* alloc,
+               VkExtent2D        size,
+               uint32_t          bytesPerPixel,
+               uint32_t          numSlots,
+               uint32_t          numWorkers,
+               WriteFunc         write);
+  ~ReadbackRing();
+
+  // Waits for the next slot, returns its command buffer, begun
+  VkCommandBuffer beginFrame(uint32_t frameIndex);
+  // Copies `image`, in `layout` and left in it, then submits the command buffer of beginFrame()
+  void endFrame(VkImage image, VkImageLayout layout);
+  // Waits for all frames to be written
+  void flush();
+
+  Stats    getStats() const;
+  uint32_t numWorkers() const { return static_cast<uint32_t>(m_workers.size()); }
+  uint32_t numSlots() const { return static_cast<uint32_t>(m_slots.size()); }
+  // Slot of the frame between beginFrame() and endFrame(), in [0, numSlots())
+  uint32_t currentSlot() const { return m_nextSlot; }
+
+private:
+  struct Slot
+  {
+    nvvk::Buffer    buffer;
+    const uint8_t*  mapped{nullptr};
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+    uint64_t        value{0};  // Of the timeline semaphore, when its copy is done
+    uint32_t        frame{0};
+    bool            busy{false};  // Submitted, until written
+  };
+
+  void workerLoop();
+
+  nvvk::Context*    m_ctx{nullptr};
+  nvvkhl::AllocVma* m_alloc{nullptr};
+  VkDevice          m_device{VK_NULL_HANDLE};
+  VkExtent2D        m_size{0, 0};
+  WriteFunc         m_write;
+
+  VkCommandPool     m_cmdPool{VK_NULL_HANDLE};
+  VkSemaphore       m_timeline{VK_NULL_HANDLE};
+  uint64_t          m_timelineValue{0};  // Last value submitted
+  std::vector<Slot> m_slots;
+  uint32_t          m_nextSlot{0};
+
+  // Writers
+  std::vector<std::thread> m_workers;
+  mutable std::mutex       m_mutex;
+  std::condition_variable  m_jobCv;     // A slot to write, or stop
+  std::condition_variable  m_slotCv;    // A slot written
+  std::deque<uint32_t>     m_jobs;      // Slots submitted, in order
+  bool                     m_stop{false};
+  Stats                    m_stats;
+};
@@ -1,3 +1,12 @@
+# BVH of the CPU reference path tracer, shared with other samples
+set(COMMON_SRC
+	${SAMPLES_COMMON_DIR}/bvh.cpp
+	${SAMPLES_COMMON_DIR}/bvh.hpp
+	)
+target_sources(${PROJECT_NAME} PRIVATE ${COMMON_SRC})
+source_group(common FILES ${COMMON_SRC})
+
+
 if(USE_HLSL)
   # HLSL
   compile_hlsl_file(
@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "cpu_pathtracer.hpp"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
+
+
+namespace cpupt {
+
+namespace {
+
+// constants.hlsli
+constexpr float kInfinite  = 1e32F;
+constexpr float kPi        = 3.1415926535897F;
+constexpr float kOneOverPi = 0.3183098861837F;
+
+// The HLSL intrinsics, component-wise
+float saturate(float x)
+{
+  return std::clamp(x, 0.0F, 1.0F);
+}
+
+float smoothstep(float a, float b, float x)
+{
+  const float t = saturate((x - a) / (b - a));
+  return t * t * (3.0F - 2.0F * t);
+}
+
+nvmath::vec3f lerp(const nvmath::vec3f& a, const nvmath::vec3f& b, float t)
+{
+  return a + (b - a) * t;
+}
+
+nvmath::vec3f reflect(const nvmath::vec3f& i, const nvmath::vec3f& n)
+{
+  return i - n * (2.0F * nvmath::dot(n, i));
+}
+
+nvmath::vec3f normalize(const nvmath::vec3f& v)
+{
+  return v / nvmath::length(v);
+}
+
+// functions.hlsli
+float clampedDot(const nvmath::vec3f& x, const nvmath::vec3f& y)
+{
+  return std::clamp(nvmath::dot(x, y), 0.0F, 1.0F);
+}
+
+void orthonormalBasis(const nvmath::vec3f& normal, nvmath::vec3f& tangent, nvmath::vec3f& bitangent)
+{
+  const float sgn = normal.z > 0.0F ? 1.0F : -1.0F;
+  const float a   = -1.0F / (sgn + normal.z);
+  const float b   = normal.x * normal.y * a;
+
+  tangent   = nvmath::vec3f(1.0F + sgn * normal.x * normal.x * a, sgn * b, -sgn * normal.x);
+  bitangent = nvmath::vec3f(b, sgn + normal.y * normal.y * a, -normal.y);
+}
+
+nvmath::vec3f cosineSampleHemisphere(float r1, float r2)
+{
+  const float   two_pi = 6.2831853071795F;
+  const float   r      = std::sqrt(r1);
+  const float   phi    = two_pi * r2;
+  nvmath::vec3f dir;
+  dir.x = r * std::cos(phi);
+  dir.y = r * std::sin(phi);
+  dir.z = std::sqrt(std::max(0.0F, 1.0F - dir.x * dir.x - dir.y * dir.y));
+  return dir;
+}
+
+nvmath::vec3f offsetRay(const nvmath::vec3f& p, const nvmath::vec3f& n)
+{
+  const float epsilon = 1.0F / 65536.0F;
+  const float offset  = epsilon * nvmath::length(p);
+  return p + n * offset;
+}
+
+// ggx.hlsli
+nvmath::vec3f fresnelSchlick(const nvmath::vec3f& f0, const nvmath::vec3f& f90, float VdotH)
+{
+  const float a  = 1.0F - VdotH;
+  const float a2 = a * a;
+  return f0 + (f90 - f0) * a2 * a2 * a;
+}
+
+float smithJointGGX(float NdotL, float NdotV, float alphaRoughness)
+{
+  const float alpha_sq = std::max(alphaRoughness * alphaRoughness, 1e-07F);
+  const float ggx_v    = NdotL * std::sqrt(NdotV * NdotV * (1.0F - alpha_sq) + alpha_sq);
+  const float ggx_l    = NdotV * std::sqrt(NdotL * NdotL * (1.0F - alpha_sq) + alpha_sq);
+  const float ggx      = ggx_v + ggx_l;
+  return ggx > 0.0F ? 0.5F / ggx : 0.0F;
+}
+
+float distributionGGX(float NdotH, float alphaRoughness)
+{
+  const float alpha_sq = std::max(alphaRoughness * alphaRoughness, 1e-07F);
+  const float denom    = NdotH * NdotH * (alpha_sq - 1.0F) + 1.0F;
+  return alpha_sq / (kPi * denom * denom);
+}
+
+nvmath::vec3f brdfLambertian(const nvmath::vec3f& diffuseColor, float metallic)
+{
+  return (diffuseColor / kPi) * (1.0F - metallic);
+}
+
+nvmath::vec3f brdfSpecularGGX(const nvmath::vec3f& f0, const nvmath::vec3f& f90, float alphaRoughness, float VdotH, float NdotL,
+                              float NdotV, float NdotH)
+{
+  const nvmath::vec3f f   = fresnelSchlick(f0, f90, VdotH);
+  const float         vis = smithJointGGX(NdotL, NdotV, alphaRoughness);
+  const float         d   = distributionGGX(NdotH, alphaRoughness);
+  return f * vis * d;
+}
+
+nvmath::vec3f ggxSampling(float alphaRoughness, float r1, float r2)
+{
+  const float alpha_sq  = std::max(alphaRoughness * alphaRoughness, 1e-07F);
+  const float phi       = 2.0F * kPi * r1;
+  const float cos_theta = std::sqrt((1.0F - r2) / (1.0F + (alpha_sq - 1.0F) * r2));
+  const float sin_theta = std::sqrt(1.0F - cos_theta * cos_theta);
+  return {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+}
+
+double msSince(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+}  // namespace
+
+
+//--------------------------------------------------------------------------------------------------
+// Ports of common/shaders
+//
+uint32_t xxhash32(uint32_t x, uint32_t y, uint32_t z)
+{
+  const uint32_t primes[4] = {2246822519U, 3266489917U, 668265263U, 374761393U};
+  uint32_t       h32       = z + primes[3] + x * primes[1];
+  h32                      = primes[2] * ((h32 << 17) | (h32 >> (32 - 17)));
+  h32 += y * primes[1];
+  h32 = primes[2] * ((h32 << 17) | (h32 >> (32 - 17)));
+  h32 = primes[0] * (h32 ^ (h32 >> 15));
+  h32 = primes[1] * (h32 ^ (h32 >> 13));
+  return h32 ^ (h32 >> 16);
+}
+
+uint32_t pcg(uint32_t& state)
+{
+  const uint32_t prev = state * 747796405U + 2891336453U;
+  const uint32_t word = ((prev >> ((prev >> 28U) + 4U)) ^ prev) * 277803737U;
+  state               = prev;
+  return (word >> 22U) ^ word;
+}
+
+float rand(uint32_t& seed)
+{
+  const uint32_t r = pcg(seed);
+  return static_cast<float>(r) * (1.F / static_cast<float>(0xffffffffU));
+}
+
+nvmath::vec3f proceduralSky(const ProceduralSkyShaderParameters& params, const nvmath::vec3f& direction, float angularSizeOfPixel)
+{
+  const float         elevation = std::asin(std::clamp(nvmath::dot(direction, params.directionUp), -1.0F, 1.0F));
+  const float         top       = smoothstep(0.F, params.horizonSize, elevation);
+  const float         bottom    = smoothstep(0.F, params.horizonSize, -elevation);
+  const nvmath::vec3f environment = lerp(lerp(params.horizonColor, params.groundColor, bottom), params.skyColor, top);
+
+  const float angle_to_light    = std::acos(std::clamp(nvmath::dot(direction, params.directionToLight), 0.0F, 1.0F));
+  const float half_angular_size = params.angularSizeOfLight * 0.5F;
+  float       light_intensity   = std::clamp(
+      1.0F - smoothstep(half_angular_size - angularSizeOfPixel * 2.0F, half_angular_size + angularSizeOfPixel * 2.0F, angle_to_light),
+      0.0F, 1.0F);
+  light_intensity = std::pow(light_intensity, 4.0F);
+  const float glow_input =
+      std::clamp(2.0F * (1.0F - smoothstep(half_angular_size - params.glowSize, half_angular_size + params.glowSize, angle_to_light)),
+                 0.0F, 1.0F);
+  const float         glow_intensity = params.glowIntensity * std::pow(glow_input, params.glowSharpness);
+  const nvmath::vec3f light          = nvmath::vec3f(params.lightColor) * std::max(light_intensity, glow_intensity);
+
+  return environment + light;
+}
+
+void bsdfEvaluate(BsdfEvaluateData& data, const PbrMaterial& mat)
+{
+  const nvmath::vec3f surface_normal = mat.normal;
+  const nvmath::vec3f view_dir       = data.k1;
+  const nvmath::vec3f light_dir      = data.k2;
+  const nvmath::vec3f albedo(mat.albedo);
+  const nvmath::vec3f f90(1.0F, 1.0F, 1.0F);
+
+  // Specular roughness
+  const float alpha = mat.roughness * mat.roughness;
+
+  const nvmath::vec3f half_vector = normalize(view_dir + light_dir);
+
+  const float NdotV = clampedDot(surface_normal, view_dir);
+  const float NdotL = clampedDot(surface_normal, light_dir);
+  const float VdotH = clampedDot(view_dir, half_vector);
+  const float NdotH = clampedDot(surface_normal, half_vector);
+  const float LdotH = clampedDot(light_dir, half_vector);
+
+  const nvmath::vec3f f_diffuse  = brdfLambertian(albedo, mat.metallic);
+  const nvmath::vec3f f_specular = brdfSpecularGGX(mat.f0, f90, alpha, VdotH, NdotL, NdotV, NdotH);
+
+  const float diffuse_ratio = 0.5F * (1.0F - mat.metallic);
+  const float diffuse_pdf   = NdotL * kOneOverPi;
+  const float specular_pdf  = distributionGGX(NdotH, alpha) * NdotH / (4.0F * LdotH);
+
+  data.bsdfDiffuse = f_diffuse * NdotL;
+  data.bsdfGlossy  = f_specular * NdotL;
+  data.pdf         = specular_pdf + (diffuse_pdf - specular_pdf) * diffuse_ratio;
+}
+
+void bsdfSample(BsdfSampleData& data, const PbrMaterial& mat)
+{
+  const nvmath::vec3f surface_normal = mat.normal;
+  const nvmath::vec3f view_dir       = data.k1;
+
+  nvmath::vec3f tangent;
+  nvmath::vec3f binormal;
+  orthonormalBasis(surface_normal, tangent, binormal);
+
+  const float alpha = mat.roughness * mat.roughness;
+
+  // Half vector for a diffuse or a glossy reflection
+  const float   diffuse_ratio = 0.5F * (1.0F - mat.metallic);
+  nvmath::vec3f half_vector;
+  if(data.xi.z < diffuse_ratio)
+    half_vector = cosineSampleHemisphere(data.xi.x, data.xi.y);
+  else
+    half_vector = ggxSampling(alpha, data.xi.x, data.xi.y);
+  half_vector = tangent * half_vector.x + binormal * half_vector.y + surface_normal * half_vector.z;
+
+  const nvmath::vec3f reflect_vector = reflect(-view_dir, half_vector);
+  if(nvmath::dot(surface_normal, reflect_vector) < 0.0F)
+  {
+    data.eventType = kBsdfEventAbsorb;
+    return;
+  }
+
+  BsdfEvaluateData eval_data;
+  eval_data.k1 = view_dir;
+  eval_data.k2 = reflect_vector;
+  bsdfEvaluate(eval_data, mat);
+
+  data.bsdfOverPdf = (eval_data.bsdfDiffuse + eval_data.bsdfGlossy) / eval_data.pdf;
+  data.pdf         = eval_data.pdf;
+  data.eventType   = kBsdfEventGlossyReflection;
+  data.k2          = reflect_vector;
+
+  // Avoid internal reflection
+  if(data.pdf <= 0.0F)
+    data.eventType = kBsdfEventAbsorb;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Renderer
+//
+void PathTracer::setScene(const std::vector<nvh::PrimitiveMesh>& meshes,
+                          const std::vector<nvh::Node>&          nodes,
+                          const std::vector<Material>&           materials,
+                          uint32_t                               numThreads)
+{
+  m_meshes    = &meshes;
+  m_materials = &materials;
+
+  // Indexed as the nodes, like the instances of the TLAS
+  m_instances.resize(nodes.size());
+  for(size_t i = 0; i < nodes.size(); i++)
+  {
+    const nvh::Node& node     = nodes[i];
+    Instance&        instance = m_instances[i];
+    instance.objectToWorld    = node.localMatrix();
+    instance.normalToWorld    = nvmath::transpose(nvmath::invert(instance.objectToWorld));
+    instance.mesh             = static_cast<uint32_t>(std::max(node.mesh, 0));
+    instance.materialID       = static_cast<uint32_t>(std::max(node.material, 0));
+  }
+
+  bvh::BuildOptions options;
+  options.numThreads = numThreads;
+  bvh::BuildStats mesh_stats;
+  bvh::BuildStats scene_stats;
+  m_bvh.build(meshes, nodes, options, &mesh_stats, &scene_stats);
+  LOGI("CPU path tracer BVH: %u triangles in %.2f ms, %u instances in %.2f ms, %.1f MB\n", mesh_stats.primitives,
+       mesh_stats.buildMs, scene_stats.primitives, scene_stats.buildMs, static_cast<double>(m_bvh.memoryBytes()) / (1024.0 * 1024.0));
+}
+
+// Closest hit shader, or the miss shader setting hitT to INFINITE
+void PathTracer::traceRay(const bvh::Ray& ray, HitPayload& payload) const
+{
+  bvh::Hit hit;
+  if(!m_bvh.intersect(ray, hit))
+  {
+    payload.hitT = kInfinite;
+    return;
+  }
+
+  const Instance&               instance = m_instances[hit.instance];
+  const nvh::PrimitiveMesh&     mesh     = (*m_meshes)[instance.mesh];
+  const nvh::PrimitiveTriangle& tri      = mesh.triangles[hit.triangle];
+  const nvh::PrimitiveVertex&   v0       = mesh.vertices[tri.v[0]];
+  const nvh::PrimitiveVertex&   v1       = mesh.vertices[tri.v[1]];
+  const nvh::PrimitiveVertex&   v2       = mesh.vertices[tri.v[2]];
+  const nvmath::vec3f           bary(1.0F - hit.bary.x - hit.bary.y, hit.bary.x, hit.bary.y);
+
+  const nvmath::vec3f position = v0.p * bary.x + v1.p * bary.y + v2.p * bary.z;
+  const nvmath::vec3f normal   = normalize(v0.n * bary.x + v1.n * bary.y + v2.n * bary.z);
+
+  payload.hitT          = hit.t;
+  payload.pos           = nvmath::vec3f(instance.objectToWorld * nvmath::vec4f(position, 1.0F));
+  payload.nrm           = normalize(nvmath::vec3f(instance.normalToWorld * nvmath::vec4f(normal, 0.0F)));
+  payload.instanceIndex = hit.instance;
+}
+
+bool PathTracer::traceShadow(const bvh::Ray& ray) const
+{
+  return m_bvh.occluded(ray);
+}
+
+nvmath::vec3f PathTracer::pathTrace(const Frame& frame, bvh::Ray ray, uint32_t& seed, RayCounts& counts) const
+{
+  const PushConstant& push_const = frame.pushConst;
+  nvmath::vec3f       radiance(0.0F, 0.0F, 0.0F);
+  nvmath::vec3f       throughput(1.0F, 1.0F, 1.0F);
+  HitPayload          payload;
+
+  for(int depth = 0; depth < push_const.maxDepth; depth++)
+  {
+    traceRay(ray, payload);
+    (depth == 0 ? counts.camera : counts.bounce)++;
+
+    // Hitting the environment, then exit
+    if(payload.hitT == kInfinite)
+    {
+      const nvmath::vec3f sky_color = proceduralSky(frame.sky, ray.dir, 0.0F);
+      return radiance + sky_color * throughput;
+    }
+
+    const uint32_t      mat_id = m_instances[payload.instanceIndex].materialID;
+    const nvmath::vec3f L      = normalize(frame.sky.directionToLight);
+
+    PbrMaterial pbr_mat;
+    pbr_mat.albedo    = (*m_materials)[mat_id].color;
+    pbr_mat.roughness = push_const.roughness;
+    pbr_mat.metallic  = push_const.metallic;
+    pbr_mat.normal    = payload.nrm;
+    pbr_mat.f0        = lerp(nvmath::vec3f(0.04F, 0.04F, 0.04F), nvmath::vec3f(pbr_mat.albedo), push_const.metallic);
+
+    // The artificial divergence of the shader also changes the albedo a little
+    nvmath::vec3f  dummy      = payload.nrm;
+    const uint32_t dummy_loop = (mat_id * 128) & (1024 - 1);
+    for(uint32_t i = 0; i < dummy_loop; i++)
+      dummy = nvmath::vec3f(std::sin(dummy.x), std::sin(dummy.y), std::sin(dummy.z));
+    pbr_mat.albedo.x += dummy.x * 0.01F;
+    pbr_mat.albedo.y += dummy.y * 0.01F;
+    pbr_mat.albedo.z += dummy.z * 0.01F;
+
+    nvmath::vec3f contrib(0.0F, 0.0F, 0.0F);
+
+    // Evaluation of direct light (sun)
+    const bool next_event_valid = nvmath::dot(L, payload.nrm) > 0.0F;
+    if(next_event_valid)
+    {
+      BsdfEvaluateData eval_data;
+      eval_data.k1 = -ray.dir;
+      eval_data.k2 = normalize(frame.sky.directionToLight);
+      bsdfEvaluate(eval_data, pbr_mat);
+
+      const nvmath::vec3f w(push_const.intensity, push_const.intensity, push_const.intensity);
+      contrib += w * eval_data.bsdfDiffuse;
+      contrib += w * eval_data.bsdfGlossy;
+      contrib *= throughput;
+    }
+
+    // Sample BSDF
+    {
+      BsdfSampleData sample_data;
+      sample_data.k1   = -ray.dir;
+      const float xi_x = rand(seed);
+      const float xi_y = rand(seed);
+      const float xi_z = rand(seed);
+      const float xi_w = rand(seed);
+      sample_data.xi   = nvmath::vec4f(xi_x, xi_y, xi_z, xi_w);
+
+      bsdfSample(sample_data, pbr_mat);
+      if(sample_data.eventType == kBsdfEventAbsorb)
+        break;
+
+      throughput *= sample_data.bsdfOverPdf;
+      ray.origin = offsetRay(payload.pos, payload.nrm);
+      ray.dir    = sample_data.k2;
+    }
+
+    // Russian-Roulette
+    const float rr_pcont = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)) + 0.001F, 0.95F);
+    if(rand(seed) >= rr_pcont)
+      break;
+    throughput /= rr_pcont;
+
+    // Adding the contribution only if the light is not occluded
+    if(next_event_valid)
+    {
+      bvh::Ray shadow_ray;
+      shadow_ray.origin = ray.origin;
+      shadow_ray.dir    = L;
+      shadow_ray.tMin   = 0.01F;
+      shadow_ray.tMax   = kInfinite;
+      counts.shadow++;
+      if(!traceShadow(shadow_ray))
+        radiance += contrib;
+    }
+  }
+
+  return radiance;
+}
+
+nvmath::vec3f PathTracer::samplePixel(const Frame& frame, const nvmath::vec2f& launchID, uint32_t& seed, RayCounts& counts) const
+{
+  // Subpixel jitter, the center of the pixel for the first frame
+  nvmath::vec2f subpixel_jitter(0.5F, 0.5F);
+  if(frame.pushConst.frame != 0)
+  {
+    subpixel_jitter.x = rand(seed);
+    subpixel_jitter.y = rand(seed);
+  }
+  const nvmath::vec2f pixel_center = launchID + subpixel_jitter;
+  const nvmath::vec2f in_uv(pixel_center.x / frame.launchSize.x, pixel_center.y / frame.launchSize.y);
+  const nvmath::vec2f d      = in_uv * 2.0F - nvmath::vec2f(1.0F, 1.0F);
+  const nvmath::vec4f target = frame.info.projInv * nvmath::vec4f(d.x, d.y, 0.01F, 1.0F);
+
+  bvh::Ray ray;
+  ray.origin = nvmath::vec3f(frame.info.viewInv * nvmath::vec4f(0.0F, 0.0F, 0.0F, 1.0F));
+  ray.dir    = nvmath::vec3f(frame.info.viewInv * nvmath::vec4f(normalize(nvmath::vec3f(target)), 0.0F));
+  ray.tMin   = 0.001F;
+  ray.tMax   = kInfinite;
+
+  nvmath::vec3f radiance = pathTrace(frame, ray, seed, counts);
+
+  // Removing fireflies
+  const float lum = nvmath::dot(radiance, nvmath::vec3f(0.212671F, 0.715160F, 0.072169F));
+  if(lum > frame.pushConst.fireflyClampThreshold)
+    radiance *= frame.pushConst.fireflyClampThreshold / lum;
+
+  return radiance;
+}
+
+//--------------------------------------------------------------------------------------------------
+// The ray generation shader for each pixel of a tile, all the frames of the pixel in a row: the
+// pixels are independent, the result is the same as frame after frame.
+//
+void PathTracer::render(const FrameInfo&                     frameInfo,
+                        const PushConstant&                  pushConst,
+                        const ProceduralSkyShaderParameters& skyParams,
+                        const RenderOptions&                 options,
+                        std::vector<nvmath::vec4f>&          image,
+                        RenderStats*                         stats) const
+{
+  const auto     t0          = std::chrono::steady_clock::now();
+  const uint32_t width       = options.width;
+  const uint32_t height      = options.height;
+  const uint32_t tile_size   = std::max(options.tileSize, 1U);
+  const uint32_t tiles_x     = (width + tile_size - 1) / tile_size;
+  const uint32_t tiles_y     = (height + tile_size - 1) / tile_size;
+  const uint32_t num_tiles   = tiles_x * tiles_y;
+  const uint32_t num_threads = options.numThreads != 0 ? options.numThreads : std::thread::hardware_concurrency();
+
+  image.assign(static_cast<size_t>(width) * height, nvmath::vec4f(0.0F, 0.0F, 0.0F, 1.0F));
+  std::vector<RayCounts> tile_counts(num_tiles);
+  if(hasScene() && num_tiles > 0)
+  {
+    nvh::parallel_batches<1>(
+        num_tiles,
+        [&](uint64_t tile) {
+          RayCounts&     counts = tile_counts[tile];
+          const uint32_t x0     = static_cast<uint32_t>(tile % tiles_x) * tile_size;
+          const uint32_t y0     = static_cast<uint32_t>(tile / tiles_x) * tile_size;
+          const uint32_t x1     = std::min(x0 + tile_size, width);
+          const uint32_t y1     = std::min(y0 + tile_size, height);
+          for(uint32_t y = y0; y < y1; y++)
+          {
+            for(uint32_t x = x0; x < x1; x++)
+            {
+              nvmath::vec3f color(0.0F, 0.0F, 0.0F);
+              for(uint32_t f = 0; f < options.frames; f++)
+              {
+                PushConstant frame_const = pushConst;
+                frame_const.frame        = static_cast<int>(f);
+                const Frame frame{frameInfo, frame_const, skyParams,
+                                  nvmath::vec2f(static_cast<float>(width), static_cast<float>(height))};
+
+                // Sampling n times the pixel
+                uint32_t      seed = xxhash32(x, y, f);
+                nvmath::vec3f pixel_color(0.0F, 0.0F, 0.0F);
+                for(int s = 0; s < frame_const.maxSamples; s++)
+                  pixel_color += samplePixel(frame, nvmath::vec2f(static_cast<float>(x), static_cast<float>(y)), seed, counts);
+                pixel_color /= static_cast<float>(frame_const.maxSamples);
+
+                // Accumulation over time
+                color = f == 0 ? pixel_color : lerp(color, pixel_color, 1.0F / static_cast<float>(f + 1));
+              }
+              image[static_cast<size_t>(y) * width + x] = nvmath::vec4f(color, 1.0F);
+            }
+          }
+        },
+        num_threads);
+  }
+
+  if(stats)
+  {
+    *stats = {};
+    for(const RayCounts& counts : tile_counts)
+    {
+      stats->cameraRays += counts.camera;
+      stats->bounceRays += counts.bounce;
+      stats->shadowRays += counts.shadow;
+    }
+    stats->tiles      = num_tiles;
+    stats->numThreads = num_threads;
+    stats->renderMs   = msSince(t0);
+  }
+}
+
+bool writeHdr(const std::string& filename, uint32_t width, uint32_t height, const std::vector<nvmath::vec4f>& pixels)
+{
+  if(pixels.size() != static_cast<size_t>(width) * height)
+    return false;
+  return stbi_write_hdr(filename.c_str(), static_cast<int>(width), static_cast<int>(height), 4,
+                        reinterpret_cast<const float*>(pixels.data()))
+         != 0;
+}
+
+}  // namespace cpupt
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bvh.hpp"
+#include "nvh/primitives.hpp"
+#include "nvmath/nvmath.h"
+
+#include "shaders/device_host.h"
+#include "nvvkhl/shaders/dh_sky.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Reference of the ser_pathtrace path tracer on the CPU, without Vulkan: same scene, same inputs
+// (FrameInfo, PushConstant, sky) and same image, to compare with the GPU or to render where there
+// is no ray tracing device.
+//
+// The functions of common/shaders used by pathtrace.hlsl are ported with the same operations in
+// the same order: xxhash32, pcg and rand give the same bits as the shaders, so each pixel draws the
+// same random numbers and follows the same path. The floating-point results only differ by the
+// precision of the GPU for sqrt, sin, cos, asin, acos and pow, and by the multiply-adds the shader
+// compiler fuses: a few ulps, which can change a path where a random number is compared with them.
+//
+// The rays are cast through a bvh::SceneBvh over the instances and their triangles. As the
+// instances of the TLAS disable the culling, the back faces are hit as well. The image is split in
+// square tiles, given to the threads one at a time, so the threads stay busy where the paths are
+// longer. The heatmap of the push constant is ignored, it measures the GPU.
+//
+namespace cpupt {
+
+//--------------------------------------------------------------------------------------------------
+// random.hlsli
+uint32_t xxhash32(uint32_t x, uint32_t y, uint32_t z);
+uint32_t pcg(uint32_t& state);
+float    rand(uint32_t& seed);  // [0, 1)
+
+//--------------------------------------------------------------------------------------------------
+// sky.hlsli
+nvmath::vec3f proceduralSky(const ProceduralSkyShaderParameters& params, const nvmath::vec3f& direction, float angularSizeOfPixel);
+
+//--------------------------------------------------------------------------------------------------
+// ggx.hlsli, the members used by bsdfEvaluate and bsdfSample
+constexpr int kBsdfEventAbsorb           = 0;
+constexpr int kBsdfEventGlossyReflection = (1 << 1) | (1 << 3);
+
+struct PbrMaterial
+{
+  nvmath::vec4f albedo;
+  float         roughness{0.0F};
+  float         metallic{0.0F};
+  nvmath::vec3f normal;
+  nvmath::vec3f f0;
+};
+
+struct BsdfEvaluateData
+{
+  nvmath::vec3f k1;  // [in] Toward the incoming ray
+  nvmath::vec3f k2;  // [in] Toward the sampled light
+  nvmath::vec3f bsdfDiffuse;
+  nvmath::vec3f bsdfGlossy;
+  float         pdf{0.0F};
+};
+
+struct BsdfSampleData
+{
+  nvmath::vec3f k1;  // [in] Toward the incoming ray
+  nvmath::vec3f k2;  // [out] Sampled direction
+  nvmath::vec4f xi;  // [in] 4 random [0..1]
+  float         pdf{0.0F};
+  nvmath::vec3f bsdfOverPdf;
+  int           eventType{kBsdfEventAbsorb};
+};
+
+void bsdfEvaluate(BsdfEvaluateData& data, const PbrMaterial& mat);
+void bsdfSample(BsdfSampleData& data, const PbrMaterial& mat);
+
+//--------------------------------------------------------------------------------------------------
+// Renderer
+//
+struct RenderOptions
+{
+  uint32_t width{0};
+  uint32_t height{0};
+  uint32_t frames{1};      // Accumulated like the GPU does over the frames 0, 1, ...
+  uint32_t tileSize{16};   // Pixels on each side
+  uint32_t numThreads{0};  // 0: all cores
+};
+
+struct RenderStats
+{
+  double   renderMs{0.0};
+  uint64_t cameraRays{0};
+  uint64_t bounceRays{0};  // Closest hits after the first
+  uint64_t shadowRays{0};
+  uint32_t tiles{0};
+  uint32_t numThreads{0};
+
+  uint64_t rays() const { return cameraRays + bounceRays + shadowRays; }
+  double   raysPerSecond() const { return renderMs > 0.0 ? static_cast<double>(rays()) * 1000.0 / renderMs : 0.0; }
+};
+
+class PathTracer
+{
+public:
+  // Builds the BVH; meshes, nodes and materials must stay alive while the tracer renders
+  void setScene(const std::vector<nvh::PrimitiveMesh>& meshes,
+                const std::vector<nvh::Node>&          nodes,
+                const std::vector<Material>&           materials,
+                uint32_t                               numThreads = 0);
+  bool hasScene() const { return m_meshes != nullptr; }
+
+  // RGBA 32-bit float, the first row at the top, alpha at 1: the rendered image of the sample
+  // before the tonemapper. pushConst.frame is replaced by the frames of the options.
+  void render(const FrameInfo&                     frameInfo,
+              const PushConstant&                  pushConst,
+              const ProceduralSkyShaderParameters& skyParams,
+              const RenderOptions&                 options,
+              std::vector<nvmath::vec4f>&          image,
+              RenderStats*                         stats = nullptr) const;
+
+private:
+  struct HitPayload
+  {
+    float         hitT{0.0F};
+    nvmath::vec3f pos;
+    nvmath::vec3f nrm;
+    uint32_t      instanceIndex{0};
+  };
+
+  struct RayCounts
+  {
+    uint64_t camera{0};
+    uint64_t bounce{0};
+    uint64_t shadow{0};
+  };
+
+  // Everything the shaders read, for one frame
+  struct Frame
+  {
+    const FrameInfo&                     info;
+    const PushConstant&                  pushConst;
+    const ProceduralSkyShaderParameters& sky;
+    nvmath::vec2f                        launchSize;
+  };
+
+  // As the instances of the TLAS
+  struct Instance
+  {
+    nvmath::mat4f objectToWorld;
+    nvmath::mat4f normalToWorld;  // Transpose of the world to object
+    uint32_t      mesh{0};
+    uint32_t      materialID{0};
+  };
+
+  void          traceRay(const bvh::Ray& ray, HitPayload& payload) const;
+  bool          traceShadow(const bvh::Ray& ray) const;
+  nvmath::vec3f pathTrace(const Frame& frame, bvh::Ray ray, uint32_t& seed, RayCounts& counts) const;
+  nvmath::vec3f samplePixel(const Frame& frame, const nvmath::vec2f& launchID, uint32_t& seed, RayCounts& counts) const;
+
+  const std::vector<nvh::PrimitiveMesh>* m_meshes{nullptr};
+  const std::vector<Material>*           m_materials{nullptr};
+  std::vector<Instance>                  m_instances;
+  bvh::SceneBvh                          m_bvh;
+};
+
+// Radiance RGBE (.hdr) of the RGB channels, through stb_image_write
+bool writeHdr(const std::string& filename, uint32_t width, uint32_t height, const std::vector<nvmath::vec4f>& pixels);
+
+}  // namespace cpupt
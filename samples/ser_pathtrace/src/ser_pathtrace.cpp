@@ -27,12 +27,15 @@
 */
 //////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <array>
 #include <vulkan/vulkan_core.h>
 
 #define VMA_IMPLEMENTATION
 #include "imgui/imgui_camera_widget.h"
 #include "imgui/imgui_helper.h"
+#include "nvh/commandlineparser.hpp"
+#include "nvh/nvprint.hpp"
 #include "nvh/primitives.hpp"
 #include "nvvk/buffers_vk.hpp"
 #include "nvvk/commands_vk.hpp"
@@ -82,6 +85,8 @@ const auto& rmiss_shd = std::vector<uint32_t>{std::begin(pathtrace_rmiss), std::
 #include "nvvk/specialization.hpp"
 #include "nvvk/images_vk.hpp"
 
+#include "cpu_pathtracer.hpp"
+
 
 /// </summary> Ray trace multiple primitives using SER
 class SerPathtrace : public nvvkhl::IAppElement
@@ -190,7 +195,20 @@ public:
               PropertyEditor::entry("Samples", [&] { return ImGui::SliderInt("#1", &m_pushConst.maxSamples, 1, 10); });
           PropertyEditor::treePop();
         }
+        if(PropertyEditor::treeNode("CPU Reference"))
+        {
+          PropertyEditor::entry("Frames", [&] { return ImGui::SliderInt("#1", &m_cpuFrames, 1, 64); });
+          PropertyEditor::entry("Render", [&] {
+            if(ImGui::Button("Render on CPU"))
+              renderCpuReference("ser_pathtrace_cpu.hdr", static_cast<uint32_t>(m_viewSize.x),
+                                 static_cast<uint32_t>(m_viewSize.y), static_cast<uint32_t>(m_cpuFrames), 0);
+            return false;
+          });
+          PropertyEditor::treePop();
+        }
         PropertyEditor::end();
+        if(m_cpuStats.tiles > 0)
+          ImGui::Text("CPU: %.1f ms, %.2f Mrays/s", m_cpuStats.renderMs, m_cpuStats.raysPerSecond() / 1.0e6);
       }
 
       if(ImGui::CollapsingHeader("Tonemapper"))
@@ -226,20 +244,8 @@ public:
       return;
     }
 
-    float         view_aspect_ratio = m_viewSize.x / m_viewSize.y;
-    nvmath::vec3f eye;
-    nvmath::vec3f center;
-    nvmath::vec3f up;
-    CameraManip.getLookat(eye, center, up);
-
     // Update Frame buffer uniform buffer
-    FrameInfo   finfo{};
-    const auto& clip = CameraManip.getClipPlanes();
-    finfo.view       = CameraManip.getMatrix();
-    finfo.proj       = nvmath::perspectiveVK(CameraManip.getFov(), view_aspect_ratio, clip.x, clip.y);
-    finfo.projInv    = nvmath::inverse(finfo.proj);
-    finfo.viewInv    = nvmath::inverse(finfo.view);
-    finfo.camPos     = eye;
+    const FrameInfo finfo = frameInfo(m_viewSize.x / m_viewSize.y);
     vkCmdUpdateBuffer(cmd, m_bFrameInfo.buffer, 0, sizeof(FrameInfo), &finfo);
 
     // Update the sky
@@ -276,7 +282,60 @@ public:
     m_tonemapper->runCompute(cmd, size);
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Same image as the ray tracing pipeline after `frames` frames, rendered on the CPU without Vulkan,
+  // saved in a Radiance .hdr file. The scene is created if the sample isn't attached.
+  //
+  bool renderCpuReference(const std::string& filename, uint32_t width, uint32_t height, uint32_t frames, uint32_t numThreads)
+  {
+    if(m_meshes.empty())
+      createScene();
+    if(!m_cpuTracer.hasScene())
+      m_cpuTracer.setScene(m_meshes, m_nodes, m_materials, numThreads);
+
+    cpupt::RenderOptions options;
+    options.width      = std::max(width, 1U);
+    options.height     = std::max(height, 1U);
+    options.frames     = std::max(frames, 1U);
+    options.numThreads = numThreads;
+    std::vector<nvmath::vec4f> image;
+    m_cpuTracer.render(frameInfo(static_cast<float>(options.width) / static_cast<float>(options.height)), m_pushConst,
+                       m_skyParams, options, image, &m_cpuStats);
+
+    LOGI("CPU reference %ux%u, %u frames of %d samples: %.1f ms on %u threads, %llu rays (camera %llu, bounce %llu, "
+         "shadow %llu), %.2f Mrays/s\n",
+         options.width, options.height, options.frames, m_pushConst.maxSamples, m_cpuStats.renderMs, m_cpuStats.numThreads,
+         static_cast<unsigned long long>(m_cpuStats.rays()), static_cast<unsigned long long>(m_cpuStats.cameraRays),
+         static_cast<unsigned long long>(m_cpuStats.bounceRays), static_cast<unsigned long long>(m_cpuStats.shadowRays),
+         m_cpuStats.raysPerSecond() / 1.0e6);
+
+    if(!cpupt::writeHdr(filename, options.width, options.height, image))
+    {
+      LOGE("Failed to write %s\n", filename.c_str());
+      return false;
+    }
+    LOGI("Saved %s\n", filename.c_str());
+    return true;
+  }
+
 private:
+  FrameInfo frameInfo(float aspectRatio) const
+  {
+    nvmath::vec3f eye;
+    nvmath::vec3f center;
+    nvmath::vec3f up;
+    CameraManip.getLookat(eye, center, up);
+
+    FrameInfo   finfo{};
+    const auto& clip = CameraManip.getClipPlanes();
+    finfo.view       = CameraManip.getMatrix();
+    finfo.proj       = nvmath::perspectiveVK(CameraManip.getFov(), aspectRatio, clip.x, clip.y);
+    finfo.projInv    = nvmath::inverse(finfo.proj);
+    finfo.viewInv    = nvmath::inverse(finfo.view);
+    finfo.camPos     = eye;
+    return finfo;
+  }
+
   void createScene()
   {
     constexpr int   num_obj       = 20;
@@ -775,6 +834,11 @@ private:
   nvvk::SBTWrapper           m_sbt;  // Shading binding table wrapper
   nvvk::RaytracingBuilderKHR m_rtBuilder;
   nvvkhl::PipelineContainer  m_rtPipe;
+
+  // CPU reference
+  cpupt::PathTracer  m_cpuTracer;
+  cpupt::RenderStats m_cpuStats;
+  int                m_cpuFrames{1};
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -783,6 +847,31 @@ private:
 ///
 auto main(int argc, char** argv) -> int
 {
+  // Rendering on the CPU only, without creating the Vulkan device
+  if(std::any_of(argv, argv + argc, [](const char* arg) { return std::string(arg) == "--cpu-reference"; }))
+  {
+    std::string output_file{"ser_pathtrace_cpu.hdr"};
+    uint32_t    width{1280};
+    uint32_t    height{720};
+    uint32_t    frames{1};
+    uint32_t    num_threads{0};
+
+    nvh::CommandLineParser parser("CPU reference");
+    parser.addArgument({"--cpu-reference"}, &output_file, "Render on the CPU to this .hdr file, then exit");
+    parser.addArgument({"-w", "--width"}, &width, "Render size width");
+    parser.addArgument({"-h", "--height"}, &height, "Render size height");
+    parser.addArgument({"-f", "--frames"}, &frames, "Frames accumulated, each of PushConstant::maxSamples samples");
+    parser.addArgument({"--threads"}, &num_threads, "Threads rendering the tiles, 0: all cores");
+    if(!parser.parse(argc, argv))
+    {
+      parser.printHelp();
+      return 1;
+    }
+
+    SerPathtrace sample;
+    return sample.renderCpuReference(output_file, width, height, frames, num_threads) ? 0 : 1;
+  }
+
   nvvkhl::ApplicationCreateInfo spec;
   spec.name             = PROJECT_NAME " Example";
   spec.vSync            = false;
@@ -1,3 +1,15 @@
+# Ray casting on the CPU, mesh optimization and vertex quantization, shared with other samples
+set(COMMON_SRC
+	${SAMPLES_COMMON_DIR}/bvh.cpp
+	${SAMPLES_COMMON_DIR}/bvh.hpp
+	${SAMPLES_COMMON_DIR}/mesh_optimizer.cpp
+	${SAMPLES_COMMON_DIR}/mesh_optimizer.hpp
+	${SAMPLES_COMMON_DIR}/quantized_vertex.cpp
+	${SAMPLES_COMMON_DIR}/quantized_vertex.hpp
+	)
+target_sources(${PROJECT_NAME} PRIVATE ${COMMON_SRC})
+source_group(common FILES ${COMMON_SRC})
+
 
 # HLSL
 if(USE_HLSL) 
@@ -27,6 +27,12 @@ struct VSin
   [[vk::location(1)]] float3 normal : NORMAl;
 };
 
+// Quantized vertices (common/quantized_vertex.hpp), the bounding box of the mesh being in pushConst.transfo
+struct VSinQuantized
+{
+  [[vk::location(0)]] uint4 positionNormal : POSITION;  // xyz: position, w: octahedral normal
+};
+
 // Output of the vertex shader, and input to the fragment shader.
 struct PSin
 {
@@ -67,6 +73,21 @@ VSout vertexMain(VSin input)
 }
 
 
+// Vertex Shader, quantized vertices
+[shader("vertex")]
+VSout vertexQuantizedMain(VSinQuantized input)
+{
+  float4 pos = mul(pushConst.transfo, float4(float3(input.positionNormal.xyz), 1.0));
+
+  VSout output;
+  output.sv_position = mul(frameInfo.proj, mul(frameInfo.view, pos));
+  output.stage.normal = decodeOctahedral(input.positionNormal.w);
+  output.stage.position = pos.xyz;
+
+  return output;
+}
+
+
 // Fragment Shader
 [shader("pixel")]
 PSout fragmentMain(PSin stage)
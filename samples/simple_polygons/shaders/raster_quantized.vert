@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#version 450
+
+#extension GL_GOOGLE_include_directive : enable
+
+#include "device_host.h"
+
+// Quantized vertices (common/quantized_vertex.hpp): the bounding box of the mesh is in pushC.transfo
+layout(location = 0) in uvec4 inPositionNormal;  // xyz: position, w: octahedral normal
+
+layout(location = 0) out vec3 outFragPos;
+layout(location = 1) out vec3 outFragNrm;
+
+layout(set = 0, binding = 0) uniform FrameInfo_
+{
+  FrameInfo frameInfo;
+};
+
+layout(push_constant) uniform PushConstant_
+{
+  PushConstant pushC;
+};
+
+// Two signed bytes, x in the lowest one
+vec3 decodeOctahedral(uint packed)
+{
+  vec2  f = vec2(ivec2(int(packed << 24), int(packed << 16)) >> 24) / 127.0;
+  vec3  n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+void main()
+{
+  vec4 pos    = pushC.transfo * vec4(vec3(inPositionNormal.xyz), 1.0);
+  gl_Position = frameInfo.proj * frameInfo.view * vec4(pos);
+
+  outFragPos = pos.xyz;
+  outFragNrm = decodeOctahedral(inPositionNormal.w);
+}
@@ -28,11 +28,20 @@
 #define IM_VEC2_CLASS_EXTRA ImVec2(const nvmath::vec2f& f) {x = f.x; y = f.y;} operator nvmath::vec2f() const { return nvmath::vec2f(x, y); }
 
 // clang-format on
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
 #include <vulkan/vulkan_core.h>
 
 #define VMA_IMPLEMENTATION
 #include "imgui/imgui_camera_widget.h"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
 #include "nvh/primitives.hpp"
 #include "nvvk/commands_vk.hpp"
 #include "nvvk/debug_util_vk.hpp"
@@ -48,24 +57,33 @@
 #include "nvvkhl/pipeline_container.hpp"
 
 
+#include "bvh.hpp"
+#include "mesh_optimizer.hpp"
+#include "quantized_vertex.hpp"
 #include "nvvk/images_vk.hpp"
 #include "shaders/device_host.h"
 
 #if USE_HLSL
 #include "_autogen/raster_vertexMain.spirv.h"
+#include "_autogen/raster_vertexQuantizedMain.spirv.h"
 #include "_autogen/raster_fragmentMain.spirv.h"
 const auto& vert_shd = std::vector<uint8_t>{std::begin(raster_vertexMain), std::end(raster_vertexMain)};
+const auto& vert_quantized_shd = std::vector<uint8_t>{std::begin(raster_vertexQuantizedMain), std::end(raster_vertexQuantizedMain)};
 const auto& frag_shd = std::vector<uint8_t>{std::begin(raster_fragmentMain), std::end(raster_fragmentMain)};
 #elif USE_SLANG
 #include "_autogen/raster_vertexMain.spirv.h"
+#include "_autogen/raster_vertexQuantizedMain.spirv.h"
 #include "_autogen/raster_fragmentMain.spirv.h"
 const auto& vert_shd = std::vector<uint32_t>{std::begin(raster_vertexMain), std::end(raster_vertexMain)};
+const auto& vert_quantized_shd = std::vector<uint32_t>{std::begin(raster_vertexQuantizedMain), std::end(raster_vertexQuantizedMain)};
 const auto& frag_shd = std::vector<uint32_t>{std::begin(raster_fragmentMain), std::end(raster_fragmentMain)};
 #else
 #include "_autogen/raster.frag.h"
 #include "_autogen/raster.vert.h"
-const auto& vert_shd = std::vector<uint32_t>{std::begin(raster_vert), std::end(raster_vert)};
-const auto& frag_shd = std::vector<uint32_t>{std::begin(raster_frag), std::end(raster_frag)};
+#include "_autogen/raster_quantized.vert.h"
+const auto& vert_shd           = std::vector<uint32_t>{std::begin(raster_vert), std::end(raster_vert)};
+const auto& vert_quantized_shd = std::vector<uint32_t>{std::begin(raster_quantized_vert), std::end(raster_quantized_vert)};
+const auto& frag_shd           = std::vector<uint32_t>{std::begin(raster_frag), std::end(raster_frag)};
 #endif  // USE_HLSL
 
 
@@ -107,9 +125,24 @@ public:
     {  // Setting menu
       ImGui::Begin("Settings");
       ImGuiH::CameraWidget();
+      ImGui::Separator();
+      ImGui::Text("Picking (double-click)");
+      ImGui::RadioButton("GPU depth readback", reinterpret_cast<int*>(&m_pickMode), static_cast<int>(PickMode::eGpuDepth));
+      ImGui::RadioButton("CPU ray cast (BVH)", reinterpret_cast<int*>(&m_pickMode), static_cast<int>(PickMode::eCpuRayCast));
+      ImGui::Text("Last pick: %s", m_pickInfo.c_str());
+      if(ImGui::Button("BVH Benchmark"))
+      {
+        benchmarkBvh();
+      }
+      ImGui::Separator();
+      ImGui::Checkbox("Quantized vertices", &m_useQuantized);
+      ImGui::Text("Vertices: %.1f KB, quantized %.1f KB", m_vertexBytes / 1024.0, m_quantizedBytes / 1024.0);
       ImGui::End();
     }
 
+    // Picks whose depth arrived since the last frame
+    resolvePicks();
+
     {  // Rendering Viewport
       ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0F, 0.0F));
       ImGui::Begin("Viewport");
@@ -157,24 +190,31 @@ public:
 
     vkCmdBeginRendering(cmd, &r_info);
     m_app->setViewport(cmd);
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_useQuantized ? m_quantizedPipeline : m_graphicsPipeline);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_dset->getPipeLayout(), 0, 1, m_dset->getSets(), 0, nullptr);
     const VkDeviceSize offsets{0};
     for(const nvh::Node& n : m_nodes)
     {
       PrimitiveMeshVk& m = m_meshVk[n.mesh];
       // Push constant information
-      m_pushConst.transfo = n.localMatrix();
+      // The quantized positions are in the bounding box of the mesh
+      m_pushConst.transfo = m_useQuantized ? n.localMatrix() * m.dequantize : n.localMatrix();
       m_pushConst.color   = m_materials[n.material].color;
       vkCmdPushConstants(cmd, m_dset->getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
                          sizeof(PushConstant), &m_pushConst);
 
-      vkCmdBindVertexBuffers(cmd, 0, 1, &m.vertices.buffer, &offsets);
+      vkCmdBindVertexBuffers(cmd, 0, 1, m_useQuantized ? &m.quantized.buffer : &m.vertices.buffer, &offsets);
       vkCmdBindIndexBuffer(cmd, m.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
       auto num_indices = static_cast<uint32_t>(m_meshes[n.mesh].triangles.size() * 3);
       vkCmdDrawIndexed(cmd, num_indices, 1, 0, 0, 0);
     }
     vkCmdEndRendering(cmd);
+
+    if(m_pickRequest)
+    {
+      recordPick(cmd);
+    }
+    m_frame++;
   }
 
 private:
@@ -190,6 +230,11 @@ private:
     m_meshes.emplace_back(nvh::createConeMesh(0.5F, 1.0F, 32));
     m_meshes.emplace_back(nvh::createTorusMesh(0.5F, 0.25F, 32, 16));
 
+    // Reordered for the vertex cache, the overdraw and the vertex fetch before the upload and the BVH
+    meshopt::Options optim;
+    optim.overdraw = true;
+    meshopt::optimizeMeshes(m_meshes, optim);
+
     const int num_meshes = static_cast<int>(m_meshes.size());
 
     // Materials (colorful)
@@ -209,6 +254,11 @@ private:
       n.translation = nvmath::vec3f(-(static_cast<float>(num_meshes) / 2.F) + static_cast<float>(i), 0.F, 0.F);
     }
 
+    // For the picking on the CPU
+    bvh::BuildStats mesh_stats;
+    m_sceneBvh.build(m_meshes, m_nodes, {}, &mesh_stats);
+    LOGI("BVH of %u triangles: %.2f ms\n", mesh_stats.primitives, mesh_stats.buildMs);
+
     CameraManip.setClipPlanes({0.1F, 100.0F});
     CameraManip.setLookat({-0.5F, 0.0F, 5.0F}, {-0.5F, 0.0F, 0.0F}, {0.0F, 1.0F, 0.0F});
   }
@@ -250,6 +300,19 @@ private:
     m_graphicsPipeline = pgen.createPipeline();
     m_dutil->setObjectName(m_graphicsPipeline, "Graphics");
     pgen.clearShaders();
+
+    // Same with the quantized vertices, see quantized_vertex.hpp
+    pstate.setBindingDescriptions({{0, sizeof(quant::QuantizedVertex)}});
+    pstate.setAttributeDescriptions({
+        {0, 0, VK_FORMAT_R16G16B16A16_UINT, static_cast<uint32_t>(offsetof(quant::QuantizedVertex, position))},  // Position + Normal
+        {1, 0, VK_FORMAT_R16G16_SFLOAT, static_cast<uint32_t>(offsetof(quant::QuantizedVertex, uv))},            // Texcoord
+    });
+    pgen.addShader(vert_quantized_shd, VK_SHADER_STAGE_VERTEX_BIT, USE_HLSL ? "vertexQuantizedMain" : "main");
+    pgen.addShader(frag_shd, VK_SHADER_STAGE_FRAGMENT_BIT, USE_HLSL ? "fragmentMain" : "main");
+
+    m_quantizedPipeline = pgen.createPipeline();
+    m_dutil->setObjectName(m_quantizedPipeline, "Graphics Quantized");
+    pgen.clearShaders();
   }
 
   void createGbuffers(const nvmath::vec2f& size)
@@ -271,14 +334,35 @@ private:
       m.indices          = m_alloc->createBuffer(cmd, m_meshes[i].triangles, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
       m_dutil->DBG_NAME_IDX(m.vertices.buffer, i);
       m_dutil->DBG_NAME_IDX(m.indices.buffer, i);
+
+      // Alternative vertex buffer, 12 bytes per vertex instead of 32
+      const quant::QuantizedMesh     quantized = quant::quantizeMesh(m_meshes[i]);
+      const quant::QuantizationError error     = quant::measureError(m_meshes[i], quantized);
+      m.quantized  = m_alloc->createBuffer(cmd, quantized.vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+      m.dequantize = quantized.dequantize();
+      m_dutil->DBG_NAME_IDX(m.quantized.buffer, i);
+      m_vertexBytes += m_meshes[i].vertices.size() * sizeof(nvh::PrimitiveVertex);
+      m_quantizedBytes += quantized.vertices.size() * sizeof(quant::QuantizedVertex);
+      LOGI("Mesh %zu quantized: position error %.1e (max %.1e) of the diagonal, normal %.2f deg (max %.2f), uv max %.1e\n",
+           i, error.meanPosition, error.maxPosition, error.meanNormalDeg, error.maxNormalDeg, error.maxUv);
     }
+    LOGI("Vertices: %zu bytes, quantized %zu bytes (%.2fx smaller)\n", m_vertexBytes, m_quantizedBytes,
+         double(m_vertexBytes) / double(std::max(m_quantizedBytes, size_t(1))));
 
     m_frameInfo = m_alloc->createBuffer(sizeof(FrameInfo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     m_dutil->DBG_NAME(m_frameInfo.buffer);
 
-    m_pixelBuffer = m_alloc->createBuffer(sizeof(float) * 4, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+    // One depth value per pick slot, mapped for the lifetime of the buffer
+    m_pixelBuffer = m_alloc->createBuffer(sizeof(uint32_t) * kPickSlots, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_dutil->DBG_NAME(m_pixelBuffer.buffer);
+    m_pixelMapped = static_cast<const uint32_t*>(m_alloc->map(m_pixelBuffer));
+    for(PickSlot& slot : m_pickSlots)
+    {
+      const VkEventCreateInfo event_info{VK_STRUCTURE_TYPE_EVENT_CREATE_INFO};
+      vkCreateEvent(m_device, &event_info, nullptr, &slot.event);
+    }
 
     m_app->submitAndWaitTempCmdBuffer(cmd);
   }
@@ -287,21 +371,30 @@ private:
   void destroyResources()
   {
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_quantizedPipeline, nullptr);
 
     for(PrimitiveMeshVk& m : m_meshVk)
     {
       m_alloc->destroy(m.vertices);
       m_alloc->destroy(m.indices);
+      m_alloc->destroy(m.quantized);
     }
     m_alloc->destroy(m_frameInfo);
+    m_alloc->unmap(m_pixelBuffer);
     m_alloc->destroy(m_pixelBuffer);
+    for(PickSlot& slot : m_pickSlots)
+    {
+      vkDestroyEvent(m_device, slot.event, nullptr);
+    }
 
     m_dset->deinit();
     m_gBuffers.reset();
   }
 
   //--------------------------------------------------------------------------------------------------
-  // Find the 3D position under the mouse cursor and set the camera interest to this position
+  // Find the 3D position under the mouse cursor and set the camera interest to this position.
+  // Nothing waits for the GPU: the depth is copied by the next frame and resolved in resolvePicks(),
+  // or the ray is cast on the CPU through the BVH of the scene, also when all pick slots are in flight.
   //
   void rasterPicking()
   {
@@ -309,86 +402,221 @@ private:
     const nvmath::vec2f corner    = ImGui::GetCursorScreenPos();  // Corner of the viewport
     mouse_pos                     = mouse_pos - corner;           // Mouse pos relative to center of viewport
 
+    const VkExtent2D size = m_gBuffers->getSize();
+    if(mouse_pos.x < 0.0F || mouse_pos.y < 0.0F || mouse_pos.x >= static_cast<float>(size.width)
+       || mouse_pos.y >= static_cast<float>(size.height))
+      return;
+
     const float          aspect_ratio = m_viewSize.x / m_viewSize.y;
     const nvmath::vec2f& clip         = CameraManip.getClipPlanes();
-    const nvmath::mat4f  view         = CameraManip.getMatrix();
-    const nvmath::mat4f  proj         = nvmath::perspectiveVK(CameraManip.getFov(), aspect_ratio, clip.x, clip.y);
 
-    // Find the distance under the cursor
-    const float d = getDepth(static_cast<int>(mouse_pos.x), static_cast<int>(mouse_pos.y));
+    PickRequest request;
+    request.mouse = mouse_pos;
+    request.view  = CameraManip.getMatrix();
+    request.proj  = nvmath::perspectiveVK(CameraManip.getFov(), aspect_ratio, clip.x, clip.y);
+    request.size  = size;
 
-    if(d < 1.0F)  // Ignore infinite
+    const bool slot_free = std::any_of(m_pickSlots.begin(), m_pickSlots.end(), [](const PickSlot& s) { return !s.pending; });
+    if(m_pickMode == PickMode::eGpuDepth && slot_free)
     {
-      const nvmath::vec3f hit_pos = unprojectScreenPosition({mouse_pos.x, mouse_pos.y, d}, view, proj);
+      m_pickRequest = request;
+      return;
+    }
 
-      // Set the interest position
-      nvmath::vec3f eye, center, up;
-      CameraManip.getLookat(eye, center, up);
-      CameraManip.setLookat(eye, hit_pos, up, false);
+    // Ray from the near to the far plane: the hit is at the same place as with the depth buffer
+    bvh::Ray ray;
+    ray.origin = unprojectScreenPosition({mouse_pos.x, mouse_pos.y, 0.0F}, request.view, request.proj, size);
+    ray.dir    = unprojectScreenPosition({mouse_pos.x, mouse_pos.y, 1.0F}, request.view, request.proj, size) - ray.origin;
+    ray.tMax   = 1.0F;
+    bvh::Hit hit;
+    if(!m_sceneBvh.intersect(ray, hit))
+    {
+      m_pickInfo = "CPU ray cast, nothing";
+      return;
     }
+    setInterest(ray.origin + ray.dir * hit.t);
+    std::array<char, 128> buf{};
+    snprintf(buf.data(), buf.size(), "CPU ray cast, instance %u, triangle %u, barycentrics (%.2f, %.2f)", hit.instance,
+             hit.triangle, hit.bary.x, hit.bary.y);
+    m_pickInfo = buf.data();
   }
 
   //--------------------------------------------------------------------------------------------------
-  // Read the depth buffer at the X,Y coordinates
-  // Note: depth format is VK_FORMAT_D32_SFLOAT
+  // Copy the depth under the requested pixel in a free slot, in the frame command buffer, after the
+  // rendering. The event of the slot tells the host when the value has landed.
+  // Note: depth format is VK_FORMAT_X8_D24_UNORM_PACK32 or VK_FORMAT_D32_SFLOAT
   //
-  float getDepth(int x, int y)
+  void recordPick(VkCommandBuffer cmd)
   {
-    VkCommandBuffer cmd = m_app->createTempCmdBuffer();
+    const auto it = std::find_if(m_pickSlots.begin(), m_pickSlots.end(), [](const PickSlot& s) { return !s.pending; });
+    if(it == m_pickSlots.end())
+      return;
+    const PickRequest request = *m_pickRequest;
+    m_pickRequest.reset();
+    const VkExtent2D size = m_gBuffers->getSize();
+    if(request.size.width != size.width || request.size.height != size.height)
+      return;  // Resized since
+
+    PickSlot&      slot  = *it;
+    const uint32_t index = static_cast<uint32_t>(it - m_pickSlots.begin());
+    slot.request         = request;
+    slot.frame           = m_frame;
+    slot.pending         = true;
 
-    // Transit the depth buffer image in eTransferSrcOptimal
+    // Transit the depth buffer image in eTransferSrcOptimal, keeping its content
     const VkImageSubresourceRange range{VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
-    nvvk::cmdBarrierImageLayout(cmd, m_gBuffers->getDepthImage(), VK_IMAGE_LAYOUT_UNDEFINED,
+    nvvk::cmdBarrierImageLayout(cmd, m_gBuffers->getDepthImage(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
                                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, range);
 
     // Copy the pixel under the cursor
     VkBufferImageCopy copy_region{};
+    copy_region.bufferOffset     = sizeof(uint32_t) * index;
     copy_region.imageSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
-    copy_region.imageOffset      = {x, y, 0};
+    copy_region.imageOffset      = {static_cast<int32_t>(slot.request.mouse.x), static_cast<int32_t>(slot.request.mouse.y), 0};
     copy_region.imageExtent      = {1, 1, 1};
     vkCmdCopyImageToBuffer(cmd, m_gBuffers->getDepthImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_pixelBuffer.buffer,
                            1, &copy_region);
 
-    // Put back the depth buffer as  it was
+    // Put back the depth buffer as it was
     nvvk::cmdBarrierImageLayout(cmd, m_gBuffers->getDepthImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, range);
-    m_app->submitAndWaitTempCmdBuffer(cmd);
+                                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, range);
+
+    // Make the value visible to the host, then signal it
+    VkMemoryBarrier host_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0,
+                         nullptr, 0, nullptr);
+    vkCmdSetEvent(cmd, slot.event, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Read the depth of the slots whose copy is done, without waiting: usually the frame that
+  // recorded it plus the frames in flight
+  //
+  void resolvePicks()
+  {
+    for(uint32_t i = 0; i < kPickSlots; i++)
+    {
+      PickSlot& slot = m_pickSlots[i];
+      if(!slot.pending || vkGetEventStatus(m_device, slot.event) != VK_EVENT_SET)
+        continue;
 
+      const float d = decodeDepth(m_pixelMapped[i]);
+      if(d < 1.0F)  // Ignore infinite
+      {
+        const PickRequest& r = slot.request;
+        setInterest(unprojectScreenPosition({r.mouse.x, r.mouse.y, d}, r.view, r.proj, r.size));
+      }
+      m_pickInfo = "GPU depth, " + std::to_string(m_frame - slot.frame) + " frames later";
+
+      vkResetEvent(m_device, slot.event);
+      slot.pending = false;
+    }
+  }
 
-    // Grab the value
+  // Depth in [0,1] from the texel copied from the depth buffer
+  float decodeDepth(uint32_t texel) const
+  {
     float value{1.0F};
-    void* mapped = m_alloc->map(m_pixelBuffer);
     switch(m_gBuffers->getDepthFormat())
     {
       case VK_FORMAT_X8_D24_UNORM_PACK32:
       case VK_FORMAT_D24_UNORM_S8_UINT: {
-        uint32_t ivalue{0};
-        memcpy(&ivalue, mapped, sizeof(uint32_t));
         const uint32_t mask = (1 << 24) - 1;
-        ivalue              = ivalue & mask;
-        value               = float(ivalue) / float(mask);
+        value               = float(texel & mask) / float(mask);
       }
       break;
       case VK_FORMAT_D32_SFLOAT: {
-        memcpy(&value, mapped, sizeof(float));
+        memcpy(&value, &texel, sizeof(float));
       }
       break;
       default:
         assert(!"Wrong Format");
     }
-    m_alloc->unmap(m_pixelBuffer);
-
     return value;
   }
 
+  // Set the camera interest, keeping the eye where it is
+  static void setInterest(const nvmath::vec3f& hitPos)
+  {
+    nvmath::vec3f eye, center, up;
+    CameraManip.getLookat(eye, center, up);
+    CameraManip.setLookat(eye, hitPos, up, false);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Logs the build time of the BVH of a mesh of 10M triangles, on one thread and on all of them,
+  // then the rays per second against that mesh and against the scene, from the camera
+  //
+  void benchmarkBvh()
+  {
+    const uint32_t num_threads = std::thread::hardware_concurrency();
+    const auto     ms_since    = [](std::chrono::steady_clock::time_point t0) {
+      return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    const nvh::PrimitiveMesh mesh = nvh::createSphereUv(0.5F, 2240, 2240);
+    LOGI("BVH benchmark: %zu triangles, %u threads\n", mesh.triangles.size(), num_threads);
+    LOGI("  %-8s %8s %10s %10s %8s %10s %10s\n", "Build", "Threads", "ms", "Nodes", "Depth", "SAH cost", "MB");
+    bvh::MeshBvh mesh_bvh;
+    double       single_ms = 0.0;
+    for(uint32_t threads : {1U, num_threads})
+    {
+      bvh::BuildOptions options;
+      options.numThreads = threads;
+      bvh::BuildStats stats;
+      mesh_bvh.build(mesh, options, &stats);
+      single_ms = threads == 1 ? stats.buildMs : single_ms;
+      LOGI("  %-8s %8u %10.1f %10u %8u %10.2f %10.1f  x%.1f\n", "Mesh", threads, stats.buildMs, stats.nodes, stats.maxDepth,
+           stats.sahCost, double(mesh_bvh.memoryBytes()) / (1024.0 * 1024.0), single_ms / stats.buildMs);
+    }
+
+    // Rays from the eye, toward random points of the bounds of the sphere, then of the scene
+    nvmath::vec3f eye, center, up;
+    CameraManip.getLookat(eye, center, up);
+    const uint32_t                        num_rays = 1 << 20;
+    std::vector<bvh::Ray>                 rays(num_rays);
+    std::mt19937                          rng(0);
+    std::uniform_real_distribution<float> dist(-1.0F, 1.0F);
+
+    LOGI("  %-8s %8s %10s %10s %10s\n", "Query", "Threads", "ms", "Mrays/s", "Hits");
+    for(bool scene : {false, true})
+    {
+      const nvmath::vec3f extent = scene ? nvmath::vec3f(4.0F, 1.0F, 1.0F) : nvmath::vec3f(0.5F);
+      for(bvh::Ray& ray : rays)
+      {
+        ray.origin = eye;
+        ray.dir    = nvmath::vec3f(dist(rng), dist(rng), dist(rng)) * extent - eye;
+      }
+      for(uint32_t threads : {1U, num_threads})
+      {
+        std::atomic<uint32_t> hits{0};
+        const auto            t0 = std::chrono::steady_clock::now();
+        nvh::parallel_batches<4096>(
+            num_rays,
+            [&](uint64_t i) {
+              bvh::Hit hit;
+              if(scene ? m_sceneBvh.intersect(rays[i], hit) : mesh_bvh.intersect(rays[i], hit))
+                hits++;
+            },
+            threads);
+        const double ms = ms_since(t0);
+        LOGI("  %-8s %8u %10.1f %10.2f %10u\n", scene ? "Scene" : "Mesh", threads, ms, num_rays / (ms * 1000.0), hits.load());
+      }
+    }
+  }
+
   //--------------------------------------------------------------------------------------------------
   // Return the 3D position of the screen 2D + depth
   //
-  nvmath::vec3f unprojectScreenPosition(const nvmath::vec3f& screenPos, const nvmath::mat4f& view, const nvmath::mat4f& proj)
+  static nvmath::vec3f unprojectScreenPosition(const nvmath::vec3f& screenPos,
+                                               const nvmath::mat4f& view,
+                                               const nvmath::mat4f& proj,
+                                               const VkExtent2D&    size)
   {
     // Transformation of normalized coordinates between -1 and 1
-    const VkExtent2D size = m_gBuffers->getSize();
-    nvmath::vec4f    win_norm;
+    nvmath::vec4f win_norm;
     win_norm.x = screenPos.x / static_cast<float>(size.width) * 2.0F - 1.0F;
     win_norm.y = screenPos.y / static_cast<float>(size.height) * 2.0F - 1.0F;
     win_norm.z = screenPos.z;
@@ -425,12 +653,15 @@ private:
   // Resources
   struct PrimitiveMeshVk
   {
-    nvvk::Buffer vertices;  // Buffer of the vertices
-    nvvk::Buffer indices;   // Buffer of the indices
+    nvvk::Buffer  vertices;    // Buffer of the vertices
+    nvvk::Buffer  indices;     // Buffer of the indices
+    nvvk::Buffer  quantized;   // Buffer of the quantized vertices
+    nvmath::mat4f dequantize;  // From the quantized positions to the mesh
   };
   std::vector<PrimitiveMeshVk> m_meshVk;
   nvvk::Buffer                 m_frameInfo;
-  nvvk::Buffer                 m_pixelBuffer;
+  nvvk::Buffer                 m_pixelBuffer;  // Depth of the picks, a value per slot
+  const uint32_t*              m_pixelMapped{nullptr};
 
   std::vector<VkSampler> m_samplers;
 
@@ -442,10 +673,45 @@ private:
   std::vector<nvh::PrimitiveMesh> m_meshes;
   std::vector<nvh::Node>          m_nodes;
   std::vector<Material>           m_materials;
+  bvh::SceneBvh                   m_sceneBvh;  // For the picking on the CPU
+
+  // Picking: the depth under the cursor is copied by the frame command buffer into a slot of
+  // m_pixelBuffer, and read once the event of the slot is set, a few frames later
+  static constexpr uint32_t kPickSlots = 4;
+  enum class PickMode
+  {
+    eGpuDepth,
+    eCpuRayCast,
+  };
+  struct PickRequest
+  {
+    nvmath::vec2f mouse;  // Pixel of the viewport
+    nvmath::mat4f view;   // Camera when it was requested
+    nvmath::mat4f proj;
+    VkExtent2D    size{0, 0};
+  };
+  struct PickSlot
+  {
+    PickRequest request;
+    VkEvent     event{VK_NULL_HANDLE};  // Set by the GPU after the copy
+    uint32_t    frame{0};               // Recorded in
+    bool        pending{false};
+  };
+  PickMode                         m_pickMode{PickMode::eGpuDepth};
+  std::optional<PickRequest>       m_pickRequest;  // For the next frame
+  std::array<PickSlot, kPickSlots> m_pickSlots;
+  uint32_t                         m_frame{0};
+  std::string                      m_pickInfo{"none"};
+
+  // Quantized vertices
+  bool   m_useQuantized{false};
+  size_t m_vertexBytes{0};  // Of all the meshes
+  size_t m_quantizedBytes{0};
 
   // Pipeline
-  PushConstant m_pushConst{};                        // Information sent to the shader
-  VkPipeline   m_graphicsPipeline = VK_NULL_HANDLE;  // The graphic pipeline to render
+  PushConstant m_pushConst{};                         // Information sent to the shader
+  VkPipeline   m_graphicsPipeline  = VK_NULL_HANDLE;  // The graphic pipeline to render
+  VkPipeline   m_quantizedPipeline = VK_NULL_HANDLE;  // Same, with the quantized vertices
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -30,13 +30,44 @@ using vec3 = nvmath::vec3f;
 #define inline
 #endif
 
+// Bricked volume
+#define BRICK_SIZE 32     // Voxels per side of a brick
+#define BRICK_STORAGE 33  // Voxels per side of a brick in the atlas, with the first voxels of the next bricks
+
+// Empty space skipping
+#define MACRO_CELL_SIZE 8  // Voxels per side of a macro cell of the dense volume
+
+// Voxels read outside of the volume, see MacroCellGrid::Edge
+#define EDGE_CLAMP 0
+#define EDGE_REPEAT 1
+#define EDGE_BORDER 2
+
+// Storage of the dense volume, see volume::Encoding
+#define VOLUME_R32F 0
+#define VOLUME_R16F 1
+#define VOLUME_R8_UNORM 2
+#define VOLUME_R8_SNORM 3
+#define VOLUME_BC4 4  // Unorm, in blocks of 4x4 voxels of a slice, made on the CPU
+
+// PerlinSettings::mode
+#define PERLIN_DENSE 0         // The whole volume
+#define PERLIN_BRICK_RANGES 1  // Min/max of each brick, one workgroup per brick
+#define PERLIN_BRICK_FILL 2    // The resident bricks in their atlas slot, one workgroup per slot and z
+#define PERLIN_MACRO_CELLS 3   // Min/max of each macro cell of the generated volume, one workgroup per cell
+
 struct PushConstant
 {
   mat4  transfo;
   vec4  color;
   float threshold;
   int   steps;
-  int   size;
+  int   size;           // Size of the volume
+  int   bricksPerAxis;  // 0: dense volume, otherwise the volume is bricked
+  int   slotsPerAxis;   // Atlas slots in x and y
+  int   cellSize;       // Voxels per side of a macro cell
+  int   cellsPerAxis;   // 0: no empty space skipping
+  float decodeScale;    // Value of the volume: texel * decodeScale + decodeOffset
+  float decodeOffset;
 };
 
 struct FrameInfo
@@ -53,13 +84,29 @@ struct PerlinSettings
   int   octave;
   float power;
   float frequency;
+  int   mode;           // PERLIN_DENSE, PERLIN_BRICK_RANGES, PERLIN_BRICK_FILL, PERLIN_MACRO_CELLS
+  int   bricksPerAxis;  // Bricked modes
+  int   slotsPerAxis;
+  int   size;           // PERLIN_MACRO_CELLS: size of the volume, macro cells and addressing mode
+  int   cellsPerAxis;
+  int   edge;
+  float encodeScale;  // PERLIN_DENSE writes (value - encodeOffset) * encodeScale, see volume::Encoding
+  float encodeOffset;
 };
 
 inline PerlinSettings PerlinDefaultValues()
 {
   PerlinSettings perlin;
-  perlin.power     = 1.0F;
-  perlin.octave    = 3;
-  perlin.frequency = 1.0F;
+  perlin.power         = 1.0F;
+  perlin.octave        = 3;
+  perlin.frequency     = 1.0F;
+  perlin.mode          = PERLIN_DENSE;
+  perlin.bricksPerAxis = 0;
+  perlin.slotsPerAxis  = 0;
+  perlin.size          = 0;
+  perlin.cellsPerAxis  = 0;
+  perlin.edge          = EDGE_CLAMP;
+  perlin.encodeScale   = 1.0F;
+  perlin.encodeOffset  = 0.0F;
   return perlin;
 }
@@ -22,7 +22,11 @@
 #include "device_host.h"
 
 #define WORKGROUP_SIZE 16
-RWTexture3D<float> g_out_image;
+[[vk::binding(0)]] [[vk::image_format("unknown")]] RWTexture3D<float> g_out_image;  // Written without format: R32F, R16F, R8 or R8_SNORM
+[[vk::binding(1)]] RWStructuredBuffer<float2> brickRanges;  // PERLIN_BRICK_RANGES: min/max per brick, PERLIN_MACRO_CELLS: per macro cell
+[[vk::binding(2)]] StructuredBuffer<uint> residentBricks;  // PERLIN_BRICK_FILL: brick of each atlas slot
+[[vk::binding(3)]] [[vk::combinedImageSampler]] Texture3D<float> g_volume;  // PERLIN_MACRO_CELLS: the generated volume, read back
+[[vk::binding(3)]] [[vk::combinedImageSampler]] SamplerState g_volumeSampler;
 
 [[vk::push_constant]] ConstantBuffer<PerlinSettings> perlinSettings;
 
@@ -121,9 +125,7 @@ float perlin(float3 P)
   return 2.2 * n_xyz;
 }
 
-[shader("compute")]
-[numthreads(WORKGROUP_SIZE, WORKGROUP_SIZE, 1)]
-void computeMain(uint3 threadIdx : SV_DispatchThreadID)
+float fbm(float3 p)
 {
   float v = 0.0F;
   float scale = perlinSettings.power;
@@ -131,12 +133,134 @@ void computeMain(uint3 threadIdx : SV_DispatchThreadID)
 
   for (int oct = 0; oct < perlinSettings.octave; oct++)
   {
-    v += perlin(float3(threadIdx.xyz) * freq) / scale;
+    v += perlin(p * freq) / scale;
 
     freq *= 2.0F; // Double the frequency
     scale *= perlinSettings.power; // Next power of b
   }
+  return v;
+}
+
+// First voxel of the brick, in the volume
+int3 brickOrigin(uint brick)
+{
+  const uint n = perlinSettings.bricksPerAxis;
+  return int3(brick % n, (brick / n) % n, brick / (n * n)) * BRICK_SIZE;
+}
+
+#define NUM_THREADS (WORKGROUP_SIZE * WORKGROUP_SIZE)
+groupshared float2 s_range[NUM_THREADS];
+
+// Min/max of the ranges of all threads, written for the workgroup
+void reduceRange(float2 range, uint groupId, uint tid)
+{
+  // Reduction in shared memory
+  s_range[tid] = range;
+  GroupMemoryBarrierWithGroupSync();
+  for (uint stride = NUM_THREADS / 2; stride > 0; stride >>= 1)
+  {
+    if (tid < stride)
+      s_range[tid] = float2(min(s_range[tid].x, s_range[tid + stride].x), max(s_range[tid].y, s_range[tid + stride].y));
+    GroupMemoryBarrierWithGroupSync();
+  }
+
+  if (tid == 0)
+    brickRanges[groupId] = s_range[0];
+}
+
+// Min/max of the brick of this workgroup, apron included
+void brickRange(uint groupId, uint tid)
+{
+  const int3 origin = brickOrigin(groupId);
+
+  float2 range = float2(1e30, -1e30);
+  for (uint i = tid; i < BRICK_STORAGE * BRICK_STORAGE * BRICK_STORAGE; i += NUM_THREADS)
+  {
+    const int3 local = int3(i % BRICK_STORAGE, (i / BRICK_STORAGE) % BRICK_STORAGE, i / (BRICK_STORAGE * BRICK_STORAGE));
+    const float v = fbm(float3(origin + local));
+    range = float2(min(range.x, v), max(range.y, v));
+  }
+
+  reduceRange(range, groupId, tid);
+}
+
+// One z-slice of the resident brick of slot groupId.x, written in the atlas
+void brickFill(uint2 groupId, uint2 localId)
+{
+  const uint slot = groupId.x;
+  const int z = int(groupId.y);
+  const int3 origin = brickOrigin(residentBricks[slot]);
+  const uint n = perlinSettings.slotsPerAxis;
+  const int3 atlas = int3(slot % n, (slot / n) % n, slot / (n * n)) * BRICK_STORAGE;
+
+  for (int y = int(localId.y); y < BRICK_STORAGE; y += WORKGROUP_SIZE)
+  {
+    for (int x = int(localId.x); x < BRICK_STORAGE; x += WORKGROUP_SIZE)
+    {
+      const int3 local = int3(x, y, z);
+      g_out_image[uint3(atlas + local)] = fbm(float3(origin + local));
+    }
+  }
+}
+
+// Value of a voxel of the generated volume, as the sampler returns it once decoded
+float decodeVoxel(float texel)
+{
+  return texel / perlinSettings.encodeScale + perlinSettings.encodeOffset;
+}
+
+// Voxel of the generated volume, following the addressing mode of the sampler
+float loadVoxel(int3 v)
+{
+  const int size = perlinSettings.size;
+  if (perlinSettings.edge == EDGE_REPEAT)
+    v = (v + size) % size;  // Never further than one voxel outside
+  else if (perlinSettings.edge == EDGE_BORDER && (any(v < 0) || any(v >= size)))
+    return decodeVoxel(0.0);
+  return decodeVoxel(g_volume.Load(int4(clamp(v, int3(0, 0, 0), int3(size - 1, size - 1, size - 1)), 0)));
+}
+
+// Min/max of the macro cell of this workgroup and of the voxels around it, see MacroCellGrid::build()
+void macroCellRange(uint cell, uint tid)
+{
+  const uint n = perlinSettings.cellsPerAxis;
+  const int3 origin = int3(cell % n, (cell / n) % n, cell / (n * n)) * MACRO_CELL_SIZE;
+  const int3 last = min(origin + MACRO_CELL_SIZE, int3(perlinSettings.size, perlinSettings.size, perlinSettings.size));
+  const uint3 extent = uint3(last - origin + 2);
+
+  float2 range = float2(1e30, -1e30);
+  for (uint i = tid; i < extent.x * extent.y * extent.z; i += NUM_THREADS)
+  {
+    const int3 local = int3(i % extent.x, (i / extent.x) % extent.y, i / (extent.x * extent.y));
+    const float v = loadVoxel(origin - 1 + local);
+    range = float2(min(range.x, v), max(range.y, v));
+  }
+  reduceRange(range, cell, tid);
+}
+
+[shader("compute")]
+[numthreads(WORKGROUP_SIZE, WORKGROUP_SIZE, 1)]
+void computeMain(uint3 threadIdx : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint3 localId : SV_GroupThreadID, uint localIndex : SV_GroupIndex)
+{
+  if (perlinSettings.mode == PERLIN_BRICK_RANGES)
+  {
+    brickRange(groupId.x, localIndex);
+    return;
+  }
+  if (perlinSettings.mode == PERLIN_BRICK_FILL)
+  {
+    brickFill(groupId.xy, localId.xy);
+    return;
+  }
+  if (perlinSettings.mode == PERLIN_MACRO_CELLS)
+  {
+    macroCellRange(groupId.x, localIndex);
+    return;
+  }
+
+  float v = fbm(float3(threadIdx.xyz));
 
-  //v += 0.5;
+  // Normalized for the format of the image, which converts on store
+  v = (v - perlinSettings.encodeOffset) * perlinSettings.encodeScale;
   g_out_image[uint3(threadIdx.xyz)] = v;
 }
@@ -32,7 +32,12 @@ layout(set = 0, binding = 0, scalar) uniform FrameInfo_
 {
   FrameInfo frameInfo;
 };
-layout(set = 0, binding = 1) uniform sampler3D inVolume;
+layout(set = 0, binding = 1) uniform sampler3D inVolume;     // The volume, or the atlas of bricks
+layout(set = 0, binding = 2) uniform sampler3D inPageTable;  // Bricked volume: constant value and atlas slot per brick
+layout(set = 0, binding = 3) readonly buffer MacroCells_
+{
+  vec2 macroCells[];  // Min/max per macro cell, see MacroCellGrid
+};
 layout(push_constant) uniform PushConstant_
 {
   PushConstant pushC;
@@ -100,32 +105,87 @@ bool intersectCube(in Ray ray, in Bbox bbox, out vec3 p1, out vec3 p2)
   return true;
 }
 
+// Value of the volume at `p`, in [0,1]. A dense volume stored in half or 8 bits is decoded, the
+// filtering of the normalized texels giving the same result. A bricked volume is looked up in the
+// page table: constant bricks return their value, others are sampled in their slot of the atlas.
+float sampleVolume(vec3 p)
+{
+  if(pushC.bricksPerAxis == 0)
+    return texture(inVolume, p).r * pushC.decodeScale + pushC.decodeOffset;
+
+  const float size  = float(pushC.size);
+  const vec3  q     = clamp(p * size - 0.5, vec3(0), vec3(size - 1));  // Voxel coordinates
+  const ivec3 brick = min(ivec3(q) / BRICK_SIZE, ivec3(pushC.bricksPerAxis - 1));
+  const vec2  entry = texelFetch(inPageTable, brick, 0).xy;
+  if(entry.y < 0)
+    return entry.x;
+
+  const int   slot  = int(entry.y);
+  const int   n     = pushC.slotsPerAxis;
+  const ivec3 atlas = ivec3(slot % n, (slot / n) % n, slot / (n * n)) * BRICK_STORAGE;
+  const vec3  local = q - vec3(brick * BRICK_SIZE);
+  return texture(inVolume, (vec3(atlas) + local + 0.5) / vec3(textureSize(inVolume, 0))).r;
+}
+
 // Computes the gradient of a 3D volume at a given position by sampling neighboring voxels and estimating
 // the rate of change in each direction using finite differences. The resulting gradient vector represents
 // the direction (normal) and magnitude of the steepest ascent/descent in the volume at that position.
-vec3 computeVolumeGradient(sampler3D volume, vec3 p, float voxelSize)
+vec3 computeVolumeGradient(vec3 p, float voxelSize)
 {
   float inc = voxelSize * 0.5F;
-  float dx  = (texture(volume, p - vec3(inc, 0, 0)).r - texture(volume, p + vec3(inc, 0, 0)).r) / voxelSize;
-  float dy  = (texture(volume, p - vec3(0, inc, 0)).r - texture(volume, p + vec3(0, inc, 0)).r) / voxelSize;
-  float dz  = (texture(volume, p - vec3(0, 0, inc)).r - texture(volume, p + vec3(0, 0, inc)).r) / voxelSize;
+  float dx  = (sampleVolume(p - vec3(inc, 0, 0)) - sampleVolume(p + vec3(inc, 0, 0))) / voxelSize;
+  float dy  = (sampleVolume(p - vec3(0, inc, 0)) - sampleVolume(p + vec3(0, inc, 0))) / voxelSize;
+  float dz  = (sampleVolume(p - vec3(0, 0, inc)) - sampleVolume(p + vec3(0, 0, inc))) / voxelSize;
 
   return normalize(vec3(dx, dy, dz));
 }
 
+// Step at which the ray leaves the macro cell along one axis
+float cellExit(float origin, float stepSize, int cell, float cellSize, float size)
+{
+  if(stepSize == 0.0)
+    return 1e30;
+  const float bound = (float(cell) + (stepSize > 0.0 ? 1.0 : 0.0)) * cellSize;
+  return ((bound + 0.5) / size - origin) / stepSize;
+}
+
+// Next step to sample after step `i`. When the macro cell of step `i` is below the threshold, the
+// steps in the cell can't be above it and are skipped.
+int nextStep(vec3 origin, vec3 stepSize, int i, int numSteps, float threshold)
+{
+  if(pushC.cellsPerAxis == 0)
+    return i + 1;
+
+  const float size     = float(pushC.size);
+  const float cellSize = float(pushC.cellSize);
+  const int   n        = pushC.cellsPerAxis;
+  const vec3  q        = clamp((origin + stepSize * float(i)) * size - 0.5, vec3(-0.5), vec3(size - 0.5));
+  const ivec3 cell     = clamp(ivec3(floor(q / cellSize)), ivec3(0), ivec3(n - 1));
+  if(macroCells[(cell.z * n + cell.y) * n + cell.x].y > threshold)
+    return i + 1;
+
+  float tExit = float(numSteps + 1);
+  tExit       = min(tExit, cellExit(origin.x, stepSize.x, cell.x, cellSize, size));
+  tExit       = min(tExit, cellExit(origin.y, stepSize.y, cell.y, cellSize, size));
+  tExit       = min(tExit, cellExit(origin.z, stepSize.z, cell.z, cellSize, size));
+
+  // One step of margin: the skipped steps are inside the cell, whatever the rounding
+  return max(i + 1, int(ceil(tExit)) - 1);
+}
+
 // Traces a ray through a volume by taking multiple steps and sampling the volume texture at each step.
 // It stops when the sampled value exceeds a threshold, and then performs interpolation to refine the hit point.
 // The function returns a boolean indicating if a hit point was found and outputs the final hit point position.
-bool rayMarching(const sampler3D volume, const vec3 p1, const vec3 p2, const int numSteps, const float threshold, out vec3 hitPoint)
+bool rayMarching(const vec3 p1, const vec3 p2, const int numSteps, const float threshold, out vec3 hitPoint)
 {
   const vec3 stepSize = (p2 - p1) / float(numSteps);
   hitPoint            = p1;
 
   vec3  prevPoint = hitPoint;
-  float value     = texture(volume, hitPoint).r;
+  float value     = sampleVolume(hitPoint);
   float prevValue = value;
 
-  for(int i = 0; i < numSteps; ++i)
+  for(int i = 0; i < numSteps;)
   {
     if(value > threshold)
     {
@@ -134,16 +194,27 @@ bool rayMarching(const sampler3D volume, const vec3 p1, const vec3 p2, const int
       return true;
     }
 
-    prevValue = value;
-    prevPoint = hitPoint;
-    hitPoint += stepSize;
-    value = texture(volume, hitPoint).r;
+    const int next = nextStep(p1, stepSize, i, numSteps, threshold);
+    if(next > i + 1)
+    {
+      // Empty space skipped, the previous point is the last step in the cell
+      prevPoint = p1 + stepSize * float(next - 1);
+      prevValue = sampleVolume(prevPoint);
+    }
+    else
+    {
+      prevPoint = hitPoint;
+      prevValue = value;
+    }
+
+    i        = next;
+    hitPoint = p1 + stepSize * float(i);
+    value    = sampleVolume(hitPoint);
   }
 
   return false;
 }
 
-
 void main()
 {
   Ray ray;
@@ -169,12 +240,12 @@ void main()
 
   // Ray-marching
   vec3 hitPoint;
-  hit = rayMarching(inVolume, p1, p2, pushC.steps, pushC.threshold, hitPoint);
+  hit = rayMarching(p1, p2, pushC.steps, pushC.threshold, hitPoint);
   if(!hit)
     discard;
 
   // Find normal at position
-  vec3 normal = computeVolumeGradient(inVolume, hitPoint, 1.0 / textureSize(inVolume, 0).x);
+  vec3 normal = computeVolumeGradient(hitPoint, 1.0 / float(pushC.size));
   if(dot(ray.direction, normal) > 0)  // Make nornal pointing toward origin
     normal *= -1;
 
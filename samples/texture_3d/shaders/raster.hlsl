@@ -50,6 +50,9 @@ struct PSout
 [[vk::binding(0, 0)]] ConstantBuffer<FrameInfo> frameInfo;
 [[vk::binding(1)]] [[vk::combinedImageSampler]] Texture3D g_Volume;
 [[vk::binding(1)]] [[vk::combinedImageSampler]] SamplerState g_Sampler;
+[[vk::binding(2)]] [[vk::combinedImageSampler]] Texture3D<float2> g_PageTable;  // Bricked volume: constant value and atlas slot per brick
+[[vk::binding(2)]] [[vk::combinedImageSampler]] SamplerState g_PageSampler;
+[[vk::binding(3)]] StructuredBuffer<float2> g_MacroCells;  // Min/max per macro cell, see MacroCellGrid
 
 struct Sampler3D
 {
@@ -102,19 +105,77 @@ bool intersectCube(in Ray ray, in Bbox bbox, out float3 p1, out float3 p2)
   return true;
 }
 
+// Value of the volume at `p`, in [0,1]. A dense volume stored in half or 8 bits is decoded, the
+// filtering of the normalized texels giving the same result. A bricked volume is looked up in the
+// page table: constant bricks return their value, others are sampled in their slot of the atlas.
+float sampleVolume(Sampler3D volume, float3 p)
+{
+  if (pushConst.bricksPerAxis == 0)
+    return volume.t.Sample(volume.s, p).r * pushConst.decodeScale + pushConst.decodeOffset;
+
+  const float size = float(pushConst.size);
+  const float3 q = clamp(p * size - 0.5, float3(0, 0, 0), float3(size - 1, size - 1, size - 1)); // Voxel coordinates
+  const int3 brick = min(int3(q) / BRICK_SIZE, int3(pushConst.bricksPerAxis - 1, pushConst.bricksPerAxis - 1, pushConst.bricksPerAxis - 1));
+  const float2 entry = g_PageTable.Load(int4(brick, 0));
+  if (entry.y < 0)
+    return entry.x;
+
+  const int slot = int(entry.y);
+  const int n = pushConst.slotsPerAxis;
+  const int3 atlas = int3(slot % n, (slot / n) % n, slot / (n * n)) * BRICK_STORAGE;
+  const float3 local = q - float3(brick * BRICK_SIZE);
+  uint3 dim;
+  uint levels;
+  volume.t.GetDimensions(0, dim.x, dim.y, dim.z, levels);
+  return volume.t.Sample(volume.s, (float3(atlas) + local + 0.5) / float3(dim)).r;
+}
+
 // Computes the gradient of a 3D volume at a given position by sampling neighboring voxels and estimating
 // the rate of change in each direction using finite differences. The resulting gradient vector represents
 // the direction (normal) and magnitude of the steepest ascent/descent in the volume at that position.
 float3 computeVolumeGradient(Sampler3D volume, float3 p, float voxelSize)
 {
   float inc = voxelSize * 0.5F;
-  float dx = (volume.t.Sample(volume.s, p - float3(inc, 0, 0)).r - volume.t.Sample(volume.s, p + float3(inc, 0, 0)).r) / voxelSize;
-  float dy = (volume.t.Sample(volume.s, p - float3(0, inc, 0)).r - volume.t.Sample(volume.s, p + float3(0, inc, 0)).r) / voxelSize;
-  float dz = (volume.t.Sample(volume.s, p - float3(0, 0, inc)).r - volume.t.Sample(volume.s, p + float3(0, 0, inc)).r) / voxelSize;
+  float dx = (sampleVolume(volume, p - float3(inc, 0, 0)) - sampleVolume(volume, p + float3(inc, 0, 0))) / voxelSize;
+  float dy = (sampleVolume(volume, p - float3(0, inc, 0)) - sampleVolume(volume, p + float3(0, inc, 0))) / voxelSize;
+  float dz = (sampleVolume(volume, p - float3(0, 0, inc)) - sampleVolume(volume, p + float3(0, 0, inc))) / voxelSize;
 
   return normalize(float3(dx, dy, dz));
 }
     
+// Step at which the ray leaves the macro cell along one axis
+float cellExit(float origin, float stepSize, int cell, float cellSize, float size)
+{
+  if (stepSize == 0.0)
+    return 1e30;
+  const float bound = (float(cell) + (stepSize > 0.0 ? 1.0 : 0.0)) * cellSize;
+  return ((bound + 0.5) / size - origin) / stepSize;
+}
+
+// Next step to sample after step `i`. When the macro cell of step `i` is below the threshold, the
+// steps in the cell can't be above it and are skipped.
+int nextStep(float3 origin, float3 stepSize, int i, int numSteps, float threshold)
+{
+  if (pushConst.cellsPerAxis == 0)
+    return i + 1;
+
+  const float size = float(pushConst.size);
+  const float cellSize = float(pushConst.cellSize);
+  const int n = pushConst.cellsPerAxis;
+  const float3 q = clamp((origin + stepSize * float(i)) * size - 0.5, float3(-0.5, -0.5, -0.5), float3(size - 0.5, size - 0.5, size - 0.5));
+  const int3 cell = clamp(int3(floor(q / cellSize)), int3(0, 0, 0), int3(n - 1, n - 1, n - 1));
+  if (g_MacroCells[(cell.z * n + cell.y) * n + cell.x].y > threshold)
+    return i + 1;
+
+  float tExit = float(numSteps + 1);
+  tExit = min(tExit, cellExit(origin.x, stepSize.x, cell.x, cellSize, size));
+  tExit = min(tExit, cellExit(origin.y, stepSize.y, cell.y, cellSize, size));
+  tExit = min(tExit, cellExit(origin.z, stepSize.z, cell.z, cellSize, size));
+
+  // One step of margin: the skipped steps are inside the cell, whatever the rounding
+  return max(i + 1, int(ceil(tExit)) - 1);
+}
+
 // Traces a ray through a volume by taking multiple steps and sampling the volume texture at each step.
 // It stops when the sampled value exceeds a threshold, and then performs interpolation to refine the hit point.
 // The function returns a boolean indicating if a hit point was found and outputs the final hit point position.
@@ -124,10 +185,10 @@ bool rayMarching(const Sampler3D volume, const float3 p1, const float3 p2, const
   hitPoint = p1;
 
   float3 prevPoint = hitPoint;
-  float value = volume.t.Sample(volume.s, hitPoint).r;
+  float value = sampleVolume(volume, hitPoint);
   float prevValue = value;
 
-  for (int i = 0; i < numSteps; ++i)
+  for (int i = 0; i < numSteps;)
   {
     if (value > threshold)
     {
@@ -136,10 +197,22 @@ bool rayMarching(const Sampler3D volume, const float3 p1, const float3 p2, const
       return true;
     }
 
-    prevValue = value;
-    prevPoint = hitPoint;
-    hitPoint += stepSize;
-    value = volume.t.Sample(volume.s, hitPoint).r;
+    const int next = nextStep(p1, stepSize, i, numSteps, threshold);
+    if (next > i + 1)
+    {
+      // Empty space skipped, the previous point is the last step in the cell
+      prevPoint = p1 + stepSize * float(next - 1);
+      prevValue = sampleVolume(volume, prevPoint);
+    }
+    else
+    {
+      prevPoint = hitPoint;
+      prevValue = value;
+    }
+
+    i = next;
+    hitPoint = p1 + stepSize * float(i);
+    value = sampleVolume(volume, hitPoint);
   }
 
   return false;
@@ -196,10 +269,7 @@ PSout fragmentMain(PSin stage, bool isFrontFacing : SV_IsFrontFace)
     discard;
 
   // Find normal at position
-  uint3 dim;
-  uint levels;
-  volume.t.GetDimensions(0, dim.x, dim.y, dim.z, levels);
-  float3 normal = computeVolumeGradient(volume, hitPoint, 1.0 / dim.x);
+  float3 normal = computeVolumeGradient(volume, hitPoint, 1.0 / float(pushConst.size));
   if (dot(ray.direction, normal) > 0)  // Make nornal pointing toward origin
     normal *= -1;
 
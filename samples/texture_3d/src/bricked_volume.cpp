@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "bricked_volume.hpp"
+#include "nvh/parallel_work.hpp"
+
+
+static constexpr uint32_t kBrickVoxels = BRICK_STORAGE * BRICK_STORAGE * BRICK_STORAGE;
+
+void BrickedVolume::init(uint32_t size)
+{
+  m_size          = size;
+  m_bricksPerAxis = std::max(1U, (size + BRICK_SIZE - 1) / BRICK_SIZE);
+  m_ranges.assign(getNumBricks(), {0.0F, 0.0F});
+  m_pageTable.clear();
+  m_resident.clear();
+}
+
+std::array<uint32_t, 3> BrickedVolume::brickOrigin(uint32_t brick) const
+{
+  const uint32_t n = m_bricksPerAxis;
+  return {(brick % n) * BRICK_SIZE, ((brick / n) % n) * BRICK_SIZE, (brick / (n * n)) * BRICK_SIZE};
+}
+
+nvmath::vec2f BrickedVolume::evalBrick(uint32_t brick, const noise::FbmSettings& settings, float* dst) const
+{
+  const std::array<uint32_t, 3> origin = brickOrigin(brick);
+
+  std::array<float, BRICK_STORAGE> x, y, z, row;
+  for(uint32_t i = 0; i < BRICK_STORAGE; i++)
+    x[i] = static_cast<float>(origin[0] + i);
+
+  nvmath::vec2f range{1e30F, -1e30F};
+  for(uint32_t k = 0; k < BRICK_STORAGE; k++)
+  {
+    z.fill(static_cast<float>(origin[2] + k));
+    for(uint32_t j = 0; j < BRICK_STORAGE; j++)
+    {
+      y.fill(static_cast<float>(origin[1] + j));
+      float* out = dst ? dst + (k * BRICK_STORAGE + j) * BRICK_STORAGE : row.data();
+      noise::fbm(x.data(), y.data(), z.data(), out, BRICK_STORAGE, settings);
+
+      const auto [lo, hi] = std::minmax_element(out, out + BRICK_STORAGE);
+      range.x             = std::min(range.x, *lo);
+      range.y             = std::max(range.y, *hi);
+    }
+  }
+  return range;
+}
+
+void BrickedVolume::computeRanges(const noise::FbmSettings& settings)
+{
+  nvh::parallel_batches<1>(
+      getNumBricks(), [&](uint64_t brick) { m_ranges[brick] = evalBrick(static_cast<uint32_t>(brick), settings, nullptr); },
+      std::thread::hardware_concurrency());
+}
+
+//--------------------------------------------------------------------------------------------------
+// The ray-marching stops on the first sample above the threshold: a brick is needed only if it
+// has values on both sides of it. Below, the largest value is kept and above, the smallest one,
+// which keeps the side of the threshold.
+//
+bool BrickedVolume::classify(float threshold, uint32_t maxAtlasDim)
+{
+  const uint32_t num_bricks = getNumBricks();
+  m_pageTable.resize(num_bricks);
+  m_resident.clear();
+
+  for(uint32_t brick = 0; brick < num_bricks; brick++)
+  {
+    const nvmath::vec2f& range    = m_ranges[brick];
+    const bool           constant = range.y - range.x <= 1e-6F;
+    if(!constant && range.x <= threshold && range.y > threshold)
+    {
+      m_pageTable[brick] = {range.x, static_cast<float>(m_resident.size())};
+      m_resident.push_back(brick);
+    }
+    else
+    {
+      m_pageTable[brick] = {range.y <= threshold ? range.y : range.x, -1.0F};
+    }
+  }
+
+  // Slots in a cube, as much as possible
+  const uint32_t max_slots = std::max(1U, maxAtlasDim / BRICK_STORAGE);
+  const uint32_t num_slots = std::max(1U, getNumResident());
+  m_slotsPerAxis           = std::min(max_slots, static_cast<uint32_t>(std::ceil(std::cbrt(double(num_slots)))));
+  m_slotsZ                 = (num_slots + m_slotsPerAxis * m_slotsPerAxis - 1) / (m_slotsPerAxis * m_slotsPerAxis);
+  return m_slotsZ <= max_slots;
+}
+
+void BrickedVolume::fillResident(const noise::FbmSettings& settings, std::vector<float>& data) const
+{
+  data.resize(static_cast<size_t>(getNumResident()) * kBrickVoxels);
+  nvh::parallel_batches<1>(
+      getNumResident(), [&](uint64_t slot) { evalBrick(m_resident[slot], settings, data.data() + slot * kBrickVoxels); },
+      std::thread::hardware_concurrency());
+}
+
+std::array<uint32_t, 3> BrickedVolume::getAtlasExtent() const
+{
+  return {m_slotsPerAxis * BRICK_STORAGE, m_slotsPerAxis * BRICK_STORAGE, m_slotsZ * BRICK_STORAGE};
+}
+
+std::array<uint32_t, 3> BrickedVolume::getSlotOffset(uint32_t slot) const
+{
+  const uint32_t n = m_slotsPerAxis;
+  return {(slot % n) * BRICK_STORAGE, ((slot / n) % n) * BRICK_STORAGE, (slot / (n * n)) * BRICK_STORAGE};
+}
+
+uint64_t BrickedVolume::getResidentBytes() const
+{
+  const std::array<uint32_t, 3> extent = getAtlasExtent();
+  return static_cast<uint64_t>(extent[0]) * extent[1] * extent[2] * sizeof(float) + getNumBricks() * sizeof(PageEntry);
+}
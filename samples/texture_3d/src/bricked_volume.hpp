@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "nvmath/nvmath.h"
+#include "perlin_noise.hpp"
+#include "shaders/device_host.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Volume made of bricks of BRICK_SIZE^3 voxels, of which only the ones the ray-marching can stop
+// in are stored.
+//
+// - The range (min/max) of each brick is computed first, on the CPU (computeRanges) or the GPU.
+// - classify() keeps the bricks crossing the threshold; all others are below or above it everywhere
+//   and collapse to a single value in the page table.
+// - Resident bricks get a slot in the atlas, a 3D image of slotsPerAxis x slotsPerAxis x N slots of
+//   BRICK_STORAGE^3 voxels. The extra voxel (apron) repeats the first voxels of the next bricks,
+//   so the linear filtering never reads outside the slot.
+//
+// The brick range includes the apron: two neighbor bricks can't be one below and the other above
+// the threshold without one of them being resident.
+//
+class BrickedVolume
+{
+public:
+  // One entry per brick, the page table image being VK_FORMAT_R32G32_SFLOAT
+  struct PageEntry
+  {
+    float value{0.0F};  // Value of a constant brick
+    float slot{-1.0F};  // Slot in the atlas, -1 if the brick is constant
+  };
+
+  void init(uint32_t size);
+
+  // Value range of all bricks, apron included. `settings.frequency` is per voxel.
+  void computeRanges(const noise::FbmSettings& settings);
+  // Ranges computed elsewhere (GPU), one per brick
+  std::vector<nvmath::vec2f>& ranges() { return m_ranges; }
+
+  // Build the page table and the list of resident bricks. Returns false if the atlas would be
+  // larger than `maxAtlasDim` voxels in one dimension.
+  bool classify(float threshold, uint32_t maxAtlasDim);
+
+  // Voxels of the resident bricks, BRICK_STORAGE^3 per slot, x being contiguous
+  void fillResident(const noise::FbmSettings& settings, std::vector<float>& data) const;
+
+  uint32_t getSize() const { return m_size; }
+  uint32_t getBricksPerAxis() const { return m_bricksPerAxis; }
+  uint32_t getNumBricks() const { return m_bricksPerAxis * m_bricksPerAxis * m_bricksPerAxis; }
+  uint32_t getNumResident() const { return static_cast<uint32_t>(m_resident.size()); }
+  uint32_t getSlotsPerAxis() const { return m_slotsPerAxis; }
+
+  const std::vector<PageEntry>& getPageTable() const { return m_pageTable; }
+  const std::vector<uint32_t>&  getResidentBricks() const { return m_resident; }
+
+  // Size of the atlas image, in voxels
+  std::array<uint32_t, 3> getAtlasExtent() const;
+  // Voxel offset of `slot` in the atlas
+  std::array<uint32_t, 3> getSlotOffset(uint32_t slot) const;
+
+  // Memory of the atlas and the page table, and of the same volume stored densely
+  uint64_t getResidentBytes() const;
+  uint64_t getDenseBytes() const { return static_cast<uint64_t>(m_size) * m_size * m_size * sizeof(float); }
+
+private:
+  std::array<uint32_t, 3> brickOrigin(uint32_t brick) const;
+  // Noise of the BRICK_STORAGE^3 voxels of `brick`; when `dst` is null, only the range is returned
+  nvmath::vec2f evalBrick(uint32_t brick, const noise::FbmSettings& settings, float* dst) const;
+
+  uint32_t m_size{0};
+  uint32_t m_bricksPerAxis{0};
+  uint32_t m_slotsPerAxis{1};
+  uint32_t m_slotsZ{1};
+
+  std::vector<nvmath::vec2f> m_ranges;     // Min/max per brick
+  std::vector<PageEntry>     m_pageTable;  // Per brick
+  std::vector<uint32_t>      m_resident;   // Brick of each atlas slot
+};
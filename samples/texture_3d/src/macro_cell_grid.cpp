@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <thread>
+
+#include "macro_cell_grid.hpp"
+#include "nvh/parallel_work.hpp"
+
+
+// Voxel index `i` of an axis of `size` voxels, following the addressing mode. Returns -1 for the border.
+static int mapVoxel(int i, int size, MacroCellGrid::Edge edge)
+{
+  if(i >= 0 && i < size)
+    return i;
+  switch(edge)
+  {
+    case MacroCellGrid::Edge::eRepeat:
+      return ((i % size) + size) % size;
+    case MacroCellGrid::Edge::eBorder:
+      return -1;
+    default:
+      return std::clamp(i, 0, size - 1);
+  }
+}
+
+static float fetchVoxel(const float* volume, int size, MacroCellGrid::Edge edge, int x, int y, int z)
+{
+  x = mapVoxel(x, size, edge);
+  y = mapVoxel(y, size, edge);
+  z = mapVoxel(z, size, edge);
+  if(x < 0 || y < 0 || z < 0)
+    return 0.0F;
+  return volume[(static_cast<size_t>(z) * size + y) * size + x];
+}
+
+void MacroCellGrid::build(const float* volume, uint32_t size, uint32_t cellSize, Edge edge)
+{
+  m_size         = size;
+  m_cellSize     = cellSize;
+  m_cellsPerAxis = cellsPerAxis(size, cellSize);
+  m_ranges.assign(getNumCells(), {0.0F, 0.0F});
+
+  const int s = static_cast<int>(size);
+  const int c = static_cast<int>(cellSize);
+  const int n = static_cast<int>(m_cellsPerAxis);
+
+  nvh::parallel_batches<1>(
+      getNumCells(),
+      [&](uint64_t cell) {
+        const int ox = static_cast<int>(cell % n) * c;
+        const int oy = static_cast<int>((cell / n) % n) * c;
+        const int oz = static_cast<int>(cell / (n * n)) * c;
+
+        // One voxel around the cell, nothing further than the border
+        nvmath::vec2f range{1e30F, -1e30F};
+        for(int z = oz - 1; z <= std::min(oz + c, s); z++)
+        {
+          for(int y = oy - 1; y <= std::min(oy + c, s); y++)
+          {
+            for(int x = ox - 1; x <= std::min(ox + c, s); x++)
+            {
+              const float v = fetchVoxel(volume, s, edge, x, y, z);
+              range.x       = std::min(range.x, v);
+              range.y       = std::max(range.y, v);
+            }
+          }
+        }
+        m_ranges[cell] = range;
+      },
+      std::thread::hardware_concurrency());
+}
+
+void MacroCellGrid::assign(uint32_t size, uint32_t cellSize, const std::vector<nvmath::vec2f>& ranges)
+{
+  m_size         = size;
+  m_cellSize     = cellSize;
+  m_cellsPerAxis = cellsPerAxis(size, cellSize);
+  m_ranges       = ranges;
+  assert(m_ranges.size() == getNumCells());
+}
+
+void MacroCellGrid::widen(float margin)
+{
+  for(nvmath::vec2f& range : m_ranges)
+  {
+    range.x -= margin;
+    range.y += margin;
+  }
+}
+
+uint32_t MacroCellGrid::countEmpty(float threshold) const
+{
+  return static_cast<uint32_t>(
+      std::count_if(m_ranges.begin(), m_ranges.end(), [threshold](const nvmath::vec2f& r) { return r.y <= threshold; }));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Same as sampleVolume(), nextStep() and rayMarching() of raster.frag
+//
+static float sampleLinear(const float* volume, int size, MacroCellGrid::Edge edge, const nvmath::vec3f& p)
+{
+  const float qx = p.x * size - 0.5F;
+  const float qy = p.y * size - 0.5F;
+  const float qz = p.z * size - 0.5F;
+  const int   x  = static_cast<int>(std::floor(qx));
+  const int   y  = static_cast<int>(std::floor(qy));
+  const int   z  = static_cast<int>(std::floor(qz));
+  const float fx = qx - x;
+  const float fy = qy - y;
+  const float fz = qz - z;
+
+  float value = 0.0F;
+  for(int k = 0; k < 2; k++)
+  {
+    for(int j = 0; j < 2; j++)
+    {
+      for(int i = 0; i < 2; i++)
+      {
+        const float w = (i ? fx : 1.0F - fx) * (j ? fy : 1.0F - fy) * (k ? fz : 1.0F - fz);
+        value += w * fetchVoxel(volume, size, edge, x + i, y + j, z + k);
+      }
+    }
+  }
+  return value;
+}
+
+// Step at which the ray leaves the cell along one axis
+static float cellExit(float origin, float stepSize, int cell, float cellSize, float size)
+{
+  if(stepSize == 0.0F)
+    return 1e30F;
+  const float bound = (static_cast<float>(cell) + (stepSize > 0.0F ? 1.0F : 0.0F)) * cellSize;
+  return ((bound + 0.5F) / size - origin) / stepSize;
+}
+
+static int nextStep(const MacroCellGrid& grid, const nvmath::vec3f& origin, const nvmath::vec3f& stepSize, int i, int numSteps,
+                    float threshold)
+{
+  const float size     = static_cast<float>(grid.getSize());
+  const float cellSize = static_cast<float>(grid.getCellSize());
+  const int   n        = static_cast<int>(grid.getCellsPerAxis());
+
+  int cell[3];
+  for(int a = 0; a < 3; a++)
+  {
+    const float p = origin[a] + stepSize[a] * static_cast<float>(i);
+    const float q = std::clamp(p * size - 0.5F, -0.5F, size - 0.5F);
+    cell[a]       = std::clamp(static_cast<int>(std::floor(q / cellSize)), 0, n - 1);
+  }
+  if(grid.getRange(cell[0], cell[1], cell[2]).y > threshold)
+    return i + 1;
+
+  float t_exit = static_cast<float>(numSteps + 1);
+  for(int a = 0; a < 3; a++)
+    t_exit = std::min(t_exit, cellExit(origin[a], stepSize[a], cell[a], cellSize, size));
+
+  // One step of margin: the skipped steps are inside the cell, whatever the rounding
+  return std::max(i + 1, static_cast<int>(std::ceil(t_exit)) - 1);
+}
+
+RayMarchResult rayMarch(const float* volume, uint32_t size, MacroCellGrid::Edge edge, const MacroCellGrid* grid,
+                        const nvmath::vec3f& p1, const nvmath::vec3f& p2, int numSteps, float threshold)
+{
+  const int           s = static_cast<int>(size);
+  const nvmath::vec3f step_size((p2.x - p1.x) / numSteps, (p2.y - p1.y) / numSteps, (p2.z - p1.z) / numSteps);
+  auto point = [&](int i) { return nvmath::vec3f(p1.x + step_size.x * i, p1.y + step_size.y * i, p1.z + step_size.z * i); };
+
+  RayMarchResult result;
+  nvmath::vec3f  hit_point  = p1;
+  nvmath::vec3f  prev_point = hit_point;
+  float          value      = sampleLinear(volume, s, edge, hit_point);
+  float          prev_value = value;
+  result.numSamples         = 1;
+
+  for(int i = 0; i < numSteps;)
+  {
+    if(value > threshold)
+    {
+      const float t   = std::clamp((threshold - prev_value) / (value - prev_value), 0.0F, 1.0F);
+      result.hit      = true;
+      result.hitPoint = nvmath::vec3f(prev_point.x + (hit_point.x - prev_point.x) * t,
+                                      prev_point.y + (hit_point.y - prev_point.y) * t,
+                                      prev_point.z + (hit_point.z - prev_point.z) * t);
+      return result;
+    }
+
+    const int next = grid ? nextStep(*grid, p1, step_size, i, numSteps, threshold) : i + 1;
+    if(next > i + 1)
+    {
+      prev_point = point(next - 1);
+      prev_value = sampleLinear(volume, s, edge, prev_point);
+      result.numSamples++;
+    }
+    else
+    {
+      prev_point = hit_point;
+      prev_value = value;
+    }
+
+    i         = next;
+    hit_point = point(i);
+    value     = sampleLinear(volume, s, edge, hit_point);
+    result.numSamples++;
+  }
+
+  return result;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "nvmath/nvmath.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Min/max of the volume per macro cell of cellSize^3 voxels, used by the ray-marching to skip the
+// cells which stay below the threshold.
+//
+// The range of a cell includes one voxel around it: all samples with the linear filtering in the
+// cell, including the half voxel at the border of the volume, are within the range. Outside of the
+// volume, voxels follow the addressing mode of the sampler.
+//
+// The builder only depends on the voxels, it is also the reference of the compute shader
+// (PERLIN_MACRO_CELLS) and of rayMarch() below.
+//
+class MacroCellGrid
+{
+public:
+  // Voxels read outside of the volume
+  enum class Edge
+  {
+    eClamp,   // Clamp to edge, mirror modes
+    eRepeat,  // Wrap around
+    eBorder,  // Transparent black border: 0
+  };
+
+  // `volume` is size^3 voxels, x being contiguous
+  void build(const float* volume, uint32_t size, uint32_t cellSize, Edge edge);
+  // Ranges computed elsewhere (bricks of BrickedVolume), one per cell
+  void assign(uint32_t size, uint32_t cellSize, const std::vector<nvmath::vec2f>& ranges);
+
+  uint32_t getSize() const { return m_size; }
+  uint32_t getCellSize() const { return m_cellSize; }
+  uint32_t getCellsPerAxis() const { return m_cellsPerAxis; }
+  uint32_t getNumCells() const { return m_cellsPerAxis * m_cellsPerAxis * m_cellsPerAxis; }
+
+  const std::vector<nvmath::vec2f>& getRanges() const { return m_ranges; }
+  const nvmath::vec2f&              getRange(uint32_t x, uint32_t y, uint32_t z) const
+  {
+    return m_ranges[(static_cast<size_t>(z) * m_cellsPerAxis + y) * m_cellsPerAxis + x];
+  }
+
+  // Grows every range by `margin` on both sides, for a volume stored with that precision
+  void widen(float margin);
+
+  // Cells the ray-marching can skip
+  uint32_t countEmpty(float threshold) const;
+
+  static uint32_t cellsPerAxis(uint32_t size, uint32_t cellSize) { return (size + cellSize - 1) / cellSize; }
+
+private:
+  uint32_t                   m_size{0};
+  uint32_t                   m_cellSize{1};
+  uint32_t                   m_cellsPerAxis{0};
+  std::vector<nvmath::vec2f> m_ranges;  // Min/max per cell
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// The ray-marching of raster.frag on a dense volume, p1 and p2 being in [0,1]. With a grid, the
+// steps in empty cells are skipped; the hit point is the same as without it.
+//
+struct RayMarchResult
+{
+  bool          hit{false};
+  nvmath::vec3f hitPoint{0.0F};
+  uint32_t      numSamples{0};  // Volume samples taken
+};
+
+RayMarchResult rayMarch(const float* volume, uint32_t size, MacroCellGrid::Edge edge, const MacroCellGrid* grid,
+                        const nvmath::vec3f& p1, const nvmath::vec3f& p2, int numSteps, float threshold);
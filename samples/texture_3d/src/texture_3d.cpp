@@ -28,6 +28,10 @@
 #define VMA_IMPLEMENTATION
 #define IMGUI_DEFINE_MATH_OPERATORS
 
+#include <chrono>
+#include <cmath>
+#include <limits>
+
 #include "backends/imgui_impl_vulkan.h"
 #include "glm/gtc/noise.hpp"
 #include "nvh/primitives.hpp"
@@ -43,7 +47,14 @@
 #include "nvvkhl/element_testing.hpp"
 #include "nvvkhl/gbuffer.hpp"
 #include "nvvkhl/shaders/dh_comp.h"
+#include "nvh/nvprint.hpp"
+#include "nvh/parallel_work.hpp"
+#include "nvh/timesampler.hpp"
+#include "perlin_noise.hpp"
 #include "shaders/device_host.h"
+#include "bricked_volume.hpp"
+#include "macro_cell_grid.hpp"
+#include "volume_format.hpp"
 
 
 #if USE_HLSL
@@ -78,6 +89,8 @@ class Texture3dSample : public nvvkhl::IAppElement
   {
     uint32_t             powerOfTwoSize = 6;
     bool                 useGpu         = true;
+    bool                 bricked        = false;
+    int                  format         = VOLUME_R32F;  // Dense volume
     VkFilter             magFilter      = VK_FILTER_LINEAR;
     VkSamplerAddressMode addressMode    = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
     PerlinSettings       perlin         = PerlinDefaultValues();
@@ -85,6 +98,7 @@ class Texture3dSample : public nvvkhl::IAppElement
     nvmath::vec3f        toLight        = {1.F, 1.F, 1.F};
     int                  steps          = 100;
     float                threshold      = 0.05f;
+    bool                 skipEmpty      = true;
     nvmath::vec4f        surfaceColor   = {0.8F, 0.8F, 0.8F, 1.0F};
     uint32_t             getSize() { return 1 << powerOfTwoSize; }
     uint32_t             getTotalSize() { return getSize() * getSize() * getSize(); }
@@ -108,6 +122,19 @@ public:
 
     m_settings.perlin = PerlinDefaultValues();
 
+    // The compute shader writes the volume without format qualifier, which needs
+    // shaderStorageImageWriteWithoutFormat. nvvk::Context enables the supported core features when
+    // creating the device; without this one, the compute pipeline isn't created and the volumes are
+    // made on the CPU.
+    VkPhysicalDeviceFeatures features{};
+    vkGetPhysicalDeviceFeatures(m_app->getPhysicalDevice(), &features);
+    m_storageWithoutFormat = features.shaderStorageImageWriteWithoutFormat == VK_TRUE;
+    if(!m_storageWithoutFormat)
+    {
+      LOGE("shaderStorageImageWriteWithoutFormat is not supported, the volume is made on the CPU\n");
+      m_settings.useGpu = false;
+    }
+
     createComputePipeline();
     createTexture();
     createVkBuffers();
@@ -152,7 +179,23 @@ public:
     std::string s_size = "Texture Size: " + std::to_string(1 << s.powerOfTwoSize) + std::string("^3");
     ImGui::Text("Perlin");
     PE::begin();
-    redoTexture |= PE::entry(s_size, [&] { return ImGui::SliderInt(s_size.c_str(), (int*)&s.powerOfTwoSize, 4, 7); });
+    redoTexture |= PE::entry(
+        "Bricked",
+        [&] {
+          bool changed = ImGui::Checkbox("##5", &s.bricked);
+          if(changed && !s.bricked)
+            s.powerOfTwoSize = std::min(s.powerOfTwoSize, 9U);
+          return changed;
+        },
+        "Store only the 32^3 bricks crossing the threshold, the others being a single value");
+    ImGui::BeginDisabled(s.bricked);
+    redoTexture |= PE::entry(
+        "Format", [&] { return ImGui::Combo("##7", &s.format, "R32 Float\0R16 Float\0R8 Unorm\0R8 Snorm\0BC4\0"); },
+        "Storage of the dense volume, the values being normalized to the range of the format");
+    ImGui::EndDisabled();
+    redoTexture |= PE::entry(s_size, [&] {
+      return ImGui::SliderInt(s_size.c_str(), (int*)&s.powerOfTwoSize, 4, s.bricked ? 10 : 9);
+    });
     m_dirty |= PE::entry(
         "Octave", [&] { return ImGui::SliderInt("##3", (int*)&s.perlin.octave, 1, 8); }, "Looping the noise n-times");
     m_dirty |= PE::entry(
@@ -163,18 +206,45 @@ public:
         "Frequency",
         [&] { return ImGui::SliderFloat("##2", &s.perlin.frequency, 0.1F, 5.F, "%.3f", ImGuiSliderFlags_Logarithmic); },
         "Number of time the noise is sampled in the domain.");
+    ImGui::BeginDisabled(!m_storageWithoutFormat);
     m_dirty |= PE::entry(
         "Gpu Creation", [&] { return ImGui::Checkbox("##4", &s.useGpu); }, "Use compute shader to generate the texture data");
+    ImGui::EndDisabled();
     PE::end();
+    ImGui::BeginDisabled(s.bricked);
+    if(ImGui::Button("Benchmark"))
+    {
+      benchmarkPerlin();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    if(ImGui::Button("Bricked Memory Report"))
+    {
+      reportBrickedMemory();
+    }
+    ImGui::SameLine();
+    if(ImGui::Button("Format Report"))
+    {
+      reportVolumeFormats();
+    }
     /// ----
     ImGui::Text("Ray Marching");
     PE::begin();
-    PE::entry(
+    bool threshold_changed = PE::entry(
         "Threshold", [&] { return ImGui::SliderFloat("##1", &m_settings.threshold, -1.0F, 1.0); },
         "Values below the threshold are ignored. High Power value is needed, for the threshold to be effective.");
     PE::entry(
         "Steps", [&] { return ImGui::SliderInt("##2", (int*)&m_settings.steps, 1, 500); }, "Number of maximum steps.");
+    PE::entry(
+        "Skip Empty Space", [&] { return ImGui::Checkbox("##3", &m_settings.skipEmpty); },
+        "Skip the macro cells of the volume which are below the threshold");
     PE::end();
+    ImGui::BeginDisabled(s.bricked);
+    if(ImGui::Button("Skipping Report"))
+    {
+      reportEmptySpaceSkipping();
+    }
+    ImGui::EndDisabled();
     /// ----
     ImGui::Text("Presets");
     PE::begin();
@@ -244,10 +314,16 @@ public:
     }
     PE::end();
 
+    // The resident bricks depend on the noise and on the threshold
+    if(s.bricked && (m_dirty || threshold_changed))
+    {
+      redoTexture = true;
+    }
+
     if(redoTexture)
     {
       vkDeviceWaitIdle(m_device);
-      m_alloc->destroy(m_texture);
+      destroyTexture();
       createTexture();
     }
 
@@ -270,7 +346,7 @@ public:
   {
     const nvvk::DebugUtil::ScopedCmdLabel sdbg = m_dutil->DBG_SCOPE(cmd);
 
-    if(m_dirty)
+    if(m_dirty && !m_settings.bricked)  // Bricks are regenerated in createTexture()
     {
       setData(cmd);
     }
@@ -308,10 +384,17 @@ public:
     {
       // Push constant information
       PushConstant pushConstant{};
-      pushConstant.threshold = m_settings.threshold;
-      pushConstant.steps     = m_settings.steps;
-      pushConstant.color     = m_settings.surfaceColor;
-      pushConstant.transfo   = nvmath::mat4f(1);  // Identity
+      pushConstant.threshold     = m_settings.threshold;
+      pushConstant.steps         = m_settings.steps;
+      pushConstant.color         = m_settings.surfaceColor;
+      pushConstant.transfo       = nvmath::mat4f(1);  // Identity
+      pushConstant.size          = static_cast<int>(m_settings.getSize());
+      pushConstant.bricksPerAxis = m_settings.bricked ? static_cast<int>(m_bricked.getBricksPerAxis()) : 0;
+      pushConstant.slotsPerAxis  = static_cast<int>(m_bricked.getSlotsPerAxis());
+      pushConstant.cellSize      = static_cast<int>(m_cellSize);
+      pushConstant.cellsPerAxis  = m_settings.skipEmpty ? static_cast<int>(m_cellsPerAxis) : 0;
+      pushConstant.decodeScale   = 1.0F / m_encoding.scale;
+      pushConstant.decodeOffset  = m_encoding.offset;
       vkCmdPushConstants(cmd, m_dsetRaster->getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
                          0, sizeof(PushConstant), &pushConstant);
 
@@ -335,36 +418,42 @@ private:
 
     assert(!m_texture.image);
 
-    VkCommandBuffer cmd = m_app->createTempCmdBuffer();
-
-    uint32_t realSize = m_settings.getSize();
+    if(m_settings.bricked)
+    {
+      createBrickedTexture();
+    }
+    else
+    {
+      createDenseTexture();
+    }
 
-    VkFormat imgFormat = VK_FORMAT_R32_SFLOAT;
+    // Debugging information
+    m_dutil->setObjectName(m_texture.image, "Image");
+    m_dutil->setObjectName(m_texture.descriptor.sampler, "Sampler");
+    m_descriptorSet = ImGui_ImplVulkan_AddTexture(m_texture.descriptor.sampler, m_texture.descriptor.imageView,
+                                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  }
 
+  // 3D image with its view and sampler, in VK_IMAGE_LAYOUT_UNDEFINED
+  nvvk::Texture createVolumeTexture(const VkExtent3D&          extent,
+                                    VkFormat                   format,
+                                    VkImageUsageFlags          usage,
+                                    const VkSamplerCreateInfo& samplerInfo)
+  {
     VkImageCreateInfo create_info{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
-    create_info.imageType     = VK_IMAGE_TYPE_3D;
-    create_info.format        = imgFormat;
-    create_info.mipLevels     = 1;
-    create_info.arrayLayers   = 1;
-    create_info.samples       = VK_SAMPLE_COUNT_1_BIT;
-    create_info.extent.width  = realSize;
-    create_info.extent.height = realSize;
-    create_info.extent.depth  = realSize;
-    create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-                        | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-
-
-    VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
-    sampler_info.addressModeU = m_settings.addressMode;
-    sampler_info.addressModeV = m_settings.addressMode;
-    sampler_info.addressModeW = m_settings.addressMode;
-    sampler_info.magFilter    = m_settings.magFilter;
-    nvvk::Image texImage      = m_alloc->createImage(create_info);
+    create_info.imageType   = VK_IMAGE_TYPE_3D;
+    create_info.format      = format;
+    create_info.mipLevels   = 1;
+    create_info.arrayLayers = 1;
+    create_info.samples     = VK_SAMPLE_COUNT_1_BIT;
+    create_info.extent      = extent;
+    create_info.usage       = usage;
+    nvvk::Image texImage    = m_alloc->createImage(create_info);
 
     VkImageViewCreateInfo view_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
     view_info.pNext                           = nullptr;
     view_info.image                           = texImage.image;
-    view_info.format                          = imgFormat;
+    view_info.format                          = format;
     view_info.viewType                        = VK_IMAGE_VIEW_TYPE_3D;
     view_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
     view_info.subresourceRange.baseMipLevel   = 0;
@@ -372,36 +461,523 @@ private:
     view_info.subresourceRange.baseArrayLayer = 0;
     view_info.subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
 
-    m_texture                        = m_alloc->createTexture(texImage, view_info, sampler_info);
+    return m_alloc->createTexture(texImage, view_info, samplerInfo);
+  }
+
+  static constexpr VkImageUsageFlags kVolumeUsage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT
+                                                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+  static VkFormat getVkFormat(int format)
+  {
+    switch(format)
+    {
+      case VOLUME_R16F:
+        return VK_FORMAT_R16_SFLOAT;
+      case VOLUME_R8_UNORM:
+        return VK_FORMAT_R8_UNORM;
+      case VOLUME_R8_SNORM:
+        return VK_FORMAT_R8_SNORM;
+      case VOLUME_BC4:
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+      default:
+        return VK_FORMAT_R32_SFLOAT;
+    }
+  }
+
+  // BC4 in 3D images is optional
+  bool isVolumeFormatSupported(int format)
+  {
+    VkImageFormatProperties properties{};
+    return vkGetPhysicalDeviceImageFormatProperties(m_app->getPhysicalDevice(), getVkFormat(format), VK_IMAGE_TYPE_3D,
+                                                    VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                    0, &properties)
+           == VK_SUCCESS;
+  }
+
+  // The compute shader writes all formats without format qualifier
+  bool canWriteFromShader(VkFormat format)
+  {
+    if(!m_storageWithoutFormat)
+      return false;
+
+    VkFormatProperties properties{};
+    vkGetPhysicalDeviceFormatProperties(m_app->getPhysicalDevice(), format, &properties);
+    return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+  }
+
+  void createDenseTexture()
+  {
+    VkCommandBuffer cmd = m_app->createTempCmdBuffer();
+
+    uint32_t realSize = m_settings.getSize();
+
+    VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.addressModeU = m_settings.addressMode;
+    sampler_info.addressModeV = m_settings.addressMode;
+    sampler_info.addressModeW = m_settings.addressMode;
+    sampler_info.magFilter    = m_settings.magFilter;
+
+    if(!isVolumeFormatSupported(m_settings.format))
+    {
+      LOGE("Format %d not supported in 3D images, using R8 Unorm\n", m_settings.format);
+      m_settings.format = VOLUME_R8_UNORM;
+    }
+
+    // Without storage support for the format, the volume is made on the CPU, as BC4 always is
+    const VkFormat format = getVkFormat(m_settings.format);
+    m_gpuWritable         = canWriteFromShader(format);
+    if(!m_gpuWritable && !volume::isBlockCompressed(m_settings.format))
+    {
+      LOGE("Format %d can't be a storage image, the volume is made on the CPU\n", m_settings.format);
+    }
+
+    const VkImageUsageFlags usage = m_gpuWritable ? kVolumeUsage : (kVolumeUsage & ~VK_IMAGE_USAGE_STORAGE_BIT);
+    m_texture = createVolumeTexture({realSize, realSize, realSize}, format, usage, sampler_info);
     m_texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
+    // Not used by the dense volume, but the shaders access them
+    createPageTable(cmd, {BrickedVolume::PageEntry{}}, 1);
+    createBrickBuffers(cmd, {0U});
+
+    // Macro cells, written by setData()
+    m_cellSize       = MACRO_CELL_SIZE;
+    m_cellsPerAxis   = MacroCellGrid::cellsPerAxis(realSize, MACRO_CELL_SIZE);
+    const size_t num = static_cast<size_t>(m_cellsPerAxis) * m_cellsPerAxis * m_cellsPerAxis;
+    m_cellRanges     = m_alloc->createBuffer(num * sizeof(nvmath::vec2f),
+                                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_dutil->DBG_NAME(m_cellRanges.buffer);
+
     // The descriptors
-    m_dsetCompWrites.clear();
-    m_dsetCompWrites.emplace_back(m_dsetCompute->makeWrite(0, 0, &m_texture.descriptor));
+    setComputeWrites();
 
     nvvk::cmdBarrierImageLayout(cmd, m_texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
     setData(cmd);
 
     m_app->submitAndWaitTempCmdBuffer(cmd);
+  }
 
-    // Debugging information
-    m_dutil->setObjectName(m_texture.image, "Image");
-    m_dutil->setObjectName(m_texture.descriptor.sampler, "Sampler");
-    m_descriptorSet = ImGui_ImplVulkan_AddTexture(m_texture.descriptor.sampler, m_texture.descriptor.imageView,
-                                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  //--------------------------------------------------------------------------------------------------
+  // Bricked volume: the range of every brick is computed first, then only the bricks crossing the
+  // threshold are generated in the atlas. The memory is the one of the resident bricks, which allows
+  // volumes far larger than the dense texture.
+  //
+  void createBrickedTexture()
+  {
+    const uint32_t size = m_settings.getSize();
+    m_bricked.init(size);
+    m_encoding = {};  // The atlas is always R32F
+
+    if(m_settings.useGpu)
+    {
+      computeBrickRangesGpu(m_bricked);
+    }
+    else
+    {
+      m_bricked.computeRanges(getFbmSettings());
+    }
+
+    if(!m_bricked.classify(m_settings.threshold, getMaxImageDimension3D()))
+    {
+      LOGE("Too many resident bricks (%u) for the atlas\n", m_bricked.getNumResident());
+    }
+
+    VkCommandBuffer cmd = m_app->createTempCmdBuffer();
+
+    // Atlas: the samples never cross the border of a slot
+    VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.magFilter    = m_settings.magFilter;
+
+    const std::array<uint32_t, 3> extent = m_bricked.getAtlasExtent();
+    m_texture = createVolumeTexture({extent[0], extent[1], extent[2]}, VK_FORMAT_R32_SFLOAT, kVolumeUsage, sampler_info);
+    m_texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    nvvk::cmdBarrierImageLayout(cmd, m_texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+    createPageTable(cmd, m_bricked.getPageTable(), m_bricked.getBricksPerAxis());
+    createBrickBuffers(cmd, m_bricked.getResidentBricks().empty() ? std::vector<uint32_t>{0U} : m_bricked.getResidentBricks());
+
+    // The bricks are the macro cells: their range includes the apron
+    m_cells.assign(size, BRICK_SIZE, m_bricked.ranges());
+    m_cellSize     = BRICK_SIZE;
+    m_cellsPerAxis = m_cells.getCellsPerAxis();
+    m_cellRanges   = m_alloc->createBuffer(cmd, m_cells.getRanges(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_dutil->DBG_NAME(m_cellRanges.buffer);
+    setComputeWrites();
+
+    if(m_bricked.getNumResident() > 0)
+    {
+      if(m_settings.useGpu)
+      {
+        runCompute(cmd, PERLIN_BRICK_FILL);
+      }
+      else
+      {
+        std::vector<float> voxels;
+        m_bricked.fillResident(getFbmSettings(), voxels);
+
+        const VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        const VkExtent3D               brick_extent{BRICK_STORAGE, BRICK_STORAGE, BRICK_STORAGE};
+        const size_t                   brick_voxels = size_t(BRICK_STORAGE) * BRICK_STORAGE * BRICK_STORAGE;
+        nvvk::cmdBarrierImageLayout(cmd, m_texture.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+        nvvk::StagingMemoryManager* staging = m_alloc->getStaging();
+        for(uint32_t slot = 0; slot < m_bricked.getNumResident(); slot++)
+        {
+          const std::array<uint32_t, 3> o = m_bricked.getSlotOffset(slot);
+          const VkOffset3D offset{static_cast<int32_t>(o[0]), static_cast<int32_t>(o[1]), static_cast<int32_t>(o[2])};
+          staging->cmdToImage(cmd, m_texture.image, offset, brick_extent, subresource, brick_voxels * sizeof(float),
+                              voxels.data() + slot * brick_voxels);
+        }
+
+        nvvk::cmdBarrierImageLayout(cmd, m_texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+      }
+    }
+
+    m_app->submitAndWaitTempCmdBuffer(cmd);
+    m_dirty = false;
+
+    logBrickedMemory(m_bricked);
+  }
+
+  // Value range of all bricks with the compute shader, read back on the host
+  void computeBrickRangesGpu(BrickedVolume& bricked)
+  {
+    const uint32_t num_bricks = bricked.getNumBricks();
+
+    VkCommandBuffer cmd = m_app->createTempCmdBuffer();
+
+    // Only the ranges are written, the image and the resident list are placeholders
+    const VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    nvvk::Texture             dummy = createVolumeTexture({1, 1, 1}, VK_FORMAT_R32_SFLOAT, kVolumeUsage, sampler_info);
+    dummy.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    nvvk::cmdBarrierImageLayout(cmd, dummy.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    nvvk::Buffer ranges   = m_alloc->createBuffer(num_bricks * sizeof(nvmath::vec2f), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    nvvk::Buffer resident = m_alloc->createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    const VkDescriptorBufferInfo      ranges_info{ranges.buffer, 0, VK_WHOLE_SIZE};
+    const VkDescriptorBufferInfo      resident_info{resident.buffer, 0, VK_WHOLE_SIZE};
+    std::vector<VkWriteDescriptorSet> writes;
+    writes.emplace_back(m_dsetCompute->makeWrite(0, 0, &dummy.descriptor));
+    writes.emplace_back(m_dsetCompute->makeWrite(0, 1, &ranges_info));
+    writes.emplace_back(m_dsetCompute->makeWrite(0, 2, &resident_info));
+    writes.emplace_back(m_dsetCompute->makeWrite(0, 3, &dummy.descriptor));
+
+    PerlinSettings perlin = m_settings.perlin;
+    perlin.frequency /= float(bricked.getSize());
+    perlin.mode          = PERLIN_BRICK_RANGES;
+    perlin.bricksPerAxis = static_cast<int>(bricked.getBricksPerAxis());
+    dispatchPerlin(cmd, perlin, writes, {num_bricks, 1, 1});
+
+    // Make the ranges visible to the host
+    VkMemoryBarrier mem_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    mem_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    mem_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &mem_barrier, 0,
+                         nullptr, 0, nullptr);
+    m_app->submitAndWaitTempCmdBuffer(cmd);
+
+    const auto* mapped = static_cast<const nvmath::vec2f*>(m_alloc->map(ranges));
+    std::copy(mapped, mapped + num_bricks, bricked.ranges().begin());
+    m_alloc->unmap(ranges);
+
+    m_alloc->destroy(dummy);
+    m_alloc->destroy(ranges);
+    m_alloc->destroy(resident);
+  }
+
+  // Page table of the bricked volume, one VK_FORMAT_R32G32_SFLOAT texel per brick
+  void createPageTable(VkCommandBuffer cmd, const std::vector<BrickedVolume::PageEntry>& entries, uint32_t bricksPerAxis)
+  {
+    VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    const VkExtent3D extent{bricksPerAxis, bricksPerAxis, bricksPerAxis};
+    m_pageTable = createVolumeTexture(extent, VK_FORMAT_R32G32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                      sampler_info);
+    m_pageTable.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    const VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    nvvk::cmdBarrierImageLayout(cmd, m_pageTable.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    m_alloc->getStaging()->cmdToImage(cmd, m_pageTable.image, {0, 0, 0}, extent, subresource,
+                                      entries.size() * sizeof(BrickedVolume::PageEntry), entries.data());
+    nvvk::cmdBarrierImageLayout(cmd, m_pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    m_dutil->setObjectName(m_pageTable.image, "PageTable");
+  }
+
+  // Brick of each atlas slot, for the compute shader
+  void createBrickBuffers(VkCommandBuffer cmd, const std::vector<uint32_t>& residentBricks)
+  {
+    m_residentBricks = m_alloc->createBuffer(cmd, residentBricks, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_dutil->DBG_NAME(m_residentBricks.buffer);
+  }
+
+  void setComputeWrites()
+  {
+    m_rangesInfo   = {m_cellRanges.buffer, 0, VK_WHOLE_SIZE};
+    m_residentInfo = {m_residentBricks.buffer, 0, VK_WHOLE_SIZE};
+    m_dsetCompWrites.clear();
+    m_dsetCompWrites.emplace_back(m_dsetCompute->makeWrite(0, 0, &m_texture.descriptor));
+    m_dsetCompWrites.emplace_back(m_dsetCompute->makeWrite(0, 1, &m_rangesInfo));
+    m_dsetCompWrites.emplace_back(m_dsetCompute->makeWrite(0, 2, &m_residentInfo));
+    m_dsetCompWrites.emplace_back(m_dsetCompute->makeWrite(0, 3, &m_texture.descriptor));
+  }
+
+  void destroyTexture()
+  {
+    m_alloc->destroy(m_texture);
+    m_alloc->destroy(m_pageTable);
+    m_alloc->destroy(m_cellRanges);
+    m_alloc->destroy(m_residentBricks);
+  }
+
+  uint32_t getMaxImageDimension3D()
+  {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(m_app->getPhysicalDevice(), &properties);
+    return properties.limits.maxImageDimension3D;
+  }
+
+  noise::FbmSettings getFbmSettings()
+  {
+    const auto size = static_cast<float>(m_settings.getSize());
+    return {m_settings.perlin.octave, m_settings.perlin.power, m_settings.perlin.frequency / size};
+  }
+
+  // Voxels read outside of the volume by the sampler
+  MacroCellGrid::Edge getEdge() const
+  {
+    switch(m_settings.addressMode)
+    {
+      case VK_SAMPLER_ADDRESS_MODE_REPEAT:
+        return MacroCellGrid::Edge::eRepeat;
+      case VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER:
+        return MacroCellGrid::Edge::eBorder;
+      default:
+        return MacroCellGrid::Edge::eClamp;
+    }
+  }
+
+  // Min/max of all ranges. From the bricks, it includes their apron: a bit wider than the volume.
+  static nvmath::vec2f getRange(const std::vector<nvmath::vec2f>& ranges)
+  {
+    nvmath::vec2f range{1e30F, -1e30F};
+    for(const nvmath::vec2f& r : ranges)
+    {
+      range.x = std::min(range.x, r.x);
+      range.y = std::max(range.y, r.y);
+    }
+    return range;
+  }
+
+  static void logBrickedMemory(const BrickedVolume& bricked)
+  {
+    const uint32_t num_bricks = bricked.getNumBricks();
+    const double   resident   = double(bricked.getResidentBytes()) / (1024.0 * 1024.0);
+    const double   dense      = double(bricked.getDenseBytes()) / (1024.0 * 1024.0);
+    LOGI("Bricked volume %u^3: %u of %u bricks resident (%.1f%%), %u collapsed to a value\n", bricked.getSize(),
+         bricked.getNumResident(), num_bricks, 100.0 * bricked.getNumResident() / num_bricks, num_bricks - bricked.getNumResident());
+    LOGI(" - Resident : %10.2f MB (atlas and page table)\n", resident);
+    LOGI(" - Dense    : %10.2f MB (x%.1f)\n", dense, dense / std::max(resident, 1e-6));
+  }
+
+  // Memory of the bricked volume at 512^3 and 1024^3, with the current noise and threshold. Only
+  // the brick ranges are computed, nothing is allocated on the GPU.
+  void reportBrickedMemory()
+  {
+    for(uint32_t size : {512U, 1024U})
+    {
+      BrickedVolume      bricked;
+      noise::FbmSettings settings = getFbmSettings();
+      settings.frequency          = m_settings.perlin.frequency / static_cast<float>(size);
+      bricked.init(size);
+      if(m_settings.useGpu)
+        computeBrickRangesGpu(bricked);
+      else
+        bricked.computeRanges(settings);
+      bricked.classify(m_settings.threshold, getMaxImageDimension3D());
+      logBrickedMemory(bricked);
+    }
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Samples per ray with and without the macro cells, with the CPU version of the ray-marching. The
+  // rays are parallel, along the camera direction, and cover the cube.
+  //
+  void reportEmptySpaceSkipping()
+  {
+    using clock = std::chrono::high_resolution_clock;
+
+    const uint32_t     size = m_settings.getSize();
+    std::vector<float> volume(m_settings.getTotalSize());
+    fillPerlinImage(volume);
+
+    MacroCellGrid grid;
+    auto          t0 = clock::now();
+    grid.build(volume.data(), size, MACRO_CELL_SIZE, getEdge());
+    auto t1 = clock::now();
+
+    nvmath::vec3f eye, center, up;
+    CameraManip.getLookat(eye, center, up);
+    const nvmath::vec3f dir   = nvmath::normalize(center - eye);
+    const nvmath::vec3f right = nvmath::normalize(nvmath::cross(dir, up));
+    const nvmath::vec3f upv   = nvmath::cross(right, dir);
+
+    struct RowStats
+    {
+      uint64_t rays{0};
+      uint64_t samples{0};
+      uint64_t samplesSkipping{0};
+      uint32_t mismatches{0};
+    };
+    const uint32_t            resolution = 256;
+    const MacroCellGrid::Edge edge       = getEdge();
+    const int                 steps      = m_settings.steps;
+    const float               threshold  = m_settings.threshold;
+    std::vector<RowStats>     rows(resolution);
+
+    auto t2 = clock::now();
+    nvh::parallel_batches<1>(
+        resolution,
+        [&](uint64_t y) {
+          RowStats& row = rows[y];
+          for(uint32_t x = 0; x < resolution; x++)
+          {
+            // Unit cube [-0.5,0.5], the rays starting outside of its bounding sphere
+            const float         u      = (float(x) + 0.5F) / float(resolution) * 1.8F - 0.9F;
+            const float         v      = (float(y) + 0.5F) / float(resolution) * 1.8F - 0.9F;
+            const nvmath::vec3f origin = right * u + upv * v - dir * 2.0F;
+
+            float t_near = -1e30F;
+            float t_far  = 1e30F;
+            for(int a = 0; a < 3; a++)
+            {
+              const float inv = 1.0F / dir[a];
+              const float ta  = (-0.5F - origin[a]) * inv;
+              const float tb  = (0.5F - origin[a]) * inv;
+              t_near          = std::max(t_near, std::min(ta, tb));
+              t_far           = std::min(t_far, std::max(ta, tb));
+            }
+            if(t_near > t_far)
+              continue;
+
+            const nvmath::vec3f  p1 = origin + dir * t_near + nvmath::vec3f(0.5F);
+            const nvmath::vec3f  p2 = origin + dir * t_far + nvmath::vec3f(0.5F);
+            const RayMarchResult r0 = rayMarch(volume.data(), size, edge, nullptr, p1, p2, steps, threshold);
+            const RayMarchResult r1 = rayMarch(volume.data(), size, edge, &grid, p1, p2, steps, threshold);
+            row.rays++;
+            row.samples += r0.numSamples;
+            row.samplesSkipping += r1.numSamples;
+            row.mismatches += (r0.hit != r1.hit || (r0.hit && nvmath::length(r0.hitPoint - r1.hitPoint) > 1e-4F)) ? 1 : 0;
+          }
+        },
+        std::thread::hardware_concurrency());
+    auto t3 = clock::now();
+
+    RowStats total;
+    for(const RowStats& row : rows)
+    {
+      total.rays += row.rays;
+      total.samples += row.samples;
+      total.samplesSkipping += row.samplesSkipping;
+      total.mismatches += row.mismatches;
+    }
+    const double rays = double(std::max(total.rays, uint64_t(1)));
+
+    LOGI("Empty space skipping: %u^3, %u^3 voxels per cell, threshold %.3f, %d steps\n", size, MACRO_CELL_SIZE,
+         m_settings.threshold, m_settings.steps);
+    LOGI(" - Empty cells : %u of %u (%.1f%%)\n", grid.countEmpty(m_settings.threshold), grid.getNumCells(),
+         100.0 * grid.countEmpty(m_settings.threshold) / grid.getNumCells());
+    LOGI(" - Build       : %8.2f ms\n", std::chrono::duration<double, std::milli>(t1 - t0).count());
+    LOGI(" - Samples/ray : %8.2f -> %.2f (x%.2f), %llu rays in %.2f ms\n", double(total.samples) / rays,
+         double(total.samplesSkipping) / rays, double(total.samples) / double(std::max(total.samplesSkipping, uint64_t(1))),
+         static_cast<unsigned long long>(total.rays), std::chrono::duration<double, std::milli>(t3 - t2).count());
+    LOGI(" - Hit changes : %u\n", total.mismatches);
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Memory, conversion and upload time, and error against the float values of each format, for a
+  // 512^3 volume with the current noise and threshold. The upload goes to a temporary image.
+  //
+  void reportVolumeFormats()
+  {
+    using clock = std::chrono::high_resolution_clock;
+
+    const uint32_t     size  = 512;
+    const size_t       count = size_t(size) * size * size;
+    noise::FbmSettings fbm   = getFbmSettings();
+    fbm.frequency            = m_settings.perlin.frequency / static_cast<float>(size);
+
+    std::vector<float> reference(count);
+    noise::fillFbmVolume(reference.data(), size, size, size, fbm);
+    const nvmath::vec2f range = volume::computeRange(reference.data(), count);
+
+    vkDeviceWaitIdle(m_device);
+    LOGI("Volume formats: %u^3, values in [%.3f, %.3f], threshold %.3f\n", size, range.x, range.y, m_settings.threshold);
+    LOGI("  %-10s %10s %10s %10s %12s %12s %10s %8s\n", "Format", "MB", "Encode ms", "Upload ms", "Max error", "RMS error",
+         "PSNR dB", "Flips");
+
+    const char*          names[] = {"R32 Float", "R16 Float", "R8 Unorm", "R8 Snorm", "BC4"};
+    std::vector<uint8_t> encoded;
+    for(int format = VOLUME_R32F; format <= VOLUME_BC4; format++)
+    {
+      if(!isVolumeFormatSupported(format))
+      {
+        LOGI("  %-10s not supported in 3D images\n", names[format]);
+        continue;
+      }
+      auto                   t0       = clock::now();
+      const volume::Encoding encoding = volume::makeEncoding(format, range);
+      encoded.resize(volume::volumeBytes(format, size));
+      volume::encodeVolume(format, encoding, reference.data(), encoded.data(), size);
+      auto t1 = clock::now();
+
+      // Staging copy and transfer, as in setData()
+      const VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+      nvvk::Texture   image = createVolumeTexture({size, size, size}, getVkFormat(format),
+                                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, sampler_info);
+      VkCommandBuffer cmd   = m_app->createTempCmdBuffer();
+      nvvk::cmdBarrierImageLayout(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+      const VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+      m_alloc->getStaging()->cmdToImage(cmd, image.image, {0, 0, 0}, {size, size, size}, subresource, encoded.size(),
+                                        encoded.data());
+      m_app->submitAndWaitTempCmdBuffer(cmd);
+      auto t2 = clock::now();
+      m_alloc->finalizeAndReleaseStaging();
+      m_alloc->destroy(image);
+
+      // Decoded as the device samples it; the peak of the PSNR is the range of the values
+      const volume::ErrorStats stats = volume::compareVolume(format, encoding, encoded.data(), reference.data(), size, m_settings.threshold);
+      const double             psnr  = stats.rmsError > 0.0 ? 20.0 * std::log10(double(range.y - range.x) / stats.rmsError) :
+                                                             std::numeric_limits<double>::infinity();
+      LOGI("  %-10s %10.1f %10.2f %10.2f %12.3g %12.3g %10.2f %8llu\n", names[format], double(encoded.size()) / (1024.0 * 1024.0),
+           std::chrono::duration<double, std::milli>(t1 - t0).count(), std::chrono::duration<double, std::milli>(t2 - t1).count(),
+           stats.maxError, stats.rmsError, psnr, static_cast<unsigned long long>(stats.thresholdFlips));
+    }
+  }
+
+  // Same noise as the compute shader, evaluated 8 voxels at a time on all threads
   void fillPerlinImage(std::vector<float>& imageData)
   {
     nvh::ScopedTimer st(__FUNCTION__);
 
     uint32_t realSize = m_settings.getSize();
-    // Simple perlin noise
-    for(uint32_t x = 0; x < realSize; x++)
+    noise::fillFbmVolume(imageData.data(), realSize, realSize, realSize, getFbmSettings());
+  }
+
+  // Scalar version of fillPerlinImage(), used as reference
+  void fillPerlinImageScalar(std::vector<float>& imageData)
+  {
+    uint32_t realSize = m_settings.getSize();
+    for(uint32_t z = 0; z < realSize; z++)
     {
       for(uint32_t y = 0; y < realSize; y++)
       {
-        for(uint32_t z = 0; z < realSize; z++)
+        for(uint32_t x = 0; x < realSize; x++)
         {
           float v     = 0.0F;
           float scale = m_settings.perlin.power;
@@ -419,15 +995,74 @@ private:
     }
   }
 
+  // Compare the creation of the texture data: scalar CPU, SIMD CPU and compute shader
+  void benchmarkPerlin()
+  {
+    using clock = std::chrono::high_resolution_clock;
+
+    std::vector<float> reference(m_settings.getTotalSize());
+    std::vector<float> imageData(m_settings.getTotalSize());
+
+    auto t0 = clock::now();
+    fillPerlinImageScalar(reference);
+    auto t1 = clock::now();
+    fillPerlinImage(imageData);
+    auto t2 = clock::now();
+
+    // The compute shader, including the submission
+    vkDeviceWaitIdle(m_device);
+    VkCommandBuffer cmd = m_app->createTempCmdBuffer();
+    auto            t3  = clock::now();
+    if(m_gpuWritable)
+    {
+      runCompute(cmd);
+    }
+    m_app->submitAndWaitTempCmdBuffer(cmd);
+    auto t4 = clock::now();
+    m_dirty = true;  // Restore the texture of the current settings
+
+    float max_diff = 0.0F;
+    for(size_t i = 0; i < reference.size(); i++)
+      max_diff = std::max(max_diff, std::abs(reference[i] - imageData[i]));
+
+    const double scalar_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    const double simd_ms   = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    const double gpu_ms    = std::chrono::duration<double, std::milli>(t4 - t3).count();
+    LOGI("Perlin benchmark: %u^3, %d octaves\n", m_settings.getSize(), m_settings.perlin.octave);
+    LOGI(" - CPU scalar : %8.2f ms\n", scalar_ms);
+    LOGI(" - CPU SIMD   : %8.2f ms (x%.1f, %u threads)\n", simd_ms, scalar_ms / std::max(simd_ms, 1e-6),
+         std::thread::hardware_concurrency());
+    LOGI(" - GPU        : %8.2f ms (submit and wait)\n", gpu_ms);
+    LOGI(" - Max diff   : %g\n", max_diff);
+  }
+
   void setData(VkCommandBuffer cmd)
   {
     const nvvk::DebugUtil::ScopedCmdLabel sdbg = m_dutil->DBG_SCOPE(cmd);
     assert(m_texture.image);
 
     uint32_t realSize = m_settings.getSize();
-    if(m_settings.useGpu)
+    if(m_settings.useGpu && m_gpuWritable)
     {
-      runCompute(cmd, {realSize, realSize, realSize});
+      // The normalization needs the range of the values first
+      m_encoding = {};
+      if(m_settings.format != VOLUME_R32F)
+      {
+        BrickedVolume bricked;
+        bricked.init(realSize);
+        computeBrickRangesGpu(bricked);
+        m_encoding = volume::makeEncoding(m_settings.format, getRange(bricked.ranges()));
+      }
+
+      runCompute(cmd);
+
+      // The macro cells read the generated volume
+      VkMemoryBarrier mem_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+      mem_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      mem_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                           &mem_barrier, 0, nullptr, 0, nullptr);
+      runCompute(cmd, PERLIN_MACRO_CELLS);
     }
     else
     {
@@ -435,16 +1070,49 @@ private:
       imageData.resize(m_settings.getTotalSize());
       fillPerlinImage(imageData);
 
+      // Half, 8-bit and BC4 formats: normalized and converted before the upload
+      const int            format = m_settings.format;
+      std::vector<uint8_t> encoded;
+      const void*          upload = imageData.data();
+      float                error  = 0.0F;  // Of the stored values
+      m_encoding                  = {};
+      if(format != VOLUME_R32F)
+      {
+        m_encoding = volume::makeEncoding(format, volume::computeRange(imageData.data(), imageData.size()));
+        encoded.resize(volume::volumeBytes(format, realSize));
+        volume::encodeVolume(format, m_encoding, imageData.data(), encoded.data(), realSize);
+        upload = encoded.data();
+        error  = volume::maxError(format, m_encoding);
+        if(volume::isBlockCompressed(format))
+        {
+          // Depends on the blocks: measured
+          error = volume::compareVolume(format, m_encoding, upload, imageData.data(), realSize, m_settings.threshold).maxError;
+        }
+      }
+
       const VkOffset3D               offset{0};
       const VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
       const VkExtent3D               extent{realSize, realSize, realSize};
       nvvk::cmdBarrierImageLayout(cmd, m_texture.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
       nvvk::StagingMemoryManager* staging = m_alloc->getStaging();
-      staging->cmdToImage(cmd, m_texture.image, offset, extent, subresource, imageData.size() * sizeof(float), imageData.data());
+      staging->cmdToImage(cmd, m_texture.image, offset, extent, subresource, volume::volumeBytes(format, realSize), upload);
 
       nvvk::cmdBarrierImageLayout(cmd, m_texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+
+      // From the values before the conversion: the stored ones are within `error` of them
+      m_cells.build(imageData.data(), realSize, MACRO_CELL_SIZE, getEdge());
+      m_cells.widen(error);
+      const std::vector<nvmath::vec2f>& ranges = m_cells.getRanges();
+      staging->cmdToBuffer(cmd, m_cellRanges.buffer, 0, ranges.size() * sizeof(nvmath::vec2f), ranges.data());
     }
+
+    // Volume and macro cells used by the ray-marching
+    VkMemoryBarrier mem_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    mem_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    mem_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &mem_barrier, 0, nullptr, 0, nullptr);
     m_dirty = false;
   }
 
@@ -455,6 +1123,9 @@ private:
 
     auto& d = m_dsetCompute;
     d->addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    d->addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    d->addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    d->addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
     d->initLayout(VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR);
     m_dutil->DBG_NAME(d->getLayout());
 
@@ -463,6 +1134,10 @@ private:
     d->initPipeLayout(1, &push_constant_ranges);
     m_dutil->DBG_NAME(d->getPipeLayout());
 
+    // The shader needs shaderStorageImageWriteWithoutFormat, see onAttach()
+    if(!m_storageWithoutFormat)
+      return;
+
     VkPipelineShaderStageCreateInfo stage_info{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
     stage_info.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
     stage_info.module = nvvk::createShaderModule(m_device, comp_shd);
@@ -479,18 +1154,50 @@ private:
     vkDestroyShaderModule(m_device, comp_info.stage.module, nullptr);
   }
 
-  void runCompute(VkCommandBuffer cmd, const VkExtent3D& size)
+  // Dense volume (PERLIN_DENSE) and its macro cells (PERLIN_MACRO_CELLS), or resident bricks of the
+  // atlas (PERLIN_BRICK_FILL)
+  void runCompute(VkCommandBuffer cmd, int mode = PERLIN_DENSE)
   {
     uint32_t       realSize = m_settings.getSize();
-    auto           sdbg     = m_dutil->DBG_SCOPE(cmd);
     PerlinSettings perlin   = m_settings.perlin;
     perlin.frequency /= float(realSize);
+    perlin.mode          = mode;
+    perlin.bricksPerAxis = static_cast<int>(m_bricked.getBricksPerAxis());
+    perlin.slotsPerAxis  = static_cast<int>(m_bricked.getSlotsPerAxis());
+    perlin.encodeScale   = m_encoding.scale;
+    perlin.encodeOffset  = m_encoding.offset;
+
+    if(mode == PERLIN_BRICK_FILL)
+    {
+      // One workgroup per slot and z-slice
+      dispatchPerlin(cmd, perlin, m_dsetCompWrites, {m_bricked.getNumResident(), BRICK_STORAGE, 1});
+    }
+    else if(mode == PERLIN_MACRO_CELLS)
+    {
+      // One workgroup per cell
+      perlin.size         = static_cast<int>(realSize);
+      perlin.cellsPerAxis = static_cast<int>(m_cellsPerAxis);
+      perlin.edge         = static_cast<int>(getEdge());
+      dispatchPerlin(cmd, perlin, m_dsetCompWrites, {m_cellsPerAxis * m_cellsPerAxis * m_cellsPerAxis, 1, 1});
+    }
+    else
+    {
+      VkExtent2D group_counts = getGroupCounts({realSize, realSize});
+      dispatchPerlin(cmd, perlin, m_dsetCompWrites, {group_counts.width, group_counts.height, realSize});
+    }
+  }
+
+  void dispatchPerlin(VkCommandBuffer                          cmd,
+                      const PerlinSettings&                    perlin,
+                      const std::vector<VkWriteDescriptorSet>& writes,
+                      const VkExtent3D&                        groups)
+  {
+    auto sdbg = m_dutil->DBG_SCOPE(cmd);
     vkCmdPushConstants(cmd, m_dsetCompute->getPipeLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PerlinSettings), &perlin);
     vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_dsetCompute->getPipeLayout(), 0,
-                              static_cast<uint32_t>(m_dsetCompWrites.size()), m_dsetCompWrites.data());
+                              static_cast<uint32_t>(writes.size()), writes.data());
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
-    VkExtent2D group_counts = getGroupCounts({size.width, size.height});
-    vkCmdDispatch(cmd, group_counts.width, group_counts.height, size.depth);
+    vkCmdDispatch(cmd, groups.width, groups.height, groups.depth);
   }
 
 
@@ -504,7 +1211,7 @@ private:
     m_alloc->destroy(m_vertices);
     m_alloc->destroy(m_indices);
     m_alloc->destroy(m_frameInfo);
-    m_alloc->destroy(m_texture);
+    destroyTexture();
   }
 
   void createVkBuffers()
@@ -530,6 +1237,8 @@ private:
   {
     m_dsetRaster->addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL);
     m_dsetRaster->addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_ALL);
+    m_dsetRaster->addBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_ALL);
+    m_dsetRaster->addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
     m_dsetRaster->initLayout(VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR);
 
     const VkPushConstantRange push_constant_ranges = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
@@ -540,6 +1249,8 @@ private:
     m_descBufInfo = std::make_unique<VkDescriptorBufferInfo>(VkDescriptorBufferInfo{m_frameInfo.buffer, 0, VK_WHOLE_SIZE});
     m_dsetRastWrites.emplace_back(m_dsetRaster->makeWrite(0, 0, m_descBufInfo.get()));
     m_dsetRastWrites.emplace_back(m_dsetRaster->makeWrite(0, 1, &m_texture.descriptor));
+    m_dsetRastWrites.emplace_back(m_dsetRaster->makeWrite(0, 2, &m_pageTable.descriptor));
+    m_dsetRastWrites.emplace_back(m_dsetRaster->makeWrite(0, 3, &m_rangesInfo));
 
     VkPipelineRenderingCreateInfo prend_info{VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR};
     prend_info.colorAttachmentCount    = 1;
@@ -566,7 +1277,8 @@ private:
 
 private:
   // Local data
-  nvvk::Texture   m_texture;
+  nvvk::Texture   m_texture;    // Dense volume, or atlas of the bricks
+  nvvk::Texture   m_pageTable;  // Bricked volume: value or atlas slot per brick
   VkDevice        m_device          = VK_NULL_HANDLE;
   VkDescriptorSet m_descriptorSet   = VK_NULL_HANDLE;
   VkPipeline      m_computePipeline = VK_NULL_HANDLE;  // The graphic pipeline to render
@@ -581,6 +1293,18 @@ private:
   nvvk::Buffer m_vertices;                                      // Buffer of the vertices
   nvvk::Buffer m_indices;                                       // Buffer of the indices
   nvvk::Buffer m_frameInfo;
+  nvvk::Buffer m_cellRanges;      // Min/max per macro cell, of the dense volume or the bricks
+  nvvk::Buffer m_residentBricks;  // Brick of each atlas slot
+
+  BrickedVolume          m_bricked;
+  MacroCellGrid          m_cells;                       // CPU macro cells, see setData()
+  volume::Encoding       m_encoding;                    // Normalization of the dense volume, see volume_format.hpp
+  bool                   m_gpuWritable{true};           // The format of the dense volume can be a storage image
+  bool                   m_storageWithoutFormat{true};  // shaderStorageImageWriteWithoutFormat, needed by the compute shader
+  uint32_t               m_cellSize{MACRO_CELL_SIZE};
+  uint32_t               m_cellsPerAxis{0};
+  VkDescriptorBufferInfo m_rangesInfo{};
+  VkDescriptorBufferInfo m_residentInfo{};
 
   nvvkhl::Application*                    m_app = nullptr;
   std::vector<VkWriteDescriptorSet>       m_dsetCompWrites;
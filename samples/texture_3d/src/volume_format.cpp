@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bc_encoder.hpp"
+#include "nvh/parallel_work.hpp"
+#include "volume_format.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VOLUME_FORMAT_AVX2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VOLUME_FORMAT_NEON 1
+#endif
+
+
+namespace volume {
+
+static constexpr size_t kChunkSize = 1 << 16;  // Values per thread batch
+
+// Calls fn(begin, end) over chunks of `count`, on all threads
+template <typename F>
+static void forEachChunk(size_t count, F&& fn)
+{
+  const size_t num_chunks = (count + kChunkSize - 1) / kChunkSize;
+  nvh::parallel_batches<1>(
+      num_chunks,
+      [&](uint64_t chunk) {
+        const size_t begin = chunk * kChunkSize;
+        fn(begin, std::min(begin + kChunkSize, count));
+      },
+      std::thread::hardware_concurrency());
+}
+
+uint32_t bytesPerVoxel(int format)
+{
+  switch(format)
+  {
+    case VOLUME_R16F:
+      return 2;
+    case VOLUME_R8_UNORM:
+    case VOLUME_R8_SNORM:
+      return 1;
+    default:
+      return 4;
+  }
+}
+
+bool isBlockCompressed(int format)
+{
+  return format == VOLUME_BC4;
+}
+
+size_t volumeBytes(int format, uint32_t size)
+{
+  if(isBlockCompressed(format))
+    return bc::compressedSize(bc::Format::eBC4, size, size) * size;
+  return size_t(size) * size * size * bytesPerVoxel(format);
+}
+
+Encoding makeEncoding(int format, const nvmath::vec2f& range)
+{
+  switch(format)
+  {
+    case VOLUME_R8_UNORM:
+    case VOLUME_BC4:
+      return {1.0F / std::max(range.y - range.x, 1e-20F), range.x};
+    case VOLUME_R16F:
+    case VOLUME_R8_SNORM:
+      // Symmetric, zero stays zero
+      return {1.0F / std::max(std::max(std::abs(range.x), std::abs(range.y)), 1e-20F), 0.0F};
+    default:
+      return {};
+  }
+}
+
+// One step of the format, around 1 in normalized values
+float maxError(int format, const Encoding& encoding)
+{
+  switch(format)
+  {
+    case VOLUME_R16F:
+      return 1.0F / 2048.0F / encoding.scale;
+    case VOLUME_R8_UNORM:
+    case VOLUME_BC4:
+      return 1.0F / 255.0F / encoding.scale;
+    case VOLUME_R8_SNORM:
+      return 1.0F / 127.0F / encoding.scale;
+    default:
+      return 0.0F;
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Scalar conversions, also used for the tail of the vectorized loops
+//
+uint16_t floatToHalf(float value)
+{
+  // Round to nearest even, overflow to infinity (F. Giesen, float_to_half_fast3_rtne)
+  const uint32_t f32_infinity = 255U << 23;
+  const uint32_t f16_max      = (127U + 16U) << 23;
+  const uint32_t denorm_magic = ((127U - 15U) + (23U - 10U) + 1U) << 23;
+
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+  const uint32_t sign = f & 0x80000000U;
+  f ^= sign;
+
+  uint16_t h;
+  if(f >= f16_max)
+  {
+    h = (f > f32_infinity) ? 0x7E00 : 0x7C00;  // NaN or infinity
+  }
+  else if(f < (113U << 23))
+  {
+    // Denormal, the rounding being done by the float addition
+    float v, magic;
+    std::memcpy(&v, &f, sizeof(v));
+    std::memcpy(&magic, &denorm_magic, sizeof(magic));
+    v += magic;
+    std::memcpy(&f, &v, sizeof(f));
+    h = static_cast<uint16_t>(f - denorm_magic);
+  }
+  else
+  {
+    const uint32_t mantissa_odd = (f >> 13) & 1U;
+    f += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFFU;
+    f += mantissa_odd;
+    h = static_cast<uint16_t>(f >> 13);
+  }
+  return h | static_cast<uint16_t>(sign >> 16);
+}
+
+float halfToFloat(uint16_t value)
+{
+  const uint32_t sign     = static_cast<uint32_t>(value & 0x8000U) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1FU;
+  const uint32_t mantissa = value & 0x3FFU;
+
+  if(exponent == 0)
+  {
+    const float v = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -v : v;
+  }
+
+  uint32_t f = sign | (mantissa << 13);
+  f |= (exponent == 31) ? 0x7F800000U : (exponent + 112U) << 23;
+  float result;
+  std::memcpy(&result, &f, sizeof(result));
+  return result;
+}
+
+static inline uint8_t toUnorm8(float v)
+{
+  return static_cast<uint8_t>(std::nearbyint(std::clamp(v, 0.0F, 1.0F) * 255.0F));
+}
+
+static inline int8_t toSnorm8(float v)
+{
+  return static_cast<int8_t>(std::nearbyint(std::clamp(v, -1.0F, 1.0F) * 127.0F));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// Vectorized loops over [begin, end)
+//
+static nvmath::vec2f rangeOf(const float* values, size_t begin, size_t end)
+{
+  float  lo = 1e30F;
+  float  hi = -1e30F;
+  size_t i  = begin;
+#if defined(VOLUME_FORMAT_AVX2)
+  __m256 vlo = _mm256_set1_ps(lo);
+  __m256 vhi = _mm256_set1_ps(hi);
+  for(; i + 8 <= end; i += 8)
+  {
+    const __m256 v = _mm256_loadu_ps(values + i);
+    vlo            = _mm256_min_ps(vlo, v);
+    vhi            = _mm256_max_ps(vhi, v);
+  }
+  alignas(32) float los[8], his[8];
+  _mm256_store_ps(los, vlo);
+  _mm256_store_ps(his, vhi);
+  for(int k = 0; k < 8; k++)
+  {
+    lo = std::min(lo, los[k]);
+    hi = std::max(hi, his[k]);
+  }
+#elif defined(VOLUME_FORMAT_NEON)
+  float32x4_t vlo = vdupq_n_f32(lo);
+  float32x4_t vhi = vdupq_n_f32(hi);
+  for(; i + 4 <= end; i += 4)
+  {
+    const float32x4_t v = vld1q_f32(values + i);
+    vlo                 = vminq_f32(vlo, v);
+    vhi                 = vmaxq_f32(vhi, v);
+  }
+  lo = vminvq_f32(vlo);
+  hi = vmaxvq_f32(vhi);
+#endif
+  for(; i < end; i++)
+  {
+    lo = std::min(lo, values[i]);
+    hi = std::max(hi, values[i]);
+  }
+  return {lo, hi};
+}
+
+static void encodeHalf(const Encoding& e, const float* values, uint16_t* dst, size_t begin, size_t end)
+{
+  size_t i = begin;
+#if defined(VOLUME_FORMAT_AVX2) && defined(__F16C__)
+  const __m256 offset = _mm256_set1_ps(e.offset);
+  const __m256 scale  = _mm256_set1_ps(e.scale);
+  for(; i + 8 <= end; i += 8)
+  {
+    const __m256 v = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), offset), scale);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+#elif defined(VOLUME_FORMAT_NEON)
+  const float32x4_t offset = vdupq_n_f32(e.offset);
+  const float32x4_t scale  = vdupq_n_f32(e.scale);
+  for(; i + 4 <= end; i += 4)
+  {
+    const float32x4_t v = vmulq_f32(vsubq_f32(vld1q_f32(values + i), offset), scale);
+    vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(v)));
+  }
+#endif
+  for(; i < end; i++)
+    dst[i] = floatToHalf((values[i] - e.offset) * e.scale);
+}
+
+static void encodeUnorm8(const Encoding& e, const float* values, uint8_t* dst, size_t begin, size_t end)
+{
+  size_t i = begin;
+#if defined(VOLUME_FORMAT_AVX2)
+  const __m256 offset = _mm256_set1_ps(e.offset);
+  const __m256 scale  = _mm256_set1_ps(e.scale * 255.0F);
+  for(; i + 8 <= end; i += 8)
+  {
+    // Values beyond [0,255] saturate when packing
+    const __m256  v  = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), offset), scale);
+    const __m256i q  = _mm256_cvtps_epi32(v);
+    const __m128i w  = _mm_packus_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+    const __m128i b8 = _mm_packus_epi16(w, w);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), b8);
+  }
+#elif defined(VOLUME_FORMAT_NEON)
+  const float32x4_t offset = vdupq_n_f32(e.offset);
+  const float32x4_t scale  = vdupq_n_f32(e.scale * 255.0F);
+  for(; i + 8 <= end; i += 8)
+  {
+    const int32x4_t  q0 = vcvtnq_s32_f32(vmulq_f32(vsubq_f32(vld1q_f32(values + i), offset), scale));
+    const int32x4_t  q1 = vcvtnq_s32_f32(vmulq_f32(vsubq_f32(vld1q_f32(values + i + 4), offset), scale));
+    const uint16x8_t w  = vcombine_u16(vqmovun_s32(q0), vqmovun_s32(q1));
+    vst1_u8(dst + i, vqmovn_u16(w));
+  }
+#endif
+  for(; i < end; i++)
+    dst[i] = toUnorm8((values[i] - e.offset) * e.scale);
+}
+
+static void encodeSnorm8(const Encoding& e, const float* values, int8_t* dst, size_t begin, size_t end)
+{
+  size_t i = begin;
+#if defined(VOLUME_FORMAT_AVX2)
+  const __m256 offset = _mm256_set1_ps(e.offset);
+  const __m256 scale  = _mm256_set1_ps(e.scale * 127.0F);
+  const __m256 lo     = _mm256_set1_ps(-127.0F);  // -128 is not a valid snorm value
+  for(; i + 8 <= end; i += 8)
+  {
+    const __m256  v  = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(values + i), offset), scale), lo);
+    const __m256i q  = _mm256_cvtps_epi32(v);
+    const __m128i w  = _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+    const __m128i b8 = _mm_packs_epi16(w, w);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), b8);
+  }
+#elif defined(VOLUME_FORMAT_NEON)
+  const float32x4_t offset = vdupq_n_f32(e.offset);
+  const float32x4_t scale  = vdupq_n_f32(e.scale * 127.0F);
+  const float32x4_t lo     = vdupq_n_f32(-127.0F);
+  for(; i + 8 <= end; i += 8)
+  {
+    const int32x4_t q0 = vcvtnq_s32_f32(vmaxq_f32(vmulq_f32(vsubq_f32(vld1q_f32(values + i), offset), scale), lo));
+    const int32x4_t q1 = vcvtnq_s32_f32(vmaxq_f32(vmulq_f32(vsubq_f32(vld1q_f32(values + i + 4), offset), scale), lo));
+    const int16x8_t w  = vcombine_s16(vqmovn_s32(q0), vqmovn_s32(q1));
+    vst1_s8(dst + i, vqmovn_s16(w));
+  }
+#endif
+  for(; i < end; i++)
+    dst[i] = toSnorm8((values[i] - e.offset) * e.scale);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+//
+nvmath::vec2f computeRange(const float* values, size_t count)
+{
+  const size_t               num_chunks = (count + kChunkSize - 1) / kChunkSize;
+  std::vector<nvmath::vec2f> ranges(num_chunks);
+  forEachChunk(count, [&](size_t begin, size_t end) { ranges[begin / kChunkSize] = rangeOf(values, begin, end); });
+
+  nvmath::vec2f range{1e30F, -1e30F};
+  for(const nvmath::vec2f& r : ranges)
+  {
+    range.x = std::min(range.x, r.x);
+    range.y = std::max(range.y, r.y);
+  }
+  return range;
+}
+
+void encode(int format, const Encoding& encoding, const float* values, void* dst, size_t count)
+{
+  forEachChunk(count, [&](size_t begin, size_t end) {
+    switch(format)
+    {
+      case VOLUME_R16F:
+        encodeHalf(encoding, values, static_cast<uint16_t*>(dst), begin, end);
+        break;
+      case VOLUME_R8_UNORM:
+        encodeUnorm8(encoding, values, static_cast<uint8_t*>(dst), begin, end);
+        break;
+      case VOLUME_R8_SNORM:
+        encodeSnorm8(encoding, values, static_cast<int8_t*>(dst), begin, end);
+        break;
+      default:
+        std::memcpy(static_cast<float*>(dst) + begin, values + begin, (end - begin) * sizeof(float));
+        break;
+    }
+  });
+}
+
+// BC4: a slice per task, normalized then compressed on its thread
+void encodeVolume(int format, const Encoding& encoding, const float* values, void* dst, uint32_t size)
+{
+  const size_t slice = size_t(size) * size;
+  if(!isBlockCompressed(format))
+  {
+    encode(format, encoding, values, dst, slice * size);
+    return;
+  }
+
+  const size_t slice_bytes = bc::compressedSize(bc::Format::eBC4, size, size);
+  nvh::parallel_batches<1>(
+      size,
+      [&](uint64_t z) {
+        std::vector<float> normalized(slice);
+        const float*       src = values + z * slice;
+        for(size_t i = 0; i < slice; i++)
+          normalized[i] = (src[i] - encoding.offset) * encoding.scale;
+        bc::encodeBC4(bc::Quality::eNormal, normalized.data(), size, size, static_cast<uint8_t*>(dst) + z * slice_bytes, 1);
+      },
+      std::min(std::thread::hardware_concurrency(), size));
+}
+
+float decode(int format, const Encoding& encoding, const void* data, size_t index)
+{
+  float stored;
+  switch(format)
+  {
+    case VOLUME_R16F:
+      stored = halfToFloat(static_cast<const uint16_t*>(data)[index]);
+      break;
+    case VOLUME_R8_UNORM:
+      stored = static_cast<float>(static_cast<const uint8_t*>(data)[index]) / 255.0F;
+      break;
+    case VOLUME_R8_SNORM:
+      stored = std::max(static_cast<float>(static_cast<const int8_t*>(data)[index]) / 127.0F, -1.0F);
+      break;
+    default:
+      stored = static_cast<const float*>(data)[index];
+      break;
+  }
+  return stored / encoding.scale + encoding.offset;
+}
+
+// Sum of the squares in rmsError, until sumErrors()
+static void accumulateErrors(ErrorStats&     stats,
+                             const Encoding& encoding,
+                             const float*    stored,
+                             const float*    reference,
+                             size_t          count,
+                             float           threshold)
+{
+  double sum_error = 0.0;
+  for(size_t i = 0; i < count; i++)
+  {
+    const float value = stored[i] / encoding.scale + encoding.offset;
+    const float error = std::abs(value - reference[i]);
+    stats.maxError    = std::max(stats.maxError, error);
+    sum_error += double(error) * error;
+    stats.thresholdFlips += ((value > threshold) != (reference[i] > threshold)) ? 1 : 0;
+  }
+  stats.rmsError += sum_error;
+}
+
+static ErrorStats sumErrors(const std::vector<ErrorStats>& parts, size_t count)
+{
+  ErrorStats total;
+  for(const ErrorStats& stats : parts)
+  {
+    total.maxError = std::max(total.maxError, stats.maxError);
+    total.rmsError += stats.rmsError;
+    total.thresholdFlips += stats.thresholdFlips;
+  }
+  total.rmsError = std::sqrt(total.rmsError / double(std::max(count, size_t(1))));
+  return total;
+}
+
+ErrorStats compare(int format, const Encoding& encoding, const void* data, const float* reference, size_t count, float threshold)
+{
+  const size_t            num_chunks = (count + kChunkSize - 1) / kChunkSize;
+  std::vector<ErrorStats> chunks(num_chunks);
+  forEachChunk(count, [&](size_t begin, size_t end) {
+    ErrorStats& stats     = chunks[begin / kChunkSize];
+    double      sum_error = 0.0;
+    for(size_t i = begin; i < end; i++)
+    {
+      const float value = decode(format, encoding, data, i);
+      const float error = std::abs(value - reference[i]);
+      stats.maxError    = std::max(stats.maxError, error);
+      sum_error += double(error) * error;
+      stats.thresholdFlips += ((value > threshold) != (reference[i] > threshold)) ? 1 : 0;
+    }
+    stats.rmsError = sum_error;  // Sum of the squares, until the end
+  });
+
+  return sumErrors(chunks, count);
+}
+
+// BC4: a slice per task, decoded as the hardware does
+ErrorStats compareVolume(int format, const Encoding& encoding, const void* data, const float* reference, uint32_t size, float threshold)
+{
+  const size_t slice = size_t(size) * size;
+  if(!isBlockCompressed(format))
+    return compare(format, encoding, data, reference, slice * size, threshold);
+
+  const size_t            slice_bytes = bc::compressedSize(bc::Format::eBC4, size, size);
+  std::vector<ErrorStats> slices(size);
+  nvh::parallel_batches<1>(
+      size,
+      [&](uint64_t z) {
+        std::vector<float> stored(slice);
+        bc::decodeBC4(static_cast<const uint8_t*>(data) + z * slice_bytes, size, size, stored.data(), 1);
+        accumulateErrors(slices[z], encoding, stored.data(), reference + z * slice, slice, threshold);
+      },
+      std::min(std::thread::hardware_concurrency(), size));
+  return sumErrors(slices, slice * size);
+}
+
+}  // namespace volume
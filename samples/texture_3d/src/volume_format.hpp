@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2023 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "nvmath/nvmath.h"
+#include "shaders/device_host.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// Storage of the dense volume: VOLUME_R32F, VOLUME_R16F, VOLUME_R8_UNORM, VOLUME_R8_SNORM or VOLUME_BC4.
+//
+// Except in float, the values are first normalized to the range of the format, [-1,1] for half and
+// snorm and [0,1] for unorm and BC4: stored = (value - offset) * scale. The shaders get the value back
+// with value = stored / scale + offset. Half and snorm only scale, so that zero, which is also the
+// border color of the sampler, stays zero; in unorm the border reads as the minimum of the volume.
+//
+// BC4 stores each slice in blocks of 4x4 voxels, half a byte per voxel (bc_encoder.hpp). Its error
+// depends on the content of the blocks, so it has no bound of its own: see compareVolume().
+//
+// The conversions are vectorized (F16C and AVX2, or NEON when the compiler enables them, scalar
+// otherwise) and multithreaded. They round to nearest, like packHalf2x16 and packUnorm4x8 in the
+// compute shader.
+//
+namespace volume {
+
+struct Encoding
+{
+  float scale{1.0F};
+  float offset{0.0F};
+};
+
+uint32_t bytesPerVoxel(int format);  // Not for the block-compressed formats
+
+// Encoded in blocks of voxels: the whole volume is needed, see encodeVolume()
+bool isBlockCompressed(int format);
+
+// Bytes of a size^3 volume, in all formats
+size_t volumeBytes(int format, uint32_t size);
+
+// Normalization of the values in `range` (min, max)
+Encoding makeEncoding(int format, const nvmath::vec2f& range);
+
+// Largest difference between a value and its stored version, in value units. For BC4, only the
+// precision of its endpoints
+float maxError(int format, const Encoding& encoding);
+
+// Min/max of `count` values
+nvmath::vec2f computeRange(const float* values, size_t count);
+
+// `count` values to `dst`, bytesPerVoxel(format) bytes each
+void encode(int format, const Encoding& encoding, const float* values, void* dst, size_t count);
+
+// A size^3 volume to `dst`, volumeBytes(format, size) bytes, in all formats
+void encodeVolume(int format, const Encoding& encoding, const float* values, void* dst, uint32_t size);
+
+// Value of voxel `index` of encoded data, not block-compressed
+float decode(int format, const Encoding& encoding, const void* data, size_t index);
+
+// Encoded data against the values it was made from
+struct ErrorStats
+{
+  float    maxError{0.0F};
+  double   rmsError{0.0};
+  uint64_t thresholdFlips{0};  // Voxels on the other side of the threshold once encoded
+};
+ErrorStats compare(int format, const Encoding& encoding, const void* data, const float* reference, size_t count, float threshold);
+// Same for a size^3 volume, in all formats
+ErrorStats compareVolume(int format, const Encoding& encoding, const void* data, const float* reference, uint32_t size, float threshold);
+
+uint16_t floatToHalf(float value);
+float    halfToFloat(uint16_t value);
+
+}  // namespace volume